@@ -0,0 +1,92 @@
+/* 
+ * File:   bench.h
+ *
+ * Performance benchmarks, registered the same way test plans are
+ */
+
+#ifndef BENCH_H
+#define	BENCH_H
+#include "log.h"
+#include <algorithm>
+#include <chrono>
+#include <set>
+#include <string>
+#include <cstring>
+
+
+class Benchmark
+{
+public:
+	//Per thread counters, only updated when the linker wraps the allocation and copy functions
+	struct Counters
+	{
+		QWORD allocations	= 0;	//Calls to malloc, calloc, realloc, posix_memalign and new
+		QWORD allocated		= 0;	//Bytes requested on them
+		QWORD copied		= 0;	//Bytes copied with memcpy and memmove, inlined copies are not seen
+	};
+public:
+	Benchmark(const char *name) : name(name)
+	{
+		benchmarks.insert(this);
+	}
+	virtual void Execute() = 0;
+	
+	std::string GetName() { return name; }
+	
+	void Report(const char* metric, double value, const char* unit)
+	{
+		//One json object per line for scripts
+		if (json)
+			printf("{\"benchmark\":\"%s\",\"metric\":\"%s\",\"value\":%.3f,\"unit\":\"%s\"}\n", name.c_str(), metric, value, unit);
+		else
+			printf("%-24s %-40s %14.3f %s\n", name.c_str(), metric, value, unit);
+		fflush(stdout);
+	}
+	
+	//Run func the given times after a warm up of a tenth of them, and report time, allocations and bytes copied per call
+	template<typename Func>
+	void Measure(const std::string& metric, size_t iterations, Func&& func)
+	{
+		//Warm up caches and lazy initializations
+		for (size_t i=0;i<std::max<size_t>(iterations/10,1);++i)
+			func();
+		
+		Counters before = GetCounters();
+		auto ini = std::chrono::steady_clock::now();
+		for (size_t i=0;i<iterations;++i)
+			func();
+		auto elapsed = std::chrono::steady_clock::now()-ini;
+		Counters after = GetCounters();
+		
+		Report((metric + " time").c_str(), std::chrono::duration<double,std::nano>(elapsed).count()/iterations, "ns/op");
+		Report((metric + " allocations").c_str(), (double)(after.allocations-before.allocations)/iterations, "allocs/op");
+		Report((metric + " allocated").c_str(), (double)(after.allocated-before.allocated)/iterations, "bytes/op");
+		Report((metric + " copied").c_str(), (double)(after.copied-before.copied)/iterations, "bytes/op");
+	}
+	
+	static const Counters& GetCounters();
+	static void SetJSON(bool json) { Benchmark::json = json; }
+public:
+	static int ExecuteAll(const char* filter = nullptr) 
+	{
+		for (Benchmarks::iterator it = benchmarks.begin(); it != benchmarks.end(); ++it)
+		{
+			Benchmark* benchmark = *it;
+			//Only run the ones matching the filter
+			if (filter && !strstr(benchmark->GetName().c_str(), filter))
+				continue;
+			Debug(">Executing: %s\r\n", benchmark->GetName().c_str());
+			benchmark->Execute();
+			Debug("<Executed %s\r\n", benchmark->GetName().c_str());
+		}
+		return 0;
+	}
+	
+private:
+	typedef std::set<Benchmark*> Benchmarks;
+	static Benchmarks benchmarks;
+	static bool json;
+	std::string name;
+};
+
+#endif	/* BENCH_H */
@@ -0,0 +1,148 @@
+#include "bench.h"
+#include "dtls.h"
+#include "EventLoop.h"
+#include <chrono>
+#include <deque>
+#include <vector>
+
+class DTLSBenchmark : public Benchmark
+{
+public:
+	//One side of the handshake, packets are exchanged in memory
+	class Peer :
+		public DTLSConnection::Listener,
+		public datachannels::Transport
+	{
+	public:
+		Peer(TimeService& timeService) : dtls(*this,timeService,*this)
+		{
+		}
+
+		virtual void onDTLSPendingData() override {}
+		virtual void onDTLSSetup(DTLSConnection::Suite suite,BYTE* localMasterKey,DWORD localMasterKeySize,BYTE* remoteMasterKey,DWORD remoteMasterKeySize) override { done = true; }
+		virtual void onDTLSSetupError() override { failed = true; }
+		virtual void onDTLSShutdown() override {}
+
+		//No sctp traffic
+		virtual size_t ReadPacket(uint8_t *data, uint32_t size) override { return 0; }
+		virtual size_t WritePacket(uint8_t *data, uint32_t size) override { return size; }
+		virtual void OnPendingData(std::function<void(void)> callback) override {}
+
+		//Move pending dtls data to the other peer
+		void Flush(Peer& remote)
+		{
+			BYTE buffer[MTU];
+			int len;
+			while ((len = dtls.Read(buffer,sizeof(buffer)))>0)
+				remote.inbox.emplace_back(buffer,buffer+len);
+		}
+
+		//Process received data
+		bool Deliver()
+		{
+			bool delivered = !inbox.empty();
+			while (!inbox.empty())
+			{
+				dtls.Write(inbox.front().data(),inbox.front().size());
+				inbox.pop_front();
+			}
+			return delivered;
+		}
+	public:
+		DTLSConnection dtls;
+		std::deque<std::vector<BYTE>> inbox;
+		bool done = false;
+		bool failed = false;
+	};
+
+public:
+	DTLSBenchmark() : Benchmark("DTLS handshake")
+	{
+	}
+
+	virtual void Execute()
+	{
+		const int num = 200;
+
+		EventLoop loop;
+		loop.Start();
+
+		//Connections create their timers on the loop
+		loop.Sync([&](...){
+			Run(loop,"rsa, full, handshakes/s"		,DTLSConnection::KEY_RSA	,false	,num);
+			Run(loop,"rsa, resumed, handshakes/s"		,DTLSConnection::KEY_RSA	,true	,num);
+			Run(loop,"ecdsa, full, handshakes/s"		,DTLSConnection::KEY_ECDSA	,false	,num);
+			Run(loop,"ecdsa, resumed, handshakes/s"		,DTLSConnection::KEY_ECDSA	,true	,num);
+		});
+
+		loop.Stop();
+	}
+
+	void Run(TimeService& timeService,const char* metric,DTLSConnection::KeyType keyType,bool resumption,int num)
+	{
+		//Create new certificate and context
+		DTLSConnection::Terminate();
+		DTLSConnection::SetKeyType(keyType);
+		DTLSConnection::EnableSessionResumption(resumption);
+		if (!DTLSConnection::Initialize())
+			return (void)Error("-DTLSBenchmark::Run() could not initialize DTLS\n");
+
+		//Both sides use the same certificate
+		std::string fingerprint = DTLSConnection::GetCertificateFingerPrint(DTLSConnection::SHA256);
+
+		//Get a session cached on first one
+		if (resumption && !Handshake(timeService,fingerprint))
+			return (void)Error("-DTLSBenchmark::Run() handshake failed\n");
+
+		int resumed = 0;
+		auto ini = std::chrono::steady_clock::now();
+		for (int i=0;i<num;++i)
+		{
+			int ret = Handshake(timeService,fingerprint);
+			if (!ret)
+				return (void)Error("-DTLSBenchmark::Run() handshake failed\n");
+			if (ret==2)
+				resumed++;
+		}
+		auto elapsed = std::chrono::steady_clock::now()-ini;
+
+		//Resumption must really happen
+		if (resumption && resumed!=num)
+			Error("-DTLSBenchmark::Run() only %d of %d handshakes resumed\n",resumed,num);
+
+		Report(metric,num/std::chrono::duration<double>(elapsed).count(),"hs/s");
+	}
+
+	//Returns 1 on full handshake, 2 on resumed one and 0 on error
+	int Handshake(TimeService& timeService,const std::string& fingerprint)
+	{
+		Peer client(timeService);
+		Peer server(timeService);
+
+		client.dtls.SetRemoteSetup(DTLSConnection::SETUP_PASSIVE);
+		client.dtls.SetRemoteFingerprint(DTLSConnection::SHA256,fingerprint.c_str());
+		server.dtls.SetRemoteSetup(DTLSConnection::SETUP_ACTIVE);
+		server.dtls.SetRemoteFingerprint(DTLSConnection::SHA256,fingerprint.c_str());
+
+		if (!server.dtls.Init() || !client.dtls.Init())
+			return 0;
+
+		//Exchange flights until both sides are done
+		for (int i=0;i<32 && !(client.done && server.done);++i)
+		{
+			client.Flush(server);
+			server.Flush(client);
+			bool delivered = server.Deliver();
+			//Nothing in flight
+			if (!client.Deliver() && !delivered)
+				break;
+		}
+
+		if (!client.done || !server.done || client.failed || server.failed)
+			return 0;
+
+		return client.dtls.IsResumed() ? 2 : 1;
+	}
+};
+
+DTLSBenchmark dtlsBenchmark;
@@ -0,0 +1,200 @@
+#include "bench.h"
+#include "dtls.h"
+#include "EventLoop.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <thread>
+#include <vector>
+
+class DTLSBurstBenchmark : public Benchmark
+{
+public:
+	//One side of the handshake, datagrams are delivered through the media loop as if read from the socket
+	class Peer :
+		public DTLSConnection::Listener,
+		public datachannels::Transport
+	{
+	public:
+		Peer(EventLoop& loop,std::atomic<int>& connected,std::atomic<int>& inflight) :
+			loop(loop),
+			connected(connected),
+			inflight(inflight),
+			dtls(*this,loop,*this)
+		{
+		}
+
+		virtual void onDTLSPendingData() override
+		{
+			BYTE buffer[MTU];
+			int len;
+			while ((len = dtls.Read(buffer,sizeof(buffer)))>0)
+			{
+				inflight++;
+				//Deliver it on next loop iteration
+				loop.CreateTimer(0ms,[remote = remote,data = std::vector<BYTE>(buffer,buffer+len),&inflight = inflight](...){
+					auto peer = remote.lock();
+					//Late retransmissions after the burst has finished or the peer has been torn down
+					if (peer && !peer->ended)
+						peer->dtls.Write(data.data(),data.size());
+					inflight--;
+				});
+			}
+		}
+		virtual void onDTLSSetup(DTLSConnection::Suite suite,BYTE* localMasterKey,DWORD localMasterKeySize,BYTE* remoteMasterKey,DWORD remoteMasterKeySize) override { connected++; }
+		virtual void onDTLSSetupError() override {}
+		virtual void onDTLSShutdown() override {}
+
+		//No sctp traffic
+		virtual size_t ReadPacket(uint8_t *data, uint32_t size) override { return 0; }
+		virtual size_t WritePacket(uint8_t *data, uint32_t size) override { return size; }
+		virtual void OnPendingData(std::function<void(void)> callback) override {}
+	public:
+		EventLoop& loop;
+		std::atomic<int>& connected;
+		std::atomic<int>& inflight;
+		DTLSConnection dtls;
+		std::weak_ptr<Peer> remote;
+		bool ended = false;
+	};
+
+public:
+	DTLSBurstBenchmark() : Benchmark("DTLS handshake burst")
+	{
+	}
+
+	virtual void Execute()
+	{
+		const int num = 1000;
+		const size_t workers = std::max(2u,std::thread::hardware_concurrency()/2);
+
+		//Handshakes on the media loop
+		Run("inline",0,num);
+		//Handshakes on the pool
+		Run("offloaded",workers,num);
+		//Half of the peers leaving while the rest is still handshaking
+		Run("offloaded, teardown",workers,num,true);
+
+		DTLSConnection::Terminate();
+		//Other benchmarks run the handshakes on their own loop
+		DTLSConnection::SetHandshakeWorkers(0);
+	}
+
+	void Run(const char* name,size_t workers,int num,bool teardown = false)
+	{
+		//Full handshakes with rsa certificate, worst case
+		DTLSConnection::Terminate();
+		DTLSConnection::SetKeyType(DTLSConnection::KEY_RSA);
+		DTLSConnection::EnableSessionResumption(false);
+		DTLSConnection::SetHandshakeWorkers(workers);
+		if (!DTLSConnection::Initialize())
+			return (void)Error("-DTLSBurstBenchmark::Run() could not initialize DTLS\n");
+
+		std::string fingerprint = DTLSConnection::GetCertificateFingerPrint(DTLSConnection::SHA256);
+
+		//Media loop
+		EventLoop loop;
+		loop.Start();
+
+		//Latency of tasks dispatched to the loop, as a forwarded packet would see it
+		std::vector<double> latencies;
+		std::atomic<bool> probing(true);
+		latencies.reserve(60000);
+		std::thread prober([&](){
+			while (probing)
+			{
+				auto sent = std::chrono::steady_clock::now();
+				loop.Async([&latencies,sent](...){
+					latencies.push_back(std::chrono::duration<double,std::micro>(std::chrono::steady_clock::now()-sent).count());
+				});
+				std::this_thread::sleep_for(1ms);
+			}
+		});
+
+		std::atomic<int> connected(0);
+		std::atomic<int> left(0);
+		std::atomic<int> inflight(0);
+		std::vector<std::shared_ptr<Peer>> peers;
+
+		//Mass join, remote descriptions are set from the api thread
+		auto ini = std::chrono::steady_clock::now();
+		for (int i=0;i<num;++i)
+		{
+			//Odd pairs are torn down during the burst, don't wait for them
+			bool leaving = teardown && i%2;
+			auto client = std::make_shared<Peer>(loop,leaving ? left : connected,inflight);
+			auto server = std::make_shared<Peer>(loop,leaving ? left : connected,inflight);
+			client->remote = server;
+			server->remote = client;
+			client->dtls.SetRemoteSetup(DTLSConnection::SETUP_PASSIVE);
+			client->dtls.SetRemoteFingerprint(DTLSConnection::SHA256,fingerprint.c_str());
+			server->dtls.SetRemoteSetup(DTLSConnection::SETUP_ACTIVE);
+			server->dtls.SetRemoteFingerprint(DTLSConnection::SHA256,fingerprint.c_str());
+			server->dtls.Init();
+			client->dtls.Init();
+			peers.push_back(std::move(client));
+			peers.push_back(std::move(server));
+		}
+
+		//Time spent on the media loop destroying each pair, as when the transports are removed
+		std::vector<double> teardowns;
+		if (teardown)
+		{
+			for (int i=1;i<num;i+=2)
+			{
+				loop.Async([&peers,&teardowns,i](...){
+					auto start = std::chrono::steady_clock::now();
+					peers[i*2].reset();
+					peers[i*2+1].reset();
+					teardowns.push_back(std::chrono::duration<double,std::micro>(std::chrono::steady_clock::now()-start).count());
+				});
+				std::this_thread::sleep_for(1ms);
+			}
+			//Only the remaining ones
+			num = (num+1)/2;
+		}
+
+		//Wait for all of them
+		while (connected<num*2 && std::chrono::steady_clock::now()-ini<120s)
+			std::this_thread::sleep_for(1ms);
+		auto elapsed = std::chrono::steady_clock::now()-ini;
+
+		probing = false;
+		prober.join();
+
+		//Stop all connections first, so no new datagrams are sent
+		loop.Sync([&](...){
+			for (auto& peer : peers)
+			{
+				if (!peer)
+					continue;
+				peer->ended = true;
+				peer->dtls.End();
+			}
+		});
+		//Wait until nothing is in flight and release them on the loop
+		while (inflight)
+			std::this_thread::sleep_for(1ms);
+		loop.Sync([&](...){
+			peers.clear();
+		});
+		loop.Stop();
+
+		if (connected<num*2)
+			Error("-DTLSBurstBenchmark::Run() only %d of %d connected\n",connected.load(),num*2);
+
+		std::sort(latencies.begin(),latencies.end());
+		auto percentile = [&](double p) { return latencies.empty() ? 0 : latencies[std::min(latencies.size()-1,(size_t)(p*latencies.size()))]; };
+
+		std::string prefix(name);
+		Report((prefix+", handshakes/s").c_str(),num/std::chrono::duration<double>(elapsed).count(),"hs/s");
+		Report((prefix+", loop latency p50").c_str(),percentile(0.50),"us");
+		Report((prefix+", loop latency p99").c_str(),percentile(0.99),"us");
+		Report((prefix+", loop latency max").c_str(),latencies.empty() ? 0 : latencies.back(),"us");
+		if (teardown)
+			Report((prefix+", teardown max").c_str(),teardowns.empty() ? 0 : *std::max_element(teardowns.begin(),teardowns.end()),"us");
+	}
+};
+
+DTLSBurstBenchmark dtlsBurstBenchmark;
@@ -0,0 +1,64 @@
+#include "bench.h"
+#include "EventLoop.h"
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+class EventLoopPostBenchmark : public Benchmark
+{
+public:
+	EventLoopPostBenchmark() : Benchmark("EventLoop post")
+	{
+	}
+
+	virtual void Execute()
+	{
+		for (int producers : {1,4})
+		{
+			std::string name = std::to_string(producers) + (producers>1 ? " producers" : " producer");
+			Report((name + ", async").c_str(),Run(producers,false),"tasks/s");
+			Report((name + ", post").c_str(),Run(producers,true),"tasks/s");
+		}
+	}
+
+	double Run(int producers,bool post)
+	{
+		const int tasks = 200000;
+
+		EventLoop loop;
+		loop.Start();
+
+		std::atomic<int> executed(0);
+		//Same captures as a forwarded packet
+		auto packet = std::make_shared<int>(0);
+
+		auto ini = std::chrono::steady_clock::now();
+		std::vector<std::thread> threads;
+		for (int i=0;i<producers;++i)
+			threads.emplace_back([&](){
+				for (int j=0;j<tasks/producers;++j)
+				{
+					auto func = [&executed,packet](...){ executed++; };
+					if (post)
+						loop.Post(func);
+					else
+						loop.Async(func);
+				}
+			});
+		for (auto& thread : threads)
+			thread.join();
+		//Wait for all of them to run
+		while (executed<tasks/producers*producers)
+			std::this_thread::yield();
+		auto elapsed = std::chrono::steady_clock::now()-ini;
+
+		loop.Stop();
+
+		return executed/std::chrono::duration<double>(elapsed).count();
+	}
+};
+
+EventLoopPostBenchmark eventLoopPostBenchmark;
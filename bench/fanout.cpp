@@ -0,0 +1,140 @@
+#include "bench.h"
+#include "rtp.h"
+#include "EventLoop.h"
+#include "rtp/RTPStreamTransponder.h"
+#include "rtp/RTPStreamTransponderGroup.h"
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+//Sender counting packets, enqueues the same way the DTLSICETransport does
+class FanOutSender : public RTPSender
+{
+public:
+	FanOutSender(EventLoop& loop,std::atomic<uint64_t>& sent) :
+		loop(loop),
+		sent(sent)
+	{
+	}
+
+	virtual int Enqueue(const RTPPacket::shared& packet) override
+	{
+		loop.Post([this,packet](...){
+			Send(packet->Clone());
+		});
+		return 1;
+	}
+
+	virtual int Enqueue(const RTPPacket::shared& packet,std::function<RTPPacket::shared(const RTPPacket::shared&)> modifier) override
+	{
+		loop.Post([this,packet,modifier](...){
+			Send(modifier(packet));
+		});
+		return 1;
+	}
+
+	virtual int Send(RTPPacket::shared&& packet) override
+	{
+		sent++;
+		return 1;
+	}
+
+	virtual TimeService* GetSenderTimeService() override { return &loop; }
+private:
+	EventLoop& loop;
+	std::atomic<uint64_t>& sent;
+};
+
+class FanOutBenchmark : public Benchmark
+{
+public:
+	FanOutBenchmark() : Benchmark("Fan-out forwarding")
+	{
+	}
+
+	virtual void Execute()
+	{
+		const int viewers = 500;
+
+		for (bool separate : {true,false})
+		{
+			std::string name = std::string("1 to ") + std::to_string(viewers) + (separate ? ", sender loop" : ", same loop");
+			Report((name + ", transponders").c_str(),Run(viewers,separate,false),"packets/s");
+			Report((name + ", group").c_str(),Run(viewers,separate,true),"packets/s");
+		}
+	}
+
+	double Run(int viewers,bool separate,bool grouped)
+	{
+		const int packets = 2000;
+
+		EventLoop ingress;
+		EventLoop egress;
+		ingress.Start();
+		if (separate) egress.Start();
+		//Senders loop
+		EventLoop& loop = separate ? egress : ingress;
+
+		std::atomic<uint64_t> sent(0);
+		RTPStreamTransponderGroup group(1,ingress);
+		std::vector<std::unique_ptr<RTPOutgoingSourceGroup>> outgoings;
+		std::vector<std::unique_ptr<FanOutSender>> senders;
+		std::vector<std::unique_ptr<RTPStreamTransponder>> transponders;
+
+		for (int i=0;i<viewers;++i)
+		{
+			outgoings.emplace_back(new RTPOutgoingSourceGroup(MediaFrame::Audio,loop));
+			outgoings.back()->media.ssrc = 1000+i;
+			senders.emplace_back(new FanOutSender(loop,sent));
+			transponders.emplace_back(new RTPStreamTransponder(outgoings.back().get(),senders.back().get()));
+			//Only the group is listening on the incoming stream
+			if (grouped)
+				transponders.back()->SetIncoming(&group,nullptr);
+		}
+
+		//Opus packets
+		std::vector<RTPPacket::shared> rtps;
+		for (int i=0;i<packets;++i)
+		{
+			auto rtp = std::make_shared<RTPPacket>(MediaFrame::Audio,AudioCodec::OPUS);
+			rtp->SetSSRC(1);
+			rtp->SetPayloadType(111);
+			rtp->SetExtSeqNum(i);
+			rtp->SetExtTimestamp(i*960);
+			rtp->SetClockRate(48000);
+			BYTE payload[100] = {};
+			rtp->SetPayload(payload,sizeof(payload));
+			rtps.push_back(rtp);
+		}
+
+		auto ini = std::chrono::steady_clock::now();
+		//Received on the ingress loop
+		for (const auto& rtp : rtps)
+		{
+			ingress.Post([&,rtp](...){
+				if (grouped)
+					group.onRTP(nullptr,rtp);
+				else
+					for (auto& transponder : transponders)
+						transponder->onRTP(nullptr,rtp);
+			});
+		}
+		//Wait until all of them are sent
+		while (sent<(uint64_t)packets*viewers)
+			std::this_thread::yield();
+		auto elapsed = std::chrono::steady_clock::now()-ini;
+
+		//Stop listening and sending
+		transponders.clear();
+		group.Stop();
+		ingress.Stop();
+		if (separate) egress.Stop();
+
+		return packets/std::chrono::duration<double>(elapsed).count();
+	}
+};
+
+FanOutBenchmark fanOutBenchmark;
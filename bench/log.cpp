@@ -0,0 +1,126 @@
+#include "bench.h"
+#include "EventLoop.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+
+class LogBenchmark : public Benchmark
+{
+public:
+	LogBenchmark() : Benchmark("Logging")
+	{
+	}
+
+	virtual void Execute()
+	{
+		for (bool async : {false,true})
+		{
+			std::string name = async ? "async" : "sync";
+			Report((name + " log calls").c_str(),Calls(async,0),"calls/s");
+			//Only async logging is rate limited
+			if (async)
+				Report((name + " log calls, rate limited").c_str(),Calls(async,100),"calls/s");
+			Report((name + " loop latency p99").c_str(),Latency(async),"us");
+		}
+	}
+
+	double Calls(bool async,DWORD rateLimit)
+	{
+		//Bursts that fit on the ring so nothing is dropped
+		const int bursts = 200;
+		const int calls = 1000;
+
+		std::chrono::steady_clock::duration elapsed(0);
+
+		Start(async,rateLimit);
+		for (int i=0;i<bursts;++i)
+		{
+			auto ini = std::chrono::steady_clock::now();
+			for (int j=0;j<calls;++j)
+				Warning("-LogBenchmark::Calls() packet not found [ssrc:%u,seq:%u,media:%s]\n",i,j,"video");
+			elapsed += std::chrono::steady_clock::now()-ini;
+			//Print them out of the measurement
+			Logger::Flush();
+		}
+		Stop();
+
+		return bursts*calls/std::chrono::duration<double>(elapsed).count();
+	}
+
+	double Latency(bool async)
+	{
+		//Same as a burst of warnings on each forwarded packet
+		const int tasks = 5000;
+		const int warnings = 20;
+
+		EventLoop loop;
+		loop.Start();
+
+		std::vector<QWORD> latencies(tasks);
+		std::atomic<int> executed(0);
+
+		Start(async,0);
+		for (int i=0;i<tasks;++i)
+		{
+			QWORD posted = getTime();
+			loop.Post([&,i,posted](...){
+				for (int j=0;j<warnings;++j)
+					Warning("-LogBenchmark::Latency() packet not found [task:%d,seq:%d]\n",i,j);
+				//Time since it was posted until done
+				latencies[i] = getTime()-posted;
+				executed++;
+			});
+			//Packet pace
+			std::this_thread::sleep_for(std::chrono::microseconds(100));
+		}
+		//Wait for all of them to run
+		while (executed<tasks)
+			std::this_thread::yield();
+		Stop();
+
+		loop.Stop();
+
+		//Get p99
+		std::sort(latencies.begin(),latencies.end());
+		return latencies[tasks*99/100];
+	}
+
+	void Start(bool async,DWORD rateLimit)
+	{
+		//Write logs to a file instead of to the console
+		fflush(stdout);
+		console = dup(STDOUT_FILENO);
+		FILE* file = tmpfile();
+		dup2(fileno(file),STDOUT_FILENO);
+		fclose(file);
+		//Enable all logs
+		log = Logger::IsLogEnabled();
+		debug = Logger::IsDebugEnabled();
+		Logger::EnableLog(true);
+		Logger::EnableDebug(true);
+		Logger::SetRateLimit(rateLimit);
+		Logger::EnableAsync(async);
+	}
+
+	void Stop()
+	{
+		//Print pending ones
+		Logger::EnableAsync(false);
+		//Restore
+		Logger::SetRateLimit(0);
+		Logger::EnableLog(log);
+		Logger::EnableDebug(debug);
+		fflush(stdout);
+		dup2(console,STDOUT_FILENO);
+		close(console);
+	}
+private:
+	int console = -1;
+	bool log = false;
+	bool debug = false;
+};
+
+LogBenchmark logBenchmark;
@@ -0,0 +1,112 @@
+/*
+ * Benchmark runner
+ *	Usage: bench [-d] [-j] [filter]
+ *		-d	enable logging
+ *		-j	print results as json lines
+ */
+#include "bench.h"
+
+Benchmark::Benchmarks Benchmark::benchmarks;
+bool Benchmark::json = false;
+
+static thread_local Benchmark::Counters counters;
+
+const Benchmark::Counters& Benchmark::GetCounters()
+{
+	return counters;
+}
+
+//Wrapped by the linker with --wrap, weak so the runner still links without it and counters stay at zero
+extern "C"
+{
+void* __real_malloc(size_t size) __attribute__((weak));
+void* __real_calloc(size_t num, size_t size) __attribute__((weak));
+void* __real_realloc(void* ptr, size_t size) __attribute__((weak));
+int   __real_posix_memalign(void** ptr, size_t alignment, size_t size) __attribute__((weak));
+void* __real__Znwm(size_t size) __attribute__((weak));
+void* __real__Znam(size_t size) __attribute__((weak));
+void* __real_memcpy(void* dst, const void* src, size_t size) __attribute__((weak));
+void* __real_memmove(void* dst, const void* src, size_t size) __attribute__((weak));
+
+void* __wrap_malloc(size_t size)
+{
+	counters.allocations++;
+	counters.allocated += size;
+	return __real_malloc(size);
+}
+
+void* __wrap_calloc(size_t num, size_t size)
+{
+	counters.allocations++;
+	counters.allocated += num*size;
+	return __real_calloc(num,size);
+}
+
+void* __wrap_realloc(void* ptr, size_t size)
+{
+	counters.allocations++;
+	counters.allocated += size;
+	return __real_realloc(ptr,size);
+}
+
+int __wrap_posix_memalign(void** ptr, size_t alignment, size_t size)
+{
+	counters.allocations++;
+	counters.allocated += size;
+	return __real_posix_memalign(ptr,alignment,size);
+}
+
+//operator new(size_t)
+void* __wrap__Znwm(size_t size)
+{
+	counters.allocations++;
+	counters.allocated += size;
+	return __real__Znwm(size);
+}
+
+//operator new[](size_t)
+void* __wrap__Znam(size_t size)
+{
+	counters.allocations++;
+	counters.allocated += size;
+	return __real__Znam(size);
+}
+
+void* __wrap_memcpy(void* dst, const void* src, size_t size)
+{
+	counters.copied += size;
+	return __real_memcpy(dst,src,size);
+}
+
+void* __wrap_memmove(void* dst, const void* src, size_t size)
+{
+	counters.copied += size;
+	return __real_memmove(dst,src,size);
+}
+}
+
+int main(int argc, char** argv)
+{
+	const char* filter = nullptr;
+	
+	//Keep logs out of the measurements
+	Logger::EnableLog(false);
+	
+	for (int i=1; i<argc; ++i)
+	{
+		//Enable logging
+		if (strcmp(argv[i],"-d")==0)
+		{
+			Logger::EnableLog(true);
+			Logger::EnableDebug(true);
+		//Machine readable output
+		} else if (strcmp(argv[i],"-j")==0) {
+			Benchmark::SetJSON(true);
+		} else {
+			//Only run matching benchmarks
+			filter = argv[i];
+		}
+	}
+
+	return Benchmark::ExecuteAll(filter);
+}
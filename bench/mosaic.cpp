@@ -0,0 +1,191 @@
+#include "bench.h"
+#include "videomixer.h"
+#include <algorithm>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+
+class MosaicBenchmark : public Benchmark
+{
+public:
+	MosaicBenchmark() : Benchmark("Mosaic composition")
+	{
+	}
+
+	virtual void Execute()
+	{
+		const DWORD workers = std::max(2u,std::thread::hardware_concurrency()/2);
+
+		//Composition on mixer thread only and on the pool
+		for (DWORD num : {0u,workers})
+		{
+			VideoMixer::SetCompositionWorkers(num);
+			for (int size : {HD720P,HD1080P})
+			{
+				Run(Mosaic::mosaic2x2	,"2x2"	,size,num);
+				Run(Mosaic::mosaic3x3	,"3x3"	,size,num);
+				Run(Mosaic::mosaic4x4	,"4x4"	,size,num);
+				Run(Mosaic::mosaic1p16A	,"1p16A",size,num);
+				Run(Mosaic::mosaic5x5	,"5x5"	,size,num);
+				//Main slot is under the others
+				Run(Mosaic::mosaicPIP3	,"PIP3"	,size,num);
+			}
+			//Same participants on several mosaics
+			Run(Mosaic::mosaic3x3	,"3x3 x4 mosaics",HD720P,num,4);
+			//Participants switching resolution on every frame
+			Run(Mosaic::mosaic3x3	,"3x3 switching sizes",HD720P,num,1,true);
+			//Participants sending a frame every other tick, scaled frames are kept meanwhile
+			Run(Mosaic::mosaic3x3	,"3x3 x4 mosaics half rate",HD720P,num,4,false,2);
+			//Same 720p participants at different slot sizes, decimated once for all of them
+			for (bool pyramid : {false,true})
+				RunLayouts(num,pyramid);
+		}
+		VideoMixer::SetCompositionWorkers(0);
+	}
+
+	void RunLayouts(DWORD workers,bool pyramid)
+	{
+		const int iterations = 50;
+		const int width = 1280;
+		const int height = 720;
+
+		FrameScaler::EnablePyramid(pyramid);
+
+		VideoMixer mixer(L"bench");
+		Properties properties;
+		properties.SetProperty("online","false");
+		properties.SetProperty("mosaics.default.compType",(int)Mosaic::mosaic2x2);
+		properties.SetProperty("mosaics.default.size",HD720P);
+		mixer.Init(properties);
+
+		std::vector<BYTE> frame(width*height*3/2);
+		for (size_t i=0;i<frame.size();++i)
+			frame[i] = (i*7)^(i>>9);
+
+		//Participants of the 2x2 mosaic also shown on a 3x3 and a 5x5 one
+		std::vector<int> ids = {VideoMixer::MosaicDefault,mixer.CreateMosaic(Mosaic::mosaic3x3,HD720P),mixer.CreateMosaic(Mosaic::mosaic5x5,HD720P)};
+		int num = Mosaic::GetNumSlotsForType(Mosaic::mosaic2x2);
+		std::vector<VideoOutput*> outputs;
+		for (int id=1;id<=num;++id)
+		{
+			mixer.CreateMixer(id,L"");
+			mixer.InitMixer(id,VideoMixer::MosaicDefault);
+			for (auto mosaicId : ids)
+				mixer.AddMosaicParticipant(mosaicId,id);
+			VideoOutput* output = mixer.GetOutput(id);
+			output->SetVideoSize(width,height);
+			outputs.push_back(output);
+		}
+
+		FrameScaler::ResetStats();
+
+		std::chrono::steady_clock::duration elapsed = {};
+		for (int i=0;i<iterations+1;++i)
+		{
+			for (auto output : outputs)
+				output->NextFrame(frame.data());
+			auto ini = std::chrono::steady_clock::now();
+			mixer.Process(true,getTime());
+			//Skip first one, it cleans the slots with the logo
+			if (i)
+				elapsed += std::chrono::steady_clock::now()-ini;
+		}
+
+		auto scalerStats = FrameScaler::GetStats();
+
+		for (int id=1;id<=num;++id)
+			mixer.DeleteMixer(id);
+		mixer.End();
+		FrameScaler::EnablePyramid(false);
+
+		std::string metric = std::string("2x2+3x3+5x5 720p participants") + (pyramid ? " pyramid" : " direct") + ", " + std::to_string(workers) + " workers";
+		Report(metric.c_str(),std::chrono::duration<double,std::milli>(elapsed).count()/iterations,"ms/frame");
+		if (pyramid)
+			Report((metric + ", shared decimations").c_str(),scalerStats.decimations ? scalerStats.sharedDecimations*100.0/scalerStats.decimations : 0,"%");
+	}
+
+	void Run(Mosaic::Type type,const char* layout,int size,DWORD workers,int mosaics = 1,bool switching = false,int frameInterval = 1)
+	{
+		const int iterations = 50;
+		const int width = 640;
+		const int height = 360;
+
+		//Mixer without its own thread, so we drive the ticks
+		VideoMixer mixer(L"bench");
+		Properties properties;
+		properties.SetProperty("online","false");
+		properties.SetProperty("mosaics.default.compType",(int)type);
+		properties.SetProperty("mosaics.default.size",size);
+		mixer.Init(properties);
+
+		//Participant frame, all of them send a new one on every tick by default, worst case
+		std::vector<BYTE> frame(width*height*3/2);
+		for (size_t i=0;i<frame.size();++i)
+			frame[i] = (i*7)^(i>>9);
+
+		//Extra mosaics with the same layout
+		std::vector<int> ids = {VideoMixer::MosaicDefault};
+		for (int i=1;i<mosaics;++i)
+			ids.push_back(mixer.CreateMosaic(type,size));
+
+		//Fill all slots
+		int num = Mosaic::GetNumSlotsForType(type);
+		std::vector<VideoOutput*> outputs;
+		for (int id=1;id<=num;++id)
+		{
+			mixer.CreateMixer(id,L"");
+			mixer.InitMixer(id,VideoMixer::MosaicDefault);
+			for (auto mosaicId : ids)
+				mixer.AddMosaicParticipant(mosaicId,id);
+			VideoOutput* output = mixer.GetOutput(id);
+			output->SetVideoSize(width,height);
+			outputs.push_back(output);
+		}
+
+		FrameScaler::ResetStats();
+
+		std::chrono::steady_clock::duration elapsed = {};
+		for (int i=0;i<iterations+1;++i)
+		{
+			for (auto output : outputs)
+			{
+				//Skip ticks without new frame
+				if (i%frameInterval)
+					continue;
+				//Alternate between full and half size
+				if (switching)
+					output->SetVideoSize(i%2 ? width/2 : width,i%2 ? height/2 : height);
+				output->NextFrame(frame.data());
+			}
+			auto ini = std::chrono::steady_clock::now();
+			mixer.Process(true,getTime());
+			//Skip first one, it cleans the slots with the logo
+			if (i)
+				elapsed += std::chrono::steady_clock::now()-ini;
+		}
+
+		auto stats = mixer.GetStats();
+		auto scalerStats = FrameScaler::GetStats();
+
+		for (int id=1;id<=num;++id)
+			mixer.DeleteMixer(id);
+		mixer.End();
+
+		std::string metric = std::string(layout) + " " + (size==HD1080P ? "1080p" : "720p") + ", " + std::to_string(workers) + " workers";
+		Report(metric.c_str(),std::chrono::duration<double,std::milli>(elapsed).count()/iterations,"ms/frame");
+		if (mosaics>1)
+			Report((metric + ", rescales saved").c_str(),stats.renditionHitRatio*100,"%");
+		if (switching || frameInterval>1)
+		{
+			Report((metric + ", scaler contexts created").c_str(),scalerStats.contextRebuilds,"");
+			Report((metric + ", scaler contexts reused").c_str(),scalerStats.contextReuses,"");
+		}
+		//Participant frames are scaled once per slot size and the scaler is kept while they are shown
+		if (frameInterval>1 && scalerStats.contextRebuilds+scalerStats.contextReuses>(QWORD)num)
+			Error("-MosaicBenchmark::Run() scaled frames not kept between frames [contexts:%llu]\n",scalerStats.contextRebuilds+scalerStats.contextReuses);
+		Report((metric + ", avg resize").c_str(),scalerStats.avgResizeTime/1000.0,"us");
+	}
+};
+
+MosaicBenchmark mosaicBenchmark;
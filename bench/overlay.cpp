@@ -0,0 +1,71 @@
+#include "bench.h"
+#include "alphablend.h"
+#include <chrono>
+#include <stdlib.h>
+#include <string>
+#include <vector>
+
+class OverlayBenchmark : public Benchmark
+{
+public:
+	OverlayBenchmark() : Benchmark("Overlay blend")
+	{
+	}
+
+	virtual void Execute()
+	{
+		for (auto size : {std::make_pair(1280,720),std::make_pair(1920,1080)})
+		{
+			Run(size.first,size.second,"text",false);
+			Run(size.first,size.second,"full",true);
+		}
+	}
+
+	void Run(DWORD width,DWORD height,const char* name,bool full)
+	{
+		const int iterations = 200;
+		DWORD numpixels = width*height;
+
+		std::vector<BYTE> frame(numpixels*3/2);
+		std::vector<BYTE> overlay(numpixels*5/2);
+		std::vector<BYTE> image(frame.size());
+		for (auto& b : frame)
+			b = rand();
+		for (auto& b : overlay)
+			b = rand();
+
+		//Either antialiased alpha everywhere or a text banner on the bottom over a transparent canvas
+		BYTE* alpha = overlay.data()+numpixels*3/2;
+		for (DWORD j=0;j<height;++j)
+			for (DWORD i=0;i<width;++i)
+				if (!full && (j<height*7/8 || i<width/8 || i>=width*7/8))
+					alpha[j*width+i] = 0;
+				else if (!full && (j/4+i/4)%3)
+					alpha[j*width+i] = 255;
+				else
+					alpha[j*width+i] = rand();
+
+		AlphaBlend::Runs runs;
+		AlphaBlend::CalculateRuns(overlay.data(),width,height,runs);
+
+		std::string prefix = std::to_string(height) + "p " + name + ", ";
+		for (auto kernel : {AlphaBlend::Scalar,AlphaBlend::SSE41,AlphaBlend::AVX2})
+		{
+			if (!AlphaBlend::IsSupported(kernel))
+				continue;
+			std::string kernelName = AlphaBlend::GetKernelName(kernel);
+			Report((prefix + kernelName).c_str(),Measure(kernel,image,frame,overlay,width,height,nullptr,iterations),"us/frame");
+			Report((prefix + kernelName + " with runs").c_str(),Measure(kernel,image,frame,overlay,width,height,&runs,iterations),"us/frame");
+		}
+	}
+
+	double Measure(AlphaBlend::Kernel kernel,std::vector<BYTE>& image,const std::vector<BYTE>& frame,const std::vector<BYTE>& overlay,DWORD width,DWORD height,const AlphaBlend::Runs* runs,int iterations)
+	{
+		auto ini = std::chrono::steady_clock::now();
+		for (int i=0;i<iterations;++i)
+			AlphaBlend::Blend(kernel,image.data(),frame.data(),overlay.data(),width,height,runs);
+		return std::chrono::duration<double,std::micro>(std::chrono::steady_clock::now()-ini).count()/iterations;
+	}
+};
+
+OverlayBenchmark overlayBenchmark;
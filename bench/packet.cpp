@@ -0,0 +1,103 @@
+#include "bench.h"
+#include "EventLoop.h"
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+class PacketSendBenchmark : public Benchmark
+{
+public:
+	PacketSendBenchmark() : Benchmark("Packet send")
+	{
+	}
+
+	virtual void Execute()
+	{
+		const int pps = 10000;
+		const int seconds = 2;
+		const int payload = 1200;
+
+		//Sending and receiving sockets on loopback
+		int fd = Bind();
+		int peer = Bind();
+		if (fd==FD_INVALID || peer==FD_INVALID)
+			return (void)Error("-PacketSendBenchmark::Execute() could not bind sockets\n");
+
+		sockaddr_in addr = {};
+		socklen_t len = sizeof(addr);
+		getsockname(peer,(sockaddr*)&addr,&len);
+		uint16_t port = ntohs(addr.sin_port);
+
+		//Drain peer socket, with a timeout so we can stop
+		timeval timeout = {0,100000};
+		setsockopt(peer,SOL_SOCKET,SO_RCVTIMEO,&timeout,sizeof(timeout));
+		std::atomic<bool> running(true);
+		std::atomic<int> received(0);
+		std::thread receiver([&](){
+			BYTE buffer[MTU];
+			while (running)
+				if (recv(peer,buffer,sizeof(buffer),0)>0)
+					received++;
+		});
+
+		EventLoop loop;
+		loop.Start(fd);
+
+		BYTE data[payload] = {};
+		auto cpu = GetCPUTime();
+		auto ini = std::chrono::steady_clock::now();
+		//Paced in bursts of 10 packets each ms, as sent by the transports
+		for (int i=0;i<pps*seconds;i+=10)
+		{
+			for (int j=0;j<10;++j)
+			{
+				Packet packet;
+				packet.SetData(data,sizeof(data));
+				loop.Send(0x7F000001,port,std::move(packet));
+			}
+			std::this_thread::sleep_until(ini+std::chrono::microseconds((i+10)*1000000LL/pps));
+		}
+		//Let it drain
+		std::this_thread::sleep_for(50ms);
+		cpu = GetCPUTime()-cpu;
+
+		loop.Stop();
+		running = false;
+		receiver.join();
+		close(fd);
+		close(peer);
+
+		auto stats = Packet::GetPoolStats();
+		//Payload copied into the packet and the packet moved from Send to the queue, out of the queue and into the sendmmsg batch
+		Report("bytes copied per packet",payload+4*sizeof(Packet),"bytes");
+		Report("cpu per packet",(double)cpu/(pps*seconds),"us");
+		Report("received",received*100.0/(pps*seconds),"%");
+		Report("pooled buffers allocated",stats.allocated,"buffers");
+	}
+
+	static int Bind()
+	{
+		int fd = socket(AF_INET,SOCK_DGRAM,0);
+		sockaddr_in addr = {};
+		addr.sin_family = AF_INET;
+		addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+		if (fd==FD_INVALID || bind(fd,(sockaddr*)&addr,sizeof(addr))<0)
+			return FD_INVALID;
+		return fd;
+	}
+
+	//Process cpu time in us, includes sending and event loop threads
+	static QWORD GetCPUTime()
+	{
+		rusage usage;
+		getrusage(RUSAGE_SELF,&usage);
+		return (QWORD)(usage.ru_utime.tv_sec+usage.ru_stime.tv_sec)*1000000+usage.ru_utime.tv_usec+usage.ru_stime.tv_usec;
+	}
+};
+
+PacketSendBenchmark packetSendBenchmark;
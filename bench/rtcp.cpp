@@ -0,0 +1,111 @@
+#include "bench.h"
+#include "rtp.h"
+#include "rtp/RTPTransportWideArrivals.h"
+#include <chrono>
+#include <vector>
+
+class RTCPBenchmark : public Benchmark
+{
+public:
+	RTCPBenchmark() : Benchmark("RTCP processing")
+	{
+	}
+
+	virtual void Execute()
+	{
+		Report("twcc feedback generate",Generate(),"feedbacks/s");
+		Report("twcc feedback parse",Parse(CreateFeedback(0)),"compounds/s");
+		Report("report compound parse",Parse(CreateReports()),"compounds/s");
+	}
+
+	double Generate()
+	{
+		const int feedbacks = 20000;
+		//Same as on the transport, 100 packets each 1ms with 2% losses
+		const int packets = 100;
+
+		RTPTransportWideArrivals arrivals;
+		BYTE data[MTU];
+		DWORD extSeqNum = 1;
+		QWORD now = 1000000;
+		size_t bytes = 0;
+
+		auto ini = std::chrono::steady_clock::now();
+		for (int i=0;i<feedbacks;++i)
+		{
+			//Received packets
+			for (int j=0;j<packets;++j,++extSeqNum,now+=1000)
+				if (extSeqNum%50)
+					arrivals.Add(extSeqNum,now);
+			//Build and serialize feedback
+			auto rtcp = RTCPCompoundPacket::Create();
+			auto feedback = rtcp->CreatePacket<RTCPRTPFeedback>(RTCPRTPFeedback::TransportWideFeedbackMessage,1,2);
+			auto field = feedback->CreateField<RTCPRTPFeedback::TransportWideFeedbackMessageField>((DWORD)i);
+			arrivals.Drain(0,field->packets);
+			bytes += rtcp->Serialize(data,sizeof(data));
+		}
+		auto elapsed = std::chrono::steady_clock::now()-ini;
+		//Avoid being optimized out
+		if (!bytes) Error("-RTCPBenchmark::Generate() nothing serialized\n");
+
+		return feedbacks/std::chrono::duration<double>(elapsed).count();
+	}
+
+	double Parse(const std::vector<BYTE>& data)
+	{
+		const int compounds = 50000;
+		DWORD fields = 0;
+
+		auto ini = std::chrono::steady_clock::now();
+		for (int i=0;i<compounds;++i)
+		{
+			auto rtcp = RTCPCompoundPacket::Parse(data.data(),data.size());
+			if (rtcp) fields += rtcp->GetPacketCount();
+		}
+		auto elapsed = std::chrono::steady_clock::now()-ini;
+		//Avoid being optimized out
+		if (!fields) Error("-RTCPBenchmark::Parse() nothing parsed\n");
+
+		return compounds/std::chrono::duration<double>(elapsed).count();
+	}
+
+	std::vector<BYTE> CreateFeedback(int num)
+	{
+		auto rtcp = RTCPCompoundPacket::Create();
+		auto feedback = rtcp->CreatePacket<RTCPRTPFeedback>(RTCPRTPFeedback::TransportWideFeedbackMessage,1,2);
+		auto field = feedback->CreateField<RTCPRTPFeedback::TransportWideFeedbackMessageField>((DWORD)num);
+		//100 packets with 2% losses and some jitter
+		for (DWORD i=1;i<=100;++i)
+			field->packets.insert(std::make_pair(i,i%50 ? 1000000+i*1000+(i%7)*300 : 0));
+		return Serialize(rtcp);
+	}
+
+	std::vector<BYTE> CreateReports()
+	{
+		auto rtcp = RTCPCompoundPacket::Create();
+		//Sender report with a report block
+		auto sr = rtcp->CreatePacket<RTCPSenderReport>();
+		sr->SetSSRC(1);
+		sr->AddReport(std::make_shared<RTCPReport>());
+		//Receiver report
+		auto rr = rtcp->CreatePacket<RTCPReceiverReport>(1);
+		rr->AddReport(std::make_shared<RTCPReport>());
+		//Nacks
+		auto nack = rtcp->CreatePacket<RTCPRTPFeedback>(RTCPRTPFeedback::NACK,1,2);
+		nack->CreateField<RTCPRTPFeedback::NACKField>((WORD)100,(WORD)0x0F0F);
+		nack->CreateField<RTCPRTPFeedback::NACKField>((WORD)200,(WORD)0x00FF);
+		//Remb
+		auto remb = rtcp->CreatePacket<RTCPPayloadFeedback>(RTCPPayloadFeedback::ApplicationLayerFeeedbackMessage,1,2);
+		remb->AddField(RTCPPayloadFeedback::ApplicationLayerFeeedbackField::CreateReceiverEstimatedMaxBitrate({2},1000000));
+		return Serialize(rtcp);
+	}
+
+	std::vector<BYTE> Serialize(const RTCPCompoundPacket::shared& rtcp)
+	{
+		std::vector<BYTE> data(MTU);
+		data.resize(rtcp->Serialize(data.data(),data.size()));
+		return data;
+	}
+};
+
+RTCPBenchmark rtcpBenchmark;
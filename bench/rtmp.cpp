@@ -0,0 +1,253 @@
+#include <sys/socket.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <vector>
+#include <thread>
+#include "bench.h"
+#include "rtmp/rtmpserver.h"
+
+/********************************
+ * RTMP server load generator
+ *	Server runs in this process, clients are forked so their cost is not
+ *	measured. For each level the clients complete the handshake and keep
+ *	sending small control messages while server CPU and RSS are measured.
+ ********************************/
+class RTMPLoadBenchmark : public Benchmark
+{
+public:
+	RTMPLoadBenchmark() : Benchmark("RTMPServer load")
+	{
+	}
+
+	virtual void Execute()
+	{
+		const int port = 19350;
+		const std::vector<int> levels = {100, 500, 1000, 2000, 4000};
+		const auto window = std::chrono::seconds(2);
+
+		//We need lots of fds
+		RaiseFileLimit();
+
+		//Sync pipes
+		int toServer[2];
+		int toClient[2];
+		if (pipe(toServer) || pipe(toClient))
+			return (void)Error("-RTMPLoadBenchmark::Execute() could not create pipes\n");
+
+		//Fork load generator before creating any thread
+		pid_t pid = fork();
+		if (pid==0)
+		{
+			close(toServer[0]);
+			close(toClient[1]);
+			//Run clients
+			Clients(port, levels, window, toServer[1], toClient[0]);
+			//Done
+			_exit(0);
+		}
+		close(toServer[1]);
+		close(toClient[0]);
+
+		//Start server
+		RTMPServer server;
+		server.Init(port);
+
+		for (auto level : levels)
+		{
+			char c;
+			//Wait until clients are connected
+			if (read(toServer[0], &c, 1)!=1)
+				break;
+
+			rusage before, after;
+			getrusage(RUSAGE_SELF, &before);
+			std::this_thread::sleep_for(window);
+			getrusage(RUSAGE_SELF, &after);
+
+			//Calculate cpu usage during the window
+			double cpu = (GetMicros(after.ru_utime)-GetMicros(before.ru_utime)+GetMicros(after.ru_stime)-GetMicros(before.ru_stime))
+				/ std::chrono::duration_cast<std::chrono::microseconds>(window).count() * 100;
+
+			std::string prefix = std::to_string(level) + " connections ";
+			Report((prefix + "cpu").c_str(), cpu, "%");
+			Report((prefix + "rss").c_str(), GetRSS()/1024.0/1024.0, "MB");
+			Report((prefix + "threads").c_str(), GetThreads(), "threads");
+
+			//Next level
+			if (write(toClient[1], &c, 1)!=1)
+				break;
+		}
+
+		//Wait for clients
+		waitpid(pid, nullptr, 0);
+		close(toServer[0]);
+		close(toClient[1]);
+
+		//Done
+		server.End();
+	}
+
+private:
+	static void RaiseFileLimit()
+	{
+		rlimit limit;
+		if (getrlimit(RLIMIT_NOFILE, &limit)==0)
+		{
+			limit.rlim_cur = limit.rlim_max;
+			setrlimit(RLIMIT_NOFILE, &limit);
+		}
+	}
+
+	static double GetMicros(const timeval& tv)
+	{
+		return tv.tv_sec*1E6 + tv.tv_usec;
+	}
+
+	static size_t GetRSS()
+	{
+		long pages = 0;
+		long rss = 0;
+		FILE* f = fopen("/proc/self/statm","r");
+		if (!f)
+			return 0;
+		if (fscanf(f, "%ld %ld", &pages, &rss)!=2)
+			rss = 0;
+		fclose(f);
+		return rss * sysconf(_SC_PAGESIZE);
+	}
+
+	static int GetThreads()
+	{
+		char line[256];
+		int threads = 0;
+		FILE* f = fopen("/proc/self/status","r");
+		if (!f)
+			return 0;
+		while (fgets(line, sizeof(line), f))
+			if (sscanf(line, "Threads: %d", &threads)==1)
+				break;
+		fclose(f);
+		return threads;
+	}
+
+	static int Connect(int port)
+	{
+		sockaddr_in addr = {};
+		addr.sin_family		= AF_INET;
+		addr.sin_addr.s_addr	= htonl(INADDR_LOOPBACK);
+		addr.sin_port		= htons(port);
+
+		//Retry until server is listening
+		for (int i=0; i<100; ++i)
+		{
+			int fd = socket(AF_INET, SOCK_STREAM, 0);
+			if (connect(fd, (sockaddr*)&addr, sizeof(addr))==0)
+				return fd;
+			close(fd);
+			std::this_thread::sleep_for(std::chrono::milliseconds(50));
+		}
+		return FD_INVALID;
+	}
+
+	static bool ReadAll(int fd, BYTE* data, size_t size)
+	{
+		size_t pos = 0;
+		while (pos<size)
+		{
+			ssize_t len = read(fd, data+pos, size-pos);
+			if (len<=0)
+				return false;
+			pos += len;
+		}
+		return true;
+	}
+
+	static bool Handshake(int fd)
+	{
+		//C0 + C1 without digest
+		BYTE c01[1537] = {};
+		BYTE s012[1+1536+1536];
+		c01[0] = 3;
+		//Send them
+		if (write(fd, c01, sizeof(c01))!=sizeof(c01))
+			return false;
+		//Get S0+S1+S2
+		if (!ReadAll(fd, s012, sizeof(s012)))
+			return false;
+		//Echo S1 as C2
+		return write(fd, s012+1, 1536)==1536;
+	}
+
+	static void Clients(int port, const std::vector<int>& levels, std::chrono::seconds window, int toServer, int toClient)
+	{
+		//Acknowledgement control message on chunk stream 2
+		const BYTE ack[] = {
+			0x02,				//fmt 0, chunk stream 2
+			0x00, 0x00, 0x00,		//timestamp
+			0x00, 0x00, 0x04,		//length
+			0x03,				//type Acknowledgement
+			0x00, 0x00, 0x00, 0x00,		//message stream id
+			0x00, 0x00, 0x00, 0x00		//sequence number
+		};
+		std::vector<int> fds;
+		BYTE data[4096];
+
+		RaiseFileLimit();
+
+		for (auto level : levels)
+		{
+			//Open new connections
+			while ((int)fds.size()<level)
+			{
+				int fd = Connect(port);
+				if (fd==FD_INVALID || !Handshake(fd))
+				{
+					Error("-RTMPLoadBenchmark::Clients() could not connect [%d]\n", (int)fds.size());
+					return;
+				}
+				//Non blocking from now on
+				fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK);
+				fds.push_back(fd);
+				//Keep already opened ones alive while connecting
+				if (fds.size()%250==0)
+					for (auto fd : fds)
+						if (write(fd, ack, sizeof(ack))<0 && errno!=EAGAIN)
+							Error("-RTMPLoadBenchmark::Clients() write error [errno:%d]\n", errno);
+			}
+
+			//Connections established
+			char c = 0;
+			if (write(toServer, &c, 1)!=1)
+				return;
+
+			//Keep sending traffic during the measurement window
+			auto until = std::chrono::steady_clock::now() + window;
+			while (std::chrono::steady_clock::now()<until)
+			{
+				for (auto fd : fds)
+				{
+					if (write(fd, ack, sizeof(ack))<0 && errno!=EAGAIN)
+						Error("-RTMPLoadBenchmark::Clients() write error [errno:%d]\n", errno);
+					//Drain anything sent by the server
+					while (read(fd, data, sizeof(data))>0);
+				}
+				std::this_thread::sleep_for(std::chrono::milliseconds(100));
+			}
+
+			//Wait for server to be done with this level
+			if (read(toClient, &c, 1)!=1)
+				return;
+		}
+
+		//Disconnect all
+		for (auto fd : fds)
+			close(fd);
+	}
+};
+
+RTMPLoadBenchmark rtmpLoad;
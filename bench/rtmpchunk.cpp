@@ -0,0 +1,108 @@
+#include <sys/uio.h>
+#include <time.h>
+#include <vector>
+#include <memory>
+#include "bench.h"
+#include "rtmp/rtmpchunk.h"
+
+/********************************
+ * RTMP chunk fan-out
+ *	Same video frame queued on the chunk streams of 1 and 1000 viewers and
+ *	drained into iovecs as the connections do before writev. Measures the
+ *	cpu spent per frame with the pre-chunked cache and without it.
+ ********************************/
+class RTMPFanoutBenchmark : public Benchmark
+{
+public:
+	RTMPFanoutBenchmark() : Benchmark("RTMPChunk fanout")
+	{
+	}
+
+	virtual void Execute()
+	{
+		//4Mbps at 30fps
+		const DWORD frameSize = 16*1024;
+		//Chunk size set by RTMPConnection
+		const DWORD chunkSize = 512;
+		const int frames = 300;
+
+		for (int viewers : {1, 1000})
+		{
+			for (bool useCache : {true, false})
+			{
+				double cpu = Run(viewers, frames, frameSize, chunkSize, useCache);
+				std::string prefix = std::to_string(viewers) + (viewers==1 ? " viewer " : " viewers ") + (useCache ? "cached " : "uncached ");
+				Report((prefix + "cpu/frame").c_str(), cpu/frames, "us");
+				Report((prefix + "cpu/frame/viewer").c_str(), cpu*1000/frames/viewers, "ns");
+			}
+		}
+	}
+
+private:
+	static double GetThreadCPU()
+	{
+		timespec ts;
+		clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+		return ts.tv_sec*1E6 + ts.tv_nsec/1E3;
+	}
+
+	static double Run(int viewers, int frames, DWORD frameSize, DWORD chunkSize, bool useCache)
+	{
+		std::vector<std::unique_ptr<RTMPChunkOutputStream>> streams;
+		std::vector<BYTE> media(frameSize, 0xAA);
+		std::vector<BYTE> headers(RTMPChunkOutputStream::MaxHeaderSize*(frameSize/chunkSize+1));
+		std::vector<iovec> iov((frameSize/chunkSize+1)*2);
+		RTMPChunkOutputStream::Chunk chunk;
+		size_t bytes = 0;
+
+		//Video chunk stream of each viewer
+		for (int i=0; i<viewers; ++i)
+			streams.emplace_back(new RTMPChunkOutputStream(5));
+
+		//Frame reused by the publisher
+		RTMPVideoFrame frame(0, frameSize);
+		frame.SetVideoCodec(RTMPVideoFrame::AVC);
+		frame.SetFrameType(RTMPVideoFrame::INTER);
+		frame.SetAVCType(RTMPVideoFrame::AVCNALU);
+		frame.SetAVCTS(0);
+
+		double ini = GetThreadCPU();
+
+		for (int n=0; n<frames; ++n)
+		{
+			//New content
+			media[0] = n;
+			frame.SetVideoFrame(media.data(), media.size());
+
+			for (auto& stream : streams)
+			{
+				//Enqueue it as RTMPConnection::onMediaFrame does
+				stream->SendMessage(new RTMPMessage(1, n*33, RTMPMessage::Video, frame.GetPayload()));
+
+				//Drain it as RTMPConnection::GatherChunks does
+				int num = 0;
+				while (stream->GetNextChunk(headers.data()+num*RTMPChunkOutputStream::MaxHeaderSize, RTMPChunkOutputStream::MaxHeaderSize, chunkSize, chunk, useCache))
+				{
+					iov[num*2].iov_base	= headers.data()+num*RTMPChunkOutputStream::MaxHeaderSize;
+					iov[num*2].iov_len	= chunk.headerLen;
+					iov[num*2+1].iov_base	= (void*)chunk.data.get();
+					iov[num*2+1].iov_len	= chunk.length;
+					num++;
+				}
+				//Account for what would be written
+				for (int i=0; i<num*2; ++i)
+					bytes += iov[i].iov_len;
+			}
+		}
+
+		double cpu = GetThreadCPU() - ini;
+
+		//Sanity check
+		if (bytes<(size_t)frames*viewers*frameSize)
+			Error("-RTMPFanoutBenchmark::Run() wrong size [bytes:%zu]\n", bytes);
+
+		return cpu;
+	}
+};
+
+RTMPFanoutBenchmark rtmpFanout;
@@ -0,0 +1,368 @@
+#include "bench.h"
+#include "rtp.h"
+#include "acumulator.h"
+#include "SRTPSession.h"
+#include "VideoLayerSelector.h"
+#include "rtp/RTPLostPackets.h"
+#include "vp8/vp8.h"
+#include "vp9/VP9PayloadDescription.h"
+#include <memory>
+#include <vector>
+
+class RTPBenchmark : public Benchmark
+{
+public:
+	//Inputs are generated, so results are comparable between runs and machines
+	static constexpr DWORD SSRC		= 0x11223344;
+	static constexpr DWORD PayloadSize	= 1100;
+	static constexpr DWORD PacketsPerFrame	= 5;
+	static constexpr DWORD Frames		= 8;
+public:
+	RTPBenchmark() : Benchmark("RTP hot paths")
+	{
+		rtpMap[96]  = VideoCodec::VP8;
+		rtpMap[98]  = VideoCodec::VP9;
+		rtpMap[100] = VideoCodec::H264;
+		rtpMap[35]  = VideoCodec::AV1;
+		//Same extensions as a browser
+		extMap[2] = RTPHeaderExtension::AbsoluteSendTime;
+		extMap[3] = RTPHeaderExtension::TransportWideCC;
+		extMap[4] = RTPHeaderExtension::MediaStreamId;
+		extMap[5] = RTPHeaderExtension::RTPStreamId;
+	}
+
+	virtual void Execute()
+	{
+		Packets();
+		SRTP();
+		RTCP();
+		for (auto codec : {VideoCodec::H264,VideoCodec::VP8,VideoCodec::VP9,VideoCodec::AV1})
+			Depacketize(codec);
+		for (auto codec : {VideoCodec::H264,VideoCodec::VP8,VideoCodec::VP9})
+			SelectLayers(codec);
+		Losses();
+		Acumulate();
+	}
+
+	void Packets()
+	{
+		const size_t iterations = 200000;
+
+		auto packet = CreatePackets(VideoCodec::VP8).front();
+		auto data = Serialize(packet);
+
+		//Get where the extension starts
+		RTPHeader header;
+		DWORD ini = header.Parse(data.data(),data.size());
+
+		BYTE buffer[MTU];
+		DWORD extensions = 0;
+
+		Measure("rtp parse",iterations,[&](){
+			if (!RTPPacket::Parse(data.data(),data.size(),rtpMap,extMap)) Error("-RTPBenchmark::Packets() could not parse\n");
+		});
+		Measure("rtp serialize",iterations,[&](){
+			if (!packet->Serialize(buffer,sizeof(buffer),extMap)) Error("-RTPBenchmark::Packets() could not serialize\n");
+		});
+		Measure("rtp header extension parse",iterations,[&](){
+			RTPHeaderExtension extension;
+			extensions += extension.Parse(extMap,data.data()+ini,data.size()-ini);
+		});
+		//Avoid being optimized out
+		if (!extensions) Error("-RTPBenchmark::Packets() could not parse extensions\n");
+	}
+
+	void SRTP()
+	{
+		const size_t iterations = 20000;
+
+		srtp_init();
+
+		//Fixed key
+		BYTE key[30];
+		for (DWORD i=0;i<sizeof(key);++i)
+			key[i] = i;
+
+		SRTPSession send;
+		SRTPSession recv;
+		if (!send.Setup("AES_CM_128_HMAC_SHA1_80",key,sizeof(key)) || !recv.Setup("AES_CM_128_HMAC_SHA1_80",key,sizeof(key)))
+			return (void)Error("-RTPBenchmark::SRTP() could not setup srtp\n");
+		recv.AddStream(SSRC);
+
+		auto packet = CreatePackets(VideoCodec::VP8).front();
+		auto data = Serialize(packet);
+
+		//Protect in place, with room for the auth tag
+		std::vector<BYTE> buffer(data);
+		buffer.resize(MTU);
+		Measure("srtp protect",iterations,[&](){
+			if (!send.ProtectRTP(buffer.data(),data.size())) Error("-RTPBenchmark::SRTP() could not protect\n");
+		});
+
+		//Protect consecutive packets before, as the replay check would reject them otherwise
+		std::vector<std::vector<BYTE>> protecteds;
+		for (size_t i=0;i<iterations+iterations/10;++i)
+		{
+			packet->SetSeqNum(i);
+			auto protected_ = Serialize(packet);
+			protected_.resize(MTU);
+			protected_.resize(send.ProtectRTP(protected_.data(),data.size()));
+			protecteds.push_back(std::move(protected_));
+		}
+		size_t next = 0;
+		Measure("srtp unprotect",iterations,[&](){
+			auto& protected_ = protecteds[next++];
+			if (!recv.UnprotectRTP(protected_.data(),protected_.size())) Error("-RTPBenchmark::SRTP() could not unprotect\n");
+		});
+	}
+
+	void RTCP()
+	{
+		const size_t iterations = 100000;
+
+		auto rtcp = RTCPCompoundPacket::Create();
+		//Sender report with a report block
+		auto sr = rtcp->CreatePacket<RTCPSenderReport>();
+		sr->SetSSRC(SSRC);
+		sr->AddReport(std::make_shared<RTCPReport>());
+		//Nacks
+		auto nack = rtcp->CreatePacket<RTCPRTPFeedback>(RTCPRTPFeedback::NACK,1,SSRC);
+		nack->CreateField<RTCPRTPFeedback::NACKField>((WORD)100,(WORD)0x0F0F);
+		//Remb
+		auto remb = rtcp->CreatePacket<RTCPPayloadFeedback>(RTCPPayloadFeedback::ApplicationLayerFeeedbackMessage,1,SSRC);
+		remb->AddField(RTCPPayloadFeedback::ApplicationLayerFeeedbackField::CreateReceiverEstimatedMaxBitrate({SSRC},1000000));
+
+		std::vector<BYTE> data(MTU);
+		data.resize(rtcp->Serialize(data.data(),data.size()));
+
+		Measure("rtcp compound parse",iterations,[&](){
+			if (!RTCPCompoundPacket::Parse(data.data(),data.size())) Error("-RTPBenchmark::RTCP() could not parse\n");
+		});
+	}
+
+	void Depacketize(VideoCodec::Type codec)
+	{
+		const size_t iterations = 100000;
+
+		auto packets = CreatePackets(codec);
+		std::unique_ptr<RTPDepacketizer> depacketizer(RTPDepacketizer::Create(MediaFrame::Video,codec));
+		if (!depacketizer)
+			return (void)Error("-RTPBenchmark::Depacketize() no depacketizer for %s\n",VideoCodec::GetNameFor(codec));
+
+		size_t next = 0;
+		Measure(std::string(VideoCodec::GetNameFor(codec)) + " depacketize",iterations,[&](){
+			//Same as the incoming stream depacketizer
+			if (depacketizer->AddPacket(packets[next++%packets.size()]))
+				depacketizer->ResetFrame();
+		});
+	}
+
+	void SelectLayers(VideoCodec::Type codec)
+	{
+		const size_t iterations = 200000;
+
+		auto packets = CreatePackets(codec);
+
+		size_t next = 0;
+		Measure(std::string(VideoCodec::GetNameFor(codec)) + " classify",iterations,[&](){
+			auto& packet = packets[next++%packets.size()];
+			//Parse again as on reception
+			packet->vp8PayloadDescriptor.reset();
+			packet->vp8PayloadHeader.reset();
+			packet->vp9PayloadDescriptor.reset();
+			packet->layerClassification = VideoLayerSelector::Classify(packet);
+			VideoLayerSelector::GetLayerIds(packet,packet->layerClassification);
+		});
+
+		std::unique_ptr<VideoLayerSelector> selector(VideoLayerSelector::Create(codec));
+		//Drop the top temporal layer
+		selector->SelectTemporalLayer(1);
+		selector->SelectSpatialLayer(0);
+
+		next = 0;
+		DWORD selected = 0;
+		Measure(std::string(VideoCodec::GetNameFor(codec)) + " layer select",iterations,[&](){
+			bool mark = false;
+			selected += selector->Select(packets[next++%packets.size()],mark);
+		});
+		//Avoid being optimized out
+		if (!selected) Error("-RTPBenchmark::SelectLayers() nothing selected\n");
+	}
+
+	void Losses()
+	{
+		const size_t iterations = 200000;
+
+		auto packet = CreatePackets(VideoCodec::VP8).front();
+		RTPLostPackets lost(256);
+		DWORD extSeqNum = 0;
+		QWORD time = 0;
+
+		Measure("lost packets add",iterations,[&](){
+			//1% losses
+			extSeqNum += extSeqNum%100 ? 1 : 2;
+			packet->SetExtSeqNum(extSeqNum);
+			packet->SetTime(++time);
+			lost.AddPacket(packet);
+		});
+		Measure("lost packets nacks",iterations/10,[&](){
+			if (lost.GetNacks().empty()) Error("-RTPBenchmark::Losses() no nacks\n");
+		});
+	}
+
+	void Acumulate()
+	{
+		const size_t iterations = 1000000;
+
+		//Bitrate with a packet each ms
+		Acumulator bitrate(1000);
+		QWORD now = 0;
+
+		Measure("acumulator update",iterations,[&](){
+			bitrate.Update(++now,PayloadSize*8);
+		});
+		//Avoid being optimized out
+		if (!bitrate.GetInstant()) Error("-RTPBenchmark::Acumulate() no bitrate\n");
+	}
+
+	std::vector<RTPPacket::shared> CreatePackets(VideoCodec::Type codec)
+	{
+		std::vector<RTPPacket::shared> packets;
+
+		for (DWORD frame=0;frame<Frames;++frame)
+		{
+			//L1T3 pattern
+			const BYTE temporalLayerIds[] = {0,2,1,2};
+			BYTE temporalLayerId = temporalLayerIds[frame%4];
+			for (DWORD i=0;i<PacketsPerFrame;++i)
+			{
+				BYTE payload[MTU];
+				DWORD len = 0;
+				bool start = !i;
+				bool end = i==PacketsPerFrame-1;
+				bool intra = !frame;
+
+				switch (codec)
+				{
+					case VideoCodec::H264:
+					{
+						//SPS and PPS before the intra frame
+						if (intra && start)
+						{
+							const BYTE sps[] = {0x67,0x42,0xc0,0x1f,0x8c,0x8d,0x40,0x50,0x1e,0xd0,0x0f,0x08,0x84,0x6a};
+							const BYTE pps[] = {0x68,0xce,0x3c,0x80};
+							//STAP-A
+							payload[len++] = 24;
+							set2(payload,len,sizeof(sps)); len += 2;
+							memcpy(payload+len,sps,sizeof(sps)); len += sizeof(sps);
+							set2(payload,len,sizeof(pps)); len += 2;
+							memcpy(payload+len,pps,sizeof(pps)); len += sizeof(pps);
+							packets.push_back(CreatePacket(codec,100,frame,payload,len,false));
+							len = 0;
+						}
+						//FU-A of an IDR or non IDR slice
+						payload[len++] = 0x60 | 28;
+						payload[len++] = (start ? 0x80 : 0) | (end ? 0x40 : 0) | (intra ? 5 : 1);
+						break;
+					}
+					case VideoCodec::VP8:
+					{
+						VP8PayloadDescriptor desc;
+						desc.startOfPartition = start;
+						desc.extendedControlBitsPresent = true;
+						desc.pictureIdPresent = true;
+						desc.pictureIdLength = 2;
+						desc.pictureId = frame;
+						desc.temporalLevelZeroIndexPresent = true;
+						desc.temporalLevelZeroIndex = frame/4;
+						desc.temporalLayerIndexPresent = true;
+						desc.temporalLayerIndex = temporalLayerId;
+						desc.layerSync = temporalLayerId>0;
+						len += desc.Serialize(payload,sizeof(payload));
+						//Payload header on first packet
+						if (start)
+						{
+							//Show frame and key frame flag
+							payload[len++] = intra ? 0x10 : 0x11;
+							payload[len++] = 0x02;
+							payload[len++] = 0x00;
+							if (intra)
+							{
+								//Start code and 640x360
+								const BYTE keyframe[] = {0x9d,0x01,0x2a,0x80,0x02,0x68,0x01};
+								memcpy(payload+len,keyframe,sizeof(keyframe));
+								len += sizeof(keyframe);
+							}
+						}
+						break;
+					}
+					case VideoCodec::VP9:
+					{
+						VP9PayloadDescription desc;
+						desc.pictureIdPresent = true;
+						desc.extendedPictureIdPresent = true;
+						desc.pictureId = frame;
+						desc.interPicturePredictedLayerFrame = !intra;
+						desc.layerIndicesPresent = true;
+						desc.startOfLayerFrame = start;
+						desc.endOfLayerFrame = end;
+						desc.temporalLayerId = temporalLayerId;
+						desc.switchingPoint = temporalLayerId>0;
+						desc.spatialLayerId = 0;
+						desc.temporalLayer0Index = frame/4;
+						len += desc.Serialize(payload,sizeof(payload));
+						break;
+					}
+					case VideoCodec::AV1:
+					{
+						//Aggregation header with a single obu element fragmented over the frame packets
+						payload[len++] = (start ? 0 : 0x80) | (end ? 0 : 0x40) | 0x10 | (intra && start ? 0x08 : 0);
+						//Frame obu header on first fragment
+						if (start)
+							payload[len++] = 0x30;
+						break;
+					}
+					default:
+						break;
+				}
+				//Fill the rest
+				for (DWORD j=0;len<PayloadSize;++j)
+					payload[len++] = frame*31+i*7+j;
+				packets.push_back(CreatePacket(codec,rtpMap.GetTypeForCodec(codec),frame,payload,len,end));
+			}
+		}
+		//Classify them as on reception
+		for (auto& packet : packets)
+			packet->layerClassification = VideoLayerSelector::Classify(packet);
+		return packets;
+	}
+
+	RTPPacket::shared CreatePacket(VideoCodec::Type codec,BYTE type,DWORD frame,const BYTE* payload,DWORD len,bool mark)
+	{
+		auto packet = std::make_shared<RTPPacket>(MediaFrame::Video,codec);
+		packet->SetPayloadType(type);
+		packet->SetSSRC(SSRC);
+		packet->SetExtSeqNum(++seqNum);
+		packet->SetExtTimestamp(frame*3000);
+		packet->SetClockRate(90000);
+		packet->SetMark(mark);
+		packet->SetAbsSentTime(frame*33);
+		packet->SetTransportSeqNum(seqNum);
+		packet->SetMediaStreamId("0");
+		packet->SetPayload(payload,len);
+		return packet;
+	}
+
+	std::vector<BYTE> Serialize(const RTPPacket::shared& packet)
+	{
+		std::vector<BYTE> data(MTU);
+		data.resize(packet->Serialize(data.data(),data.size(),extMap));
+		return data;
+	}
+private:
+	RTPMap rtpMap;
+	RTPMap extMap;
+	DWORD seqNum = 0;
+};
+
+RTPBenchmark rtpBenchmark;
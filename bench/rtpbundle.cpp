@@ -0,0 +1,77 @@
+#include "bench.h"
+#include "rtp.h"
+#include "RTPBundleTransport.h"
+#include <chrono>
+#include <vector>
+
+class RTPBundleDemuxBenchmark : public Benchmark
+{
+public:
+	RTPBundleDemuxBenchmark() : Benchmark("RTPBundle demux")
+	{
+	}
+
+	virtual void Execute()
+	{
+		const int num = 500;
+		const int packets = 2000000;
+
+		RTPBundleTransport bundle;
+
+		//Random port
+		if (!bundle.Init())
+		{
+			Error("-RTPBundleDemuxBenchmark::Execute() could not init bundle transport\n");
+			return;
+		}
+
+		//Register one ICE transport with one remote candidate each
+		for (int i=0;i<num;++i)
+		{
+			Properties properties;
+			std::string username = "local" + std::to_string(i) + ":remote" + std::to_string(i);
+			properties.SetProperty("ice.localUsername","local" + std::to_string(i));
+			properties.SetProperty("ice.localPassword","localpassword");
+			properties.SetProperty("ice.remoteUsername","remote" + std::to_string(i));
+			properties.SetProperty("ice.remotePassword","remotepassword");
+			properties.SetProperty("dtls.setup","passive");
+			properties.SetProperty("dtls.hash","sha-256");
+			properties.SetProperty("dtls.fingerprint","00:00:00:00:00:00:00:00:00:00:00:00:00:00:00:00:00:00:00:00:00:00:00:00:00:00:00:00:00:00:00:00");
+			bundle.AddICETransport(username,properties);
+			//Loopback peers, binding requests go nowhere
+			bundle.AddRemoteCandidate(username,"127.0.0.2",20000+i);
+		}
+
+		//SRTP looking packet, dropped by the ICE transport as it has no keys
+		BYTE packet[200] = {};
+		packet[0] = 0x80;
+		packet[1] = 96;
+
+		//Peer ip
+		uint32_t ip = 0x7F000002;
+
+		//Bursts from same peer as when receiving a video frame
+		Run(bundle,"burst of 10, ns/packet",packet,sizeof(packet),ip,num,packets,10);
+		//Each packet from a different peer
+		Run(bundle,"interleaved, ns/packet",packet,sizeof(packet),ip,num,packets,1);
+
+		bundle.End();
+	}
+
+	void Run(RTPBundleTransport& bundle,const char* metric,const BYTE* packet,size_t size,uint32_t ip,int num,int packets,int burst)
+	{
+		std::chrono::steady_clock::duration elapsed;
+
+		//Dispatch on the transport thread as it is done when reading from the socket
+		bundle.GetTimeService().Sync([&](...){
+			auto ini = std::chrono::steady_clock::now();
+			for (int i=0;i<packets;++i)
+				bundle.OnRead(FD_INVALID,packet,size,ip,20000+(i/burst)%num);
+			elapsed = std::chrono::steady_clock::now()-ini;
+		});
+
+		Report(metric,(double)std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count()/packets,"ns");
+	}
+};
+
+RTPBundleDemuxBenchmark rtpBundleDemux;
@@ -0,0 +1,135 @@
+#include "bench.h"
+#include "framescaler.h"
+#include <algorithm>
+#include <chrono>
+#include <math.h>
+#include <string>
+#include <vector>
+
+class ScalerBenchmark : public Benchmark
+{
+public:
+	ScalerBenchmark() : Benchmark("Frame scaling")
+	{
+	}
+
+	virtual void Execute()
+	{
+		//Slot sizes of 2x2 down to 5x5 mosaics on a 720p canvas
+		const std::vector<std::pair<int,int>> slots = {{640,360},{426,240},{320,180},{256,144},{160,90}};
+
+		for (auto src : {std::make_pair(1280,720),std::make_pair(1920,1080)})
+		{
+			//Source rendered from a zone plate so aliasing shows up on the psnr
+			std::vector<BYTE> frame = Render(src.first,src.second);
+
+			for (auto slot : slots)
+			{
+				//Same zone plate rendered at slot size
+				std::vector<BYTE> reference = Render(slot.first,slot.second);
+				std::string metric = std::to_string(src.second) + "p to " + std::to_string(slot.first) + "x" + std::to_string(slot.second);
+				for (bool pyramid : {false,true})
+				{
+					double psnr;
+					double time = Run(frame,src.first,src.second,reference,slot.first,slot.second,pyramid,psnr);
+					std::string name = metric + (pyramid ? ", pyramid" : ", direct");
+					Report(name.c_str(),time,"us/frame");
+					Report((name + " psnr").c_str(),psnr,"dB");
+				}
+			}
+
+			//Same frame shown at all the slot sizes, as a participant on several mosaics
+			std::string metric = std::to_string(src.second) + "p to all sizes";
+			std::vector<BYTE> own,shared;
+			Report((metric + ", pyramid per scaler").c_str(),RunSizes(frame,src.first,src.second,slots,false,own),"us/frame");
+			Report((metric + ", shared pyramid").c_str(),RunSizes(frame,src.first,src.second,slots,true,shared),"us/frame");
+			//Sanity check
+			if (own!=shared)
+				Error("-ScalerBenchmark::Execute() shared pyramid output differs [%s]\n",metric.c_str());
+		}
+		FrameScaler::EnablePyramid(false);
+	}
+
+	double RunSizes(std::vector<BYTE>& frame,DWORD width,DWORD height,const std::vector<std::pair<int,int>>& slots,bool share,std::vector<BYTE>& scaled)
+	{
+		const int iterations = 50;
+
+		FrameScaler::EnablePyramid(true);
+		std::vector<FrameScaler> scalers(slots.size());
+		FrameScaler::Pyramid pyramid;
+		//All slots one after the other
+		size_t size = 0;
+		for (auto slot : slots)
+			size += slot.first*slot.second*3/2;
+		scaled.resize(size);
+		//Smallest level used
+		int level = 0;
+		for (auto slot : slots)
+			level = std::max(level,FrameScaler::GetPyramidLevel(width,height,slot.first,slot.second,false));
+
+		auto ini = std::chrono::steady_clock::now();
+		for (int i=0;i<iterations;++i)
+		{
+			//Decimate once for all of them
+			if (share)
+				pyramid.Build(frame.data(),width,height,level);
+			BYTE* dst = scaled.data();
+			for (size_t j=0;j<slots.size();++j)
+			{
+				scalers[j].Resize(frame.data(),width,height,dst,slots[j].first,slots[j].second,false,share ? &pyramid : nullptr);
+				dst += slots[j].first*slots[j].second*3/2;
+			}
+		}
+		auto elapsed = std::chrono::steady_clock::now()-ini;
+
+		return std::chrono::duration<double,std::micro>(elapsed).count()/iterations;
+	}
+
+	double Run(std::vector<BYTE>& frame,DWORD width,DWORD height,const std::vector<BYTE>& reference,DWORD dstWidth,DWORD dstHeight,bool pyramid,double& psnr)
+	{
+		const int iterations = 50;
+
+		FrameScaler::EnablePyramid(pyramid);
+		FrameScaler scaler;
+		std::vector<BYTE> scaled(dstWidth*dstHeight*3/2);
+
+		auto ini = std::chrono::steady_clock::now();
+		for (int i=0;i<iterations;++i)
+			scaler.Resize(frame.data(),width,height,scaled.data(),dstWidth,dstHeight,false);
+		auto elapsed = std::chrono::steady_clock::now()-ini;
+
+		//Luma psnr against the reference rendering
+		double mse = 0;
+		for (DWORD i=0;i<dstWidth*dstHeight;++i)
+			mse += (scaled[i]-reference[i])*(scaled[i]-reference[i]);
+		mse /= dstWidth*dstHeight;
+		psnr = mse ? 10*log10(255.0*255.0/mse) : 99;
+
+		return std::chrono::duration<double,std::micro>(elapsed).count()/iterations;
+	}
+
+	//Render a zone plate over the unit square, each pixel is the average of 4x4 samples
+	static std::vector<BYTE> Render(DWORD width,DWORD height)
+	{
+		std::vector<BYTE> frame(width*height*3/2);
+		for (DWORD j=0;j<height;++j)
+		{
+			for (DWORD i=0;i<width;++i)
+			{
+				double sum = 0;
+				for (int k=0;k<16;++k)
+				{
+					double x = (i+(k%4+0.5)/4)/width-0.5;
+					double y = ((j+(k/4+0.5)/4)/height-0.5)*9/16;
+					sum += cos(600*(x*x+y*y));
+				}
+				frame[j*width+i] = 128+100*sum/16;
+			}
+		}
+		//Neutral chroma
+		memset(frame.data()+width*height,128,width*height/2);
+		return frame;
+	}
+};
+
+ScalerBenchmark scalerBenchmark;
@@ -0,0 +1,65 @@
+#include "bench.h"
+#include "stunmessage.h"
+#include "Packet.h"
+#include <chrono>
+#include <memory>
+
+class STUNBenchmark : public Benchmark
+{
+public:
+	STUNBenchmark() : Benchmark("STUN binding")
+	{
+	}
+
+	virtual void Execute()
+	{
+		const int num = 200000;
+
+		BYTE transId[12];
+		set4(transId,0,0);
+		set8(transId,4,getTime());
+
+		//Binding request as sent by browsers for consent freshness
+		STUNMessage request(STUNMessage::Request,STUNMessage::Binding,transId);
+		request.AddUsernameAttribute("localusername","remoteusername");
+		request.AddAttribute(STUNMessage::Attribute::IceControlling,(QWORD)1);
+		request.AddAttribute(STUNMessage::Attribute::Priority,(DWORD)33554431);
+		request.AddAttribute(STUNMessage::Attribute::UseCandidate);
+
+		BYTE data[1024];
+		DWORD size = request.AuthenticatedFingerPrint(data,sizeof(data),"localpassword");
+
+		//Parse, authenticate and reply as done by the bundle transport
+		auto ini = std::chrono::steady_clock::now();
+		for (int i=0;i<num;++i)
+		{
+			auto stun = std::unique_ptr<STUNMessage>(STUNMessage::Parse(data,size));
+			if (!stun || !stun->GetAttribute(STUNMessage::Attribute::Username) || !stun->CheckAuthenticatedFingerPrint(data,size,"localpassword"))
+				return (void)Error("-STUNBenchmark::Execute() failed\n");
+			auto resp = std::unique_ptr<STUNMessage>(stun->CreateResponse());
+			resp->AddXorAddressAttribute(htonl(0x7F000001),htons(5000));
+			Packet buffer;
+			buffer.SetSize(resp->AuthenticatedFingerPrint(buffer.GetData(),buffer.GetCapacity(),"localpassword"));
+		}
+		auto elapsed = std::chrono::steady_clock::now()-ini;
+		Report("legacy, requests/s",num/std::chrono::duration<double>(elapsed).count(),"req/s");
+
+		//Same with views, cached hmac keys and direct serialization
+		STUNMessage::Integrity integrity;
+		ini = std::chrono::steady_clock::now();
+		for (int i=0;i<num;++i)
+		{
+			STUNMessage::View stun;
+			if (!stun.Parse(data,size) || !stun.GetAttribute(STUNMessage::Attribute::Username) || !stun.CheckAuthenticatedFingerPrint(integrity,"localpassword"))
+				return (void)Error("-STUNBenchmark::Execute() failed\n");
+			Packet buffer;
+			STUNMessage::Writer resp(buffer.GetData(),buffer.GetCapacity(),STUNMessage::Response,STUNMessage::Binding,stun.GetTransactionId());
+			resp.AddXorAddressAttribute(htonl(0x7F000001),htons(5000));
+			buffer.SetSize(resp.AuthenticatedFingerPrint(integrity,"localpassword"));
+		}
+		elapsed = std::chrono::steady_clock::now()-ini;
+		Report("view, requests/s",num/std::chrono::duration<double>(elapsed).count(),"req/s");
+	}
+};
+
+STUNBenchmark stunBenchmark;
@@ -16,6 +16,7 @@
 #include <netinet/in.h>
 #include <arpa/inet.h>
 #include <list>
+#include <atomic>
 
 #include "config.h"
 #include "stunmessage.h"
@@ -31,6 +32,7 @@
 #include "Endpoint.h"
 #include "SRTPSession.h"
 #include "SendSideBandwidthEstimation.h"
+#include "rtp/RTPTransportWideArrivals.h"
 
 class DTLSICETransport : 
 	public RTPSender,
@@ -75,6 +77,7 @@ public:
 	virtual int SendPLI(DWORD ssrc) override;
 	virtual int Enqueue(const RTPPacket::shared& packet) override;
 	virtual int Enqueue(const RTPPacket::shared& packet,std::function<RTPPacket::shared(const RTPPacket::shared&)> modifier) override;
+	virtual int Send(RTPPacket::shared&& packet) override;
 	int Dump(const char* filename, bool inbound = true, bool outbound = true, bool rtcp = true, bool rtpHeadersOnly = false);
 	int Dump(UDPDumper* dumper, bool inbound = true, bool outbound = true, bool rtcp = true, bool rtpHeadersOnly = false);
 	int StopDump();
@@ -113,15 +116,16 @@ public:
 	virtual int onData(const ICERemoteCandidate* candidate,const BYTE* data,DWORD size)  override;
 	
 	DWORD GetRTT() const { return rtt; }
+	virtual DWORD GetAvailableBitrate() override { return availableBitrate; }
 	
 	TimeService& GetTimeService() { return timeService; }
+	virtual TimeService* GetSenderTimeService() override { return &timeService; }
 	
 	void SetListener(Listener* listener);
 
 private:
 	void SetState(DTLSState state);
 	void Probe(QWORD now);
-	int Send(RTPPacket::shared&& packet);
 	int Send(const RTCPCompoundPacket::shared& rtcp);
 	void SetRTT(DWORD rtt,QWORD now);
 	void onRTCP(const RTCPCompoundPacket::shared &rtcp);
@@ -166,7 +170,6 @@ private:
 	SRTPSession	recv;
 	WORD		transportSeqNum			= 0;
 	WORD		feedbackPacketCount		= 0;
-	DWORD		lastFeedbackPacketExtSeqNum	= 0;
 	WORD		feedbackCycles			= 0;
 	OutgoingStreams outgoing;
 	IncomingStreams incoming;
@@ -186,7 +189,7 @@ private:
 	Acumulator rtxBitrate;
 	Acumulator probingBitrate;
 	
-	std::map<DWORD,PacketStats::shared> transportWideReceivedPacketsStats;
+	RTPTransportWideArrivals transportWideArrivals;
 	
 	UDPDumper* dumper			= nullptr;
 	volatile bool dumpInRTP			= false;
@@ -204,6 +207,7 @@ private:
 	volatile bool started = false;
 	
 	SendSideBandwidthEstimation senderSideBandwidthEstimator;
+	std::atomic<DWORD> availableBitrate = {0};	//Last estimation, readable from other threads
 
 	bool overrideBWE = false;
 	uint32_t remoteOverrideBitrate = 0;
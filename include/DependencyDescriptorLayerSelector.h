@@ -26,6 +26,8 @@ public:
 	std::optional<std::vector<bool>> GetForwardedDecodeTargets() const { return forwardedDecodeTargets;	}
 	
 	static std::vector<LayerInfo> GetLayerIds(const RTPPacket::shared& packet);
+	static std::vector<LayerInfo> GetLayerIds(const RTPPacket::shared& packet,const std::optional<LayerClassification>& layer);
+	static std::optional<LayerClassification> Classify(const RTPPacket::shared& packet);
 private:
 	WrapExtender<uint16_t,uint64_t> frameNumberExtender;
 	uint64_t currentFrameNumber = std::numeric_limits<uint64_t>::max();
@@ -6,7 +6,12 @@
 #include <chrono>
 #include <poll.h>
 #include <cassert>
+#include <atomic>
+#include <map>
+#include <mutex>
+#include <string>
 #include "config.h"
+#include "Metrics.h"
 #include "concurrentqueue.h"
 #include "Packet.h"
 #include "TimeService.h"
@@ -28,6 +33,14 @@ public:
 		Lagging,
 		Overflown
 	};
+	//All times in nanoseconds
+	struct Stats
+	{
+		Metrics::HistogramSnapshot timerLateness;	//From the scheduled time until the timer callback is run, timers are scheduled with ms resolution
+		Metrics::HistogramSnapshot taskWait;		//From posted until run, only for sampled tasks
+		Metrics::HistogramSnapshot taskDuration;	//Time running each task, only for sampled tasks
+		std::map<std::string,Metrics::HistogramSnapshot> timerDuration; //Time running timer callbacks by timer name
+	};
 private:
 	class TimerImpl : 
 		public Timer, 
@@ -58,7 +71,10 @@ private:
 		EventLoop&		  loop;
 		std::chrono::milliseconds next;
 		std::chrono::milliseconds repeat;
+		QWORD due = 0;	//When it should run on the steady clock in ns, next may be in the past if scheduled from another thread
 		std::function<void(std::chrono::milliseconds)> callback;
+		Metrics::Histogram*	  duration = nullptr;
+		std::string		  durationName;
 	};
 public:
 	EventLoop(Listener* listener = nullptr);
@@ -73,6 +89,7 @@ public:
 	virtual Timer::shared CreateTimer(const std::chrono::milliseconds& ms, std::function<void(std::chrono::milliseconds)> timeout) override;
 	virtual Timer::shared CreateTimer(const std::chrono::milliseconds& ms, const std::chrono::milliseconds& repeat, std::function<void(std::chrono::milliseconds)> timeout) override;
 	virtual std::future<void> Async(std::function<void(std::chrono::milliseconds)> func) override;
+	virtual void Post(Task&& task) override;
 	
 	void Send(const uint32_t ipAddr, const uint16_t port, Packet&& packet);
 	void Run(const std::chrono::milliseconds &duration = std::chrono::milliseconds::max());
@@ -81,10 +98,16 @@ public:
 	
 	bool IsRunning() const { return running; }
 	
+	//Snapshot of the loop histograms, can be called from any thread
+	Stats GetStats() const;
+	//Log a warning for each timer callback or task running longer than threshold, zero disables it
+	void SetSlowCallbackThreshold(const std::chrono::microseconds& threshold) { slowCallbackThreshold = threshold.count()*1000; }
+	
 protected:
 	void Signal();
 	inline void AssertThread() const { assert(std::this_thread::get_id()==thread.get_id()); }
 	void CancelTimer(TimerImpl::shared timer);
+	Metrics::Histogram& GetTimerDuration(TimerImpl& timer);
 	
 	const std::chrono::milliseconds Now();
 private:
@@ -101,8 +124,15 @@ private:
 		uint16_t port;
 		Packet   packet;
 	};
+	struct QueuedTask
+	{
+		Task  task;
+		QWORD enqueued = 0;
+	};
 	static const size_t MaxSendingQueueSize;
 	static const size_t MaxMultipleSendingMessages;
+	static const size_t MaxTasksDequeued;
+	static const size_t TaskWaitSampling;
 private:
 	std::thread	thread;
 	State		state		= State::Normal;
@@ -110,13 +140,20 @@ private:
 	int		fd		= 0;
 	int		pipe[2]		= {FD_INVALID, FD_INVALID};
 	pollfd		ufds[2]		= {};
-	volatile bool	signaled	= false;
+	std::atomic<bool> signaled	= {false};
 	volatile bool	running		= false;
 	std::chrono::milliseconds now	= 0ms;
 	moodycamel::ConcurrentQueue<SendBuffer>	sending;
-	moodycamel::ConcurrentQueue<std::pair<std::promise<void>,std::function<void(std::chrono::milliseconds)>>>  tasks;
+	moodycamel::ConcurrentQueue<QueuedTask> tasks;
 	std::multimap<std::chrono::milliseconds,TimerImpl::shared> timers;
 	
+	Metrics::Histogram timerLateness;
+	Metrics::Histogram taskWait;
+	Metrics::Histogram taskDuration;
+	std::map<std::string,std::unique_ptr<Metrics::Histogram>> timerDuration;
+	mutable std::mutex timerDurationMutex;
+	std::atomic<QWORD> slowCallbackThreshold = {0};
+	
 };
 
 #endif /* EVENTLOOP_H */
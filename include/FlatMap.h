@@ -0,0 +1,79 @@
+#ifndef FLATMAP_H
+#define FLATMAP_H
+
+#include <algorithm>
+#include <utility>
+#include <vector>
+
+//Sorted map on contiguous storage, appending keys in order is amortized O(1) and iteration is cache friendly
+template<typename K,typename V>
+class FlatMap
+{
+public:
+	using value_type		= std::pair<K,V>;
+	using Storage			= std::vector<value_type>;
+	using iterator			= typename Storage::iterator;
+	using const_iterator		= typename Storage::const_iterator;
+	using const_reverse_iterator	= typename Storage::const_reverse_iterator;
+public:
+	std::pair<iterator,bool> insert(const value_type& value)
+	{
+		//Fast path, appending in order
+		if (items.empty() || items.back().first<value.first)
+			return {items.insert(items.end(),value),true};
+		//Find position
+		auto it = lower_bound(value.first);
+		//If already present
+		if (it!=items.end() && it->first==value.first)
+			//Do not override it, same as std::map
+			return {it,false};
+		//Insert in place
+		return {items.insert(it,value),true};
+	}
+
+	V& operator[](const K& key)
+	{
+		//Insert default value if not present
+		return insert(value_type(key,V())).first->second;
+	}
+
+	iterator find(const K& key)
+	{
+		auto it = lower_bound(key);
+		return it!=items.end() && it->first==key ? it : items.end();
+	}
+
+	const_iterator find(const K& key) const
+	{
+		auto it = lower_bound(key);
+		return it!=items.end() && it->first==key ? it : items.end();
+	}
+
+	iterator erase(const_iterator it)	{ return items.erase(it);	}
+	void clear()				{ items.clear();		}
+	void reserve(size_t size)		{ items.reserve(size);		}
+	size_t size() const			{ return items.size();		}
+	bool empty() const			{ return items.empty();		}
+
+	iterator begin()			{ return items.begin();		}
+	iterator end()				{ return items.end();		}
+	const_iterator begin() const		{ return items.begin();		}
+	const_iterator end() const		{ return items.end();		}
+	const_iterator cbegin() const		{ return items.cbegin();	}
+	const_iterator cend() const		{ return items.cend();		}
+	const_reverse_iterator rbegin() const	{ return items.rbegin();	}
+	const_reverse_iterator rend() const	{ return items.rend();		}
+private:
+	iterator lower_bound(const K& key)
+	{
+		return std::lower_bound(items.begin(),items.end(),key,[](const value_type& item,const K& key){ return item.first<key; });
+	}
+	const_iterator lower_bound(const K& key) const
+	{
+		return std::lower_bound(items.begin(),items.end(),key,[](const value_type& item,const K& key){ return item.first<key; });
+	}
+private:
+	Storage items;
+};
+
+#endif /* FLATMAP_H */
@@ -83,8 +83,14 @@ public:
 	      DWORD     GetIPAddress()		const { return ntohl(addr.sin_addr.s_addr);	}
 	      WORD	GetPort()		const {	return ntohs(addr.sin_port);		}
 	std::string	GetRemoteAddress()	const { return std::string(GetIP()) + ":" + std::to_string(GetPort()); }
+	uint64_t	GetRemoteKey()		const { return GetRemoteKey(GetIPAddress(),GetPort());	}
 	State		GetState()		const { return state;				}
 public:
+	//Packed ip:port in host order, cheap to hash and compare
+	static uint64_t GetRemoteKey(DWORD address,WORD port)
+	{
+		return ((uint64_t)address)<<16 | port;
+	}
 	static std::string GetRemoteAddress(DWORD address,WORD port)
 	{
 		const uint8_t* host = (const uint8_t*)&address;
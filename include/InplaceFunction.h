@@ -0,0 +1,110 @@
+#ifndef INPLACEFUNCTION_H
+#define INPLACEFUNCTION_H
+
+#include <cstddef>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+template<typename Signature,size_t Capacity = 64>
+class InplaceFunction;
+
+//Move only callable, functors up to Capacity bytes are stored inline and bigger ones on the heap
+template<typename R,typename... Args,size_t Capacity>
+class InplaceFunction<R(Args...),Capacity>
+{
+private:
+	struct Ops
+	{
+		R    (*invoke)(void* storage,Args&&... args);
+		void (*move)(void* from,void* to);	//Move construct on to and destroy from
+		void (*destroy)(void* storage);
+	};
+
+	template<typename F>
+	struct InlineOps
+	{
+		static R Invoke(void* storage,Args&&... args)	{ return (*static_cast<F*>(storage))(std::forward<Args>(args)...);	}
+		static void Move(void* from,void* to)		{ new (to) F(std::move(*static_cast<F*>(from))); static_cast<F*>(from)->~F();	}
+		static void Destroy(void* storage)		{ static_cast<F*>(storage)->~F();	}
+		static constexpr Ops ops = {Invoke,Move,Destroy};
+	};
+
+	template<typename F>
+	struct HeapOps
+	{
+		static R Invoke(void* storage,Args&&... args)	{ return (**static_cast<F**>(storage))(std::forward<Args>(args)...);	}
+		static void Move(void* from,void* to)		{ *static_cast<F**>(to) = *static_cast<F**>(from);	}
+		static void Destroy(void* storage)		{ delete(*static_cast<F**>(storage));	}
+		static constexpr Ops ops = {Invoke,Move,Destroy};
+	};
+
+public:
+	InplaceFunction() = default;
+
+	template<typename F,typename = std::enable_if_t<!std::is_same<std::decay_t<F>,InplaceFunction>::value>>
+	InplaceFunction(F&& func)
+	{
+		using Functor = std::decay_t<F>;
+		//Check if it fits inline
+		if constexpr (sizeof(Functor)<=Capacity && alignof(Functor)<=alignof(std::max_align_t) && std::is_nothrow_move_constructible<Functor>::value)
+		{
+			new (&storage) Functor(std::forward<F>(func));
+			ops = &InlineOps<Functor>::ops;
+		} else {
+			*reinterpret_cast<Functor**>(&storage) = new Functor(std::forward<F>(func));
+			ops = &HeapOps<Functor>::ops;
+		}
+	}
+
+	InplaceFunction(InplaceFunction&& other) noexcept
+	{
+		//Take the other functor
+		if ((ops = other.ops))
+			ops->move(&other.storage,&storage);
+		other.ops = nullptr;
+	}
+
+	InplaceFunction& operator=(InplaceFunction&& other) noexcept
+	{
+		//Check self assignment
+		if (this==&other)
+			return *this;
+		//Destroy ours
+		Reset();
+		//Take the other functor
+		if ((ops = other.ops))
+			ops->move(&other.storage,&storage);
+		other.ops = nullptr;
+		return *this;
+	}
+
+	InplaceFunction(const InplaceFunction&) = delete;
+	InplaceFunction& operator=(const InplaceFunction&) = delete;
+
+	~InplaceFunction()
+	{
+		Reset();
+	}
+
+	R operator()(Args... args)
+	{
+		return ops->invoke(&storage,std::forward<Args>(args)...);
+	}
+
+	explicit operator bool() const { return ops; }
+
+	void Reset()
+	{
+		//Destroy functor
+		if (ops)
+			ops->destroy(&storage);
+		ops = nullptr;
+	}
+
+private:
+	const Ops* ops = nullptr;
+	std::aligned_storage_t<Capacity,alignof(std::max_align_t)> storage;
+};
+
+#endif /* INPLACEFUNCTION_H */
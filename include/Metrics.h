@@ -0,0 +1,130 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <vector>
+#include "config.h"
+
+/********************************
+ * Metrics
+ *	Process wide registry of counters and histograms cheap enough to be
+ *	updated on the media threads. Each thread updates its own shard with
+ *	relaxed atomics, and snapshots add all the shards up without locking
+ *	or stopping the threads updating them.
+ ********************************/
+class Metrics
+{
+public:
+	static constexpr size_t Shards = 16;
+public:
+	class Counter
+	{
+	public:
+		void Increment(QWORD value = 1)
+		{
+			shards[GetShard()].value.fetch_add(value,std::memory_order_relaxed);
+		}
+		QWORD GetValue() const;
+	private:
+		struct alignas(64) Shard
+		{
+			std::atomic<QWORD> value = {0};
+		};
+		Shard shards[Shards];
+	};
+
+	struct HistogramSnapshot
+	{
+		QWORD count	= 0;
+		QWORD sum	= 0;
+		QWORD max	= 0;
+		std::vector<QWORD> buckets;
+
+		double GetMean() const { return count ? (double)sum/count : 0; }
+		//Upper bound of the bucket containing the given percentile, between 0 and 100
+		QWORD GetPercentile(double percentile) const;
+		//Number of values lower than the given one, exact for powers of two
+		QWORD GetCountBelow(QWORD value) const;
+	};
+
+	//Log linear buckets as HDR histograms, values are recorded with a max relative error of 1/SubBuckets
+	class Histogram
+	{
+	public:
+		static constexpr DWORD SubBucketBits	= 3;
+		static constexpr DWORD SubBuckets	= 1<<SubBucketBits;
+		static constexpr DWORD MaxBits		= 40;
+		static constexpr DWORD Buckets		= (MaxBits-SubBucketBits+1)*SubBuckets;
+	public:
+		Histogram() = default;
+		~Histogram();
+		Histogram(const Histogram&) = delete;
+		Histogram& operator=(const Histogram&) = delete;
+
+		void Record(QWORD value);
+		HistogramSnapshot GetSnapshot() const;
+
+		static DWORD GetBucket(QWORD value);
+		static QWORD GetBucketStart(DWORD bucket);
+		static QWORD GetBucketEnd(DWORD bucket);
+	private:
+		struct Shard
+		{
+			std::atomic<QWORD> sum			= {0};
+			std::atomic<QWORD> max			= {0};
+			std::atomic<QWORD> buckets[Buckets]	= {};
+		};
+		Shard* GetShard();
+	private:
+		std::atomic<Shard*> shards[Shards] = {};
+	};
+
+	enum Type
+	{
+		CounterType,
+		HistogramType
+	};
+
+	struct Value
+	{
+		std::string name;
+		std::string help;
+		std::string labels;
+		Type type;
+		double scale;
+		QWORD value;
+		HistogramSnapshot histogram;
+	};
+
+	using Snapshot = std::vector<Value>;
+public:
+	//Get or create a metric, the same instance is returned for the same name and labels
+	static Counter& GetCounter(const std::string& name,const std::string& help,const std::string& labels = "");
+	//Scale converts the recorded values to the dumped ones, i.e. 1E-9 for nanoseconds recorded as seconds
+	static Histogram& GetHistogram(const std::string& name,const std::string& help,const std::string& labels = "",double scale = 1);
+
+	//Get current values of all metrics
+	static Snapshot GetSnapshot();
+	//Prometheus text exposition format
+	static std::string Dump();
+	static std::string Dump(const Snapshot& snapshot);
+
+	//Monotonic time in nanoseconds for durations
+	static QWORD Now()
+	{
+		return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+	}
+
+	static size_t GetShard()
+	{
+		static std::atomic<size_t> threads = {0};
+		//Each thread gets a shard the first time it is called
+		static thread_local size_t shard = threads++ % Shards;
+		return shard;
+	}
+};
+
+#endif /* METRICS_H */
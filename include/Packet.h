@@ -4,18 +4,86 @@
 #include "config.h"
 #include <cstring>
 
+//Handle to a fixed size buffer taken from a process wide pool, so moving a packet only moves a pointer
 class Packet
 {
-public:	
-	const uint8_t* GetData() const		{ return buffer.data();		}
-	uint8_t* GetData()			{ return buffer.data();		}
-	size_t GetCapacity() const		{ return capacity;		}
-	size_t GetSize() const			{ return size;			}
-
-	void SetSize(size_t size) 
-	{ 
+public:
+	static const DWORD SIZE = 1700;
+
+	struct Buffer
+	{
+		uint8_t data[SIZE];
+	};
+
+	struct PoolStats
+	{
+		size_t allocated;	//Buffers allocated, in use or pooled
+		size_t pooled;		//Approximate number of buffers on the shared pool
+	};
+public:
+	Packet() : buffer(Acquire())
+	{
+	}
+
+	Packet(const Packet& packet) : buffer(Acquire())
+	{
+		SetData(packet);
+	}
+
+	Packet(Packet&& packet) noexcept :
+		buffer(packet.buffer),
+		size(packet.size)
+	{
+		//Moved from packets have no buffer
+		packet.buffer = nullptr;
+		packet.size = 0;
+	}
+
+	~Packet()
+	{
+		//Give it back to the pool
+		if (buffer)
+			Release(buffer);
+	}
+
+	Packet& operator=(const Packet& packet)
+	{
+		//Check self assignment
+		if (this==&packet)
+			return *this;
+		//We could have been moved
+		if (!buffer)
+			buffer = Acquire();
+		//Copy content
+		SetData(packet);
+		return *this;
+	}
+
+	Packet& operator=(Packet&& packet) noexcept
+	{
+		//Check self assignment
+		if (this==&packet)
+			return *this;
+		//Release ours
+		if (buffer)
+			Release(buffer);
+		//Get the other one
+		buffer = packet.buffer;
+		size = packet.size;
+		packet.buffer = nullptr;
+		packet.size = 0;
+		return *this;
+	}
+
+	const uint8_t* GetData() const		{ return buffer ? buffer->data : nullptr;	}
+	uint8_t* GetData()			{ return buffer ? buffer->data : nullptr;	}
+	size_t GetCapacity() const		{ return buffer ? SIZE : 0;			}
+	size_t GetSize() const			{ return size;					}
+
+	void SetSize(size_t size)
+	{
 		//Check capacity
-		if (size>capacity)
+		if (size>GetCapacity())
 			return;
 		//Set new size
 		this->size = size;
@@ -24,25 +92,28 @@ public:
 	void SetData(const uint8_t* data,const size_t size)
 	{
 		//Check size
-		if (size>capacity)
+		if (size>GetCapacity())
 			return;
 		//Copy
-		std::memcpy(buffer.data(),data,size);
+		std::memcpy(buffer->data,data,size);
 		//Reset size
 		this->size = size;
 	}
-	
+
 	void SetData(const Packet& packet)
 	{
 		SetData(packet.GetData(),packet.GetSize());
 	}
+
+	static PoolStats GetPoolStats();
 private:
-	static const DWORD SIZE = 1700;
+	//Get a buffer from the thread cache, the shared pool or allocate a new one
+	static Buffer* Acquire();
+	//Put buffer back on the thread cache, overflowing to the shared pool
+	static void Release(Buffer* buffer);
 protected:
-	std::array<uint8_t,SIZE> buffer;
-	size_t capacity		= SIZE;
+	Buffer* buffer		= nullptr;
 	size_t size		= 0;
 };
 
 #endif /* PACKET_H */
-
@@ -6,7 +6,9 @@
 #include <netinet/in.h>
 #include <arpa/inet.h>
 #include <map>
+#include <unordered_map>
 #include <string>
+#include <string_view>
 #include <memory>
 #include <poll.h>
 #include <srtp2/srtp.h>
@@ -36,6 +38,9 @@ public:
 		size_t iceRequestsReceived	= 0;
 		size_t iceResponsesSent		= 0;
 		size_t iceResponsesReceived	= 0;
+		//Keyed hmacs for local and remote passwords
+		STUNMessage::Integrity localIntegrity;
+		STUNMessage::Integrity remoteIntegrity;
 		
 	};
 public:
@@ -60,6 +65,8 @@ public:
 private:
 	void onTimer(std::chrono::milliseconds now);
 	void SendBindingRequest(Connection* connection,ICERemoteCandidate* candidate);
+	ICERemoteCandidate* GetCandidate(uint64_t key);
+	void RemoveCandidate(uint64_t key);
 private:
 	//Sockets
 	int 	socket;
@@ -69,9 +76,12 @@ private:
 	Timer::shared iceTimer;
 	std::chrono::milliseconds iceTimeout = 10000ms;
 
-	std::map<std::string,Connection*>	 connections;
-	std::map<std::string,ICERemoteCandidate> candidates;
-	std::map<std::pair<uint64_t,uint32_t>,std::pair<std::string,std::string>> transactions;
+	std::map<std::string,Connection*,std::less<>> connections;	//Transparent so it can be searched by the STUN username view
+	std::unordered_map<uint64_t,ICERemoteCandidate> candidates;
+	std::map<std::pair<uint64_t,uint32_t>,std::pair<std::string,uint64_t>> transactions;
+	//Last candidate that received data, packets usually come in bursts from the same peer
+	uint64_t lastKey = 0;
+	ICERemoteCandidate* lastCandidate = nullptr;
 	uint32_t maxTransId = 0;
 	Use	use;
 };
@@ -8,6 +8,7 @@
 #include "acumulator.h"
 #include "MovingCounter.h"
 #include "rtp/PacketStats.h"
+#include "rtp/RTCPRTPFeedback.h"
 #include "remoterateestimator.h"
 #include "WrapExtender.h"
 
@@ -27,7 +28,7 @@ public:
 	SendSideBandwidthEstimation();
         ~SendSideBandwidthEstimation();
 	void SentPacket(const PacketStats::shared& packet);
-	void ReceivedFeedback(uint8_t feedbackNum, const std::map<uint32_t,uint64_t>& packets, uint64_t when = 0);
+	void ReceivedFeedback(uint8_t feedbackNum, const RTCPRTPFeedback::TransportWideFeedbackMessageField::Packets& packets, uint64_t when = 0);
 	void UpdateRTT(uint64_t when, uint32_t rtt);
 	uint32_t GetEstimatedBitrate() const;
 	uint32_t GetTargetBitrate() const;
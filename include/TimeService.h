@@ -6,6 +6,7 @@
 #include <string>
 #include <functional>
 #include <future>
+#include "InplaceFunction.h"
 
 class Timer
 {
@@ -19,13 +20,16 @@ public:
 	virtual std::chrono::milliseconds GetNextTick()	const = 0;
 	virtual std::chrono::milliseconds GetRepeat() const = 0;
 	void SetName(const std::string& name) { this->name = name; }
-	std::string GetName() const  { return name; }
+	const std::string& GetName() const  { return name; }
 private:
 	std::string name;
 };
 	
 class TimeService
 {
+public:
+	//Small callables are stored inline, so posting them does not allocate
+	using Task = InplaceFunction<void(std::chrono::milliseconds)>;
 public:
 	virtual ~TimeService() = default;
 	virtual const std::chrono::milliseconds GetNow() const = 0;
@@ -33,6 +37,8 @@ public:
 	virtual Timer::shared CreateTimer(const std::chrono::milliseconds& ms, std::function<void(std::chrono::milliseconds)> timeout) = 0;
 	virtual Timer::shared CreateTimer(const std::chrono::milliseconds& ms, const std::chrono::milliseconds& repeat, std::function<void(std::chrono::milliseconds)> timeout) = 0;
 	virtual std::future<void> Async(std::function<void(std::chrono::milliseconds)> func) = 0;
+	//Fire and forget version of Async, without promise nor future
+	virtual void Post(Task&& task) = 0;
 	inline void Sync(std::function<void(std::chrono::milliseconds)> func) 
 	{
 		//Run async and wait for future
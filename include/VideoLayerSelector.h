@@ -22,6 +22,10 @@ public:
 	//Factory method
 	static VideoLayerSelector* Create(VideoCodec::Type codec);
 	static std::vector<LayerInfo> GetLayerIds(const RTPPacket::shared& packet);
+	//Layer ids of an already classified packet, so it is not parsed again
+	static std::vector<LayerInfo> GetLayerIds(const RTPPacket::shared& packet,const std::optional<LayerClassification>& layer);
+	//Parses the payload descriptors and sets the key frame flag if not done yet
+	static std::optional<LayerClassification> Classify(const RTPPacket::shared& packet);
 	static bool AreLayersInfoeAggregated(const RTPPacket::shared& packet);
 };
 
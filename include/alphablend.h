@@ -0,0 +1,47 @@
+#ifndef _ALPHABLEND_H_
+#define _ALPHABLEND_H_
+#include "config.h"
+#include <vector>
+
+//Blending of an I420 overlay with alpha plane (Y,U,V,A planes) over an I420 frame
+class AlphaBlend
+{
+public:
+	enum Kernel
+	{
+		Scalar,
+		SSE41,
+		AVX2
+	};
+
+	enum Span
+	{
+		Transparent,	//Copy frame
+		Opaque,		//Copy overlay
+		Mixed		//Blend
+	};
+
+	struct Run
+	{
+		Span  span;
+		DWORD left;	//In pixels, even
+		DWORD width;	//In pixels, even
+	};
+
+	//Runs for each pair of lines
+	typedef std::vector<std::vector<Run>> Runs;
+
+public:
+	//Best kernel supported by the cpu
+	static Kernel GetKernel();
+	static bool IsSupported(Kernel kernel);
+	static const char* GetKernelName(Kernel kernel);
+
+	//Calculate transparent and opaque runs of the overlay alpha plane
+	static void CalculateRuns(const BYTE* overlay,DWORD width,DWORD height,Runs& runs);
+
+	//Blend overlay over frame into image, if runs are not provided all pixels are blended
+	static void Blend(Kernel kernel,BYTE* image,const BYTE* frame,const BYTE* overlay,DWORD width,DWORD height,const Runs* runs = nullptr);
+};
+
+#endif
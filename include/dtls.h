@@ -6,13 +6,18 @@
 #include <openssl/err.h>
 #include <openssl/bio.h>
 #include <atomic>
+#include <mutex>
 #include <string>
 #include <map>
+#include <deque>
+#include <memory>
 #include <vector>
 #include "config.h"
 #include "log.h"
 #include "Datachannels.h"
 
+class EventLoop;
+
 class DTLSConnection
 {
 public:
@@ -46,6 +51,12 @@ public:
 		CONNECTION_NEW,		// Endpoint wants to use a new connection 
 		CONNECTION_EXISTING	// Endpoint wishes to use existing connection 
 	};
+
+	enum KeyType
+	{
+		KEY_RSA,		// RSA 2048 bits
+		KEY_ECDSA		// ECDSA on P-256, much cheaper signatures during handshake
+	};
 public:
 	class Listener
 	{
@@ -62,9 +73,13 @@ public:
 
 public:
 	static void SetCertificate(const char* cert,const char* key);
+	//Must be called before Initialize
+	static void SetKeyType(KeyType type);
+	static void EnableSessionResumption(bool enabled);
+	static void SetHandshakeWorkers(size_t num);
 	static int Initialize();
 	static int Terminate();
-	static std::string GetCertificateFingerPrint(Hash hash);
+	static const std::string& GetCertificateFingerPrint(Hash hash);
 	static bool IsDTLS(const BYTE* buffer,const DWORD size)		{ return buffer[0]>=20 && buffer[0]<=64; }
 	static Suite SuiteFromName(const char* suite) 
 	{
@@ -109,6 +124,9 @@ private:
 private:
 	typedef std::map<Hash, std::string> LocalFingerPrints;
 	typedef std::vector<Hash> AvailableHashes;
+	typedef std::map<std::string, SSL_SESSION*> Sessions;
+	typedef std::vector<std::unique_ptr<EventLoop>> Workers;
+	static const size_t MaxSessions = 1024;
 private:
 	static std::string	certfile;		// Certificate file name
 	static std::string	pvtfile;		// Private key file name
@@ -119,6 +137,13 @@ private:
 	static LocalFingerPrints localFingerPrints;
 	static AvailableHashes	availableHashes;
 	static bool		hasDTLS;
+	static KeyType		keyType;		// Key type of generated certificates
+	static bool		resumption;		// Allow abbreviated handshakes
+	static Sessions		sessions;		// Client sessions by remote fingerprint
+	static std::mutex	sessionsMutex;
+	static size_t		numWorkers;		// Number of handshake threads, 0 to run them on the owner loop
+	static Workers		workers;		// Handshake threads
+	static std::atomic<size_t> nextWorker;
 
 public:
 	DTLSConnection(Listener& listener,TimeService& timeService,datachannels::Transport& sctp);
@@ -132,31 +157,67 @@ public:
 	void Reset();
 
 	Setup GetSetup() const { return setup; }
+	bool IsResumed() const { return state && state->ssl && SSL_session_reused(state->ssl); }
 	
 	int  Read(BYTE* data,DWORD size);
 	int  Write(const BYTE *buffer,DWORD size);
 	int  HandleTimeout();
 	int  Renegotiate();
 
-// Callbacks fired by OpenSSL events. 
-public:
-	void onSSLInfo(int where, int ret);
-
 protected:
-	int  SetupSRTP();
-	void CheckPending();
+	static TimeService& GetWorker(TimeService& timeService);
+
+private:
+	//SSL session and everything touched on the worker, kept alive by the tasks queued on it after End
+	class State : public std::enable_shared_from_this<State>
+	{
+	public:
+		State(Listener& listener,TimeService& timeService,TimeService& worker,datachannels::Transport& sctp);
+		~State();
+
+		int  InitSSL(const std::string& profiles);
+		void Release();
+		int  Process(const BYTE *buffer,DWORD size);
+		void CheckPending();
+		void OnSCTPPendingData();
+		void Dispatch(std::function<void(void)> func);
+		int  SetupSRTP();
+		std::string GetSessionKey() const;
+		void RestoreSession();
+		void StoreSession();
+
+		// Callbacks fired by OpenSSL events. 
+		void onSSLInfo(int where, int ret);
+	public:
+		Listener& listener;
+		TimeService& timeService;	// Owner loop, listener and sctp are called on it
+		TimeService& worker;		// Loop on which all the ssl processing is done
+		datachannels::Transport &sctp;	// SCTP transport
+		bool offload;			// If worker is not the owner loop
+		std::atomic<bool> ended;	// Set on the owner loop, tasks queued before don't run anymore
+		std::mutex pendingMutex;
+		std::deque<std::vector<BYTE>> pending;	// Outgoing dtls datagrams when offloaded
+		Timer::shared timeout;		// DTLS timout handler
+		SSL *ssl;			// SSL session 
+		BIO *read_bio;			// Memory buffer for reading 
+		BIO *write_bio;			// Memory buffer for writing 
+		Setup setup;			// Setup state when inited
+		unsigned char remoteFingerprint[EVP_MAX_MD_SIZE];	// Fingerprint of the peer certificate 
+		unsigned int remoteFingerprintSize;	// Length of the peer fingerprint 
+		Hash remoteHash;		// Hash of the peer fingerprint 
+		Connection connection;		// Whether this is a new or existing connection 
+	};
 private:
 	Listener& listener;
-	TimeService& timeService;
-	Timer::shared timeout;		// DTLS timout handler
+	TimeService& timeService;	// Owner loop, listener and sctp are called on it
+	TimeService& worker;		// Loop on which all the ssl processing is done
+	bool offload;			// If worker is not the owner loop
 	datachannels::Transport &sctp;	// SCTP transport
-	SSL *ssl;			// SSL session 
-	BIO *read_bio;			// Memory buffer for reading 
-	BIO *write_bio;			// Memory buffer for writing 
+	std::shared_ptr<State> state;	// Current ssl session, null if not inited
 	Setup setup;			// Current setup state 
 	unsigned char remoteFingerprint[EVP_MAX_MD_SIZE];	// Fingerprint of the peer certificate 
+	unsigned int remoteFingerprintSize;	// Length of the peer fingerprint 
 	Hash remoteHash;		// Hash of the peer fingerprint 
-	Connection connection;		// Whether this is a new or existing connection 
 	unsigned int rekey;		// Interval at which to renegotiate and rekey 
 	int rekeyid;			// Scheduled item id for rekeying 
 	std::atomic<bool> inited;	// Set to true once the SSL stuff is set for this DTLS session 
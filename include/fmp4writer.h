@@ -0,0 +1,101 @@
+#ifndef _FMP4WRITER_H_
+#define _FMP4WRITER_H_
+#include "config.h"
+#include "codecs.h"
+#include "media.h"
+#include "mp4filewriter.h"
+#include <vector>
+#include <string>
+#include <memory>
+#include <chrono>
+
+/********************************
+ * FMP4Writer
+ *	Fragmented MP4 (CMAF style) writer. The init segment (ftyp+moov) is
+ *	written before the first fragment and then a moof+mdat pair is emitted
+ *	each fragment duration, cutting on video key frames when there is a
+ *	video track. Only the samples of the current fragment are kept in memory.
+ *	Supports H264, VP8, VP9 and Opus.
+ ********************************/
+class FMP4Writer
+{
+public:
+	FMP4Writer(std::chrono::milliseconds fragmentDuration = std::chrono::milliseconds(2000));
+	~FMP4Writer();
+
+	bool Open(const char* filename);
+	//Continue recording on a new file starting on next key frame
+	bool Rotate(const char* filename);
+	bool Close();
+
+	//Return track id or 0 if not supported
+	DWORD AddAudioTrack(AudioCodec::Type codec,DWORD rate);
+	DWORD AddVideoTrack(VideoCodec::Type codec,DWORD rate,DWORD width,DWORD height);
+	void  SetH264SequenceParameterSet(DWORD trackId,const BYTE* nal,DWORD size);
+	void  SetH264PictureParameterSet(DWORD trackId,const BYTE* nal,DWORD size);
+	bool  WriteSample(DWORD trackId,const BYTE* data,DWORD size,DWORD duration,bool isSync);
+
+	bool   IsOpened() const		{ return opened;	}
+	size_t GetBufferedSize() const;
+	DWORD  GetFragments() const	{ return sequence;	}
+	//Stats of current or last file, can be called from any thread
+	MP4FileWriter::Stats GetStats();
+
+private:
+	struct Sample
+	{
+		DWORD size;
+		DWORD duration;
+		bool  isSync;
+	};
+	struct Track
+	{
+		DWORD			id;
+		MediaFrame::Type	type;
+		DWORD			codec;
+		DWORD			rate;
+		DWORD			width		= 0;
+		DWORD			height		= 0;
+		std::vector<BYTE>	sps;
+		std::vector<BYTE>	pps;
+		//Codec configuration, taken from the stream before the init segment is written
+		BYTE			channels	= 1;
+		BYTE			profile		= 0;
+		BYTE			level		= 0;
+		BYTE			bitDepth	= 8;
+		BYTE			chromaSubsampling = 1;	//4:2:0 colocated
+		bool			fullRange	= false;
+		BYTE			colorPrimaries	= 2;	//Unspecified
+		BYTE			transferCharacteristics = 2;
+		BYTE			matrixCoefficients = 2;
+		bool			inInit		= false;
+		uint64_t		decodeTime	= 0;
+		uint64_t		duration	= 0;	//Duration of samples in current fragment
+		std::vector<Sample>	samples;
+		std::vector<BYTE>	data;
+	};
+private:
+	bool IsCutPoint(const Track& track,bool isSync) const;
+	bool IsReady() const;
+	bool HasSamples() const;
+	void ClearSamples();
+	void UpdateCodecConfig(Track& track,const BYTE* data,DWORD size,bool isSync);
+	bool Flush();
+	bool SwitchFile();
+	bool WriteInit();
+	bool WriteFragment();
+
+	void WriteTrack(std::vector<BYTE>& buffer,const Track& track);
+	void WriteSampleEntry(std::vector<BYTE>& buffer,const Track& track);
+
+private:
+	std::chrono::milliseconds fragmentDuration;
+	std::shared_ptr<MP4FileWriter> file;	//Kept after close, stats could be read from other threads
+	bool  opened = false;
+	std::vector<Track> tracks;
+	std::string pendingRotation;
+	bool  initWritten = false;
+	DWORD sequence = 0;
+};
+
+#endif
@@ -5,36 +5,115 @@ extern "C" {
 #include <libavutil/opt.h>
 }
 #include <config.h>
+#include <list>
+#include <atomic>
+#include <mutex>
+#include <tuple>
 
 class FrameScaler
 {
+public:
+	struct Stats
+	{
+		QWORD contextRebuilds	= 0;	//Scaling contexts created
+		QWORD contextReuses	= 0;	//Scaling contexts taken from the cache
+		QWORD cachedContexts	= 0;	//Idle contexts on the cache
+		QWORD resizes		= 0;
+		QWORD copies		= 0;	//Resizes done as a plain copy as size did not change
+		QWORD decimations	= 0;	//Resizes done from a 2x or 4x decimated frame
+		QWORD sharedDecimations	= 0;	//Of them, done from a pyramid shared with other scalers
+		QWORD totalResizeTime	= 0;	//In ns
+		QWORD avgResizeTime	= 0;	//In ns
+	};
+	//Decimated frames of a contiguous source frame, built once and shared by all the scalers resizing it
+	class Pyramid
+	{
+	public:
+		Pyramid() = default;
+		Pyramid(const Pyramid&) = delete;
+		Pyramid& operator=(const Pyramid&) = delete;
+		~Pyramid();
+		//Decimate frame down to level, previous levels are discarded
+		void Build(BYTE *frame,int width,int height,int level);
+	private:
+		friend class FrameScaler;
+		BYTE*	frame	= nullptr;
+		int	width	= 0;
+		int	height	= 0;
+		int	levels	= 0;
+		BYTE*	buffer	= nullptr;
+		DWORD	size	= 0;
+	};
 public:
 	FrameScaler();
 	~FrameScaler();
 	int SetResize(int srcWidth,int srcHeight,int srcLineWidth,int dstWidth,int dstHeight,int dstLineWidth,bool keepAspectRatio = true);
-	int Resize(BYTE *srcY,BYTE *srcU,BYTE *srcV,BYTE *dstY, BYTE *dstU, BYTE *dstV);
-	int Resize(BYTE *src,DWORD srcWidth,DWORD srcHeight,BYTE *dst,DWORD dstWidth,DWORD dstHeight,bool keepAspectRatio = true);
+	//Scale from the pyramid levels instead of decimating again if it has been built for the source frame
+	int Resize(BYTE *srcY,BYTE *srcU,BYTE *srcV,BYTE *dstY, BYTE *dstU, BYTE *dstV,const Pyramid* pyramid = nullptr);
+	int Resize(BYTE *src,DWORD srcWidth,DWORD srcHeight,BYTE *dst,DWORD dstWidth,DWORD dstHeight,bool keepAspectRatio = true,const Pyramid* pyramid = nullptr);
+
+	//Process wide cache of idle scaling contexts
+	static void SetContextCacheSize(DWORD size);
+	//Decimate source frame by 2x or 4x with a box filter before scaling down to small sizes, applies on next size change
+	static void EnablePyramid(bool enabled);
+	//Pyramid level a frame would be scaled from to the given size, 0 if it is not decimated
+	static int GetPyramidLevel(int srcWidth,int srcHeight,int dstWidth,int dstHeight,bool keepAspectRatio = true);
+	//Box filter 2x decimation of a plane, dst size is width/2 x height/2
+	static void Decimate(const BYTE* src,int srcLineWidth,int width,int height,BYTE* dst,int dstLineWidth);
+	static Stats GetStats();
+	static void ResetStats();
+
+private:
+	//srcWidth,srcHeight,dstWidth,dstHeight,format,flags
+	typedef std::tuple<int,int,int,int,int,int> ContextKey;
+	typedef std::list<std::pair<ContextKey,struct SwsContext*>> Contexts;
+	//Updated on every resize, so not guarded by the cache mutex
+	struct Counters
+	{
+		std::atomic<QWORD> contextRebuilds	= 0;
+		std::atomic<QWORD> contextReuses	= 0;
+		std::atomic<QWORD> resizes		= 0;
+		std::atomic<QWORD> copies		= 0;
+		std::atomic<QWORD> decimations		= 0;
+		std::atomic<QWORD> sharedDecimations	= 0;
+		std::atomic<QWORD> totalResizeTime	= 0;
+	};
+
+	static void GetAdjustedSize(int srcWidth,int srcHeight,int dstWidth,int dstHeight,bool keepAspectRatio,int& width,int& height);
+	static int GetLevel(int srcWidth,int srcHeight,int width,int height);
+	//Decimate the planes in src down to level into buffer, src is set to the planes of the level
+	static void DecimateLevels(BYTE* src[3],int lineWidth,int width,int height,int level,BYTE* buffer);
+	static DWORD GetLevelsSize(int width,int height,int level);
+	static struct SwsContext* AcquireContext(const ContextKey& key);
+	static void ReleaseContext(const ContextKey& key,struct SwsContext* ctx);
+	void ReleaseContext();
+	bool IsShared(const Pyramid* pyramid,const BYTE* srcY) const;
 
 private:
 	struct SwsContext* resizeCtx;
+	ContextKey resizeKey;
+	bool	resizeCopy;
 	int     resizeWidth;
 	int     resizeHeight;
+	int	resizeLineWidth;
 	int	resizeDstWidth;
 	int     resizeDstHeight;
 	int     resizeDstAdjustedHeight;
 	int     resizeDstAdjustedWidth;
 	int	resizeDstLineWidth;
+	bool	resizeKeepAspectRatio;
 	int     resizeSrc[3];
 	int     resizeDst[3];
 	int     resizeFlags;
-	int	tmpWidth;
-	int	tmpHeight;
-	int	tmpBufferSize;
-	BYTE*	tmpBuffer;
-	BYTE*	tmpY;
-	BYTE* 	tmpU;
-	BYTE* 	tmpV;
+	int	resizeLevel;	//Pyramid level used as scaling source, 0 is the source frame
+	BYTE*	levelBuffer;
+	DWORD	levelBufferSize;
 
+	static std::mutex	cacheMutex;
+	static Contexts		cache;		//Most recently used first
+	static DWORD		cacheSize;
+	static Counters		counters;
+	static bool		pyramid;
 };
 
 #endif
@@ -2,15 +2,64 @@
 #define _LOG_H_
 
 #include <stdio.h>
+#include <string.h>
 #include <unistd.h>
 #include <stdarg.h>
 #include <pthread.h>
 #include <sys/time.h>
+#include <algorithm>
+#include <tuple>
+#include <type_traits>
 #include "config.h"
 #include "tools.h"
 
+//How a log argument is captured
+enum class LogArgumentKind : BYTE { Value, String, Pointer };
+
+//Captures a log argument by value so it can be formatted later on the flusher thread
+template<typename T>
+struct LogArgument
+{
+	static_assert(std::is_trivially_copyable<T>::value,"log arguments must be trivially copyable");
+	typedef T Type;
+	//Only the address of pointers is captured, not what they point to
+	static constexpr LogArgumentKind Kind = std::is_pointer<T>::value ? LogArgumentKind::Pointer : LogArgumentKind::Value;
+	static size_t Size(const T& value)		{ return sizeof(T);					}
+	static BYTE* Write(BYTE* data,const T& value)	{ memcpy(data,&value,sizeof(T)); return data+sizeof(T);	}
+	static Type Read(const BYTE*& data)		{ T value; memcpy(&value,data,sizeof(T)); data+=sizeof(T); return value; }
+};
+
+//Strings are copied up to the null terminator, as the pointer could be gone when formatted
+template<>
+struct LogArgument<const char*>
+{
+	typedef const char* Type;
+	static constexpr LogArgumentKind Kind = LogArgumentKind::String;
+	static const char* Get(const char* str)		{ return str ? str : "(null)";				}
+	static size_t Size(const char* str)		{ return strlen(Get(str))+1;				}
+	static BYTE* Write(BYTE* data,const char* str)	{ size_t len = Size(str); memcpy(data,Get(str),len); return data+len; }
+	static Type Read(const BYTE*& data)		{ Type str = (Type)data; data+=strlen(str)+1; return str; }
+};
+
+template<>
+struct LogArgument<char*> : public LogArgument<const char*>
+{
+};
+
 class Logger
 {
+public:
+	//Formats the captured arguments of a record
+	typedef int (*Formatter)(char* out,size_t size,const BYTE* data);
+
+	//Header of the records stored on the per thread rings, followed by the captured arguments
+	struct Record
+	{
+		DWORD		size;
+		Formatter	format;
+		const char*	level;
+		struct timeval	tv;
+	};
 public:
         static Logger& getInstance()
         {
@@ -33,6 +82,11 @@ public:
 		return getInstance().log;
 	}
 
+	static bool IsAsyncEnabled()
+	{
+		return getInstance().async;
+	}
+
 	static bool EnableDebug(bool debug)
 	{
 		return getInstance().debug = debug;
@@ -48,7 +102,36 @@ public:
 	{
 		return getInstance().log = log;
 	}
-	
+
+	//Write logs to per thread rings and print them on a background thread instead of on the calling one
+	static bool EnableAsync(bool async);
+
+	//Max number of async messages per second printed from the same call site, 0 for unlimited
+	static DWORD SetRateLimit(DWORD rateLimit)
+	{
+		return getInstance().rateLimit = rateLimit;
+	}
+
+	//Print all the pending async messages
+	static void Flush();
+
+	template<typename... Args>
+	static void Write(const char* level,const char* prefix,bool flush,const char* msg,Args... args)
+	{
+		//If async
+		if (getInstance().async)
+		{
+			//Check rate limit, the format string identifies the call site
+			if (getInstance().rateLimit && !Throttle(msg))
+				//Skip
+				return;
+			//Defer formatting and printing to the flusher thread
+			Enqueue(level,prefix,msg,args...);
+		} else
+			//Print it now
+			Print(level,prefix,flush,msg,args...);
+	}
+
 	inline int Log(const char *msg, ...)
 	{
 		return 1;
@@ -58,16 +141,130 @@ public:
 	{
 		return 0;
 	}
+protected:
+	template<typename... Args>
+	static bool Enqueue(const char* level,const char* prefix,const char* msg,Args... args)
+	{
+		//If there is any pointer
+		if constexpr (((LogArgument<Args>::Kind!=LogArgumentKind::Value) || ... || false))
+		{
+			const LogArgumentKind kinds[] = { LogArgument<Args>::Kind... };
+			//If pointed data is printed or strings are bounded, they could be gone or not null terminated, format it now
+			if (!IsDeferrable(msg,kinds,sizeof...(Args)))
+				return EnqueueFormatted(level,prefix,msg,args...);
+		}
+		//Get record size with all the captured arguments
+		size_t size = sizeof(Record) + LogArgument<const char*>::Size(msg) + LogArgument<const char*>::Size(prefix ? prefix : "") + (LogArgument<Args>::Size(args) + ... + 0);
+		//Get space on this thread ring
+		Record* record = Reserve(size);
+		//If full
+		if (!record)
+			//Dropped
+			return false;
+		//Set header
+		record->format = Format<Args...>;
+		record->level = level;
+		gettimeofday(&record->tv,NULL);
+		//Capture arguments
+		BYTE* data = (BYTE*)(record+1);
+		data = LogArgument<const char*>::Write(data,msg);
+		data = LogArgument<const char*>::Write(data,prefix ? prefix : "");
+		((data = LogArgument<Args>::Write(data,args)), ...);
+		//Publish it
+		Commit(record);
+		//Done
+		return true;
+	}
+
+	template<typename... Args>
+	static bool EnqueueFormatted(const char* level,const char* prefix,const char* msg,Args... args)
+	{
+		//Get formatted length
+		int len = Sprintf(nullptr,0,msg,args...);
+		//If error
+		if (len<0)
+			//Skip
+			return false;
+		//Stored as the only argument of a plain string message
+		size_t size = sizeof(Record) + LogArgument<const char*>::Size("%s") + LogArgument<const char*>::Size(prefix ? prefix : "") + len + 1;
+		//Get space on this thread ring
+		Record* record = Reserve(size);
+		//If full
+		if (!record)
+			//Dropped
+			return false;
+		//Set header
+		record->format = Format<const char*>;
+		record->level = level;
+		gettimeofday(&record->tv,NULL);
+		//Write formatted message
+		BYTE* data = (BYTE*)(record+1);
+		data = LogArgument<const char*>::Write(data,"%s");
+		data = LogArgument<const char*>::Write(data,prefix ? prefix : "");
+		Sprintf((char*)data,len+1,msg,args...);
+		//Publish it
+		Commit(record);
+		//Done
+		return true;
+	}
+
+	template<typename... Args>
+	static int Format(char* out,size_t size,const BYTE* data)
+	{
+		//Get format and prefix
+		const char* msg = LogArgument<const char*>::Read(data);
+		const char* prefix = LogArgument<const char*>::Read(data);
+		//Read arguments in order
+		std::tuple<typename LogArgument<Args>::Type...> values { LogArgument<Args>::Read(data)... };
+		//Print prefix
+		int len = *prefix ? snprintf(out,size,"%s ",prefix) : 0;
+		//Print message after it
+		return len + std::apply([=](auto... values){ return Sprintf(out+std::min<size_t>(len,size),size-std::min<size_t>(len,size),msg,values...); },values);
+	}
+
+	static int Sprintf(char* out,size_t size,const char* msg,...)
+	{
+		va_list ap;
+		va_start(ap, msg);
+		int len = vsnprintf(out,size,msg,ap);
+		va_end(ap);
+		return len;
+	}
+
+	static void Print(const char* level,const char* prefix,bool flush,const char* msg,...)
+	{
+		struct timeval tv;
+		va_list ap;
+		gettimeofday(&tv,NULL);
+		if (prefix)
+			printf("[0x%lx][%.10ld.%.3ld][%s]%s ", (long) pthread_self(),(long)tv.tv_sec,(long)tv.tv_usec/1000,level,prefix);
+		else
+			printf("[0x%lx][%.10ld.%.3ld][%s]", (long) pthread_self(),(long)tv.tv_sec,(long)tv.tv_usec/1000,level);
+		va_start(ap, msg);
+		vprintf(msg, ap);
+		va_end(ap);
+		if (flush) fflush(stdout);
+	}
+
+	static bool Throttle(const char* msg);
+	//Check if the captured arguments are enough to format the message later
+	static bool IsDeferrable(const char* msg,const LogArgumentKind* kinds,size_t num);
+	static Record* Reserve(size_t size);
+	static void Commit(Record* record);
 protected:
 	bool log;
 	bool debug;
 	bool ultradebug;
+	bool async;
+	DWORD rateLimit;
 private:
         Logger()
 	{
 		log = true;
 		debug = false;
 		ultradebug = false;
+		async = false;
+		rateLimit = 0;
 	}
         // Dont forget to declare these two. You want to make sure they
         // are unaccessable otherwise you may accidently get copies of
@@ -76,96 +273,51 @@ private:
         void operator=(Logger const&);		// Don't implement
 };
 
-inline int Log(const char *msg, ...)
+template<typename... Args>
+inline int Log(const char *msg, Args... args)
 {
 	if (Logger::IsLogEnabled())
-	{
-		struct timeval tv;
-		va_list ap;
-		gettimeofday(&tv,NULL);
-		printf("[0x%lx][%.10ld.%.3ld][LOG]", (long) pthread_self(),(long)tv.tv_sec,(long)tv.tv_usec/1000);
-		va_start(ap, msg);
-		vprintf(msg, ap);
-		va_end(ap);
-		fflush(stdout);
-	}
+		Logger::Write("LOG",nullptr,true,msg,args...);
 	return 1;
 }
 
-inline int Log2(const char* prefix,const char *msg, ...)
+template<typename... Args>
+inline int Log2(const char* prefix,const char *msg, Args... args)
 {
 	if (Logger::IsLogEnabled())
-	{
-		struct timeval tv;
-		va_list ap;
-		gettimeofday(&tv,NULL);
-		printf("[0x%lx][%.10ld.%.3ld][LOG]%s ", (long) pthread_self(),(long)tv.tv_sec,(long)tv.tv_usec/1000,prefix);
-		va_start(ap, msg);
-		vprintf(msg, ap);
-		va_end(ap);
-		fflush(stdout);
-	}
+		Logger::Write("LOG",prefix,true,msg,args...);
 	return 1;
 }
 
-inline int UltraDebug(const char *msg, ...)
+template<typename... Args>
+inline int UltraDebug(const char *msg, Args... args)
 {
 	if (Logger::IsUltraDebugEnabled())
-	{
-		struct timeval tv;
-		va_list ap;
-		gettimeofday(&tv,NULL);
-		printf("[0x%lx][%.10ld.%.3ld][DBG]", (long) pthread_self(),(long)tv.tv_sec,(long)tv.tv_usec/1000);
-		va_start(ap, msg);
-		vprintf(msg, ap);
-		va_end(ap);
-		fflush(stdout);
-	}
+		Logger::Write("DBG",nullptr,true,msg,args...);
 	return 1;
 }
 
-inline int Debug(const char *msg, ...)
+template<typename... Args>
+inline int Debug(const char *msg, Args... args)
 {
 	if (Logger::IsDebugEnabled())
-	{
-		struct timeval tv;
-		va_list ap;
-		gettimeofday(&tv,NULL);
-		printf("[0x%lx][%.10ld.%.3ld][DBG]", (long) pthread_self(),(long)tv.tv_sec,(long)tv.tv_usec/1000);
-		va_start(ap, msg);
-		vprintf(msg, ap);
-		va_end(ap);
-		fflush(stdout);
-	}
+		Logger::Write("DBG",nullptr,true,msg,args...);
 	return 1;
 }
 
-inline int Warning(const char *msg, ...)
+template<typename... Args>
+inline int Warning(const char *msg, Args... args)
 {
 	if (Logger::IsDebugEnabled())
-	{
-		struct timeval tv;
-		va_list ap;
-		gettimeofday(&tv,NULL);
-		printf("[0x%lx][%.10ld.%.3ld][WRN]", (long) pthread_self(),(long)tv.tv_sec,(long)tv.tv_usec/1000);
-		va_start(ap, msg);
-		vprintf(msg, ap);
-		va_end(ap);
-		fflush(stdout);
-	}
+		Logger::Write("WRN",nullptr,true,msg,args...);
 	return 0;
 }
 
 
-inline int Error(const char *msg, ...)
+template<typename... Args>
+inline int Error(const char *msg, Args... args)
 {
-	struct timeval tv;
-	va_list ap;
-	gettimeofday(&tv,NULL);
-	printf("[0x%lx][%.10ld.%.3ld][ERR]", (long) pthread_self(),(long)tv.tv_sec,(long)tv.tv_usec/1000);
-	va_start(ap, msg);
-	vprintf(msg, ap);
-	va_end(ap);
+	Logger::Write("ERR",nullptr,false,msg,args...);
 	return 0;
 }
 
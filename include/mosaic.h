@@ -1,6 +1,7 @@
 #ifndef _MOSAIC_H_
 #define _MOSAIC_H_
 #include "config.h"
+#include "video.h"
 #include "framescaler.h"
 #include "overlay.h"
 #include "vad.h"
@@ -18,6 +19,8 @@ public:
 	static const int SlotFree     = 0;
 	static const int SlotLocked   = -1;
 	static const int SlotVAD      = -2;
+
+	static const QWORD SlotInvalid = (QWORD)-1;
 	typedef enum
 	{
 		mosaic1x1	= 0,
@@ -97,7 +100,8 @@ public:
 	int HasChanged()	const { return mosaicChanged;	}
 
 	BYTE* GetFrame();
-	virtual int Update(int index,BYTE *frame,int width,int heigth, bool keepAspectRatio = true) = 0;
+	//Pyramid is the one built for frame if any, so it is not decimated again on each slot
+	virtual int Update(int index,BYTE *frame,int width,int heigth, bool keepAspectRatio = true, const FrameScaler::Pyramid* pyramid = nullptr) = 0;
 	virtual int Clean(int index) = 0;
 	virtual int Clean(int index,const Logo& logo)
 	{
@@ -123,6 +127,12 @@ public:
 
 	int* GetPositions();
 	int* GetOldPositions();
+	QWORD GetSlotGeneration(int pos);
+	void SetSlotGeneration(int pos,QWORD generation);
+	void InvalidateSlot(int pos)	{ SetSlotGeneration(pos,SlotInvalid); }
+	bool IsSlotOverlapping(int pos);
+	VideoRegions GetChangedRegions();
+	void ClearChangedRegions();
 	int* GetSlots();
 	int GetNumSlots();
 	void SetSlots(int *slots,int num);
@@ -151,6 +161,8 @@ public:
 	Type  GetType() { return mosaicType;	}
 protected:
 	void SetChanged()	{ mosaicChanged = true; overlayNeedsUpdate = true; }
+	void SetChanged(int pos);
+	void AddChangedRegion(DWORD left,DWORD top,DWORD width,DWORD height);
 
 
 protected:
@@ -166,6 +178,10 @@ protected:
 	// association between position and ids
 	int *mosaicPos;
 	int *oldPos;
+	// frame generation displayed on each slot
+	QWORD *slotGenerations;
+	// regions modified since last cleared
+	VideoRegions changedRegions;
 	QWORD vadBlockingTime;
 	
 	int vadParticipant;
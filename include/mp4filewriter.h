@@ -0,0 +1,92 @@
+#ifndef _MP4FILEWRITER_H_
+#define _MP4FILEWRITER_H_
+#include <mp4v2/mp4v2.h>
+#include "config.h"
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <vector>
+#include <chrono>
+#include <atomic>
+
+/********************************
+ * MP4FileWriter
+ *	Write behind file used as mp4v2 file provider. Small sample writes are
+ *	coalesced into big blocks that are written with pwrite from a background
+ *	thread, so disk stalls do not block the recorder loop until the queue
+ *	reaches its limit.
+ ********************************/
+class MP4FileWriter
+{
+public:
+	struct Stats
+	{
+		uint64_t bytesWritten	= 0;
+		uint64_t blocksWritten	= 0;
+		uint64_t queuedBytes	= 0;	//Current bytes pending to be written
+		uint64_t queuedBlocks	= 0;	//Current blocks pending to be written
+		uint64_t maxQueuedBytes	= 0;
+		uint64_t maxQueuedBlocks= 0;
+		uint64_t stalls		= 0;	//Times the producer had to wait for the queue
+		std::chrono::microseconds avgWriteLatency = {};	//From block queued to written on disk
+		std::chrono::microseconds maxWriteLatency = {};
+		bool	 failed		= false;
+	};
+public:
+	MP4FileWriter(size_t blockSize = 1024*1024, size_t maxQueuedBytes = 64*1024*1024);
+	virtual ~MP4FileWriter();
+
+	//Create mp4 file using this writer as file provider
+	MP4FileHandle Create(const char* filename,uint32_t flags = 0);
+
+	bool Open(const char* filename);
+	bool Seek(uint64_t pos);
+	bool Read(BYTE* data,size_t size,size_t& read);
+	bool Write(const BYTE* data,size_t size);
+	bool Flush();
+	bool Close();
+
+	Stats GetStats();
+
+protected:
+	//Actual disk write, run on the writer thread
+	virtual bool WriteBlock(const BYTE* data,size_t size,uint64_t offset);
+
+private:
+	struct Block
+	{
+		uint64_t offset = 0;
+		std::vector<BYTE> data;
+		std::chrono::steady_clock::time_point queued;
+	};
+private:
+	void Submit();
+	void Run();
+
+	static const MP4FileProvider provider;
+private:
+	int fd			= FD_INVALID;
+	size_t blockSize;
+	size_t maxQueuedBytes;
+
+	//Block being filled by the producer
+	Block current;
+	uint64_t position	= 0;
+
+	//Writer thread
+	std::thread thread;
+	std::mutex mutex;
+	std::condition_variable cond;
+	std::deque<Block> queue;
+	std::vector<std::vector<BYTE>> pool;
+	bool running		= false;
+	bool writing		= false;
+	std::atomic<bool> failed = {false};
+
+	//Stats, protected by mutex
+	Stats stats;
+	std::chrono::microseconds totalWriteLatency = {};
+};
+
+#endif
@@ -10,14 +10,19 @@
 #include "recordercontrol.h"
 #include "Buffer.h"
 #include "EventLoop.h"
+#include "mp4filewriter.h"
+#include "fmp4writer.h"
 
 #include <deque>
 #include <optional>
+#include <atomic>
 
 class mp4track
 {
 public:
-	mp4track(MP4FileHandle mp4);
+	mp4track(MP4FileHandle mp4, bool deferHints = false);
+	//Write samples as fragments instead
+	mp4track(FMP4Writer* fmp4);
 	int CreateAudioTrack(AudioCodec::Type codec, DWORD rate, bool disableHints = false);
 	int CreateVideoTrack(VideoCodec::Type codec, DWORD rate, int width, int height, bool disableHints = false);
 	int CreateTextTrack();
@@ -28,12 +33,32 @@ public:
 	int Close();
 	void AddH264SequenceParameterSet(const BYTE* data, DWORD size);
 	void AddH264PictureParameterSet(const BYTE* data, DWORD size);
+private:
+	struct HintPacket
+	{
+		BYTE	prefix[14];
+		BYTE	prefixLen;
+		DWORD	pos;
+		DWORD	size;
+		bool	mark;
+	};
+	struct HintSample
+	{
+		int	sampleId;
+		DWORD	duration;
+		bool	isSync;
+		std::vector<HintPacket> packets;
+	};
 private:
 	int FlushAudioFrame(AudioFrame* frame,DWORD duration);
 	int FlushVideoFrame(VideoFrame* frame,DWORD duration);
 	int FlushTextFrame(TextFrame* frame,DWORD duration);
+	void WriteHint(const HintSample& sample);
+	void AddHint(HintSample&& sample);
+	void AddFragmentedParameterSets(const VideoFrame* frame);
 private:
 	MP4FileHandle mp4	= MP4_INVALID_FILE_HANDLE;
+	FMP4Writer* fmp4	= nullptr;
 	MP4TrackId track	= 0;
 	MP4TrackId hint		= 0;
 	int sampleId		= 0;
@@ -46,6 +71,8 @@ private:
 	uint64_t lastSenderTime = 0;
 	uint64_t lastTimestamp  = 0;
 	uint32_t clockrate	= 0;
+	bool deferHints		= false;
+	std::vector<HintSample> hints;
 };
 
 
@@ -60,12 +87,24 @@ public:
 		virtual void onFirstFrame(QWORD time) = 0;
 		virtual void onClosed() = 0;
 	};
+	struct Stats
+	{
+		uint64_t queuedFrames		= 0;	//Frames pending to be processed by the recorder loop
+		uint64_t maxQueuedFrames	= 0;
+		std::chrono::microseconds avgFrameLatency = {};	//From onMediaFrame to written into the file
+		std::chrono::microseconds maxFrameLatency = {};
+		MP4FileWriter::Stats writer;
+	};
 public:
 	MP4Recorder(Listener* listener = nullptr);
 	virtual ~MP4Recorder();
 
 	//Recorder interface
 	virtual bool Create(const char *filename);
+	//Create fragmented mp4 file, memory is bounded to the samples of a fragment
+	bool CreateFragmented(const char *filename, std::chrono::milliseconds fragmentDuration = std::chrono::milliseconds(2000));
+	//Continue fragmented recording on a new file starting on next key frame
+	bool Rotate(const char *filename);
 	virtual bool Record();
 	virtual bool Record(bool waitVideo);
 		bool Record(bool waitVideo, bool disableHints);
@@ -79,6 +118,9 @@ public:
 	virtual void onMediaFrame(DWORD ssrc, const MediaFrame &frame);
 	
 	void SetTimeShiftDuration(DWORD duration) { timeShiftDuration = duration; }
+	//Write hint tracks on close instead of with each sample, trading memory for less work while recording
+	void SetDeferHints(bool deferHints)	  { this->deferHints = deferHints; }
+	Stats GetStats();
 	bool SetH264ParameterSets(const std::string& sprop);
 	
 private:
@@ -89,17 +131,27 @@ private:
 	EventLoop	loop;
 	Listener*	listener	= nullptr;
 	MP4FileHandle	mp4		= MP4_INVALID_FILE_HANDLE;
+	std::shared_ptr<MP4FileWriter> writer;
+	std::shared_ptr<FMP4Writer> fmp4;
 	Tracks		audioTracks;
 	Tracks		videoTracks;
 	Tracks		textTracks;
 	bool		recording	= false;
 	bool		waitVideo	= false;
 	bool		disableHints    = false;
+	bool		deferHints	= false;
 	QWORD		first		= (QWORD)-1;
 	
 	std::deque<std::pair<uint32_t,std::unique_ptr<MediaFrame>>> timeShiftBuffer;
 	std::optional<Buffer>	h264SPS;
 	std::optional<Buffer>	h264PPS;
 	DWORD timeShiftDuration = 0;
+
+	//Frame queue stats
+	std::atomic<uint64_t> queuedFrames	= {0};
+	std::atomic<uint64_t> maxQueuedFrames	= {0};
+	std::atomic<uint64_t> processedFrames	= {0};
+	std::atomic<uint64_t> totalFrameLatency	= {0};
+	std::atomic<uint64_t> maxFrameLatency	= {0};
 };
 #endif
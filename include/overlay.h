@@ -8,6 +8,7 @@
 #ifndef OVERLAY_H
 #define	OVERLAY_H
 #include "config.h"
+#include "alphablend.h"
 
 
 class Canvas
@@ -29,6 +30,8 @@ protected:
 	DWORD width;
 	DWORD height;
 	bool display;	
+	AlphaBlend::Runs runs;
+	bool runsChanged;
 };
 
 class Overlay : public Canvas
@@ -18,7 +18,7 @@ public:
 	virtual int   StopVideoCapture();
 
 	int Init();
-	int SetFrame(BYTE * buffer, int height, int width);
+	int SetFrame(BYTE * buffer, int height, int width, const VideoRegions* changed = nullptr);
 	int End();
 
 private:
@@ -34,6 +34,9 @@ private:
 	int capturing;
 	BYTE *imgBuffer[2];
 	BYTE *grabPic;
+	//Changes since last grabbed frame
+	bool grabPartial;
+	VideoRegions grabChanged;
 
 	pthread_mutex_t newPicMutex;
 	pthread_cond_t  newPicCond;
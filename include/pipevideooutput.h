@@ -18,6 +18,7 @@ public:
 
 	BYTE*	GetFrame();
 	int	IsChanged(DWORD version);
+	QWORD	GetGeneration() const	{ return generation;		};
 	int 	GetWidth()	{ return videoWidth;		};
 	int 	GetHeight()	{ return videoHeight;		};
 	int	Init();
@@ -31,6 +32,7 @@ private:
 	bool	versionChanged;
 	int 	inited;
 	DWORD	version;
+	QWORD	generation;
 
 	pthread_mutex_t* videoMixerMutex;
 	pthread_cond_t*  videoMixerCond;
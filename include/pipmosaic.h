@@ -15,7 +15,7 @@ public:
 
 	virtual BYTE* GetFrame();
 
-	virtual int Update(int index,BYTE *frame,int width,int heigth, bool keepAspectRatio);
+	virtual int Update(int index,BYTE *frame,int width,int heigth, bool keepAspectRatio, const FrameScaler::Pyramid* pyramid);
 	virtual int Clean(int index);
 
 	virtual int GetWidth(int pos);
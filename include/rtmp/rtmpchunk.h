@@ -32,6 +32,16 @@ protected:
 
 class RTMPChunkOutputStream : public RTMPChunkStreamInfo
 {
+public:
+	//Next chunk to send, header is serialized on caller buffer and data points into the shared message payload
+	struct Chunk
+	{
+		DWORD		headerLen = 0;
+		std::shared_ptr<const BYTE> data;
+		DWORD		length = 0;
+	};
+	//Basic header + type 0 header + extended timestamp
+	static constexpr DWORD MaxHeaderSize = 3+11+4;
 public:
 	RTMPChunkOutputStream(DWORD id);
 	~RTMPChunkOutputStream();
@@ -39,6 +49,7 @@ public:
 	bool HasData();
 	bool ResetStream(DWORD id);
 	DWORD GetNextChunk(BYTE *data,DWORD size,DWORD maxChunkSize);
+	bool GetNextChunk(BYTE *header,DWORD size,DWORD maxChunkSize,Chunk& chunk,bool useCache = true);
 
 private:
 	typedef std::list<RTMPMessage*> RTMPMessages;
@@ -47,7 +58,9 @@ private:
 	DWORD chunkStreamId;
 	RTMPMessage* message;
 	DWORD pos;
-	BYTE* msgBuffer;
+	RTMPPayload payload;
+	RTMPMessagePayload::Chunked chunked;	//Current message already chunked by another connection
+	DWORD chunkedSize;			//Chunk size of the chunked message
 	pthread_mutex_t mutex;
 };
 
@@ -1,17 +1,19 @@
 #ifndef _RTMPCONNECTION_H_
 #define _RTMPCONNECTION_H_
 #include <pthread.h>
-#include <sys/poll.h>
 #include "config.h"
 #include "rtmp.h"
 #include "rtmpchunk.h"
 #include "rtmpmessage.h"
 #include "rtmpstream.h"
 #include "rtmpapplication.h"
+#include "rtmpeventloop.h"
 #include <pthread.h>
 #include <map>
 #include <memory>
-#include <thread>
+#include <atomic>
+#include <chrono>
+#include <sys/uio.h>
 
 
 class RTMPConnection :
@@ -33,7 +35,7 @@ public:
 	};
 	using shared = std::shared_ptr<RTMPConnection>;
 public:
-	RTMPConnection(Listener* listener);
+	RTMPConnection(Listener* listener,RTMPEventLoop& loop);
 	~RTMPConnection();
 
 	int Init(int fd);
@@ -60,14 +62,19 @@ public:
 	
 	DWORD GetRTT()	{ return rtt; }
 protected:
-	void Start();
 	void Stop();
-	int Run();
 	void PingRequest();
+	
+	//Called from the event loop thread
+	bool OnReadable();
+	bool OnWritable();
+	void OnClosed();
+	friend class RTMPEventLoop;
 private:
 	void ParseData(BYTE *data,const DWORD size);
-	DWORD SerializeChunkData(BYTE *data,const DWORD size);
-	int WriteData(BYTE *data,const DWORD size);
+	DWORD GatherChunks(iovec* iov,RTMPChunkOutputStream::Chunk* chunks,BYTE* headers,DWORD max);
+	bool WriteData(const BYTE *data,const DWORD size);
+	bool WriteData(iovec* iov,int count);
 
 	void ProcessControlMessage(DWORD messageStremId,BYTE type,RTMPObject* msg);
 	void ProcessCommandMessage(DWORD messageStremId,RTMPCommandMessage* cmd);
@@ -89,9 +96,13 @@ private:
 	typedef std::map<DWORD,RTMPNetStream::shared> RTMPNetStreams;
 private:
 	int socket;
-	pollfd ufds[1];
+	RTMPEventLoop& loop;
 	volatile bool inited;
 	volatile bool running;
+	std::atomic<bool> writePending = {false};
+	std::chrono::milliseconds lastActivity = std::chrono::milliseconds(0);
+	std::vector<BYTE> pending;
+	size_t pendingPos = 0;
 	State state;
 
 	RTMPHandshake01 s01;
@@ -120,7 +131,6 @@ private:
 	DWORD maxChunkSize;
 	DWORD maxOutChunkSize;
 
-	std::thread thread;
 	pthread_mutex_t mutex;
 
 	RTMPNetConnection::shared app;
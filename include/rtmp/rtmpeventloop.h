@@ -0,0 +1,65 @@
+#ifndef _RTMPEVENTLOOP_H_
+#define _RTMPEVENTLOOP_H_
+#include "config.h"
+#include "concurrentqueue.h"
+#include <thread>
+#include <functional>
+#include <unordered_map>
+#include <memory>
+#include <atomic>
+#include <chrono>
+
+class RTMPConnection;
+
+/********************************
+ * RTMPEventLoop
+ *	Edge triggered epoll loop multiplexing many RTMP connections on a single
+ *	thread. Sockets are read until EAGAIN and output is queued on each
+ *	connection and flushed when the socket is writable again.
+ ********************************/
+class RTMPEventLoop
+{
+public:
+	using shared = std::shared_ptr<RTMPEventLoop>;
+	using Task = std::function<void(void)>;
+public:
+	RTMPEventLoop();
+	~RTMPEventLoop();
+
+	bool Start();
+	bool Stop();
+
+	bool AddConnection(const std::shared_ptr<RTMPConnection>& connection);
+	void RemoveConnection(RTMPConnection* connection);
+	void SignalWriteNeeded(const std::shared_ptr<RTMPConnection>& connection);
+	void Async(Task&& task);
+
+	size_t GetConnectionsCount() const	{ return numConnections;	}
+	bool IsRunning() const			{ return running;		}
+	bool IsLoopThread() const		{ return std::this_thread::get_id()==thread.get_id(); }
+	std::chrono::milliseconds GetNow() const{ return now;			}
+
+protected:
+	void Run();
+	void Signal();
+	void CloseConnection(int fd);
+	void CheckIdleConnections();
+
+private:
+	static const size_t MaxEvents;
+	static const std::chrono::milliseconds IdleTimeout;
+private:
+	std::thread	thread;
+	int		epollfd		= FD_INVALID;
+	int		wakeup		= FD_INVALID;
+	volatile bool	running		= false;
+	std::atomic<bool> signaled	= {false};
+	std::atomic<size_t> numConnections = {0};
+	std::chrono::milliseconds now	= std::chrono::milliseconds(0);
+	std::chrono::milliseconds lastIdleCheck = std::chrono::milliseconds(0);
+
+	moodycamel::ConcurrentQueue<Task> tasks;
+	std::unordered_map<int,std::shared_ptr<RTMPConnection>> connections;
+};
+
+#endif
@@ -7,6 +7,45 @@
 #include "avcdescriptor.h"
 #include "aac/aacconfig.h"
 #include <vector>
+#include <memory>
+#include <mutex>
+
+/********************************
+ * RTMPMessagePayload
+ *	Serialized message body, immutable once created so it can be shared by
+ *	all the connections it is sent to. When the same payload is chunked more
+ *	than once with the same chunk size and chunk stream, the chunked wire
+ *	bytes (without the first chunk header) are cached so they are only built
+ *	once for all the viewers.
+ ********************************/
+class RTMPMessagePayload
+{
+public:
+	using Chunked = std::shared_ptr<const std::vector<BYTE>>;
+public:
+	RTMPMessagePayload(DWORD size) : buffer(size) {}
+
+	BYTE*		GetData()		{ return buffer.data();	}
+	const BYTE*	GetData() const		{ return buffer.data();	}
+	DWORD		GetSize() const		{ return buffer.size();	}
+	void		SetSize(DWORD size)	{ buffer.resize(size);	}
+
+	Chunked		GetChunked(DWORD chunkStreamId,DWORD chunkSize) const;
+private:
+	static const size_t MaxChunkedEntries;
+	struct ChunkedEntry
+	{
+		DWORD	chunkStreamId;
+		DWORD	chunkSize;
+		Chunked	data;
+	};
+private:
+	std::vector<BYTE> buffer;
+	mutable std::mutex mutex;
+	mutable std::vector<ChunkedEntry> chunked;
+};
+
+using RTMPPayload = std::shared_ptr<const RTMPMessagePayload>;
 
 class RTMPMediaFrame 
 {
@@ -24,10 +63,14 @@ public:
 	virtual DWORD Serialize(BYTE* buffer,DWORD size);
 	virtual DWORD GetSize()	{ return bufferSize+1; 	}
 
-	virtual BYTE*	GetMediaData()			{ return buffer;		}
+	//Data could be written, so the payload is serialized again when requested, do not write it after getting the payload
+	virtual BYTE*	GetMediaData()			{ InvalidatePayload(); return buffer;	}
+	const BYTE*	GetMediaData() const		{ return buffer;		}
 	virtual DWORD	GetMediaSize()			{ return mediaSize;		}
 	virtual DWORD	GetMaxMediaSize()		{ return bufferSize;		}
-	virtual void	SetMediaSize(DWORD mediaSize)	{ this->mediaSize = mediaSize;	}
+	virtual void	SetMediaSize(DWORD mediaSize)	{ this->mediaSize = mediaSize; InvalidatePayload(); }
+
+	RTMPPayload	GetPayload();
 
 	virtual void	Dump();
 
@@ -47,12 +90,15 @@ protected:
 	RTMPMediaFrame(Type type,QWORD timestamp,BYTE *data,DWORD size);
 	RTMPMediaFrame(Type type,QWORD timestamp,DWORD size);
 
+	void InvalidatePayload()	{ payload.reset();	}
+
 	QWORD timestamp;
 	BYTE *buffer;
 	DWORD bufferSize;
 	DWORD mediaSize;
 	DWORD pos;
 	Type type;
+	RTMPPayload payload;
 };
 
 class RTMPVideoFrame : public RTMPMediaFrame
@@ -71,16 +117,16 @@ public:
 	virtual DWORD	Serialize(BYTE* buffer,DWORD size);
 	virtual DWORD	GetSize();
 
-	void		SetVideoCodec(VideoCodec codec)		{ this->codec = codec;		}
-	void		SetFrameType(FrameType frameType)	{ this->frameType = frameType;	}
+	void		SetVideoCodec(VideoCodec codec)		{ this->codec = codec; InvalidatePayload();		}
+	void		SetFrameType(FrameType frameType)	{ this->frameType = frameType; InvalidatePayload();	}
 	VideoCodec	GetVideoCodec()				const { return codec;		}
 	FrameType	GetFrameType()				const { return frameType;	}
 	BYTE		GetAVCType()				const { return extraData[0];	}
 	DWORD		GetAVCTS()				const { return ((DWORD)extraData[1]) << 16 | ((DWORD)extraData[2]) << 8 | extraData[3]; }
 	
 	DWORD		SetVideoFrame(BYTE* data,DWORD size);
-	void		SetAVCType(BYTE type)			{ extraData[0] = type;		}
-	void		SetAVCTS(DWORD ts)			{ extraData[1] = ts >>16 ; extraData[2] = ts >>8 ;  extraData[3] = ts; }
+	void		SetAVCType(BYTE type)			{ extraData[0] = type; InvalidatePayload();	}
+	void		SetAVCTS(DWORD ts)			{ extraData[1] = ts >>16 ; extraData[2] = ts >>8 ;  extraData[3] = ts; InvalidatePayload(); }
 	virtual void	Dump();
 protected:
 	VideoCodec	codec;
@@ -109,13 +155,13 @@ public:
 	SoundRate	GetSoundRate()			{ return rate;			}
 	bool		IsSamples18Bits()		{ return sample16bits;		}
 	bool		IsStereo()			{ return stereo;		}
-	void		SetAudioCodec(AudioCodec codec)	{ this->codec = codec;		}
-	void		SetSoundRate(SoundRate rate)	{ this->rate = rate;		}
-	void		SetSamples16Bits(bool sample16bits) { this->sample16bits = sample16bits; }
-	void		SetStereo(bool stereo)		{ this->stereo = stereo;	}
+	void		SetAudioCodec(AudioCodec codec)	{ this->codec = codec; InvalidatePayload();	}
+	void		SetSoundRate(SoundRate rate)	{ this->rate = rate; InvalidatePayload();	}
+	void		SetSamples16Bits(bool sample16bits) { this->sample16bits = sample16bits; InvalidatePayload(); }
+	void		SetStereo(bool stereo)		{ this->stereo = stereo; InvalidatePayload();	}
 	DWORD		SetAudioFrame(const BYTE* data,DWORD size);
 
-	void		SetAACPacketType(AACPacketType type)	{ extraData[0] = type;	}
+	void		SetAACPacketType(AACPacketType type)	{ extraData[0] = type; InvalidatePayload(); }
 	AACPacketType   GetAACPacketType()			{ return (AACPacketType) extraData[0]; }
 
 	virtual void	Dump();
@@ -267,6 +313,7 @@ public:
 	RTMPMessage(DWORD streamId,QWORD timestamp,RTMPCommandMessage* cmd);
 	RTMPMessage(DWORD streamId,QWORD timestamp,RTMPMediaFrame* media);
 	RTMPMessage(DWORD streamId,QWORD timestamp,RTMPMetaData* meta);
+	RTMPMessage(DWORD streamId,QWORD timestamp,Type type,const RTMPPayload& payload);
 	~RTMPMessage();
 	
 	DWORD Parse(BYTE* buffer,DWORD size);
@@ -285,6 +332,7 @@ public:
 	RTMPCommandMessage* 	GetCommandMessage()		{ return cmd; 	}
 	RTMPMetaData* 		GetMetaData()			{ return meta;	}
 	RTMPMediaFrame*		GetMediaFrame()			{ return media;	}
+	RTMPPayload		GetPayload();
 
 	DWORD	GetStreamId() 	{ return streamId; 	}
 	Type	GetType()	{ return type; 		}
@@ -296,6 +344,7 @@ private:
 	RTMPCommandMessage* 	cmd;
 	RTMPMetaData*		meta;
 	RTMPMediaFrame*		media;
+	RTMPPayload		payload;
 
 	//Header values
 	DWORD 	streamId;
@@ -5,7 +5,9 @@
 #include "rtmpstream.h"
 #include "rtmpapplication.h"
 #include "rtmpconnection.h"
+#include "rtmpeventloop.h"
 #include <list>
+#include <vector>
 
 
 class RTMPServer : public RTMPConnection::Listener
@@ -15,7 +17,7 @@ public:
 	RTMPServer();
 	virtual ~RTMPServer();
 
-	int Init(int port);
+	int Init(int port,DWORD numLoops = 0);
 	int AddApplication(const wchar_t* name,RTMPApplication *app);
 	int End();
 	
@@ -38,6 +40,7 @@ private:
 	int server;
 
 	std::map<int,RTMPConnection::shared> connections;
+	std::vector<RTMPEventLoop::shared> loops;
 	std::map<std::wstring,RTMPApplication *> applications;
 	pthread_t serverThread;
 	pthread_mutex_t	sessionMutex;
@@ -46,6 +46,12 @@ class RTPSender
 public:
 	virtual int Enqueue(const RTPPacket::shared& packet) = 0;
 	virtual int Enqueue(const RTPPacket::shared& packet,std::function<RTPPacket::shared(const RTPPacket::shared&)> modifier) = 0;
+	//Time service packets can be sent right away from, null if they have to be enqueued
+	virtual TimeService* GetSenderTimeService() { return nullptr; }
+	//Send packet right away, only to be called from the sender time service thread
+	virtual int Send(RTPPacket::shared&& packet) { return Enqueue(packet); }
+	//Bitrate available towards the remote peer in bps, 0 if not estimated, can be called from any thread
+	virtual DWORD GetAvailableBitrate() { return 0; }
 };
 
 class RTPReceiver
@@ -31,5 +31,17 @@ struct LayerInfo
 	}
 };
 
+//Layer classification of a packet, done once on reception so layer selectors only have to compare it
+struct LayerClassification
+{
+	BYTE temporalLayerId	= 0;
+	BYTE spatialLayerId	= 0;
+	bool switchingPoint	= false;	//Temporal layer up switch is possible
+	bool startOfLayerFrame	= false;
+	bool endOfLayerFrame	= false;
+	bool keyFrame		= false;
+	uint32_t decodeTargets	= 0;		//Mask of decode targets the frame is present on
+};
+
 #endif /* LAYERINFO_H */
 
@@ -17,6 +17,7 @@
 #include "bitstream.h"
 #include "rtp/RTCPPacket.h"
 #include "rtp/RTCPCommonHeader.h"
+#include "FlatMap.h"
 #include <vector>
 #include <list>
 #include <map>
@@ -264,8 +265,11 @@ public:
 		virtual DWORD Serialize(BYTE* data,DWORD size) const;
 		virtual void Dump() const;
 		
-		//Pair<seqnum,us> -> us = 0, not received
-		typedef std::map<DWORD,QWORD> Packets;
+		//Write status chunks and deltas, or only calculate their length if no writter, returns chunks length
+		DWORD Encode(BitWritter* writter,BYTE* deltas,DWORD& deltasLen) const;
+		
+		//Pair<seqnum,us> -> us = 0, not received, stored contiguously in seqnum order
+		typedef FlatMap<DWORD,QWORD> Packets;
 		
 		BYTE feedbackPacketCount;
 		QWORD referenceTime = 0;
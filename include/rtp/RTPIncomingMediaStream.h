@@ -20,6 +20,8 @@
 
 #include <vector>
 
+struct RTPIncomingSource;
+
 class RTPIncomingMediaStream
 {
 public:
@@ -41,6 +43,8 @@ public:
 	virtual void RemoveListener(Listener* listener) = 0;
 	virtual DWORD GetMediaSSRC() = 0;
 	virtual TimeService& GetTimeService() = 0;
+	//Source with the per layer bitrates of the stream, only to be accessed from the time service thread
+	virtual const RTPIncomingSource* GetMediaSource() const { return nullptr; }
 };
 
 #endif /* RTPINCOMINGMEDIASTREAM_H */
@@ -27,6 +27,7 @@ public:
 	virtual void RemoveListener(RTPIncomingMediaStream::Listener* listener) override;
 	virtual DWORD GetMediaSSRC()		override { return media.ssrc;	}
 	virtual TimeService& GetTimeService()	override { return timeService;	}
+	virtual const RTPIncomingSource* GetMediaSource() const override { return &media; }
 	int AddPacket(const RTPPacket::shared &packet, DWORD size, QWORD now);
 	RTPIncomingSource* Process(RTPPacket::shared &packet);
 	void Bye(DWORD ssrc);
@@ -18,6 +18,7 @@
 #include "rtp/RTPHeader.h"
 #include "rtp/RTPHeaderExtension.h"
 #include "rtp/RTPPayload.h"
+#include "rtp/LayerInfo.h"
 #include "vp8/vp8.h"
 #include "vp9/VP9PayloadDescription.h"
 #include <memory>
@@ -183,6 +184,7 @@ public:
 	std::optional<VP9PayloadDescription>	vp9PayloadDescriptor;
 	std::optional<std::vector<bool>>	activeDecodeTargets;
 	std::optional<TemplateDependencyStructure> templateDependencyStructure;
+	std::optional<LayerClassification>	layerClassification;
 	
 	bool rewitePictureIds = false;
 	
@@ -17,6 +17,7 @@
 #include "rtp.h"
 #include "VideoLayerSelector.h"
 #include "WrapExtender.h"
+#include <optional>
 
 class RTPStreamTransponder : 
 	public RTPIncomingMediaStream::Listener,
@@ -26,6 +27,25 @@ public:
 	static constexpr uint64_t NoFrameNum = std::numeric_limits<uint64_t>::max();
 	static constexpr uint32_t NoSeqNum = std::numeric_limits<uint32_t>::max();
 	static constexpr uint64_t NoTimestamp = std::numeric_limits<uint64_t>::max();
+	static constexpr QWORD AutoLayerSelectionInterval	= 500;	//ms between checks of the viewer estimation
+	static constexpr QWORD AutoLayerUpSwitchDelay		= 2000;	//ms since last switch before going up again
+	static constexpr double AutoLayerUpSwitchMargin		= 1.2;	//Headroom over the layer bitrate needed to go up
+
+	//Header rewrite of a forwarded packet, applied on the clone done on the sender thread
+	struct Rewrite
+	{
+		RTPPacket::shared Apply(const RTPPacket::shared& packet) const;
+
+		DWORD extSeqNum			= 0;
+		uint64_t timestamp		= 0;
+		bool mark			= false;
+		DWORD ssrc			= 0;
+		bool rewitePictureIds		= false;
+		DWORD pictureId			= 0;
+		DWORD temporalLevelZeroIndex	= 0;
+		uint64_t continousFrameNumber	= NoFrameNum;
+		std::optional<std::vector<bool>> forwaredDecodeTargets;
+	};
 public:
 	RTPStreamTransponder(RTPOutgoingSourceGroup* outgoing,RTPSender* sender);
 	virtual ~RTPStreamTransponder();
@@ -41,12 +61,21 @@ public:
 	virtual void onREMB(RTPOutgoingSourceGroup* group,DWORD ssrc,DWORD bitrate) override;
 	
 	void SelectLayer(int spatialLayerId,int temporalLayerId);
+	//Select highest layer, up to the one set by SelectLayer, fitting in the sender bandwidth estimation
+	void SetAutoLayerSelection(bool enabled);
 	void Mute(bool muting);
 
+	//Update the stream state with an incoming packet, returns false if it has not to be forwarded
+	bool Process(const RTPPacket::shared& packet,Rewrite& rewrite);
+
 	const RTPIncomingMediaStream* GetIncoming() const { return incoming; }
+	RTPSender* GetSender() const { return sender; }
+	//Layer chosen by the automatic layer selection, only to be accessed from the time service thread
+	LayerInfo GetAutoLayer() const { return LayerInfo(autoTemporalLayerId,autoSpatialLayerId); }
 
 protected:
 	void RequestPLI();
+	void UpdateAutoLayer(QWORD now);
 
 private:
 	
@@ -78,6 +107,11 @@ private:
 	volatile BYTE spatialLayerId		= LayerInfo::MaxLayerId;
 	volatile BYTE temporalLayerId		= LayerInfo::MaxLayerId;
 	volatile BYTE lastSpatialLayerId	= LayerInfo::MaxLayerId;
+	volatile bool autoLayerSelection	= false;
+	BYTE autoSpatialLayerId			= LayerInfo::MaxLayerId;
+	BYTE autoTemporalLayerId		= LayerInfo::MaxLayerId;
+	QWORD lastAutoLayerSelection		= 0;	//Last time estimation was checked
+	QWORD lastAutoLayerSwitch		= 0;	//Last time auto selected layer changed
 	WORD lastPicId		= 0;
 	WORD lastTl0Idx		= 0;
 	QWORD picId		= 0;
@@ -0,0 +1,56 @@
+#ifndef RTPSTREAMTRANSPONDERGROUP_H
+#define RTPSTREAMTRANSPONDERGROUP_H
+
+#include <set>
+#include <vector>
+
+#include "config.h"
+#include "rtp.h"
+#include "rtp/RTPStreamTransponder.h"
+#include "TimeService.h"
+
+/********************************
+ * RTPStreamTransponderGroup
+ *	Fan out of an incoming stream to many transponders. Each packet is
+ *	received once, the header rewrites of all transponders are calculated
+ *	in a single pass and a single batch is posted to each sender loop
+ *	instead of one task per packet and transponder.
+ ********************************/
+class RTPStreamTransponderGroup :
+	public RTPIncomingMediaStream,
+	public RTPIncomingMediaStream::Listener
+{
+public:
+	RTPStreamTransponderGroup(DWORD ssrc, TimeService& timeService);
+	virtual ~RTPStreamTransponderGroup() = default;
+	virtual void AddListener(RTPIncomingMediaStream::Listener* listener) override;
+	virtual void RemoveListener(RTPIncomingMediaStream::Listener* listener) override;
+	virtual DWORD GetMediaSSRC() override { return ssrc; }
+
+	virtual void onRTP(RTPIncomingMediaStream* stream,const RTPPacket::shared& packet) override;
+	virtual void onBye(RTPIncomingMediaStream* stream) override;
+	virtual void onEnded(RTPIncomingMediaStream* stream) override;
+	virtual TimeService& GetTimeService() override { return timeService; }
+	void Stop();
+private:
+	void Forward(const RTPPacket::shared& packet);
+private:
+	struct Forwarded
+	{
+		RTPSender* sender;
+		RTPStreamTransponder::Rewrite rewrite;
+	};
+	struct Batch
+	{
+		TimeService* loop;
+		std::vector<Forwarded> forwarded;
+	};
+private:
+	DWORD		ssrc = 0;
+	TimeService&	timeService;
+	std::vector<RTPStreamTransponder*> transponders;
+	std::set<RTPIncomingMediaStream::Listener*> listeners;
+	std::vector<Batch> batches;
+};
+
+#endif /* RTPSTREAMTRANSPONDERGROUP_H */
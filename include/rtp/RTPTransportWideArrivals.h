@@ -0,0 +1,44 @@
+#ifndef RTPTRANSPORTWIDEARRIVALS_H
+#define RTPTRANSPORTWIDEARRIVALS_H
+
+#include <array>
+
+#include "config.h"
+#include "rtp/RTCPRTPFeedback.h"
+
+//Arrival times of the transport wide sequence numbers pending to be reported, indexed by seq num on a ring
+class RTPTransportWideArrivals
+{
+public:
+	static constexpr DWORD Capacity = 1024;
+public:
+	//Check if the seq num fits on the ring with the pending ones and the lost ones since last drain, if not they have to be drained first
+	bool Fits(DWORD extSeqNum) const;
+	//Late arrivals of seq nums already reported as lost are dropped, returns false if so
+	bool Add(DWORD extSeqNum,QWORD time);
+	//Append pending ones and the lost ones since last drain, up to the ring capacity, to the feedback, times relative to initTime
+	void Drain(QWORD initTime,RTCPRTPFeedback::TransportWideFeedbackMessageField::Packets& packets);
+	void Reset();
+
+	bool  IsEmpty()		const { return !count;				}
+	DWORD GetCount()	const { return count;				}
+	QWORD GetFirstTime()	const { return firstTime;			}
+	//Max seq num received, pending or already reported
+	DWORD GetMaxExtSeqNum()	const { return count ? last : lastReported;	}
+private:
+	struct Arrival
+	{
+		DWORD extSeqNum = 0;
+		QWORD time	= 0;
+	};
+private:
+	std::array<Arrival,Capacity> arrivals;
+	DWORD first		= 0;	//Min pending seq num
+	DWORD last		= 0;	//Max pending seq num
+	DWORD count		= 0;
+	QWORD firstTime		= 0;	//Arrival time of the first pending one
+	DWORD lastReported	= 0;
+	bool  reported		= false;	//If any has been reported since reset
+};
+
+#endif /* RTPTRANSPORTWIDEARRIVALS_H */
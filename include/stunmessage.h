@@ -16,6 +16,8 @@
 #include <sys/types.h>
 #include <netinet/in.h>
 #include <arpa/inet.h>
+#include <string>
+#include <openssl/ossl_typ.h>
 
 class STUNMessage
 {
@@ -98,6 +100,74 @@ public:
 		WORD size;
 		BYTE *attr;
 	};
+	//HMAC-SHA1 for the MESSAGE-INTEGRITY attribute, the key is only set up again when the password changes
+	class Integrity
+	{
+	public:
+		Integrity();
+		~Integrity();
+		Integrity(const Integrity&) = delete;
+		Integrity& operator=(const Integrity&) = delete;
+		//Calculate hmac of data using length as the value of the message length field
+		bool Calculate(const char* pwd,const BYTE* data,DWORD size,WORD length,BYTE* hmac);
+	private:
+		HMAC_CTX* ctx = nullptr;
+		std::string pwd;
+		bool keyed = false;
+	};
+
+	//Parsed message pointing to the received data, no allocations are done
+	class View
+	{
+	public:
+		struct Attribute
+		{
+			WORD type;
+			WORD size;
+			const BYTE* attr;
+		};
+	public:
+		bool Parse(const BYTE* data,DWORD size);
+		bool CheckAuthenticatedFingerPrint(Integrity& integrity,const char* pwd) const;
+		const Attribute* GetAttribute(STUNMessage::Attribute::Type type) const;
+		bool  HasAttribute(STUNMessage::Attribute::Type type) const { return GetAttribute(type); }
+
+		Type   GetType()		const { return type;		}
+		Method GetMethod()		const { return method;		}
+		const BYTE*  GetTransactionId()	const { return data+8;		}
+		DWORD  GetNumAttributes()	const { return numAttributes;	}
+		const Attribute& GetAttributeAt(DWORD i) const { return attributes[i];	}
+	private:
+		static constexpr DWORD MaxAttributes = 32;
+	private:
+		const BYTE* data	= nullptr;
+		DWORD size		= 0;
+		Type	type		= Request;
+		Method	method		= Binding;
+		Attribute attributes[MaxAttributes];
+		DWORD numAttributes	= 0;
+	};
+
+	//Serializes a message directly into the output buffer
+	class Writer
+	{
+	public:
+		Writer(BYTE* data,DWORD size,Type type,Method method,const BYTE* transId);
+		bool AddAttribute(Attribute::Type type,const BYTE *data,WORD size);
+		bool AddAttribute(Attribute::Type type,QWORD data);
+		bool AddAttribute(Attribute::Type type,DWORD data);
+		bool AddXorAddressAttribute(uint32_t addr, uint16_t port);
+		bool AddUsernameAttribute(const char* local,const char* remote);
+		//Add MESSAGE-INTEGRITY and FINGERPRINT, returns message size or 0 if it did not fit
+		DWORD AuthenticatedFingerPrint(Integrity& integrity,const char* pwd);
+	private:
+		BYTE* Reserve(Attribute::Type type,WORD size);
+	private:
+		BYTE* data;
+		DWORD size;
+		DWORD pos;
+		bool  overflow = false;
+	};
 public:
 	static bool IsSTUN(const BYTE* data,DWORD size);
 	static STUNMessage* Parse(const BYTE* data,DWORD size);
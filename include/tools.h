@@ -12,7 +12,7 @@
 #include <climits>
 #include <pthread.h>
 
-int Log(const char *msg, ...);
+template<typename... Args> int Log(const char *msg, Args... args);
 
 /*************************************
 * blocksignals
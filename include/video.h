@@ -1,6 +1,7 @@
 #ifndef _VIDEO_H_
 #define _VIDEO_H_
 #include <optional>
+#include <vector>
 #include "config.h"
 #include "media.h"
 #include "codecs.h"
@@ -135,6 +136,16 @@ private:
 
 };
 
+struct VideoRegion
+{
+	DWORD left	= 0;
+	DWORD top	= 0;
+	DWORD width	= 0;
+	DWORD height	= 0;
+};
+
+typedef std::vector<VideoRegion> VideoRegions;
+
 struct VideoBuffer
 {
 	VideoBuffer() = default;
@@ -158,6 +169,9 @@ struct VideoBuffer
 	DWORD	width = 0;
 	DWORD	height = 0;
 	BYTE*	buffer = nullptr;
+	//If set, only the changed regions differ from previous grabbed frame
+	bool	partial = false;
+	VideoRegions changed;
 };
 
 class VideoInput
@@ -188,6 +202,8 @@ public:
 	virtual VideoFrame* EncodeFrame(BYTE *in,DWORD len)=0;
 	virtual int FastPictureUpdate()=0;
 	virtual int SetFrameRate(int fps,int kbits,int intraPeriod)=0;
+	//Hint of which regions changed on next frame, null if full frame
+	virtual int SetChangedRegions(const VideoRegions* changed) { return 0; }
 public:
 	VideoCodec::Type type;
 };
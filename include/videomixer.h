@@ -8,8 +8,14 @@
 #include "mosaic.h"
 #include "logo.h"
 #include "EventSource.h"
+#include "EventLoop.h"
 #include <list>
 #include <map>
+#include <future>
+#include <functional>
+#include <tuple>
+#include <memory>
+#include <vector>
 
 class VideoMixer 
 {
@@ -20,6 +26,19 @@ public:
 		BasicVAD = 1,
 		FullVAD  = 2
 	};
+
+	struct Stats
+	{
+		QWORD ticks		= 0;
+		QWORD updatedSlots	= 0;	//Slots rescaled and blitted because of a new source frame
+		QWORD skippedSlots	= 0;	//Slots without new source frame since previous tick
+		QWORD lastCPUTime	= 0;	//Mixer thread cpu time in us for last tick
+		QWORD avgCPUTime	= 0;
+		QWORD maxCPUTime	= 0;
+		QWORD renditionHits	= 0;	//Slots reusing a participant frame already scaled to the slot size
+		QWORD renditionMisses	= 0;	//Slots needing a rescale of the participant frame
+		double renditionHitRatio = 0;
+	};
 public:
 	// Los valores indican el n�mero de mosaicos por composicion
 
@@ -58,14 +77,72 @@ public:
 
 	void Process(bool forceUpdate, QWORD now);
 	int End();
+	Stats GetStats();
 	
 public:
 	static int MosaicDefault;
 	static int NoMosaic;	
 public:
 	static void SetVADDefaultChangePeriod(DWORD ms);
+	//Threads shared by all mixers to rescale the slots, set before starting mixers
+	static void SetCompositionWorkers(DWORD num);
 
 protected:
+	struct SlotUpdate
+	{
+		Mosaic* mosaic	= nullptr;
+		int	pos	= 0;
+		BYTE*	frame	= nullptr;	//Clean slot if not set
+		int	width	= 0;
+		int	height	= 0;
+		int	partId	= 0;
+		QWORD	generation = 0;
+		int	slotWidth  = 0;
+		int	slotHeight = 0;
+		bool	vumeter	= false;
+		DWORD	vad	= 0;
+		bool	overlapping = false;	//Draws on the area of other slots
+		const FrameScaler::Pyramid* pyramid = nullptr;	//Decimated participant frame to scale from
+	};
+
+	//Participant frame decimated once for all the slots and renditions scaling it down
+	struct Decimation
+	{
+		FrameScaler::Pyramid pyramid;
+		QWORD	generation	= Mosaic::SlotInvalid;
+		int	built		= 0;	//Level decimated for the generation
+		int	level		= 0;	//Level needed on current tick
+		QWORD	tick		= 0;
+		BYTE*	frame		= nullptr;
+		int	width		= 0;
+		int	height		= 0;
+	};
+
+	//Participant frame scaled to a slot size, shared by all slots of that size
+	struct Rendition
+	{
+		~Rendition()	{ free(buffer);	}
+
+		FrameScaler scaler;
+		BYTE*	buffer		= nullptr;
+		DWORD	size		= 0;
+		int	width		= 0;
+		int	height		= 0;
+		QWORD	tick		= 0;
+		QWORD	generation	= Mosaic::SlotInvalid;
+		BYTE*	frame		= nullptr;
+		int	frameWidth	= 0;
+		int	frameHeight	= 0;
+		const FrameScaler::Pyramid* pyramid = nullptr;
+	};
+	//Participant id, slot width, slot height and keep aspect ratio
+	typedef std::tuple<int,int,int,bool> RenditionKey;
+
+	void UpdateSlot(const SlotUpdate& update);
+	void ShareRenditions(DWORD& hits,DWORD& misses);
+	const FrameScaler::Pyramid* SharePyramid(const SlotUpdate& update);
+	void ComposeSlots();
+	void RunParallel(size_t count,const std::function<void(size_t)>& job);
 	int MixVideo();
 	int DumpMosaic(DWORD id,Mosaic* mosaic);
 	int GetPosition(int mosaicId,int id);
@@ -98,8 +175,10 @@ private:
 
 	typedef std::map<int,VideoSource *> Videos;
 	typedef std::map<int,Mosaic *> Mosaics;
+	typedef std::vector<std::unique_ptr<EventLoop>> Workers;
 private:
 	static DWORD vadDefaultChangePeriod;
+	static Workers workers;
 private:
 	EvenSource	eventSource;
 	std::wstring tag;
@@ -125,7 +204,21 @@ private:
 	bool		keepAspectRatio		= true;
 	bool		displayNames		= false;
 	uint32_t	speakingThreshold	= 0;
-	DWORD		version = 0;
+	//Slots to compose on current tick and outputs locked meanwhile
+	std::vector<SlotUpdate> updates;
+	std::vector<PipeVideoOutput*> locked;
+	std::vector<std::future<void>> composing;
+	//Scaled frames shared between slots
+	std::map<RenditionKey,Rendition> renditions;
+	std::map<RenditionKey,int> uses;
+	std::vector<Rendition*> scaling;
+	//Decimated frames shared between slots and renditions, by participant
+	std::map<int,Decimation> decimations;
+	std::vector<Decimation*> decimating;
+	QWORD		ticks			= 0;
+	Stats		stats;
+	QWORD		totalCPUTime		= 0;
+	Mutex		statsMutex;
 	Properties	overlay;
 	Properties	overlaySpeaking;
 };
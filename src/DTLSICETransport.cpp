@@ -186,7 +186,7 @@ int DTLSICETransport::onData(const ICERemoteCandidate* candidate,const BYTE* dat
 		WORD transportSeqNum = packet->GetTransportSeqNum();
 
 		//Get max seq num so far, it is either last one if queue is empy or last one of the queue
-		DWORD maxFeedbackPacketExtSeqNum = transportWideReceivedPacketsStats.size() ? transportWideReceivedPacketsStats.rbegin()->first : lastFeedbackPacketExtSeqNum;
+		DWORD maxFeedbackPacketExtSeqNum = transportWideArrivals.GetMaxExtSeqNum();
 
 		//Check if we have a sequence wrap
 		if (transportSeqNum < 0x00FF && (maxFeedbackPacketExtSeqNum & 0xFFFF)>0xFF00)
@@ -202,11 +202,16 @@ int DTLSICETransport::onData(const ICERemoteCandidate* candidate,const BYTE* dat
 		//Get extended value
 		DWORD transportExtSeqNum = feedbackCycles << 16 | transportSeqNum;
 
-		//Add packets to the transport wide stats
-		transportWideReceivedPacketsStats[transportExtSeqNum] = PacketStats::Create(packet, size, now);
+		//If it is too far from the pending ones
+		if (!transportWideArrivals.Fits(transportExtSeqNum))
+			//Send feedback message now
+			SendTransportWideFeedbackMessage(ssrc);
+
+		//Add arrival time to the transport wide ring
+		transportWideArrivals.Add(transportExtSeqNum, now);
 
 		//If we have enought or timeout 
-		if (packet->GetMark() || transportWideReceivedPacketsStats.size() > TransportWideCCMaxPackets || (now - transportWideReceivedPacketsStats.begin()->second->time) > TransportWideCCMaxInterval)
+		if (packet->GetMark() || transportWideArrivals.GetCount() > TransportWideCCMaxPackets || (now - transportWideArrivals.GetFirstTime()) > TransportWideCCMaxInterval)
 			//Send feedback message
 			SendTransportWideFeedbackMessage(ssrc);
 	}
@@ -415,7 +420,7 @@ int DTLSICETransport::onData(const ICERemoteCandidate* candidate,const BYTE* dat
 		 packet->SetCodec(codec);
 		 packet->SetPayloadType(apt);
 		 //TODO: Move from here, required to fill the vp8/vp9 descriptors
-		 VideoLayerSelector::GetLayerIds(packet);
+		 packet->layerClassification = VideoLayerSelector::Classify(packet);
 	} 
 
 	//Add packet and see if we have lost any in between
@@ -2234,6 +2239,7 @@ void DTLSICETransport::onRTCP(const RTCPCompoundPacket::shared& rtcp)
 					case RTCPRTPFeedback::TransportWideFeedbackMessage:
 						//If sender side estimation is enabled
 						if (senderSideEstimationEnabled)
+						{
 							//Get each fiedl
 							for (DWORD i=0;i<fb->GetFieldCount();i++)
 							{
@@ -2242,6 +2248,9 @@ void DTLSICETransport::onRTCP(const RTCPCompoundPacket::shared& rtcp)
 								//Pass it to the estimator
 								senderSideBandwidthEstimator.ReceivedFeedback(field->feedbackPacketCount,field->packets,now);
 							}
+							//Publish new estimation
+							availableBitrate = senderSideBandwidthEstimator.GetAvailableBitrate();
+						}
 						break;
 				}
 				break;
@@ -2439,31 +2448,8 @@ void DTLSICETransport::SendTransportWideFeedbackMessage(DWORD ssrc)
 	//Create trnasport field
 	auto field = feedback->CreateField<RTCPRTPFeedback::TransportWideFeedbackMessageField>(++feedbackPacketCount);
 
-	//Proccess and delete all elements
-	for (auto it =transportWideReceivedPacketsStats.cbegin();
-		  it!=transportWideReceivedPacketsStats.cend();
-		  it = transportWideReceivedPacketsStats.erase(it))
-	{
-		//Get stat
-		auto stats = it->second;
-		//Get transport seq
-		DWORD transportExtSeqNum = it->first;
-		//Get relative time
-		QWORD time = stats->time - initTime;
-
-		//if not first and not out of order
-		if (lastFeedbackPacketExtSeqNum && transportExtSeqNum>lastFeedbackPacketExtSeqNum)
-			//For each lost
-			for (DWORD i = lastFeedbackPacketExtSeqNum+1; i<transportExtSeqNum; ++i)
-				//Add it
-				field->packets.insert(std::make_pair(i,0));
-
-		//Store last
-		lastFeedbackPacketExtSeqNum = transportExtSeqNum;
-
-		//Add this one
-		field->packets.insert(std::make_pair(transportExtSeqNum,time));
-	}
+	//Add pending arrivals and lost ones walking the ring in order
+	transportWideArrivals.Drain(initTime,field->packets);
 
 	//Send packet
 	Send(rtcp);
@@ -2527,7 +2513,7 @@ void DTLSICETransport::Stop()
 int DTLSICETransport::Enqueue(const RTPPacket::shared& packet)
 {
 	//Send async
-	timeService.Async([this,packet](...){
+	timeService.Post([this,packet](...){
 		//Send
 		Send(packet->Clone());
 	});
@@ -2538,7 +2524,7 @@ int DTLSICETransport::Enqueue(const RTPPacket::shared& packet)
 int DTLSICETransport::Enqueue(const RTPPacket::shared& packet,std::function<RTPPacket::shared(const RTPPacket::shared&)> modifier)
 {
 	//Send async
-	timeService.Async([this,packet,modifier](...){
+	timeService.Post([this,packet,modifier](...){
 		//Send
 		Send(modifier(packet));
 	});
@@ -80,8 +80,11 @@ bool DependencyDescriptorLayerSelector::Select(const RTPPacket::shared& packet,b
 		currentFrameNumber = extFrameNum;
 	}
 	
+	//Get layer classification done on reception
+	auto layer = packet->layerClassification ? packet->layerClassification : Classify(packet);
+	
 	//Ensure that we have the packet frame dependency template
-	if (!templateDependencyStructure->ContainsFrameDependencyTemplate(dependencyDescriptor->frameDependencyTemplateId))
+	if (!layer)
 		//Skip
 		return Warning("-DependencyDescriptorLayerSelector::Select() | Current frame dependency templates don't contain reference templateId [id:%d]\n",dependencyDescriptor->frameDependencyTemplateId);
 	
@@ -98,7 +101,7 @@ bool DependencyDescriptorLayerSelector::Select(const RTPPacket::shared& packet,b
 	
 	//We will only forward full frames
 	// TODO: check rtp seq num continuity?
-	if (extFrameNum>currentFrameNumber && !dependencyDescriptor->startOfFrame)
+	if (extFrameNum>currentFrameNumber && !layer->startOfLayerFrame)
 		//The frame is not complete
 		decodable = false;
 	
@@ -240,9 +243,6 @@ bool DependencyDescriptorLayerSelector::Select(const RTPPacket::shared& packet,b
 		return Warning("-DependencyDescriptorLayerSelector::Select() | No decode target information available [dt:%d]\n",currentDecodeTarget);
 	}
 	
-	//Get decode target indicattion
-	auto dti = decodeTargetIndications[currentDecodeTarget];
-
 	//Log
 	//Debug("-DependencyDescriptorLayerSelector::Select() | Selected [number=%llu,t:%d,dt:%llu,chain:%d,dti:%d,top:{S%dT%d],current:{S%dT%d],frame:[S%dT%d]\n",
 	//	extFrameNum,
@@ -270,7 +270,7 @@ bool DependencyDescriptorLayerSelector::Select(const RTPPacket::shared& packet,b
 	}
 	
 	//If frame is not present in selected decode target
-	if (dti==DecodeTargetIndication::NotPresent)
+	if (currentDecodeTarget>=32 || !(layer->decodeTargets & (1u<<currentDecodeTarget)))
 	{
 		//Log
 		//UltraDebug("-DependencyDescriptorLayerSelector::Select() | Discarding packet, not present\n");
@@ -279,10 +279,10 @@ bool DependencyDescriptorLayerSelector::Select(const RTPPacket::shared& packet,b
 	}
 
 	//RTP mark is set for the last frame layer of the selected spatial layer
-	mark = packet->GetMark() || (dependencyDescriptor->endOfFrame && spatialLayerId==frameDependencyTemplate.spatialLayerId);
+	mark = packet->GetMark() || (layer->endOfLayerFrame && spatialLayerId==layer->spatialLayerId);
 
 	//If it is the last in current frame
-	if (dependencyDescriptor->endOfFrame)
+	if (layer->endOfLayerFrame)
 		//We only count full forwarded frames
 		forwardedFrames.Add(extFrameNum);
 	
@@ -297,34 +297,27 @@ bool DependencyDescriptorLayerSelector::Select(const RTPPacket::shared& packet,b
 }
 
 std::vector<LayerInfo> DependencyDescriptorLayerSelector::GetLayerIds(const RTPPacket::shared& packet)
+{
+	return GetLayerIds(packet,Classify(packet));
+}
+
+std::vector<LayerInfo> DependencyDescriptorLayerSelector::GetLayerIds(const RTPPacket::shared& packet,const std::optional<LayerClassification>& layer)
 {
 	std::vector<LayerInfo> infos;
 	
-	//Get dependency description
-	auto& dependencyDescriptor = packet->GetDependencyDescriptor();
+	//Get dependency structure
 	auto& currentTemplateDependencyStructure = packet->GetTemplateDependencyStructure();
 	
 	//check 
-	if (dependencyDescriptor 
-		&& currentTemplateDependencyStructure
-		&& currentTemplateDependencyStructure->ContainsFrameDependencyTemplate(dependencyDescriptor->frameDependencyTemplateId))
+	if (layer && currentTemplateDependencyStructure)
 	{
-		//Get dependencey structure from template
-		const auto& templateDependencyStructure = currentTemplateDependencyStructure->GetFrameDependencyTemplate(dependencyDescriptor->frameDependencyTemplateId);
-		//Get decode target indications
-		const auto& decodeTargetIndications = dependencyDescriptor->customDecodeTargetIndications 
-			? dependencyDescriptor->customDecodeTargetIndications.value()
-			: templateDependencyStructure.decodeTargetIndications; 
 		//Do not add duplicate layers
 		LayerInfo last;
 		//Traverse all layers
 		for (auto& [decodeTarget,layerInfo] : currentTemplateDependencyStructure->decodeTargetLayerMapping)
 		{
-			
-			//Get decode target indicattion
-			auto dti = decodeTargetIndications[decodeTarget];
 			//If frame is present in selected decode target and it is not a duplicate
-			if (dti!=DecodeTargetIndication::NotPresent && last!=layerInfo)
+			if (decodeTarget<32 && (layer->decodeTargets & (1u<<decodeTarget)) && last!=layerInfo)
 			{
 				//Add layer info
 				infos.push_back(layerInfo);
@@ -337,3 +330,47 @@ std::vector<LayerInfo> DependencyDescriptorLayerSelector::GetLayerIds(const RTPP
 	//Return empty layer info
 	return infos;
 }
+
+std::optional<LayerClassification> DependencyDescriptorLayerSelector::Classify(const RTPPacket::shared& packet)
+{
+	//Get dependency description
+	auto& dependencyDescriptor = packet->GetDependencyDescriptor();
+	auto& templateDependencyStructure = packet->GetTemplateDependencyStructure();
+	
+	//Check we have the frame dependency template
+	if (!dependencyDescriptor 
+		|| !templateDependencyStructure
+		|| !templateDependencyStructure->ContainsFrameDependencyTemplate(dependencyDescriptor->frameDependencyTemplateId))
+		//None
+		return std::nullopt;
+	
+	//Get template
+	const auto& frameDependencyTemplate = templateDependencyStructure->GetFrameDependencyTemplate(dependencyDescriptor->frameDependencyTemplateId);
+	
+	//Get dtis and references for current frame
+	const auto& decodeTargetIndications	= dependencyDescriptor->customDecodeTargetIndications	? dependencyDescriptor->customDecodeTargetIndications.value()	: frameDependencyTemplate.decodeTargetIndications; 
+	const auto& frameDiffs			= dependencyDescriptor->customFrameDiffs		? dependencyDescriptor->customFrameDiffs.value()		: frameDependencyTemplate.frameDiffs;
+	
+	LayerClassification layer;
+	layer.temporalLayerId	= frameDependencyTemplate.temporalLayerId;
+	layer.spatialLayerId	= frameDependencyTemplate.spatialLayerId;
+	layer.startOfLayerFrame	= dependencyDescriptor->startOfFrame;
+	layer.endOfLayerFrame	= dependencyDescriptor->endOfFrame;
+	//Frame not referencing any other one
+	layer.keyFrame		= frameDiffs.empty();
+	
+	//Max 32 decode targets
+	for (size_t i=0; i<decodeTargetIndications.size() && i<32; ++i)
+	{
+		//If frame is present in decode target
+		if (decodeTargetIndications[i]!=DecodeTargetIndication::NotPresent)
+			//Set it on mask
+			layer.decodeTargets |= 1u<<i;
+		//If it is a switch indication
+		if (decodeTargetIndications[i]==DecodeTargetIndication::Switch)
+			//Can switch to it
+			layer.switchingPoint = true;
+	}
+	
+	return layer;
+}
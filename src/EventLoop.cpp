@@ -14,8 +14,44 @@
 #include <pthread.h>
 
 #include "log.h"
+#include "Metrics.h"
 
 const size_t EventLoop::MaxSendingQueueSize = 16*1024;
+const size_t EventLoop::MaxTasksDequeued = 32;
+const size_t EventLoop::TaskWaitSampling = 16;
+
+namespace
+{
+
+//Metrics of all the loops
+struct LoopMetrics
+{
+	Metrics::Histogram& iteration	= Metrics::GetHistogram("mediaserver_eventloop_iteration_seconds","Time processing each event loop iteration, without waiting on poll","",1E-9);
+	Metrics::Histogram& taskWait	= Metrics::GetHistogram("mediaserver_eventloop_task_wait_seconds","Time tasks wait on the event loop queue before running","",1E-9);
+	Metrics::Histogram& sendQueue	= Metrics::GetHistogram("mediaserver_eventloop_send_queue_packets","Packets waiting on the event loop send queue on each iteration");
+	Metrics::Counter& tasks		= Metrics::GetCounter("mediaserver_eventloop_tasks_total","Tasks run by the event loops");
+	Metrics::Counter& sent		= Metrics::GetCounter("mediaserver_eventloop_sent_packets_total","Packets sent by the event loops");
+};
+
+LoopMetrics& GetLoopMetrics()
+{
+	static LoopMetrics metrics;
+	return metrics;
+}
+
+//Convert a time of the timers clock to the steady clock of the stats
+QWORD ToSteadyClock(const std::chrono::milliseconds& time)
+{
+	//Sample both clocks
+	auto wall = std::chrono::system_clock::now().time_since_epoch();
+	QWORD steady = Metrics::Now();
+	//Get how far it is from now
+	int64_t diff = std::chrono::duration_cast<std::chrono::nanoseconds>(time - wall).count();
+	//Apply it to the steady clock
+	return diff>=0 || steady>(QWORD)-diff ? steady+diff : 0;
+}
+
+}
 
 
 #if __APPLE__
@@ -289,33 +325,43 @@ std::future<void> EventLoop::Async(std::function<void(std::chrono::milliseconds)
 {
 	//UltraDebug(">EventLoop::Async()\n");
 	
-	//Create task
+	//Create promise
 	std::promise<void> promise;
-	auto task = std::make_pair(std::move(promise),std::move(func));
 	
 	//Get future before moving the promise
-	auto future = task.first.get_future();
+	auto future = promise.get_future();
 	
+	//Post a task resolving the promise after running the function
+	Post([promise = std::move(promise),func = std::move(func)](std::chrono::milliseconds now) mutable {
+		//Execute it
+		func(now);
+		//Resolve the promise
+		promise.set_value();
+	});
+	
+	//UltraDebug("<EventLoop::Async()\n");
+	
+	//Return the future for the promise
+	return future;
+}
+
+void EventLoop::Post(Task&& task)
+{
 	//If not in the same thread
 	if (std::this_thread::get_id()!=thread.get_id())
 	{
+		//Only timestamp one out of TaskWaitSampling tasks of each thread, as reading the clock is not free
+		static thread_local size_t posted = 0;
+		QWORD enqueued = (posted++ % TaskWaitSampling) ? 0 : Metrics::Now();
 		//Add to pending taks
-		tasks.enqueue(std::move(task));
+		tasks.enqueue({std::move(task),enqueued});
 
 		//Signal the thread this will cause the poll call to exit
 		Signal();
 	} else {
 		//Call now otherwise
-		task.second(GetNow());
-		
-		//Resolve the promise
-		task.first.set_value();
+		task(GetNow());
 	}
-	
-	//UltraDebug("<EventLoop::Async()\n");
-	
-	//Return the future for the promise
-	return future;
 }
 
 Timer::shared EventLoop::CreateTimer(std::function<void(std::chrono::milliseconds)> callback)
@@ -341,9 +387,11 @@ Timer::shared EventLoop::CreateTimer(const std::chrono::milliseconds& ms, const
 	auto next = this->GetNow() + ms;
 	
 	//Add it async
-	Async([this,timer,next](...){
+	Post([this,timer,next](...){
 		//Set next tick
 		timer->next = next;
+		//Do not count the time it took to get here as lateness
+		timer->due = std::max(ToSteadyClock(next),Metrics::Now());
 
 		//Add to timer list
 		timers.emplace(next, timer);
@@ -356,7 +404,7 @@ Timer::shared EventLoop::CreateTimer(const std::chrono::milliseconds& ms, const
 void EventLoop::TimerImpl::Cancel()
 {
 	//Add it async
-	loop.Async([timer = shared_from_this()](...){
+	loop.Post([timer = shared_from_this()](...){
 		//Remove us
 		timer->loop.CancelTimer(timer);
 	});
@@ -370,12 +418,14 @@ void EventLoop::TimerImpl::Again(const std::chrono::milliseconds& ms)
 	auto next = loop.GetNow() + ms;
 	
 	//Reschedule it async
-	loop.Async([timer = shared_from_this(),next](...){
+	loop.Post([timer = shared_from_this(),next](...){
 		//Remove us
 		timer->loop.CancelTimer(timer);
 
 		//Set next tick
 		timer->next = next;
+		//Do not count the time it took to get here as lateness
+		timer->due = std::max(ToSteadyClock(next),Metrics::Now());
 		
 		//Add to timer list
 		timer->loop.timers.emplace(next, timer);
@@ -418,6 +468,46 @@ void EventLoop::CancelTimer(TimerImpl::shared timer)
 	//UltraDebug("<EventLoop::CancelTimer() \n");
 }
 
+Metrics::Histogram& EventLoop::GetTimerDuration(TimerImpl& timer)
+{
+	//If it is the first run or the timer has been renamed
+	if (!timer.duration || timer.durationName!=timer.GetName())
+	{
+		//Store name
+		timer.durationName = timer.GetName();
+		//Lock as stats could be read from other thread
+		std::lock_guard<std::mutex> lock(timerDurationMutex);
+		//Get the one for timers with same name
+		auto& histogram = timerDuration[timer.durationName];
+		//If first one
+		if (!histogram)
+			//Create it
+			histogram = std::make_unique<Metrics::Histogram>();
+		//Cache it
+		timer.duration = histogram.get();
+	}
+	return *timer.duration;
+}
+
+EventLoop::Stats EventLoop::GetStats() const
+{
+	Stats stats;
+	
+	//Get loop histograms
+	stats.timerLateness	= timerLateness.GetSnapshot();
+	stats.taskWait		= taskWait.GetSnapshot();
+	stats.taskDuration	= taskDuration.GetSnapshot();
+	
+	//Lock timer names
+	std::lock_guard<std::mutex> lock(timerDurationMutex);
+	//Get timer callbacks
+	for (const auto& [name,histogram] : timerDuration)
+		stats.timerDuration[name] = histogram->GetSnapshot();
+	
+	//Done
+	return stats;
+}
+
 const std::chrono::milliseconds EventLoop::Now()
 {
 	//Get new now and store in cache
@@ -429,15 +519,15 @@ void EventLoop::Signal()
 	//UltraDebug("-EventLoop::Signal()\r\n");
 	uint64_t one = 1;
 	
-	//If we are in the same thread or already signaled and pipe is ok
-	if (std::this_thread::get_id()==thread.get_id() || signaled || pipe[1]==FD_INVALID)
+	//If we are in the same thread or pipe is not ok
+	if (std::this_thread::get_id()==thread.get_id() || pipe[1]==FD_INVALID)
 		//No need to do anything
 		return;
 	
-	//We have signaled it
-	//worst case scenario is that race happens between this to points
-	//and that we signal it twice
-	signaled = true;
+	//Only first one signals until the loop wakes up, so a burst of tasks costs a single write
+	if (signaled.exchange(true))
+		//Already signaled
+		return;
 	
 	//Write to tbe pipe, and assign to one to avoid warning in compile time
 	one = write(pipe[1],(uint8_t*)&one,sizeof(one));
@@ -461,7 +551,17 @@ void EventLoop::Run(const std::chrono::milliseconds &duration)
 	uint32_t flags = MSG_DONTWAIT;
 	
 	//Pending data
-	std::vector<SendBuffer> items(MaxMultipleSendingMessages);
+	std::vector<SendBuffer> items;
+	items.reserve(MaxMultipleSendingMessages);
+	
+	//Dequeued item, only packet handles are moved around
+	SendBuffer item;
+	
+	//Dequeued tasks
+	QueuedTask pending[MaxTasksDequeued];
+	
+	//Get metrics
+	LoopMetrics& metrics = GetLoopMetrics();
 	
 	//Set values for polling
 	ufds[0].fd = fd;
@@ -539,9 +639,15 @@ void EventLoop::Run(const std::chrono::milliseconds &duration)
 
 		//UltraDebug(">EventLoop::Run() | poll timeout:%d timers:%d tasks:%d size:%d\n",timeout,timers.size(),tasks.size_approx(), sizeof(ufds) / sizeof(pollfd));
 		
+		//Sample send queue
+		metrics.sendQueue.Record(sending.size_approx());
+		
 		//Wait for events
 		poll(ufds,sizeof(ufds)/sizeof(pollfd),timeout);
 		
+		//Start processing
+		QWORD iteration = Metrics::Now();
+		
 		//Update now
 		now = Now();
 		
@@ -642,9 +748,6 @@ void EventLoop::Run(const std::chrono::milliseconds &duration)
 			//Now send all that we can
 			while (items.size()<MaxMultipleSendingMessages)
 			{
-				//Get current item
-				SendBuffer item;
-				
 				//Get next item
 				if (!sending.try_dequeue(item))
 					break;
@@ -687,7 +790,10 @@ void EventLoop::Run(const std::chrono::milliseconds &duration)
 			}
 			
 			//Send them
-			sendmmsg(fd, messages, len, flags);
+			int sent = sendmmsg(fd, messages, len, flags);
+			
+			//Count them
+			if (sent>0) metrics.sent.Increment(sent);
 			
 			//First
 			auto it = items.begin();
@@ -715,17 +821,56 @@ void EventLoop::Run(const std::chrono::milliseconds &duration)
 				}
 		}
 		
-		//Run queued task
-		std::pair<std::promise<void>,std::function<void(std::chrono::milliseconds)>> task;
-		//Get all pending taks
-		while (tasks.try_dequeue(task))
+		//Only time all tasks when tracing slow ones
+		QWORD threshold = slowCallbackThreshold;
+		
+		//Get all pending taks in batches
+		while (size_t num = tasks.try_dequeue_bulk(pending,MaxTasksDequeued))
 		{
-			//UltraDebug(">EventLoop::Run() | task pending\n");
-			//Execute it
-			task.second(now);
-			//Resolce promise
-			task.first.set_value();
-			//UltraDebug("<EventLoop::Run() | task run\n");
+			//UltraDebug(">EventLoop::Run() | tasks pending %d\n",num);
+			//Get dequeue time, also the start of the first task
+			QWORD start = Metrics::Now();
+			for (size_t i=0;i<num;++i)
+			{
+				//Check if we have to time it
+				bool timed = pending[i].enqueued || threshold;
+				//If previous one was not timed
+				if (timed && !start)
+					//Get its start now
+					start = Metrics::Now();
+				//Time waiting in queue if sampled
+				QWORD wait = pending[i].enqueued && start>pending[i].enqueued ? start-pending[i].enqueued : 0;
+				if (pending[i].enqueued)
+				{
+					metrics.taskWait.Record(wait);
+					taskWait.Record(wait);
+				}
+				//Execute it
+				pending[i].task(now);
+				//Release captured state now
+				pending[i].task.Reset();
+				//If not timed
+				if (!timed)
+				{
+					//Next one could be timed, start will be taken just before it
+					start = 0;
+					continue;
+				}
+				//Get end, which is also start of next one
+				QWORD end = Metrics::Now();
+				//Time running it
+				QWORD elapsed = end-start;
+				if (pending[i].enqueued)
+					taskDuration.Record(elapsed);
+				//Trace slow ones
+				if (threshold && elapsed>threshold)
+					Warning("-EventLoop::Run() | slow task [duration:%lluus,wait:%lluus]\n",elapsed/1000,wait/1000);
+				//Next one
+				start = end;
+			}
+			//Count them
+			metrics.tasks.Increment(num);
+			//UltraDebug("<EventLoop::Run() | tasks run\n");
 		}
 
 		//Timers triggered
@@ -743,20 +888,37 @@ void EventLoop::Run(const std::chrono::milliseconds &duration)
 			it = timers.erase(it);
 		}
 
+		//Start of first timer callback
+		QWORD start = triggered.size() ? Metrics::Now() : 0;
+		
 		//Now process all timers triggered
 		for (auto timer : triggered)
 		{
 			//UltraDebug(">EventLoop::Run() | timer [%s] triggered at ll%u\n",timer->GetName().c_str(),now.count());
+			//Get how late we are
+			QWORD lateness = start>timer->due ? start-timer->due : 0;
+			timerLateness.Record(lateness);
 			//We are executing
 			timer->next = 0ms;
 			//Execute it
 			timer->callback(now);
+			//Get end, which is also start of next one
+			QWORD end = Metrics::Now();
+			QWORD elapsed = end>start ? end-start : 0;
+			//Time running it
+			GetTimerDuration(*timer).Record(elapsed);
+			//Trace slow ones
+			if (threshold && elapsed>threshold)
+				Warning("-EventLoop::Run() | slow timer callback [name:\"%s\",duration:%lluus,lateness:%lluus]\n",timer->GetName().c_str(),elapsed/1000,lateness/1000);
+			//Next one
+			start = end;
 			//If we have to reschedule it again
 			if (timer->repeat.count() && !timer->next.count())
 			{
 				//UltraDebug("-EventLoop::Run() | timer rescheduled\n");
 				//Set next
 				timer->next = now + timer->repeat;
+				timer->due = ToSteadyClock(timer->next);
 				//Schedule
 				timers.emplace(timer->next, timer);
 			}
@@ -775,22 +937,23 @@ void EventLoop::Run(const std::chrono::milliseconds &duration)
 			signaled = false;
 		}
 		
+		//Time processing this iteration
+		metrics.iteration.Record(Metrics::Now()-iteration);
+		
 		//Update now
 		now = Now();
 	}
 	
 	//Run queued task
-	std::pair<std::promise<void>,std::function<void(std::chrono::milliseconds)>> task;
+	QueuedTask queued;
 	//Get all pending taks
-	while (tasks.try_dequeue(task))
+	while (tasks.try_dequeue(queued))
 	{
 		//UltraDebug("-EventLoop::Run() | task pending\n");
 		//Update now
 		auto now = Now();
 		//Execute it
-		task.second(now);
-		//Resolce promise
-		task.first.set_value();
+		queued.task(now);
 	}
 
 	//Log("<EventLoop::Run()\n");
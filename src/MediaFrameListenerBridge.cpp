@@ -51,7 +51,7 @@ MediaFrameListenerBridge::~MediaFrameListenerBridge()
 void MediaFrameListenerBridge::AddListener(RTPIncomingMediaStream::Listener* listener)
 {
 	Debug("-MediaFrameListenerBridge::AddListener() [listener:%p]\n",listener);
-	loop.Async([=](...){
+	loop.Post([=](...){
 		listeners.insert(listener);
 	});
 }
@@ -66,7 +66,7 @@ void MediaFrameListenerBridge::RemoveListener(RTPIncomingMediaStream::Listener*
 
 void MediaFrameListenerBridge::onMediaFrame(const MediaFrame& frame)
 {
-	loop.Async([=,cloned = frame.Clone()](...){
+	loop.Post([=,cloned = frame.Clone()](...){
 		
 		std::unique_ptr<MediaFrame> frame(cloned);
 		
@@ -233,7 +233,9 @@ void MediaFrameListenerBridge::onMediaFrame(const MediaFrame& frame)
 			//Fill payload descriptors
 			//TODO: move out of here
 			if (frame->GetType()==MediaFrame::Video)
-				VideoLayerSelector::GetLayerIds(packet);
+			{
+				packet->layerClassification = VideoLayerSelector::Classify(packet);
+			}
 
 			//If doing smooting
 			if (smooth)
@@ -268,7 +270,7 @@ void MediaFrameListenerBridge::Dispatch(const RTPPacket::shared& packet)
 
 void MediaFrameListenerBridge::Reset()
 {
-	loop.Async([=](...){
+	loop.Post([=](...){
 		reset = true;
 	});
 }
@@ -300,7 +302,7 @@ void MediaFrameListenerBridge::Update(QWORD now)
 
 void MediaFrameListenerBridge::AddMediaListener(MediaFrame::Listener *listener)
 {
-	loop.Async([=](...){
+	loop.Post([=](...){
 		//Add to set
 		mediaFrameListenerss.insert(listener);
 	});
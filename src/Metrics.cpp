@@ -0,0 +1,329 @@
+#include "Metrics.h"
+
+#include <algorithm>
+#include <cmath>
+#include <mutex>
+
+namespace
+{
+
+struct Entry
+{
+	std::string name;
+	std::string help;
+	std::string labels;
+	Metrics::Type type;
+	double scale = 1;
+	std::unique_ptr<Metrics::Counter> counter;
+	std::unique_ptr<Metrics::Histogram> histogram;
+};
+
+struct Registry
+{
+	std::mutex mutex;
+	//Entries are never removed so references returned are always valid
+	std::vector<std::unique_ptr<Entry>> entries;
+};
+
+Registry& GetRegistry()
+{
+	//Never deleted, threads could still be updating metrics while exiting
+	static Registry* registry = new Registry();
+	return *registry;
+}
+
+Entry& GetEntry(Metrics::Type type,const std::string& name,const std::string& help,const std::string& labels,double scale)
+{
+	Registry& registry = GetRegistry();
+
+	std::lock_guard<std::mutex> lock(registry.mutex);
+
+	//Find previous one
+	for (auto& entry : registry.entries)
+		//If same name and labels
+		if (entry->type==type && entry->name==name && entry->labels==labels)
+			//Found
+			return *entry;
+
+	//Create new one
+	auto entry = std::make_unique<Entry>();
+	entry->type = type;
+	entry->name = name;
+	entry->help = help;
+	entry->labels = labels;
+	entry->scale = scale;
+	//Create metric
+	if (type==Metrics::CounterType)
+		entry->counter = std::make_unique<Metrics::Counter>();
+	else
+		entry->histogram = std::make_unique<Metrics::Histogram>();
+	//Add it
+	registry.entries.push_back(std::move(entry));
+	//Done
+	return *registry.entries.back();
+}
+
+void AppendSample(std::string& dump,const std::string& name,const std::string& labels,const char* extra,const char* value)
+{
+	//Print name and labels
+	dump += name;
+	if (!labels.empty() || extra)
+	{
+		dump += "{";
+		dump += labels;
+		if (!labels.empty() && extra)
+			dump += ",";
+		if (extra)
+			dump += extra;
+		dump += "}";
+	}
+	//Print value
+	dump += " ";
+	dump += value;
+	dump += "\n";
+}
+
+void AppendSample(std::string& dump,const std::string& name,const std::string& labels,const char* extra,QWORD value)
+{
+	char number[32];
+	snprintf(number,sizeof(number),"%llu",(unsigned long long)value);
+	AppendSample(dump,name,labels,extra,number);
+}
+
+void AppendSample(std::string& dump,const std::string& name,const std::string& labels,const char* extra,double value)
+{
+	char number[32];
+	snprintf(number,sizeof(number),"%.9g",value);
+	AppendSample(dump,name,labels,extra,number);
+}
+
+}
+
+QWORD Metrics::Counter::GetValue() const
+{
+	QWORD value = 0;
+	//Add all shards
+	for (const auto& shard : shards)
+		value += shard.value.load(std::memory_order_relaxed);
+	return value;
+}
+
+Metrics::Histogram::~Histogram()
+{
+	//Delete shards
+	for (auto& shard : shards)
+		delete shard.load();
+}
+
+DWORD Metrics::Histogram::GetBucket(QWORD value)
+{
+	//Small values are stored exactly
+	if (value<SubBuckets)
+		return value;
+	//Get highest bit
+	DWORD exponent = 63 - __builtin_clzll(value);
+	//Saturate
+	if (exponent>=MaxBits)
+		return Buckets-1;
+	//Get the next bits after the highest one
+	DWORD mantissa = (value >> (exponent-SubBucketBits)) & (SubBuckets-1);
+	//Get bucket
+	return (exponent-SubBucketBits+1)*SubBuckets + mantissa;
+}
+
+QWORD Metrics::Histogram::GetBucketStart(DWORD bucket)
+{
+	//Small values are stored exactly
+	if (bucket<SubBuckets)
+		return bucket;
+	//Get exponent and mantissa
+	DWORD exponent = bucket/SubBuckets + SubBucketBits - 1;
+	DWORD mantissa = bucket%SubBuckets;
+	//Get lowest value
+	return (QWORD)(SubBuckets+mantissa) << (exponent-SubBucketBits);
+}
+
+QWORD Metrics::Histogram::GetBucketEnd(DWORD bucket)
+{
+	//Next one is where this one ends
+	return bucket+1<Buckets ? GetBucketStart(bucket+1) : (QWORD)1<<MaxBits;
+}
+
+Metrics::Histogram::Shard* Metrics::Histogram::GetShard()
+{
+	auto& slot = shards[Metrics::GetShard()];
+	//Get thread shard
+	Shard* shard = slot.load(std::memory_order_acquire);
+	//If it is the first time this shard is used
+	if (!shard)
+	{
+		//Create it
+		Shard* created = new Shard();
+		//Set it unless other thread sharing it has been faster
+		if (slot.compare_exchange_strong(shard,created,std::memory_order_acq_rel))
+			shard = created;
+		else
+			delete created;
+	}
+	return shard;
+}
+
+void Metrics::Histogram::Record(QWORD value)
+{
+	Shard* shard = GetShard();
+
+	//Update values
+	shard->sum.fetch_add(value,std::memory_order_relaxed);
+	shard->buckets[GetBucket(value)].fetch_add(1,std::memory_order_relaxed);
+
+	//Update max
+	QWORD max = shard->max.load(std::memory_order_relaxed);
+	while (value>max && !shard->max.compare_exchange_weak(max,value,std::memory_order_relaxed));
+}
+
+Metrics::HistogramSnapshot Metrics::Histogram::GetSnapshot() const
+{
+	HistogramSnapshot snapshot;
+
+	snapshot.buckets.resize(Buckets,0);
+
+	//Add all shards
+	for (const auto& slot : shards)
+	{
+		//Get shard
+		const Shard* shard = slot.load(std::memory_order_acquire);
+		//If not used
+		if (!shard)
+			//Skip
+			continue;
+		//Add values
+		snapshot.sum += shard->sum.load(std::memory_order_relaxed);
+		snapshot.max = std::max(snapshot.max,shard->max.load(std::memory_order_relaxed));
+		for (DWORD i=0;i<Buckets;++i)
+			snapshot.buckets[i] += shard->buckets[i].load(std::memory_order_relaxed);
+	}
+
+	//Count from buckets, so it is consistent with them even if updated while adding them
+	for (auto count : snapshot.buckets)
+		snapshot.count += count;
+
+	return snapshot;
+}
+
+QWORD Metrics::HistogramSnapshot::GetPercentile(double percentile) const
+{
+	//If empty
+	if (!count)
+		return 0;
+	//Get number of values below percentile
+	QWORD target = std::max<QWORD>(1,std::ceil(count*percentile/100));
+	QWORD accumulated = 0;
+	//Find bucket
+	for (DWORD i=0;i<buckets.size();++i)
+	{
+		accumulated += buckets[i];
+		//If we have reached it
+		if (accumulated>=target)
+			//Highest value on bucket, but never more than max
+			return std::min(Histogram::GetBucketEnd(i)-1,std::max(max,Histogram::GetBucketStart(i)));
+	}
+	return max;
+}
+
+QWORD Metrics::HistogramSnapshot::GetCountBelow(QWORD value) const
+{
+	QWORD accumulated = 0;
+	//Add all buckets ending before the value
+	for (DWORD i=0;i<buckets.size() && Histogram::GetBucketEnd(i)<=value;++i)
+		accumulated += buckets[i];
+	return accumulated;
+}
+
+Metrics::Counter& Metrics::GetCounter(const std::string& name,const std::string& help,const std::string& labels)
+{
+	return *GetEntry(CounterType,name,help,labels,1).counter;
+}
+
+Metrics::Histogram& Metrics::GetHistogram(const std::string& name,const std::string& help,const std::string& labels,double scale)
+{
+	return *GetEntry(HistogramType,name,help,labels,scale).histogram;
+}
+
+Metrics::Snapshot Metrics::GetSnapshot()
+{
+	Registry& registry = GetRegistry();
+
+	Snapshot snapshot;
+
+	std::lock_guard<std::mutex> lock(registry.mutex);
+
+	//Get all values, grouped by name as required by the text format
+	for (auto& entry : registry.entries)
+	{
+		//Find where to insert it
+		auto it = snapshot.end();
+		for (auto prev = snapshot.begin(); prev!=snapshot.end(); ++prev)
+			if (prev->name==entry->name)
+				it = std::next(prev);
+
+		Value value;
+		value.name	= entry->name;
+		value.help	= entry->help;
+		value.labels	= entry->labels;
+		value.type	= entry->type;
+		value.scale	= entry->scale;
+		value.value	= entry->counter ? entry->counter->GetValue() : 0;
+		if (entry->histogram)
+			value.histogram = entry->histogram->GetSnapshot();
+		//Add after the last one with the same name
+		snapshot.insert(it,std::move(value));
+	}
+
+	return snapshot;
+}
+
+std::string Metrics::Dump()
+{
+	return Dump(GetSnapshot());
+}
+
+std::string Metrics::Dump(const Snapshot& snapshot)
+{
+	std::string dump;
+	char le[64];
+
+	for (size_t i=0;i<snapshot.size();++i)
+	{
+		const Value& value = snapshot[i];
+		//If it is the first one of this name
+		if (!i || snapshot[i-1].name!=value.name)
+		{
+			//Print metadata
+			dump += "# HELP " + value.name + " " + value.help + "\n";
+			dump += "# TYPE " + value.name + (value.type==CounterType ? " counter\n" : " histogram\n");
+		}
+
+		//If it is a counter
+		if (value.type==CounterType)
+		{
+			//Print value
+			AppendSample(dump,value.name,value.labels,nullptr,value.value);
+			//Next
+			continue;
+		}
+
+		//Bucket boundaries on powers of two, as the histogram buckets are aligned to them
+		for (DWORD bits=0;bits<=Histogram::MaxBits;++bits)
+		{
+			//Values are integers, so lower than 2^bits is lower or equal than 2^bits-1
+			QWORD limit = (QWORD)1<<bits;
+			snprintf(le,sizeof(le),"le=\"%.9g\"",(limit-1)*value.scale);
+			AppendSample(dump,value.name+"_bucket",value.labels,le,value.histogram.GetCountBelow(limit));
+		}
+		AppendSample(dump,value.name+"_bucket",value.labels,"le=\"+Inf\"",value.histogram.count);
+		AppendSample(dump,value.name+"_sum",value.labels,nullptr,(double)value.histogram.sum*value.scale);
+		AppendSample(dump,value.name+"_count",value.labels,nullptr,value.histogram.count);
+	}
+
+	return dump;
+}
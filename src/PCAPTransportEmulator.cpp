@@ -610,7 +610,7 @@ outher:	while(running)
 			packet->SetCodec(codec);
 			packet->SetPayloadType(apt);
 			//TODO: Move from here
-			VideoLayerSelector::GetLayerIds(packet);
+			packet->layerClassification = VideoLayerSelector::Classify(packet);
 		}
 		
 		//Log("-%llu(%lld) %s seqNum:%llu(%u) mark:%d\n",ini+now,now,MediaFrame::TypeToString(group->type),packet->GetExtSeqNum(),packet->GetSeqNum(),packet->GetMark());
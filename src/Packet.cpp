@@ -0,0 +1,106 @@
+#include "Packet.h"
+#include "concurrentqueue.h"
+#include <atomic>
+#include <vector>
+
+namespace {
+
+//Buffers moved at once between a thread cache and the shared pool
+const size_t Batch = 32;
+//Max buffers kept on the shared pool, the rest are freed
+const size_t MaxPooled = 16*1024;
+
+std::atomic<size_t> allocated(0);
+
+moodycamel::ConcurrentQueue<Packet::Buffer*>& GetPool()
+{
+	//Created on first use
+	static moodycamel::ConcurrentQueue<Packet::Buffer*> pool;
+	return pool;
+}
+
+//Set when thread cache is destroyed, packets released later on thread exit are just freed
+thread_local bool exited = false;
+
+struct Cache
+{
+	~Cache()
+	{
+		//Do not use it anymore
+		exited = true;
+		//Give buffers back to the shared pool on thread exit
+		if (!buffers.empty())
+			GetPool().enqueue_bulk(buffers.data(),buffers.size());
+	}
+	std::vector<Packet::Buffer*> buffers;
+};
+
+thread_local Cache cache;
+
+}
+
+Packet::Buffer* Packet::Acquire()
+{
+	//If thread is exiting
+	if (exited)
+	{
+		//One more
+		allocated++;
+		//Do not cache it
+		return new Buffer;
+	}
+	auto& buffers = cache.buffers;
+	//Refill thread cache from the shared pool
+	if (buffers.empty())
+	{
+		buffers.resize(Batch);
+		buffers.resize(GetPool().try_dequeue_bulk(buffers.data(),Batch));
+	}
+	//If there was none available
+	if (buffers.empty())
+	{
+		//One more
+		allocated++;
+		//Create new one
+		return new Buffer;
+	}
+	//Get last one
+	Buffer* buffer = buffers.back();
+	buffers.pop_back();
+	return buffer;
+}
+
+void Packet::Release(Buffer* buffer)
+{
+	//If thread is exiting
+	if (exited)
+	{
+		//Free it
+		delete(buffer);
+		allocated--;
+		return;
+	}
+	auto& buffers = cache.buffers;
+	//Keep it on the thread cache
+	buffers.push_back(buffer);
+	//If we have too many, as when packets are created on one thread and sent on another
+	if (buffers.size()>=Batch*2)
+	{
+		//Move a batch to the shared pool if it is not full
+		if (GetPool().size_approx()<MaxPooled)
+		{
+			GetPool().enqueue_bulk(buffers.end()-Batch,Batch);
+		} else {
+			for (auto it = buffers.end()-Batch; it!=buffers.end(); ++it)
+				delete(*it);
+			allocated -= Batch;
+		}
+		//Remove them
+		buffers.resize(buffers.size()-Batch);
+	}
+}
+
+Packet::PoolStats Packet::GetPoolStats()
+{
+	return {allocated.load(),GetPool().size_approx()};
+}
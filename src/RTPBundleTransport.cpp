@@ -139,7 +139,7 @@ int RTPBundleTransport::RemoveICETransport(const std::string &username)
 			//Get candidate object
 			ICERemoteCandidate* candidate = *candidatesIterator;
 			//Remove from all candidates list
-			candidates.erase(candidate->GetRemoteAddress());
+			RemoveCandidate(candidate->GetRemoteKey());
 		}
 	
 		//Stop transport
@@ -349,23 +349,54 @@ int RTPBundleTransport::Send(const ICERemoteCandidate* candidate, Packet&& buffe
 	return 1;
 }
 
+ICERemoteCandidate* RTPBundleTransport::GetCandidate(uint64_t key)
+{
+	//Check if it is the same as last one
+	if (lastCandidate && lastKey==key)
+		return lastCandidate;
+
+	//Find candidate
+	auto it = candidates.find(key);
+
+	//Check if it was not registered
+	if (it==candidates.end())
+		return nullptr;
+
+	//Store for next time
+	lastKey = key;
+	lastCandidate = &it->second;
+
+	//Found
+	return lastCandidate;
+}
+
+void RTPBundleTransport::RemoveCandidate(uint64_t key)
+{
+	//Clear last candidate if it is the one being removed
+	if (lastCandidate && lastKey==key)
+		lastCandidate = nullptr;
+
+	//Remove it
+	candidates.erase(key);
+}
+
 void RTPBundleTransport::OnRead(const int fd, const uint8_t* data, const size_t size, const uint32_t ip, const uint16_t port)
 {
-	//Get remote ip:port address
-	std::string remote = ICERemoteCandidate::GetRemoteAddress(ip,port);
+	//Get remote ip:port key
+	uint64_t remote = ICERemoteCandidate::GetRemoteKey(ip,port);
 	
-	//UltraDebug("-RTPBundleTransport::OnRead() | [remote:%s,size:%u]\n",remote.c_str(),size);
+	//UltraDebug("-RTPBundleTransport::OnRead() | [remote:%s,size:%u]\n",ICERemoteCandidate::GetRemoteAddress(ip,port).c_str(),size);
 			
 	//Check if it looks like a STUN message
 	if (STUNMessage::IsSTUN(data,size))
 	{
 		//UltraDebug("-RTPBundleTransport::OnRead() | stun\n");
 		
-		//Parse it
-		auto stun = std::unique_ptr<STUNMessage>(STUNMessage::Parse(data,size));
+		//Parse it without copying
+		STUNMessage::View stun;
 
 		//It was not a valid STUN message
-		if (!stun)
+		if (!stun.Parse(data,size))
 		{
 			//Error
 			Error("-RTPBundleTransport::Read() | failed to parse STUN message\n");
@@ -373,16 +404,19 @@ void RTPBundleTransport::OnRead(const int fd, const uint8_t* data, const size_t
 			return;
 		}
 
-		STUNMessage::Type type = stun->GetType();
-		STUNMessage::Method method = stun->GetMethod();
+		STUNMessage::Type type = stun.GetType();
+		STUNMessage::Method method = stun.GetMethod();
 
 		//If it is a request
 		if (type==STUNMessage::Request && method==STUNMessage::Binding)
 		{
 			//UltraDebug("-RTPBundleTransport::OnRead() | Binding request\n");
 			
-			//Check if it has the prio attribute
-			if (!stun->HasAttribute(STUNMessage::Attribute::Username))
+			//Get username
+			const STUNMessage::View::Attribute* attr = stun.GetAttribute(STUNMessage::Attribute::Username);
+			
+			//Check if it has the username attribute
+			if (!attr)
 			{
 				//Error
 				Debug("-RTPBundleTransport::Read() | STUN Message without username attribute\n");
@@ -390,11 +424,8 @@ void RTPBundleTransport::OnRead(const int fd, const uint8_t* data, const size_t
 				return;
 			}
 			
-			//Get username
-			STUNMessage::Attribute* attr = stun->GetAttribute(STUNMessage::Attribute::Username);
-			
-			//Copy username string
-			std::string username((char*)attr->attr,attr->size);
+			//Username string pointing to the received data
+			std::string_view username((const char*)attr->attr,attr->size);
 			
 			//Check if we have an ICE transport for that username
 			auto it = connections.find(username);
@@ -404,7 +435,7 @@ void RTPBundleTransport::OnRead(const int fd, const uint8_t* data, const size_t
 			{
 				//TODO: Reject
 				//Error
-				Debug("-RTPBundleTransport::Read() | ICE username not found [%s}\n",username.c_str());
+				Debug("-RTPBundleTransport::Read() | ICE username not found [%s}\n",std::string(username).c_str());
 				//Done
 				return;
 			}
@@ -414,7 +445,7 @@ void RTPBundleTransport::OnRead(const int fd, const uint8_t* data, const size_t
 			DTLSICETransport* transport = connection->transport;
 			
 			//Authenticate request with remote username
-			if (!stun->CheckAuthenticatedFingerPrint(data,size,transport->GetLocalPwd()))
+			if (!stun.CheckAuthenticatedFingerPrint(connection->localIntegrity,transport->GetLocalPwd()))
 			{
 				//Error
 				Error("-RTPBundleTransport::Read() | STUN Message request failed authentication [pwd:%s]\n",transport->GetLocalPwd());
@@ -425,8 +456,11 @@ void RTPBundleTransport::OnRead(const int fd, const uint8_t* data, const size_t
 			//Inc stats
 			connection->iceRequestsReceived++;
 
+			//Get attribute
+			const STUNMessage::View::Attribute* priority = stun.GetAttribute(STUNMessage::Attribute::Priority);
+			
 			//Check if it has the prio attribute
-			if (!stun->HasAttribute(STUNMessage::Attribute::Priority))
+			if (!priority)
 			{
 				//Error
 				Debug("-RTPBundleTransport::Read() | STUN Message without priority attribute\n");
@@ -437,11 +471,8 @@ void RTPBundleTransport::OnRead(const int fd, const uint8_t* data, const size_t
 			//Check wether we have to reply to this message or not
 			bool reply = !(connection->disableSTUNKeepAlive && transport->HasActiveRemoteCandidate());
 			
-			//Get attribute
-			STUNMessage::Attribute* priority = stun->GetAttribute(STUNMessage::Attribute::Priority);
-			
 			//Get prio
-			DWORD prio = priority ? get4(priority->attr,0) : 0;
+			DWORD prio = priority->size>=4 ? get4(priority->attr,0) : 0;
 			
 			//Find candidate or try to create one if not present
 			auto [itc, inserted] = candidates.try_emplace(remote,ip,port,transport);
@@ -452,7 +483,7 @@ void RTPBundleTransport::OnRead(const int fd, const uint8_t* data, const size_t
 			//Check if it is not already present
 			if (inserted)
 			{
-				Log("-RTPBundleTransport::Read() | Got new remote ICE candidate [remote:%s]\n",remote.c_str());
+				Log("-RTPBundleTransport::Read() | Got new remote ICE candidate [remote:%s]\n",ICERemoteCandidate::GetRemoteAddress(ip,port).c_str());
 				//Add it to the connection
 				connection->candidates.insert(candidate);
 				//We need to reply the first always
@@ -460,19 +491,24 @@ void RTPBundleTransport::OnRead(const int fd, const uint8_t* data, const size_t
 			}
 			
 			//Set it active
-			transport->ActivateRemoteCandidate(candidate,stun->HasAttribute(STUNMessage::Attribute::UseCandidate),prio);
+			transport->ActivateRemoteCandidate(candidate,stun.HasAttribute(STUNMessage::Attribute::UseCandidate),prio);
+			
+			//Create new mesage
+			Packet buffer;
 			
-			//Create response
-			auto resp = std::unique_ptr<STUNMessage>(stun->CreateResponse());
+			//Serialize response directly on the packet
+			STUNMessage::Writer resp(buffer.GetData(),buffer.GetCapacity(),STUNMessage::Response,method,stun.GetTransactionId());
 			
 			//Add received xor mapped addres
-			resp->AddXorAddressAttribute(htonl(ip),htons(port));
+			resp.AddXorAddressAttribute(htonl(ip),htons(port));
 			
-			//Create new mesage
-			Packet buffer;
-		
-			//Serialize and autenticate
-			size_t len = resp->AuthenticatedFingerPrint(buffer.GetData(),buffer.GetCapacity(),transport->GetLocalPwd());
+			//Autenticate
+			size_t len = resp.AuthenticatedFingerPrint(connection->localIntegrity,transport->GetLocalPwd());
+			
+			//Check
+			if (!len)
+				//Error
+				return (void)Error("-RTPBundleTransport::Read() | could not serialize STUN response\n");
 			
 			//resize
 			buffer.SetSize(len);
@@ -490,8 +526,8 @@ void RTPBundleTransport::OnRead(const int fd, const uint8_t* data, const size_t
 		} else if (type==STUNMessage::Response && method==STUNMessage::Binding) {
 			
 			//Get ts and id
-			uint32_t id = get4(stun->GetTransactionId(),0);
-			uint64_t ts = get8(stun->GetTransactionId(),4);
+			uint32_t id = get4(stun.GetTransactionId(),0);
+			uint64_t ts = get8(stun.GetTransactionId(),4);
 			
 			//Find transaction
 			auto transactionIterator = transactions.find({ts,id});
@@ -527,21 +563,18 @@ void RTPBundleTransport::OnRead(const int fd, const uint8_t* data, const size_t
 			DTLSICETransport* transport = connection->transport;
 			
 			//Find candidate
-			auto candidateIterator = candidates.find(remote);
+			ICERemoteCandidate* candidate = GetCandidate(remote);
 			
 			//Check we have it
-			if (candidateIterator==candidates.end())
+			if (!candidate)
 			{
 				//Error
-				Debug("-RTPBundleTransport::Read() | remote candidate not found for response [remote:%s]}\n",remote.c_str());
+				Debug("-RTPBundleTransport::Read() | remote candidate not found for response [remote:%s]}\n",ICERemoteCandidate::GetRemoteAddress(ip,port).c_str());
 				return;
 			}
-		
-			//Get it
-			ICERemoteCandidate* candidate = &candidateIterator->second;
 			
 			//Authenticate request with remote username
-			if (!stun->CheckAuthenticatedFingerPrint(data,size,transport->GetRemotePwd()))
+			if (!stun.CheckAuthenticatedFingerPrint(connection->remoteIntegrity,transport->GetRemotePwd()))
 			{
 				//Error
 				Error("-RTPBundleTransport::Read() | STUN Message response failed authentication [pwd:%s]\n",transport->GetRemotePwd());
@@ -550,13 +583,13 @@ void RTPBundleTransport::OnRead(const int fd, const uint8_t* data, const size_t
 			}
 
 			//Get attribute
-			STUNMessage::Attribute* priority = stun->GetAttribute(STUNMessage::Attribute::Priority);
+			const STUNMessage::View::Attribute* priority = stun.GetAttribute(STUNMessage::Attribute::Priority);
 
 			//Get prio
-			DWORD prio = priority ? get4(priority->attr,0) : 0;
+			DWORD prio = priority && priority->size>=4 ? get4(priority->attr,0) : 0;
 
 			//Set it active
-			transport->ActivateRemoteCandidate(candidate,stun->HasAttribute(STUNMessage::Attribute::UseCandidate),prio);
+			transport->ActivateRemoteCandidate(candidate,stun.HasAttribute(STUNMessage::Attribute::UseCandidate),prio);
 			
 			//Set state
 			candidate->SetState(ICERemoteCandidate::Connected);
@@ -570,19 +603,19 @@ void RTPBundleTransport::OnRead(const int fd, const uint8_t* data, const size_t
 	}
 	
 	//Find candidate
-	auto it = candidates.find(remote);
+	ICERemoteCandidate* candidate = GetCandidate(remote);
 	
 	//Check if it was not registered
-	if (it==candidates.end())
+	if (!candidate)
 	{
 		//Error
-		Debug("-RTPBundleTransport::Read() | No registered ICE candidate for [%s]\n",remote.c_str());
+		Debug("-RTPBundleTransport::Read() | No registered ICE candidate for [%s]\n",ICERemoteCandidate::GetRemoteAddress(ip,port).c_str());
 		//DOne
 		return;
 	}
 	
 	//Send data on ice transport
-	it->second.onData(data,size);
+	candidate->onData(data,size);
 }
 
 int RTPBundleTransport::AddRemoteCandidate(const std::string& username,const char* host, WORD port)
@@ -610,8 +643,8 @@ int RTPBundleTransport::AddRemoteCandidate(const std::string& username,const cha
 		Connection* connection = it->second;
 		DTLSICETransport* transport = connection->transport;
 		
-		//Get remote ip:port address
-		std::string remote = ip + ":" + std::to_string(port);
+		//Get remote ip:port key
+		uint64_t remote = ICERemoteCandidate::GetRemoteKey(ntohl(inet_addr(ip.c_str())),port);
 		
 		//Create new candidate if it is not already present
 		auto [itc, inserted] = candidates.try_emplace(remote,ip,port,transport);
@@ -650,22 +683,22 @@ void RTPBundleTransport::SendBindingRequest(Connection* connection,ICERemoteCand
 	set8(transId,4,ts);
 	
 	//Add to outgoing transactions
-	transactions[{ts,id}] = {connection->username,candidate->GetRemoteAddress()};
+	transactions[{ts,id}] = {connection->username,candidate->GetRemoteKey()};
 				
-	//Create binding request to send back
-	auto request = std::make_unique<STUNMessage>(STUNMessage::Request,STUNMessage::Binding,transId);
+	//Create new mesage
+	Packet buffer;
+
+	//Create binding request to send back directly on the packet
+	STUNMessage::Writer request(buffer.GetData(),buffer.GetCapacity(),STUNMessage::Request,STUNMessage::Binding,transId);
 	//Add username
-	request->AddUsernameAttribute(transport->GetLocalUsername(),transport->GetRemoteUsername());
+	request.AddUsernameAttribute(transport->GetLocalUsername(),transport->GetRemoteUsername());
 
 	//Add other attributes
-	request->AddAttribute(STUNMessage::Attribute::IceControlled,(QWORD)1);
-	request->AddAttribute(STUNMessage::Attribute::Priority,(DWORD)33554431);
-
-	//Create new mesage
-	Packet buffer;
+	request.AddAttribute(STUNMessage::Attribute::IceControlled,(QWORD)1);
+	request.AddAttribute(STUNMessage::Attribute::Priority,(DWORD)33554431);
 
 	//Serialize and autenticate
-	size_t len = request->AuthenticatedFingerPrint(buffer.GetData(),buffer.GetCapacity(),transport->GetRemotePwd());
+	size_t len = request.AuthenticatedFingerPrint(connection->remoteIntegrity,transport->GetRemotePwd());
 
 	//resize
 	buffer.SetSize(len);
@@ -716,15 +749,12 @@ void RTPBundleTransport::onTimer(std::chrono::milliseconds now)
 		Connection* connection = cconnectionIterator->second;
 		
 		//Find candidate
-		auto candidateIterator = candidates.find(remote);
+		ICERemoteCandidate* candidate = GetCandidate(remote);
 			
 		//Check we have it
-		if (candidateIterator==candidates.end())
+		if (!candidate)
 			break;
 		
-		//Get it
-		ICERemoteCandidate* candidate = &candidateIterator->second;
-		
 		//Check again
 		SendBindingRequest(connection,candidate);
 	}
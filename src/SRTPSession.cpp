@@ -4,6 +4,27 @@
 #include <algorithm>
 #include <arpa/inet.h>
 #include "log.h"
+#include "Metrics.h"
+
+namespace
+{
+
+//Time spent on srtp of all the sessions
+struct SRTPMetrics
+{
+	Metrics::Histogram& protectRTP		= Metrics::GetHistogram("mediaserver_srtp_seconds","Time protecting and unprotecting packets","op=\"protect\",packet=\"rtp\"",1E-9);
+	Metrics::Histogram& protectRTCP		= Metrics::GetHistogram("mediaserver_srtp_seconds","Time protecting and unprotecting packets","op=\"protect\",packet=\"rtcp\"",1E-9);
+	Metrics::Histogram& unprotectRTP	= Metrics::GetHistogram("mediaserver_srtp_seconds","Time protecting and unprotecting packets","op=\"unprotect\",packet=\"rtp\"",1E-9);
+	Metrics::Histogram& unprotectRTCP	= Metrics::GetHistogram("mediaserver_srtp_seconds","Time protecting and unprotecting packets","op=\"unprotect\",packet=\"rtcp\"",1E-9);
+};
+
+SRTPMetrics& GetSRTPMetrics()
+{
+	static SRTPMetrics metrics;
+	return metrics;
+}
+
+}
 
 SRTPSession::~SRTPSession()
 {
@@ -148,21 +169,27 @@ void SRTPSession::RemoveStream(uint32_t ssrc)
 size_t SRTPSession::ProtectRTP(const uint8_t* data, size_t size)
 {
 	size_t len = size;
+	QWORD ini = Metrics::Now();
 	err = (Status)srtp_protect(srtp,(uint8_t*)data,(int*)&len);
+	GetSRTPMetrics().protectRTP.Record(Metrics::Now()-ini);
 	return err==Status::OK ? len : 0;
 }
 
 size_t SRTPSession::ProtectRTCP(const uint8_t* data, size_t size)
 {
 	size_t len = size;
+	QWORD ini = Metrics::Now();
 	err = (Status)srtp_protect_rtcp(srtp,(uint8_t*)data,(int*)&len);
+	GetSRTPMetrics().protectRTCP.Record(Metrics::Now()-ini);
 	return err==Status::OK ? len : 0;
 }
 
 size_t SRTPSession::UnprotectRTP(const uint8_t* data, size_t size)
 {
 	size_t len = size;
+	QWORD ini = Metrics::Now();
 	err = (Status)srtp_unprotect(srtp,(uint8_t*)data,(int*)&len);
+	GetSRTPMetrics().unprotectRTP.Record(Metrics::Now()-ini);
 	return err==Status::OK ? len : 0;
 }
 
@@ -170,7 +197,9 @@ size_t SRTPSession::UnprotectRTP(const uint8_t* data, size_t size)
 size_t SRTPSession::UnprotectRTCP(const uint8_t* data, size_t size)
 {
 	size_t len = size;
+	QWORD ini = Metrics::Now();
 	err = (Status)srtp_unprotect_rtcp(srtp,(uint8_t*)data,(int*)&len);
+	GetSRTPMetrics().unprotectRTCP.Record(Metrics::Now()-ini);
 	return err==Status::OK ? len : 0;
 }
 
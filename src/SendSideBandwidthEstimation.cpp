@@ -82,7 +82,7 @@ void SendSideBandwidthEstimation::SentPacket(const PacketStats::shared& stat)
 
 }
 
-void SendSideBandwidthEstimation::ReceivedFeedback(uint8_t feedbackNum, const std::map<uint32_t,uint64_t>& packets, uint64_t when)
+void SendSideBandwidthEstimation::ReceivedFeedback(uint8_t feedbackNum, const RTCPRTPFeedback::TransportWideFeedbackMessageField::Packets& packets, uint64_t when)
 {
 	//Extend seq num
 	feedbackNumExtender.Extend(feedbackNum);
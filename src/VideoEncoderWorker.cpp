@@ -273,6 +273,9 @@ int VideoEncoderWorker::Encode()
 
 		
 
+		//Tell encoder which parts of the picture have changed
+		videoEncoder->SetChangedRegions(pic.partial ? &pic.changed : nullptr);
+
 		//Procesamos el frame
 		VideoFrame *videoFrame = videoEncoder->EncodeFrame(pic.buffer,pic.GetBufferSize());
 
@@ -51,23 +51,45 @@ VideoLayerSelector* VideoLayerSelector::Create(VideoCodec::Type codec)
 }
 
  std::vector<LayerInfo> VideoLayerSelector::GetLayerIds(const RTPPacket::shared& packet)
+{
+	return GetLayerIds(packet,packet->layerClassification ? packet->layerClassification : Classify(packet));
+}
+
+ std::vector<LayerInfo> VideoLayerSelector::GetLayerIds(const RTPPacket::shared& packet,const std::optional<LayerClassification>& layer)
 {
 	switch(packet->GetCodec())
 	{
 		case VideoCodec::VP9:
-			return VP9LayerSelector::GetLayerIds(packet);
+			return VP9LayerSelector::GetLayerIds(packet,layer);
 		case VideoCodec::VP8:
-			return VP8LayerSelector::GetLayerIds(packet);
+			return VP8LayerSelector::GetLayerIds(packet,layer);
 		case VideoCodec::H264:
-			return H264LayerSelector::GetLayerIds(packet);
+			return H264LayerSelector::GetLayerIds(packet,layer);
 		case VideoCodec::AV1:
-			return DependencyDescriptorLayerSelector::GetLayerIds(packet);
+			return DependencyDescriptorLayerSelector::GetLayerIds(packet,layer);
 		default:
 			return {};
 	}
 }
 
 
+std::optional<LayerClassification> VideoLayerSelector::Classify(const RTPPacket::shared& packet)
+{
+	switch(packet->GetCodec())
+	{
+		case VideoCodec::VP9:
+			return VP9LayerSelector::Classify(packet);
+		case VideoCodec::VP8:
+			return VP8LayerSelector::Classify(packet);
+		case VideoCodec::H264:
+			return H264LayerSelector::Classify(packet);
+		case VideoCodec::AV1:
+			return DependencyDescriptorLayerSelector::Classify(packet);
+		default:
+			return std::nullopt;
+	}
+}
+
  bool VideoLayerSelector::AreLayersInfoeAggregated(const RTPPacket::shared& packet)
  {
 	 return packet->GetCodec()== VideoCodec::AV1;
@@ -0,0 +1,373 @@
+#include "alphablend.h"
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define HAVE_X86_KERNELS
+#define TARGET_SSE41	__attribute__((target("sse4.1")))
+#define TARGET_AVX2	__attribute__((target("avx2")))
+#endif
+
+namespace {
+
+//Pointers to a pair of lines of each image
+struct Lines
+{
+	const BYTE* srcY1;
+	const BYTE* srcY2;
+	const BYTE* srcU;
+	const BYTE* srcV;
+	const BYTE* ovrY1;
+	const BYTE* ovrY2;
+	const BYTE* ovrU;
+	const BYTE* ovrV;
+	const BYTE* ovrA1;
+	const BYTE* ovrA2;
+	BYTE* dstY1;
+	BYTE* dstY2;
+	BYTE* dstU;
+	BYTE* dstV;
+};
+
+//Blend pixels in [left,right), both even
+typedef void (*BlendFunc)(const Lines& lines,DWORD left,DWORD right);
+
+//Exact x/255 for x<=255*255
+inline DWORD Div255(DWORD x)
+{
+	return (x+1+(x>>8))>>8;
+}
+
+//Same as (o*a+s*(255-a))/255, which is s for a==0 and o for a==255
+inline BYTE BlendLuma(DWORD o,DWORD s,DWORD a)
+{
+	return Div255(o*a+s*(255-a));
+}
+
+//Same as (o*a+s*(1020-a))/1020, as x/1020==(x/4)/255
+inline BYTE BlendChroma(DWORD o,DWORD s,DWORD a)
+{
+	return Div255((o*a+s*(1020-a))>>2);
+}
+
+void BlendScalar(const Lines& l,DWORD left,DWORD right)
+{
+	for (DWORD i=left;i<right;i+=2)
+	{
+		//Get alpha values
+		DWORD a11 = l.ovrA1[i];
+		DWORD a12 = l.ovrA1[i+1];
+		DWORD a21 = l.ovrA2[i];
+		DWORD a22 = l.ovrA2[i+1];
+		//Blend luma
+		l.dstY1[i]   = BlendLuma(l.ovrY1[i]  ,l.srcY1[i]  ,a11);
+		l.dstY1[i+1] = BlendLuma(l.ovrY1[i+1],l.srcY1[i+1],a12);
+		l.dstY2[i]   = BlendLuma(l.ovrY2[i]  ,l.srcY2[i]  ,a21);
+		l.dstY2[i+1] = BlendLuma(l.ovrY2[i+1],l.srcY2[i+1],a22);
+		//Chroma weight is a21 twice and no a12, as it has always been, keep it so output does not change
+		DWORD alpha = a11+a21+a21+a22;
+		//Blend chroma
+		l.dstU[i/2] = BlendChroma(l.ovrU[i/2],l.srcU[i/2],alpha);
+		l.dstV[i/2] = BlendChroma(l.ovrV[i/2],l.srcV[i/2],alpha);
+	}
+}
+
+#ifdef HAVE_X86_KERNELS
+//8 luma samples in 16 bit lanes
+TARGET_SSE41 inline __m128i BlendLuma8(__m128i o,__m128i s,__m128i a)
+{
+	//o*a+s*(255-a) fits in 16 bits
+	__m128i x = _mm_add_epi16(_mm_mullo_epi16(o,a),_mm_mullo_epi16(s,_mm_sub_epi16(_mm_set1_epi16(255),a)));
+	//Div255
+	return _mm_srli_epi16(_mm_add_epi16(x,_mm_add_epi16(_mm_set1_epi16(1),_mm_srli_epi16(x,8))),8);
+}
+
+//4 chroma samples in 32 bit lanes, overlay and frame samples interleaved as its weights
+TARGET_SSE41 inline __m128i BlendChroma4(__m128i os,__m128i weights)
+{
+	//o*a+s*(1020-a), divided by 4 so Div255 can be used
+	__m128i x = _mm_srli_epi32(_mm_madd_epi16(os,weights),2);
+	//Div255
+	return _mm_srli_epi32(_mm_add_epi32(x,_mm_add_epi32(_mm_set1_epi32(1),_mm_srli_epi32(x,8))),8);
+}
+
+//16 luma pixels
+TARGET_SSE41 inline void BlendLumaSSE41(const BYTE* ovr,const BYTE* src,const BYTE* alpha,BYTE* dst)
+{
+	__m128i zero = _mm_setzero_si128();
+	__m128i o = _mm_loadu_si128((const __m128i*)ovr);
+	__m128i s = _mm_loadu_si128((const __m128i*)src);
+	__m128i a = _mm_loadu_si128((const __m128i*)alpha);
+	__m128i lo = BlendLuma8(_mm_cvtepu8_epi16(o),_mm_cvtepu8_epi16(s),_mm_cvtepu8_epi16(a));
+	__m128i hi = BlendLuma8(_mm_unpackhi_epi8(o,zero),_mm_unpackhi_epi8(s,zero),_mm_unpackhi_epi8(a,zero));
+	_mm_storeu_si128((__m128i*)dst,_mm_packus_epi16(lo,hi));
+}
+
+//8 chroma samples with its alphas in 16 bit lanes
+TARGET_SSE41 inline void BlendChromaSSE41(const BYTE* ovr,const BYTE* src,__m128i alpha,BYTE* dst)
+{
+	__m128i o = _mm_cvtepu8_epi16(_mm_loadl_epi64((const __m128i*)ovr));
+	__m128i s = _mm_cvtepu8_epi16(_mm_loadl_epi64((const __m128i*)src));
+	__m128i n = _mm_sub_epi16(_mm_set1_epi16(1020),alpha);
+	__m128i lo = BlendChroma4(_mm_unpacklo_epi16(o,s),_mm_unpacklo_epi16(alpha,n));
+	__m128i hi = BlendChroma4(_mm_unpackhi_epi16(o,s),_mm_unpackhi_epi16(alpha,n));
+	_mm_storel_epi64((__m128i*)dst,_mm_packus_epi16(_mm_packus_epi32(lo,hi),_mm_setzero_si128()));
+}
+
+//Chroma alpha from the 16 bit words of each alpha line, low byte is even pixel
+TARGET_SSE41 inline __m128i ChromaAlphaSSE41(__m128i a1,__m128i a2)
+{
+	__m128i mask = _mm_set1_epi16(0x00FF);
+	//a11+a21+a21+a22
+	return _mm_add_epi16(_mm_and_si128(a1,mask),_mm_add_epi16(_mm_slli_epi16(_mm_and_si128(a2,mask),1),_mm_srli_epi16(a2,8)));
+}
+
+TARGET_SSE41 void BlendSSE41(const Lines& l,DWORD left,DWORD right)
+{
+	DWORD i = left;
+	//16 pixels and 8 chroma samples on each step
+	for (;i+16<=right;i+=16)
+	{
+		BlendLumaSSE41(l.ovrY1+i,l.srcY1+i,l.ovrA1+i,l.dstY1+i);
+		BlendLumaSSE41(l.ovrY2+i,l.srcY2+i,l.ovrA2+i,l.dstY2+i);
+		__m128i alpha = ChromaAlphaSSE41(_mm_loadu_si128((const __m128i*)(l.ovrA1+i)),_mm_loadu_si128((const __m128i*)(l.ovrA2+i)));
+		BlendChromaSSE41(l.ovrU+i/2,l.srcU+i/2,alpha,l.dstU+i/2);
+		BlendChromaSSE41(l.ovrV+i/2,l.srcV+i/2,alpha,l.dstV+i/2);
+	}
+	//Rest of the line
+	BlendScalar(l,i,right);
+}
+
+//16 luma samples in 16 bit lanes
+TARGET_AVX2 inline __m256i BlendLuma16(__m256i o,__m256i s,__m256i a)
+{
+	__m256i x = _mm256_add_epi16(_mm256_mullo_epi16(o,a),_mm256_mullo_epi16(s,_mm256_sub_epi16(_mm256_set1_epi16(255),a)));
+	return _mm256_srli_epi16(_mm256_add_epi16(x,_mm256_add_epi16(_mm256_set1_epi16(1),_mm256_srli_epi16(x,8))),8);
+}
+
+//8 chroma samples in 32 bit lanes
+TARGET_AVX2 inline __m256i BlendChroma8(__m256i os,__m256i weights)
+{
+	__m256i x = _mm256_srli_epi32(_mm256_madd_epi16(os,weights),2);
+	return _mm256_srli_epi32(_mm256_add_epi32(x,_mm256_add_epi32(_mm256_set1_epi32(1),_mm256_srli_epi32(x,8))),8);
+}
+
+//Pack 16 bit lanes into bytes in order
+TARGET_AVX2 inline __m128i Pack16(__m256i x)
+{
+	return _mm_packus_epi16(_mm256_castsi256_si128(x),_mm256_extracti128_si256(x,1));
+}
+
+//16 luma pixels
+TARGET_AVX2 inline void BlendLumaAVX2(const BYTE* ovr,const BYTE* src,const BYTE* alpha,BYTE* dst)
+{
+	__m256i o = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*)ovr));
+	__m256i s = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*)src));
+	__m256i a = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*)alpha));
+	_mm_storeu_si128((__m128i*)dst,Pack16(BlendLuma16(o,s,a)));
+}
+
+//16 chroma samples with its alphas in 16 bit lanes
+TARGET_AVX2 inline void BlendChromaAVX2(const BYTE* ovr,const BYTE* src,__m256i alpha,BYTE* dst)
+{
+	__m256i o = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*)ovr));
+	__m256i s = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*)src));
+	__m256i n = _mm256_sub_epi16(_mm256_set1_epi16(1020),alpha);
+	//Unpack and pack are done per 128 bit lane, so samples keep their order
+	__m256i lo = BlendChroma8(_mm256_unpacklo_epi16(o,s),_mm256_unpacklo_epi16(alpha,n));
+	__m256i hi = BlendChroma8(_mm256_unpackhi_epi16(o,s),_mm256_unpackhi_epi16(alpha,n));
+	_mm_storeu_si128((__m128i*)dst,Pack16(_mm256_packus_epi32(lo,hi)));
+}
+
+TARGET_AVX2 void BlendAVX2(const Lines& l,DWORD left,DWORD right)
+{
+	__m256i mask = _mm256_set1_epi16(0x00FF);
+	DWORD i = left;
+	//32 pixels and 16 chroma samples on each step
+	for (;i+32<=right;i+=32)
+	{
+		BlendLumaAVX2(l.ovrY1+i   ,l.srcY1+i   ,l.ovrA1+i   ,l.dstY1+i);
+		BlendLumaAVX2(l.ovrY1+i+16,l.srcY1+i+16,l.ovrA1+i+16,l.dstY1+i+16);
+		BlendLumaAVX2(l.ovrY2+i   ,l.srcY2+i   ,l.ovrA2+i   ,l.dstY2+i);
+		BlendLumaAVX2(l.ovrY2+i+16,l.srcY2+i+16,l.ovrA2+i+16,l.dstY2+i+16);
+		//a11+a21+a21+a22
+		__m256i a1 = _mm256_loadu_si256((const __m256i*)(l.ovrA1+i));
+		__m256i a2 = _mm256_loadu_si256((const __m256i*)(l.ovrA2+i));
+		__m256i alpha = _mm256_add_epi16(_mm256_and_si256(a1,mask),_mm256_add_epi16(_mm256_slli_epi16(_mm256_and_si256(a2,mask),1),_mm256_srli_epi16(a2,8)));
+		BlendChromaAVX2(l.ovrU+i/2,l.srcU+i/2,alpha,l.dstU+i/2);
+		BlendChromaAVX2(l.ovrV+i/2,l.srcV+i/2,alpha,l.dstV+i/2);
+	}
+	//Rest of the line
+	BlendSSE41(l,i,right);
+}
+#endif
+
+BlendFunc GetBlendFunc(AlphaBlend::Kernel kernel)
+{
+	//Fallback to scalar if not supported
+	if (!AlphaBlend::IsSupported(kernel))
+		return BlendScalar;
+#ifdef HAVE_X86_KERNELS
+	switch(kernel)
+	{
+		case AlphaBlend::AVX2:
+			return BlendAVX2;
+		case AlphaBlend::SSE41:
+			return BlendSSE41;
+		default:
+			break;
+	}
+#endif
+	return BlendScalar;
+}
+
+//Copy a span of a pair of lines from one image
+void Copy(const BYTE* Y1,const BYTE* Y2,const BYTE* U,const BYTE* V,const Lines& l,DWORD left,DWORD width)
+{
+	memcpy(l.dstY1+left,Y1+left,width);
+	memcpy(l.dstY2+left,Y2+left,width);
+	memcpy(l.dstU+left/2,U+left/2,width/2);
+	memcpy(l.dstV+left/2,V+left/2,width/2);
+}
+
+}
+
+AlphaBlend::Kernel AlphaBlend::GetKernel()
+{
+	//Detect only once
+	static const Kernel kernel = IsSupported(AVX2) ? AVX2 : IsSupported(SSE41) ? SSE41 : Scalar;
+	//Return it
+	return kernel;
+}
+
+bool AlphaBlend::IsSupported(Kernel kernel)
+{
+	switch(kernel)
+	{
+		case Scalar:
+			return true;
+#ifdef HAVE_X86_KERNELS
+		case SSE41:
+			return __builtin_cpu_supports("sse4.1");
+		case AVX2:
+			return __builtin_cpu_supports("avx2");
+#endif
+		default:
+			return false;
+	}
+}
+
+const char* AlphaBlend::GetKernelName(Kernel kernel)
+{
+	switch(kernel)
+	{
+		case Scalar:
+			return "scalar";
+		case SSE41:
+			return "sse4.1";
+		case AVX2:
+			return "avx2";
+	}
+	return "unknown";
+}
+
+void AlphaBlend::CalculateRuns(const BYTE* overlay,DWORD width,DWORD height,Runs& runs)
+{
+	//Shorter transparent or opaque runs are blended, as copying them is not worth it
+	const DWORD minRun = 32;
+	//Only full 2x2 blocks
+	const DWORD w = width & ~1;
+	//Get alpha plane
+	const BYTE* alpha = overlay+width*height*3/2;
+
+	//One entry per pair of lines
+	runs.assign(height/2,{});
+
+	for (DWORD j=0;j<height/2;++j)
+	{
+		const BYTE* a1 = alpha+2*j*width;
+		const BYTE* a2 = a1+width;
+		std::vector<Run> line;
+		//Classify each 2x2 block
+		for (DWORD i=0;i<w;i+=2)
+		{
+			Span span = Mixed;
+			if (!(a1[i] | a1[i+1] | a2[i] | a2[i+1]))
+				span = Transparent;
+			else if ((a1[i] & a1[i+1] & a2[i] & a2[i+1])==255)
+				span = Opaque;
+			//Extend last run or start a new one
+			if (!line.empty() && line.back().span==span)
+				line.back().width += 2;
+			else
+				line.push_back({span,i,2});
+		}
+		//Merge short runs
+		std::vector<Run>& merged = runs[j];
+		for (auto run : line)
+		{
+			if (run.span!=Mixed && run.width<minRun)
+				run.span = Mixed;
+			if (!merged.empty() && merged.back().span==run.span)
+				merged.back().width += run.width;
+			else
+				merged.push_back(run);
+		}
+	}
+}
+
+void AlphaBlend::Blend(Kernel kernel,BYTE* image,const BYTE* frame,const BYTE* overlay,DWORD width,DWORD height,const Runs* runs)
+{
+	BlendFunc blend = GetBlendFunc(kernel);
+	//Only full 2x2 blocks
+	const DWORD w = width & ~1;
+	const DWORD numpixels = width*height;
+
+	//Ignore runs if they are not from this size
+	if (runs && runs->size()!=height/2)
+		runs = nullptr;
+
+	for (DWORD j=0;j<height/2;++j)
+	{
+		//Offsets of the lines
+		DWORD y = 2*j*width;
+		DWORD uv = j*width/2;
+		Lines lines = {
+			frame+y,
+			frame+y+width,
+			frame+numpixels+uv,
+			frame+numpixels*5/4+uv,
+			overlay+y,
+			overlay+y+width,
+			overlay+numpixels+uv,
+			overlay+numpixels*5/4+uv,
+			overlay+numpixels*3/2+y,
+			overlay+numpixels*3/2+y+width,
+			image+y,
+			image+y+width,
+			image+numpixels+uv,
+			image+numpixels*5/4+uv
+		};
+		//Blend everything
+		if (!runs)
+		{
+			blend(lines,0,w);
+			continue;
+		}
+		for (const auto& run : (*runs)[j])
+		{
+			switch(run.span)
+			{
+				case Transparent:
+					Copy(lines.srcY1,lines.srcY2,lines.srcU,lines.srcV,lines,run.left,run.width);
+					break;
+				case Opaque:
+					Copy(lines.ovrY1,lines.ovrY2,lines.ovrU,lines.ovrV,lines,run.left,run.width);
+					break;
+				case Mixed:
+					blend(lines,run.left,run.left+run.width);
+					break;
+			}
+		}
+	}
+}
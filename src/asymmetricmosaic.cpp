@@ -24,7 +24,7 @@ AsymmetricMosaic::~AsymmetricMosaic()
 * Update
 * 	Update slot of mosaic with given image
 *****************************/
-int AsymmetricMosaic::Update(int pos, BYTE *image, int imgWidth, int imgHeight,bool keepAspectRatio)
+int AsymmetricMosaic::Update(int pos, BYTE *image, int imgWidth, int imgHeight,bool keepAspectRatio,const FrameScaler::Pyramid* pyramid)
 {
 	//Check it's in the mosaic
 	if (pos<0 || pos >= numSlots)
@@ -88,13 +88,13 @@ int AsymmetricMosaic::Update(int pos, BYTE *image, int imgWidth, int imgHeight,b
 		//Set resize
 		resizer[pos]->SetResize(imgWidth,imgHeight,imgWidth,mosaicWidth,mosaicHeight,mosaicTotalWidth,keepAspectRatio);
 		//Resize and set to slot
-		resizer[pos]->Resize(imageY,imageU,imageV,lineaY,lineaU,lineaV);
+		resizer[pos]->Resize(imageY,imageU,imageV,lineaY,lineaU,lineaV,pyramid);
 	} else {
 		return 0;
 	}
 
 	//We have changed
-	SetChanged();
+	SetChanged(pos);
 
 	return 1;
 }
@@ -153,7 +153,7 @@ int AsymmetricMosaic::Clean(int pos)
 	}
 
 	//We have changed
-	SetChanged();
+	SetChanged(pos);
 
 	return 1;
 }
@@ -3,6 +3,7 @@
 #include "log.h"
 #include "use.h"
 #include "Datachannels.h"
+#include "EventLoop.h"
 
 using namespace std::chrono_literals;
 	
@@ -14,9 +15,16 @@ SSL_CTX*		DTLSConnection::ssl_ctx		= NULL;
 X509*			DTLSConnection::certificate	= NULL;
 EVP_PKEY*		DTLSConnection::privateKey	= NULL;
 bool			DTLSConnection::hasDTLS		= false;
+DTLSConnection::KeyType	DTLSConnection::keyType		= DTLSConnection::KEY_RSA;
+bool			DTLSConnection::resumption	= false;
+std::mutex		DTLSConnection::sessionsMutex;
+size_t			DTLSConnection::numWorkers	= 0;
+std::atomic<size_t>	DTLSConnection::nextWorker(0);
 
 DTLSConnection::LocalFingerPrints	DTLSConnection::localFingerPrints;
 DTLSConnection::AvailableHashes		DTLSConnection::availableHashes;
+DTLSConnection::Sessions		DTLSConnection::sessions;
+DTLSConnection::Workers			DTLSConnection::workers;
 
 // Static methods. 
 void DTLSConnection::SetCertificate(const char* cert,const char* key)
@@ -28,6 +36,39 @@ void DTLSConnection::SetCertificate(const char* cert,const char* key)
 	DTLSConnection::pvtfile.assign(key);
 }
 
+void DTLSConnection::SetKeyType(KeyType type)
+{
+	//Log
+	Debug("-DTLSConnection::SetKeyType() | [type:%s]\n",type==KEY_ECDSA ? "ecdsa" : "rsa");
+	//Only used when generating the certificate
+	DTLSConnection::keyType = type;
+}
+
+void DTLSConnection::EnableSessionResumption(bool enabled)
+{
+	//Log
+	Debug("-DTLSConnection::EnableSessionResumption() | [enabled:%d]\n",enabled);
+	//Store it
+	DTLSConnection::resumption = enabled;
+}
+
+void DTLSConnection::SetHandshakeWorkers(size_t num)
+{
+	//Log
+	Debug("-DTLSConnection::SetHandshakeWorkers() | [num:%d]\n",num);
+	//Threads will be started on Initialize
+	DTLSConnection::numWorkers = num;
+}
+
+TimeService& DTLSConnection::GetWorker(TimeService& timeService)
+{
+	//If handshakes are done on the owner loop
+	if (workers.empty())
+		return timeService;
+	//Round robin
+	return *workers[nextWorker++ % workers.size()];
+}
+
 int DTLSConnection::GenerateCertificate()
 {
 	Debug(">DTLSConnection::GenerateCertificate()\n");
@@ -35,9 +76,51 @@ int DTLSConnection::GenerateCertificate()
 	int ret = 0;
 	BIGNUM* bne = NULL;
 	RSA* rsa_key = NULL;
+	EC_KEY* ec_key = NULL;
 	int num_bits = 2048;
 	X509_NAME* cert_name = NULL;
 
+	// Create a private key object (needed to hold the RSA or EC key).
+	privateKey = EVP_PKEY_new();
+	if (!privateKey)
+	{
+		Error("EVP_PKEY_new() failed");
+		goto error;
+	}
+
+	// ECDSA keys are generated instantly and sign way faster than RSA ones
+	if (keyType == KEY_ECDSA)
+	{
+		// Generate a P-256 key, the only curve supported by all browsers.
+		ec_key = EC_KEY_new_by_curve_name(NID_X9_62_prime256v1);
+		if (!ec_key)
+		{
+			Error("EC_KEY_new_by_curve_name() failed");
+			goto error;
+		}
+
+		// Use named curve so it is encoded in the certificate by its OID.
+		EC_KEY_set_asn1_flag(ec_key, OPENSSL_EC_NAMED_CURVE);
+
+		ret = EC_KEY_generate_key(ec_key);
+		if (ret == 0)
+		{
+			Error("EC_KEY_generate_key() failed");
+			goto error;
+		}
+
+		ret = EVP_PKEY_assign_EC_KEY(privateKey, ec_key);
+		if (ret == 0)
+		{
+			Error("EVP_PKEY_assign_EC_KEY() failed");
+			goto error;
+		}
+		// The EC key now belongs to the private key, so don't clean it up separately.
+		ec_key = NULL;
+
+		goto create_certificate;
+	}
+
 	// Create a big number object.
 	bne = BN_new();
 	if (!bne)
@@ -69,14 +152,6 @@ int DTLSConnection::GenerateCertificate()
 		goto error;
 	}
 
-	// Create a private key object (needed to hold the RSA key).
-	privateKey = EVP_PKEY_new();
-	if (!privateKey)
-	{
-		Error("EVP_PKEY_new() failed");
-		goto error;
-	}
-
 	ret = EVP_PKEY_assign_RSA(privateKey, rsa_key);
 	if (ret == 0)
 	{
@@ -86,6 +161,7 @@ int DTLSConnection::GenerateCertificate()
 	// The RSA key now belongs to the private key, so don't clean it up separately.
 	rsa_key = NULL;
 
+create_certificate:
 	// Create the X509 certificate.
 	certificate = X509_new();
 	if (!certificate)
@@ -132,7 +208,7 @@ int DTLSConnection::GenerateCertificate()
 	}
 
 	// Sign the certificate with its own private key.
-	ret = X509_sign(certificate, privateKey, EVP_sha1());
+	ret = X509_sign(certificate, privateKey, EVP_sha256());
 	if (ret == 0)
 	{
 		Error("X509_sign() failed");
@@ -149,8 +225,10 @@ int DTLSConnection::GenerateCertificate()
 error:
 	if (bne)
 		BN_free(bne);
-	if (rsa_key && !privateKey)
+	if (rsa_key)
 		RSA_free(rsa_key);
+	if (ec_key)
+		EC_KEY_free(ec_key);
 	if (privateKey)
 	{
 		EVP_PKEY_free(privateKey); // NOTE: This also frees the RSA key.
@@ -229,8 +307,18 @@ int DTLSConnection::Initialize()
 	// Enable ECDH ciphers.
 	SSL_CTX_set_ecdh_auto(ssl_ctx, 1);
 
-	// Don't use session cache.
-	SSL_CTX_set_session_cache_mode(ssl_ctx, SSL_SESS_CACHE_OFF);
+	if (resumption)
+	{
+		// Cache sessions and issue tickets so reconnecting peers can do an abbreviated handshake.
+		// Client sessions are stored by remote fingerprint on DTLSConnection::StoreSession().
+		SSL_CTX_set_session_cache_mode(ssl_ctx, SSL_SESS_CACHE_SERVER);
+		// Needed to resume sessions when peer certificate is verified
+		SSL_CTX_set_session_id_context(ssl_ctx, (const BYTE*)"medooze", 7);
+	} else {
+		// Don't use session cache.
+		SSL_CTX_set_session_cache_mode(ssl_ctx, SSL_SESS_CACHE_OFF);
+		SSL_CTX_set_options(ssl_ctx, SSL_OP_NO_TICKET);
+	}
 
 	// Set look ahead
 	// See -> https://bugs.debian.org/cgi-bin/bugreport.cgi?bug=775502
@@ -244,8 +332,8 @@ int DTLSConnection::Initialize()
 
 	// Set SSL info callback.
 	SSL_CTX_set_info_callback(ssl_ctx, [](const SSL* ssl, int where, int ret) {
-		DTLSConnection *conn = (DTLSConnection*)SSL_get_ex_data(ssl, 0);
-		conn->onSSLInfo(where, ret);
+		DTLSConnection::State *state = (DTLSConnection::State*)SSL_get_ex_data(ssl, 0);
+		state->onSSLInfo(where, ret);
 	});
 
 	// Try to use GCM suite
@@ -278,6 +366,7 @@ int DTLSConnection::Initialize()
 		return Error("-DTLSConnection::Initialize() | Invalid cipher specified in cipher list '%s' for DTLS-SRTP\n",cipher.c_str());
 	
 	// Fill the DTLSConnection::availableHashes vector.
+	DTLSConnection::availableHashes.clear();
 	DTLSConnection::availableHashes.push_back(SHA1);
 	DTLSConnection::availableHashes.push_back(SHA224);
 	DTLSConnection::availableHashes.push_back(SHA256);
@@ -327,7 +416,18 @@ int DTLSConnection::Initialize()
 		// Store in the map.
 		DTLSConnection::localFingerPrints[hash] = std::string(hex_fingerprint);
 		
-		Debug("-LocalFingerprint %d %s\n",hash, DTLSConnection::localFingerPrints[hash].c_str());
+		Debug("-LocalFingerprint %d %s\n",hash, hex_fingerprint);
+	}
+
+	// Start handshake threads, so they don't block the media loops
+	for (size_t i = workers.size(); i < numWorkers; i++)
+	{
+		auto worker = std::make_unique<EventLoop>();
+		//Start it without socket
+		if (!worker->Start())
+			return Error("-DTLSConnection::Initialize() | Could not start handshake worker\n");
+		//Add it
+		workers.push_back(std::move(worker));
 	}
 
 	// OK, we have DTLS.
@@ -350,42 +450,89 @@ int DTLSConnection::Terminate()
 	if (ssl_ctx)
 		SSL_CTX_free(ssl_ctx);
 	
+	//Free cached client sessions
+	{
+		std::lock_guard<std::mutex> lock(sessionsMutex);
+		for (auto& entry : sessions)
+			SSL_SESSION_free(entry.second);
+		sessions.clear();
+	}
+	
+	//Stop handshake threads
+	for (auto& worker : workers)
+		worker->Stop();
+	workers.clear();
+	
 	//Reset values
 	privateKey = nullptr;
 	certificate = nullptr;
 	ssl_ctx = nullptr;
+	hasDTLS = false;
+	localFingerPrints.clear();
 	
 	//All done
 	return 1;
 }
 
-std::string DTLSConnection::GetCertificateFingerPrint(Hash hash)
+const std::string& DTLSConnection::GetCertificateFingerPrint(Hash hash)
 {
-	return DTLSConnection::localFingerPrints[hash];
+	static const std::string empty;
+	//Computed once on Initialize, don't insert on lookup as it is called from any thread
+	auto it = DTLSConnection::localFingerPrints.find(hash);
+	//If not found
+	if (it==DTLSConnection::localFingerPrints.end())
+		return empty;
+	//Return cached one
+	return it->second;
 }
 
 
 DTLSConnection::DTLSConnection(Listener& listener,TimeService& timeService,datachannels::Transport& sctp) :
 	listener(listener),
 	timeService(timeService),
+	worker(GetWorker(timeService)),
+	offload(&worker!=&timeService),
 	sctp(sctp),
 	inited(false)
 {
 	//Set default values
 	rekey		  	     = 0;
 	setup			     = SETUP_PASSIVE;
+	remoteHash		     = UNKNOWN_HASH;
+	remoteFingerprintSize	     = 0;
+	//Reset remote fingerprint
+	memset(remoteFingerprint,0,EVP_MAX_MD_SIZE);
+}
+
+DTLSConnection::~DTLSConnection()
+{
+	End();
+}
+
+DTLSConnection::State::State(Listener& listener,TimeService& timeService,TimeService& worker,datachannels::Transport& sctp) :
+	listener(listener),
+	timeService(timeService),
+	worker(worker),
+	sctp(sctp),
+	offload(&worker!=&timeService),
+	ended(false)
+{
+	//Set default values
+	setup			     = SETUP_PASSIVE;
 	connection		     = CONNECTION_NEW;
 	ssl			     = NULL;		// SSL session 
 	read_bio		     = NULL;		// Memory buffer for reading 
 	write_bio		     = NULL;		// Memory buffer for writing 
 	remoteHash		     = UNKNOWN_HASH;
+	remoteFingerprintSize	     = 0;
 	//Reset remote fingerprint
 	memset(remoteFingerprint,0,EVP_MAX_MD_SIZE);
 }
 
-DTLSConnection::~DTLSConnection()
+DTLSConnection::State::~State()
 {
-	End();
+	//In case it was not released
+	Release();
 }
 
 void DTLSConnection::SetSRTPProtectionProfiles(const std::string& profiles)
@@ -396,6 +543,39 @@ void DTLSConnection::SetSRTPProtectionProfiles(const std::string& profiles)
 }
 
 int DTLSConnection::Init()
+{
+	//Create new session with current remote parameters
+	auto state = std::make_shared<State>(listener,timeService,worker,sctp);
+	state->setup			= setup;
+	state->remoteHash		= remoteHash;
+	state->remoteFingerprintSize	= remoteFingerprintSize;
+	memcpy(state->remoteFingerprint,remoteFingerprint,EVP_MAX_MD_SIZE);
+
+	//Now we are ready to read and write DTLS packets, first ones are sent while starting the handshake
+	this->state = state;
+	inited = true;
+
+	int ret = 0;
+	//If running on same loop
+	if (!offload)
+		ret = state->InitSSL(profiles);
+	else
+		//Create ssl session on the handshake thread
+		worker.Sync([&](...){
+			ret = state->InitSSL(profiles);
+		});
+
+	//Check
+	if (!ret)
+	{
+		inited = false;
+		this->state.reset();
+	}
+
+	return ret;
+}
+
+int DTLSConnection::State::InitSSL(const std::string& profiles)
 {
 	Log(">DTLSConnection::Init()\n");
 
@@ -449,6 +629,8 @@ int DTLSConnection::Init()
 		case SETUP_ACTPASS:
 			Debug("-DTLSConnection::Init() | we are SETUP_ACTIVE\n");
 			SSL_set_connect_state(ssl);
+			//Try to resume previous session with same peer
+			RestoreSession();
 			break;
 		case SETUP_PASSIVE:
 			Debug("-DTLSConnection::Init() | we are SETUP_PASSIVE\n");
@@ -456,28 +638,28 @@ int DTLSConnection::Init()
 			break;
 		case SETUP_HOLDCONN:
 		default:
+			SSL_free(ssl);
+			ssl = nullptr;
 			return Error("-DTLSConnection::Init() | we are hold conn!");
 	}
 	
 	//New connection
 	connection = CONNECTION_NEW;
 	
-	//Now we are ready to read and write DTLS packets.
-	inited = true;
-	
 	//Start handshake
 	SSL_do_handshake(ssl);
 	
-	//Start timeout
-	timeout = timeService.CreateTimer(0ms, [this](...){
+	//Start timeout, don't keep the session alive from it
+	timeout = worker.CreateTimer(0ms, [self = weak_from_this()](...){
 		//UltraDebug("-DTLSConnection::Timeout()\n");
+		auto state = self.lock();
 		//Check if still inited
-		if (inited)
+		if (state && !state->ended)
 		{
 			//Run timeut
-			DTLSv1_handle_timeout(ssl);
+			DTLSv1_handle_timeout(state->ssl);
 			//Check if there is any pending data
-			CheckPending();
+			state->CheckPending();
 		}
 	});
 
@@ -485,25 +667,10 @@ int DTLSConnection::Init()
 	timeout->SetName("DTLSConnection - timeout");
 	
 	//Start sctp transport
-	sctp.OnPendingData([this](...){
-		//UltraDebug("-sctp::OnPendingData() [ssl:%p]\n",ssl);
-
-		if (ssl)
-		{
-			BYTE msg[MTU];
-			size_t len;
-			//Read from sctp transport
-			while((len = sctp.ReadPacket(msg,MTU)))
-			{
-				UltraDebug("-sctp::OnPendingData() [len:%d]\n",len);
-				DumpAsC(msg,len);
-				//Write it to the ssl context
-				SSL_write(ssl,msg,len);
-			}
-			
-			//Check if there is any pending data
-			CheckPending();
-		}
+	sctp.OnPendingData([self = weak_from_this()](...){
+		//Check if still inited
+		if (auto state = self.lock())
+			state->OnSCTPPendingData();
 	});
 
 	Log("<DTLSConnection::Init()\n");
@@ -511,6 +678,49 @@ int DTLSConnection::Init()
 	return 1;
 }
 
+void DTLSConnection::State::OnSCTPPendingData()
+{
+	//UltraDebug("-sctp::OnPendingData() [ssl:%p]\n",ssl);
+
+	//Check we are still inited
+	if (ended)
+		return;
+
+	BYTE msg[MTU];
+	size_t len;
+
+	//If ssl is processed on the handshake thread
+	if (offload)
+	{
+		std::vector<std::vector<BYTE>> msgs;
+		//Read from sctp transport on this thread
+		while((len = sctp.ReadPacket(msg,MTU)))
+			msgs.emplace_back(msg,msg+len);
+		//Write them to the ssl context on the handshake thread
+		worker.Async([state = shared_from_this(),msgs = std::move(msgs)](...){
+			//Check we are still inited
+			if (state->ended || !state->ssl)
+				return;
+			for (const auto& msg : msgs)
+				SSL_write(state->ssl,msg.data(),msg.size());
+			//Check if there is any pending data
+			state->CheckPending();
+		});
+	} else if (ssl) {
+		//Read from sctp transport
+		while((len = sctp.ReadPacket(msg,MTU)))
+		{
+			UltraDebug("-sctp::OnPendingData() [len:%d]\n",len);
+			DumpAsC(msg,len);
+			//Write it to the ssl context
+			SSL_write(ssl,msg,len);
+		}
+		
+		//Check if there is any pending data
+		CheckPending();
+	}
+}
+
 void DTLSConnection::End()
 {
 	Log("-DTLSConnection::End()\n");
@@ -518,38 +728,66 @@ void DTLSConnection::End()
 	if (!inited)
 		return;
 
-	// NOTE: Don't use BIO_free() for write_bio and read_bio as they are
-	// automatically freed by SSL_free().
-	
 	//Not inited anymore
 	inited = false;
+
+	//Take the session, tasks queued on the handshake thread keep it alive until they are run
+	auto state = std::move(this->state);
+
+	//Don't process queued packets nor fire pending events
+	state->ended = true;
 	
 	//Cancel dtls timeout
-	if (timeout) timeout->Cancel();
+	if (state->timeout) state->timeout->Cancel();
+
+	//Free it on the handshake thread after any queued packet, without waiting for them
+	if (offload)
+		worker.Async([state](...){
+			state->Release();
+		});
+	else
+		state->Release();
+}
 
-	if (ssl) 
+void DTLSConnection::State::Release()
+{
+	// NOTE: Don't use BIO_free() for write_bio and read_bio as they are
+	// automatically freed by SSL_free().
+	if (ssl)
 	{
+		//Peers just go away, so mark it as shutdown or OpenSSL will invalidate the session for resumption
+		if (SSL_is_init_finished(ssl))
+			SSL_set_shutdown(ssl, SSL_SENT_SHUTDOWN | SSL_RECEIVED_SHUTDOWN);
 		SSL_free(ssl);
 		ssl = NULL;
 		read_bio = NULL;
 		write_bio = NULL;		
 	}
+
+	//Drop timer
+	timeout.reset();
 	
+	//Drop pending datagrams
+	std::lock_guard<std::mutex> lock(pendingMutex);
+	pending.clear();
 }
 
 void DTLSConnection::Reset()
 {
 	Log("-DTLSConnection::Reset()\n");
 
-	//Run in event loop thread
-	timeService.Async([this](...){
+	if (!inited)
+		return;
+
+	//Run in handshake thread
+	worker.Async([state = state](...){
 		// If the SSL session is not yet finalized don't bother resetting
-		if (!SSL_is_init_finished(ssl))
+		if (state->ended || !SSL_is_init_finished(state->ssl))
 			return;
 
-		SSL_shutdown(ssl);
+		SSL_shutdown(state->ssl);
 
-		connection = CONNECTION_NEW;
+		state->connection = CONNECTION_NEW;
 	});
 }
 
@@ -586,25 +824,36 @@ void DTLSConnection::SetRemoteSetup(Setup remote)
 	}
 
 	// If the setup state did not change we go on as if nothing happened 
-	if (old == setup || !ssl)
+	if (old == setup || !inited)
 		return;
 
-	switch (setup)
-	{
-		case SETUP_ACTIVE:
-			Debug("-DTLSConnection::SetRemoteSetup() | we are SETUP_ACTIVE\n");
-			SSL_set_connect_state(ssl);
-			break;
-		case SETUP_PASSIVE:
-			Debug("-DTLSConnection::SetRemoteSetup() | we are SETUP_PASSIVE\n");
-			SSL_set_accept_state(ssl);
-			break;
-		case SETUP_HOLDCONN:
-		default:
+	//Change it on the handshake thread, after any queued packet
+	auto change = [state = state,setup = setup](...){
+		if (state->ended || !state->ssl)
 			return;
-	}
 
-	return;
+		switch (setup)
+		{
+			case SETUP_ACTIVE:
+				Debug("-DTLSConnection::SetRemoteSetup() | we are SETUP_ACTIVE\n");
+				SSL_set_connect_state(state->ssl);
+				break;
+			case SETUP_PASSIVE:
+				Debug("-DTLSConnection::SetRemoteSetup() | we are SETUP_PASSIVE\n");
+				SSL_set_accept_state(state->ssl);
+				break;
+			case SETUP_HOLDCONN:
+			default:
+				return;
+		}
+		//Keys are assigned depending on it
+		state->setup = setup;
+	};
+
+	if (offload)
+		worker.Async(change);
+	else
+		change();
 }
 
 void DTLSConnection::SetRemoteFingerprint(Hash hash, const char *fingerprint)
@@ -621,7 +870,14 @@ void DTLSConnection::SetRemoteFingerprint(Hash hash, const char *fingerprint)
 	int pos = 0;
 
 	while ((value = strsep(&str, ":")) && (pos != (EVP_MAX_MD_SIZE - 1)))
-		sscanf(value, "%02x", (unsigned int*)&remoteFingerprint[pos++]);
+	{
+		unsigned int byte = 0;
+		sscanf(value, "%02x", &byte);
+		remoteFingerprint[pos++] = byte;
+	}
+
+	//Store length
+	remoteFingerprintSize = pos;
 
 	free(tmp);
 }
@@ -636,14 +892,31 @@ int DTLSConnection::Read(BYTE* data,DWORD size)
 	if (! inited)
 		return Error("-DTLSConnection::Read() | SSL not yet ready\n");
 
-	if (BIO_ctrl_pending(write_bio))
-		return BIO_read(write_bio, data, size);
+	//If processed on the handshake thread
+	if (offload)
+	{
+		std::lock_guard<std::mutex> lock(state->pendingMutex);
+		//Check if we have any datagram
+		if (state->pending.empty())
+			return 0;
+		//Get first one
+		auto& datagram = state->pending.front();
+		DWORD len = std::min<DWORD>(datagram.size(),size);
+		//Copy it
+		memcpy(data,datagram.data(),len);
+		//Remove it
+		state->pending.pop_front();
+		return len;
+	}
+
+	if (BIO_ctrl_pending(state->write_bio))
+		return BIO_read(state->write_bio, data, size);
 
 	return 0;
 }
 
 inline
-void DTLSConnection::onSSLInfo(int where, int ret)
+void DTLSConnection::State::onSSLInfo(int where, int ret)
 {
 	UltraDebug("-DTLSConnection::onSSLInfo() | SSL status: %s [where:%d, ret:%d] | handshake done: %s\n",  SSL_state_string_long(this->ssl),where, ret, SSL_is_init_finished(this->ssl) ? "yes" : "no");
 
@@ -659,7 +932,10 @@ void DTLSConnection::onSSLInfo(int where, int ret)
 		// Use the keying material to set up key/salt information 
 		if (!SetupSRTP())
 			//Error
-			listener.onDTLSSetupError();
+			Dispatch([this](){ listener.onDTLSSetupError(); });
+		else if (!SSL_is_server(ssl))
+			//Keep session for resuming next time
+			StoreSession();
 	}
 
 	//Check pending data for writing
@@ -668,22 +944,25 @@ void DTLSConnection::onSSLInfo(int where, int ret)
 
 int DTLSConnection::Renegotiate()
 {
-	//Run in event loop thread
-	timeService.Async([this](...){
-		if (ssl)
-		{
+	if (!inited)
+		return 0;
 
-			SSL_renegotiate(ssl);
-			SSL_do_handshake(ssl);
+	//Run in handshake thread
+	worker.Async([state = state](...){
+		if (!state->ended && state->ssl)
+		{
 
-			rekeyid = -1;
+			SSL_renegotiate(state->ssl);
+			SSL_do_handshake(state->ssl);
 		}
 	}).wait();
+
+	rekeyid = -1;
 	
 	return 1;
 }
 
-int DTLSConnection::SetupSRTP()
+int DTLSConnection::State::SetupSRTP()
 {
 	if (! DTLSConnection::hasDTLS)
 		return Error("-DTLSConnection::SetupSRTP() | no DTLS\n");
@@ -783,7 +1062,9 @@ int DTLSConnection::SetupSRTP()
 	memcpy(remoteMasterKey+keysalt.first	,remoteSalt	,keysalt.second);
 
 	//Fire event
-	listener.onDTLSSetup(suite,localMasterKey,total,remoteMasterKey,total);
+	Dispatch([this,suite,local = std::vector<BYTE>(localMasterKey,localMasterKey+total),remote = std::vector<BYTE>(remoteMasterKey,remoteMasterKey+total)]() mutable {
+		listener.onDTLSSetup(suite,local.data(),local.size(),remote.data(),remote.size());
+	});
 
 	return 1;
 }
@@ -798,6 +1079,23 @@ int DTLSConnection::Write(const BYTE *buffer, DWORD size)
 	if (!inited) 
 		return Error("-DTLSConnection::Write() | SSL not yet ready\n");
 
+	//If running on same loop
+	if (!offload)
+		return state->Process(buffer,size);
+
+	//Process a copy on the handshake thread
+	worker.Async([state = state,data = std::vector<BYTE>(buffer,buffer+size)](...){
+		//Check we have not been ended meanwhile
+		if (!state->ended)
+			state->Process(data.data(),data.size());
+	});
+
+	//Queued
+	return 1;
+}
+
+int DTLSConnection::State::Process(const BYTE *buffer, DWORD size)
+{
 	BIO_write(read_bio, buffer, size);
 	
 	//Check pending dtls data for sending
@@ -817,8 +1115,13 @@ int DTLSConnection::Write(const BYTE *buffer, DWORD size)
 	//DumpAsC(msg,len);
 	Debug("-sctp of len %d\n",len);
 	if (len) DumpAsC(msg,len);
-	//Pass data to sctp
-	if (len && !sctp.WritePacket(msg,len))
+	//Pass data to sctp on the owner loop
+	if (len && offload)
+		Dispatch([this,data = std::vector<BYTE>(msg,msg+len)]() mutable {
+			if (!sctp.WritePacket(data.data(),data.size()))
+				Error("sctp parse error\n");
+		});
+	else if (len && !sctp.WritePacket(msg,len))
 		return Error("sctp parse error");
 
 	// Check if the peer sent close alert or a fatal error happened.
@@ -827,7 +1130,7 @@ int DTLSConnection::Write(const BYTE *buffer, DWORD size)
 		Debug("-DTLSConnection::Write() | SSL_RECEIVED_SHUTDOWN on instance '%p', resetting SSL\n", this);
 		SSL_clear(ssl);
 		//Fire eventº
-		listener.onDTLSShutdown();
+		Dispatch([this](){ listener.onDTLSShutdown(); });
 		return 0;
 	}
 	
@@ -835,15 +1138,115 @@ int DTLSConnection::Write(const BYTE *buffer, DWORD size)
 	return 1;
 }
 
-void DTLSConnection::CheckPending()
+void DTLSConnection::State::CheckPending()
 {
 	//UltraDebug("-DTLSConnection::CheckPending()\n");
 	//Check if there is any pending 
 	if (BIO_ctrl_pending(write_bio))
-		listener.onDTLSPendingData();
+	{
+		//If running on the owner loop
+		if (!offload)
+		{
+			listener.onDTLSPendingData();
+		} else {
+			std::lock_guard<std::mutex> lock(pendingMutex);
+			BYTE msg[MTU];
+			int len;
+			//Move datagrams out of the bio so they can be read from the owner loop
+			while ((len = BIO_read(write_bio, msg, MTU))>0)
+				pending.emplace_back(msg,msg+len);
+			//Send them from the owner loop
+			Dispatch([this](){ listener.onDTLSPendingData(); });
+		}
+	}
 	//Reschedule timer
 	timeval tv = {};
 	if (timeout && DTLSv1_get_timeout(ssl, &tv))
 		timeout->Again(std::chrono::milliseconds(getTime(tv)/1000));
 }
 
+void DTLSConnection::State::Dispatch(std::function<void(void)> func)
+{
+	//If running on the owner loop
+	if (!offload)
+		return func();
+
+	//Run it on the owner loop unless we are ended before
+	timeService.Async([state = shared_from_this(),func = std::move(func)](...){
+		if (!state->ended)
+			func();
+	});
+}
+
+std::string DTLSConnection::State::GetSessionKey() const
+{
+	//Sessions can only be reused with the same peer certificate
+	if (!remoteFingerprintSize)
+		return std::string();
+	//Hash and fingerprint
+	std::string key(1,(char)remoteHash);
+	key.append((const char*)remoteFingerprint,remoteFingerprintSize);
+	return key;
+}
+
+void DTLSConnection::State::RestoreSession()
+{
+	//Check if enabled
+	if (!resumption)
+		return;
+
+	//Get key
+	auto key = GetSessionKey();
+	if (key.empty())
+		return;
+
+	std::lock_guard<std::mutex> lock(sessionsMutex);
+	//Find previous session
+	auto it = sessions.find(key);
+	if (it==sessions.end())
+		return;
+
+	//Resume it, if it is expired a full handshake will be done instead
+	if (!SSL_set_session(ssl, it->second))
+		Debug("-DTLSConnection::RestoreSession() | could not set session\n");
+	else
+		Debug("-DTLSConnection::RestoreSession() | resuming session\n");
+}
+
+void DTLSConnection::State::StoreSession()
+{
+	//Check if enabled
+	if (!resumption)
+		return;
+
+	//Get key
+	auto key = GetSessionKey();
+	if (key.empty())
+		return;
+
+	//Get session with ticket if any
+	SSL_SESSION* session = SSL_get1_session(ssl);
+	if (!session)
+		return;
+
+	std::lock_guard<std::mutex> lock(sessionsMutex);
+	//Find previous session
+	auto it = sessions.find(key);
+	if (it!=sessions.end())
+	{
+		//Replace it
+		SSL_SESSION_free(it->second);
+		it->second = session;
+		return;
+	}
+
+	//Don't grow unbounded
+	if (sessions.size()>=MaxSessions)
+	{
+		SSL_SESSION_free(sessions.begin()->second);
+		sessions.erase(sessions.begin());
+	}
+
+	//Store new one
+	sessions[key] = session;
+}
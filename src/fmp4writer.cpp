@@ -0,0 +1,836 @@
+#include "log.h"
+#include "tools.h"
+#include "fmp4writer.h"
+#include "h264/h264.h"
+#include "bitstream.h"
+#include "opus/opusconfig.h"
+#include <algorithm>
+
+//Fragments are cut anyway after this many fragment durations if there is no key frame
+static const DWORD MaxFragmentDurations = 4;
+
+/********************************
+ * Box serialization helper, box sizes are patched when the box is ended
+ ********************************/
+class BoxWriter
+{
+public:
+	BoxWriter(std::vector<BYTE>& buffer) : buffer(buffer) {}
+
+	void Begin(const char* type)
+	{
+		//Store box start
+		boxes.push_back(buffer.size());
+		//Size is set on End()
+		Set4(0);
+		Set(type,4);
+	}
+	void BeginFull(const char* type,BYTE version,DWORD flags)
+	{
+		Begin(type);
+		Set4(((DWORD)version)<<24 | (flags & 0xFFFFFF));
+	}
+	void End()
+	{
+		//Get start
+		size_t start = boxes.back();
+		boxes.pop_back();
+		//Set box size
+		set4(buffer.data(),start,buffer.size()-start);
+	}
+
+	void Set1(BYTE val)			{ buffer.push_back(val);				}
+	void Set2(DWORD val)			{ Set1(val>>8); Set1(val);				}
+	void Set4(DWORD val)			{ Set2(val>>16); Set2(val);				}
+	void Set8(QWORD val)			{ Set4(val>>32); Set4(val);				}
+	void Set(const BYTE* data,size_t size)	{ buffer.insert(buffer.end(),data,data+size);		}
+	void Set(const char* data,size_t size)	{ Set((const BYTE*)data,size);				}
+	void Zero(size_t size)			{ buffer.insert(buffer.end(),size,0);			}
+	size_t GetPos() const			{ return buffer.size();					}
+private:
+	std::vector<BYTE>& buffer;
+	std::vector<size_t> boxes;
+};
+
+static void WriteMatrix(BoxWriter& box)
+{
+	//Unity matrix
+	box.Set4(0x00010000); box.Set4(0); box.Set4(0);
+	box.Set4(0); box.Set4(0x00010000); box.Set4(0);
+	box.Set4(0); box.Set4(0); box.Set4(0x40000000);
+}
+
+FMP4Writer::FMP4Writer(std::chrono::milliseconds fragmentDuration) :
+	fragmentDuration(fragmentDuration)
+{
+}
+
+FMP4Writer::~FMP4Writer()
+{
+	//Close if still opened
+	if (opened)
+		Close();
+}
+
+bool FMP4Writer::Open(const char* filename)
+{
+	Log("-FMP4Writer::Open() [file:%s,fragment:%lldms]\n",filename,fragmentDuration.count());
+
+	//Check not opened
+	if (opened)
+		return Error("-FMP4Writer::Open() already opened\n");
+
+	//Create write behind file
+	auto file = std::make_shared<MP4FileWriter>();
+
+	//Store it
+	std::atomic_store(&this->file,file);
+
+	//Open it
+	if (!file->Open(filename))
+		//Error
+		return Error("-FMP4Writer::Open() could not open file\n");
+
+	//Opened, init segment will be written with the first fragment
+	opened = true;
+	initWritten = false;
+
+	//Done
+	return true;
+}
+
+bool FMP4Writer::Rotate(const char* filename)
+{
+	Log("-FMP4Writer::Rotate() [file:%s]\n",filename);
+
+	//Check opened
+	if (!opened)
+		return Error("-FMP4Writer::Rotate() not opened\n");
+
+	//Switch on next cut point so new file starts with a key frame
+	pendingRotation = filename;
+
+	//If nothing is buffered switch now
+	if (!HasSamples())
+		return SwitchFile();
+
+	//Done
+	return true;
+}
+
+bool FMP4Writer::Close()
+{
+	Log("-FMP4Writer::Close()\n");
+
+	//Check opened
+	if (!opened)
+		return false;
+
+	//Write last fragment
+	bool ok = Flush();
+
+	//Close file
+	if (!file->Close())
+		ok = false;
+
+	//Not opened anymore
+	opened = false;
+	pendingRotation.clear();
+
+	//Done
+	return ok;
+}
+
+DWORD FMP4Writer::AddAudioTrack(AudioCodec::Type codec,DWORD rate)
+{
+	//Check codec
+	if (codec!=AudioCodec::OPUS)
+		return Error("-FMP4Writer::AddAudioTrack() codec not supported [codec:%s]\n",AudioCodec::GetNameFor(codec));
+
+	//Create new track
+	Track track;
+	track.id	= tracks.size()+1;
+	track.type	= MediaFrame::Audio;
+	track.codec	= codec;
+	track.rate	= rate;
+	//Add it
+	tracks.push_back(std::move(track));
+
+	//Return id
+	return tracks.back().id;
+}
+
+DWORD FMP4Writer::AddVideoTrack(VideoCodec::Type codec,DWORD rate,DWORD width,DWORD height)
+{
+	//Check codec
+	if (codec!=VideoCodec::H264 && codec!=VideoCodec::VP8 && codec!=VideoCodec::VP9)
+		return Error("-FMP4Writer::AddVideoTrack() codec not supported [codec:%s]\n",VideoCodec::GetNameFor(codec));
+
+	//Create new track
+	Track track;
+	track.id	= tracks.size()+1;
+	track.type	= MediaFrame::Video;
+	track.codec	= codec;
+	track.rate	= rate;
+	track.width	= width;
+	track.height	= height;
+	//Add it
+	tracks.push_back(std::move(track));
+
+	//Return id
+	return tracks.back().id;
+}
+
+void FMP4Writer::SetH264SequenceParameterSet(DWORD trackId,const BYTE* nal,DWORD size)
+{
+	//Check track
+	if (!trackId || trackId>tracks.size() || !size)
+		return;
+
+	Track& track = tracks[trackId-1];
+
+	//Store it
+	track.sps.assign(nal,nal+size);
+
+	//Get dimensions if not known
+	if (!track.width || !track.height)
+	{
+		H264SeqParameterSet sps;
+		//Decode SPS skipping nal header
+		if (sps.Decode(nal+1,size-1))
+		{
+			track.width  = sps.GetWidth();
+			track.height = sps.GetHeight();
+		}
+	}
+}
+
+void FMP4Writer::SetH264PictureParameterSet(DWORD trackId,const BYTE* nal,DWORD size)
+{
+	//Check track
+	if (!trackId || trackId>tracks.size() || !size)
+		return;
+
+	//Store it
+	tracks[trackId-1].pps.assign(nal,nal+size);
+}
+
+bool FMP4Writer::WriteSample(DWORD trackId,const BYTE* data,DWORD size,DWORD duration,bool isSync)
+{
+	//Check
+	if (!opened || !trackId || trackId>tracks.size())
+		return false;
+
+	Track& track = tracks[trackId-1];
+
+	//Tracks created after the init segment will be available after next rotation
+	if (initWritten && !track.inInit)
+		return false;
+
+	//Get codec configuration for the init segment
+	if (!initWritten)
+		UpdateCodecConfig(track,data,size,isSync);
+
+	//Check if current fragment has to be written before this sample
+	if (IsCutPoint(track,isSync) && !Flush())
+		return false;
+
+	//Append sample
+	track.samples.push_back({size,duration,isSync});
+	track.data.insert(track.data.end(),data,data+size);
+	track.duration += duration;
+
+	//Done
+	return true;
+}
+
+size_t FMP4Writer::GetBufferedSize() const
+{
+	size_t size = 0;
+	//Sum all data pending
+	for (const auto& track : tracks)
+		size += track.data.size();
+	return size;
+}
+
+MP4FileWriter::Stats FMP4Writer::GetStats()
+{
+	//Get a reference to current file
+	auto file = std::atomic_load(&this->file);
+	//Get its stats
+	return file ? file->GetStats() : MP4FileWriter::Stats{};
+}
+
+bool FMP4Writer::HasSamples() const
+{
+	//Check any track has samples
+	for (const auto& track : tracks)
+		if (!track.samples.empty())
+			return true;
+	return false;
+}
+
+void FMP4Writer::ClearSamples()
+{
+	//Drop samples of current fragment
+	for (auto& track : tracks)
+	{
+		track.duration = 0;
+		track.samples.clear();
+		track.data.clear();
+	}
+}
+
+void FMP4Writer::UpdateCodecConfig(Track& track,const BYTE* data,DWORD size,bool isSync)
+{
+	//Check size
+	if (!size)
+		return;
+
+	//Opus
+	if (track.type==MediaFrame::Audio)
+	{
+		//Get stereo flag from TOC
+		auto [mode, bandwidth, frameSize, stereo, codeNumber] = OpusTOC::TOC(data[0]);
+		//Stereo if any packet is
+		if (stereo)
+			track.channels = 2;
+		return;
+	}
+
+	//VP8 key frame header
+	if (track.codec==VideoCodec::VP8 && size>=10 && !(data[0] & 0x01) && data[3]==0x9d && data[4]==0x01 && data[5]==0x2a)
+	{
+		//Version is the profile
+		track.profile = (data[0]>>1) & 0x07;
+		//Get dimensions if not known
+		if (!track.width || !track.height)
+		{
+			track.width  = (data[6] | ((DWORD)data[7])<<8) & 0x3FFF;
+			track.height = (data[8] | ((DWORD)data[9])<<8) & 0x3FFF;
+		}
+	}
+	//VP9 key frame uncompressed header
+	else if (track.codec==VideoCodec::VP9 && isSync && size>=10)
+	{
+		BitReader r(data,size);
+		//Frame marker
+		if (r.Get(2)!=2)
+			return;
+		BYTE profile = r.Get(1);
+		profile |= r.Get(1)<<1;
+		if (profile==3)
+			r.Skip(1);
+		//Skip show existing frames and non key frames
+		if (r.Get(1) || r.Get(1))
+			return;
+		//Show frame and error resilient mode
+		r.Skip(2);
+		//Sync code
+		if (r.Get(24)!=0x498342)
+			return;
+		//Color config
+		BYTE bitDepth = profile>=2 ? (r.Get(1) ? 12 : 10) : 8;
+		BYTE colorSpace = r.Get(3);
+		bool fullRange = true;
+		BYTE subsamplingX = 0;
+		BYTE subsamplingY = 0;
+		//Not sRGB
+		if (colorSpace!=7)
+		{
+			fullRange = r.Get(1);
+			if (profile==1 || profile==3)
+			{
+				subsamplingX = r.Get(1);
+				subsamplingY = r.Get(1);
+				r.Skip(1);
+			} else {
+				subsamplingX = subsamplingY = 1;
+			}
+		} else if (profile==1 || profile==3) {
+			r.Skip(1);
+		}
+		DWORD width  = r.Get(16)+1;
+		DWORD height = r.Get(16)+1;
+		//Check we had enough data
+		if (r.Error())
+			return;
+
+		//Color space to ISO/IEC 23001-8 code points
+		static const BYTE primaries[8] = {2,6,1,6,7,9,2,1};
+		static const BYTE transfer[8]  = {2,6,1,6,7,14,2,13};
+		static const BYTE matrix[8]    = {2,6,1,6,7,9,2,0};
+
+		track.profile			= profile;
+		track.bitDepth			= bitDepth;
+		track.fullRange			= fullRange;
+		track.chromaSubsampling		= subsamplingX ? (subsamplingY ? 1 : 2) : 3;
+		track.colorPrimaries		= primaries[colorSpace];
+		track.transferCharacteristics	= transfer[colorSpace];
+		track.matrixCoefficients	= matrix[colorSpace];
+		//Get dimensions if not known
+		if (!track.width || !track.height)
+		{
+			track.width  = width;
+			track.height = height;
+		}
+	} else {
+		return;
+	}
+
+	//Level by picture size, as level limits on rates can't be known in advance
+	static const std::pair<DWORD,BYTE> levels[] = {
+		{36864,10},{73728,11},{122880,20},{245760,21},{552960,30},
+		{983040,31},{2228224,40},{8912896,50},{35651584,60}
+	};
+	track.level = 0;
+	for (const auto& [samples,level] : levels)
+	{
+		if (track.width*track.height<=samples)
+		{
+			track.level = level;
+			break;
+		}
+	}
+}
+
+bool FMP4Writer::IsReady() const
+{
+	//H264 tracks need parameter sets before writing the init segment
+	for (const auto& track : tracks)
+		if (track.codec==VideoCodec::H264 && track.type==MediaFrame::Video && (track.sps.empty() || track.pps.empty()))
+			return false;
+	return true;
+}
+
+bool FMP4Writer::IsCutPoint(const Track& track,bool isSync) const
+{
+	//Nothing to write yet
+	if (!HasSamples())
+		return false;
+
+	bool hasVideo = false;
+	uint64_t elapsed = 0;
+
+	//Get fragment duration so far
+	for (const auto& candidate : tracks)
+	{
+		//Only tracks that are going to be written
+		if (initWritten && !candidate.inInit)
+			continue;
+		//Check if there is video
+		hasVideo |= candidate.type==MediaFrame::Video;
+		//Get max duration in ms
+		if (candidate.rate)
+			elapsed = std::max<uint64_t>(elapsed,candidate.duration*1000/candidate.rate);
+	}
+
+	//Too long without a key frame, cut anyway to keep memory bounded, Flush() drops the samples if parameter sets are still missing
+	if (elapsed>=(uint64_t)fragmentDuration.count()*MaxFragmentDurations)
+		return true;
+
+	//Wait for H264 parameter sets before writing the init segment
+	if (!initWritten && !IsReady())
+		return false;
+
+	//If there is video, fragments must start with a key frame
+	if (hasVideo && !(track.type==MediaFrame::Video && isSync))
+		return false;
+
+	//Cut if we have to rotate or fragment is long enough
+	return !pendingRotation.empty() || elapsed>=(uint64_t)fragmentDuration.count();
+}
+
+bool FMP4Writer::Flush()
+{
+	bool ok = true;
+
+	//Init segment can't be written without H264 parameter sets, samples are not decodable anyway
+	if (HasSamples() && !initWritten && !IsReady())
+	{
+		Warning("-FMP4Writer::Flush() dropping fragment, no H264 parameter sets yet\n");
+		//Drop them
+		ClearSamples();
+	}
+
+	//If we have samples
+	if (HasSamples())
+	{
+		//Write init segment first
+		if (!initWritten)
+			ok = WriteInit();
+		//Write fragment
+		if (ok)
+			ok = WriteFragment();
+	}
+
+	//Check if we have to start a new file
+	if (ok && !pendingRotation.empty())
+		ok = SwitchFile();
+
+	return ok;
+}
+
+bool FMP4Writer::SwitchFile()
+{
+	//Get new file name
+	std::string filename = pendingRotation;
+	pendingRotation.clear();
+
+	//Close current one
+	if (opened && !file->Close())
+		Error("-FMP4Writer::SwitchFile() error closing previous file\n");
+	opened = false;
+
+	//Open new one, init segment will include all known tracks
+	return Open(filename.c_str());
+}
+
+bool FMP4Writer::WriteInit()
+{
+	std::vector<BYTE> buffer;
+	BoxWriter box(buffer);
+
+	//All current tracks go to the init segment
+	for (auto& track : tracks)
+		track.inInit = true;
+
+	//File type
+	box.Begin("ftyp");
+	box.Set("iso6",4);	//major brand
+	box.Set4(0);		//minor version
+	box.Set("iso6",4);
+	box.Set("cmfc",4);
+	box.Set("mp41",4);
+	box.End();
+
+	box.Begin("moov");
+
+	//Movie header
+	box.BeginFull("mvhd",0,0);
+	box.Set4(0);			//creation time
+	box.Set4(0);			//modification time
+	box.Set4(1000);			//timescale
+	box.Set4(0);			//duration, unknown as it is fragmented
+	box.Set4(0x00010000);		//rate
+	box.Set2(0x0100);		//volume
+	box.Zero(2+4*2);		//reserved
+	WriteMatrix(box);
+	box.Zero(6*4);			//pre defined
+	box.Set4(tracks.size()+1);	//next track id
+	box.End();
+
+	//Tracks
+	for (const auto& track : tracks)
+		WriteTrack(buffer,track);
+
+	//Movie extends, samples are in fragments
+	box.Begin("mvex");
+	for (const auto& track : tracks)
+	{
+		box.BeginFull("trex",0,0);
+		box.Set4(track.id);
+		box.Set4(1);		//default sample description index
+		box.Set4(0);		//default sample duration
+		box.Set4(0);		//default sample size
+		box.Set4(0);		//default sample flags
+		box.End();
+	}
+	box.End();
+
+	box.End();
+
+	//Written
+	initWritten = true;
+
+	//Write it
+	return file->Write(buffer.data(),buffer.size());
+}
+
+void FMP4Writer::WriteTrack(std::vector<BYTE>& buffer,const Track& track)
+{
+	BoxWriter box(buffer);
+	bool isVideo = track.type==MediaFrame::Video;
+
+	box.Begin("trak");
+
+	//Track header, enabled and in movie
+	box.BeginFull("tkhd",0,0x03);
+	box.Set4(0);			//creation time
+	box.Set4(0);			//modification time
+	box.Set4(track.id);
+	box.Set4(0);			//reserved
+	box.Set4(0);			//duration
+	box.Zero(2*4);			//reserved
+	box.Set2(0);			//layer
+	box.Set2(0);			//alternate group
+	box.Set2(isVideo ? 0 : 0x0100);	//volume
+	box.Set2(0);			//reserved
+	WriteMatrix(box);
+	box.Set4(track.width<<16);
+	box.Set4(track.height<<16);
+	box.End();
+
+	box.Begin("mdia");
+
+	//Media header
+	box.BeginFull("mdhd",0,0);
+	box.Set4(0);			//creation time
+	box.Set4(0);			//modification time
+	box.Set4(track.rate);		//timescale
+	box.Set4(0);			//duration
+	box.Set2(0x55C4);		//language "und"
+	box.Set2(0);			//pre defined
+	box.End();
+
+	//Handler
+	box.BeginFull("hdlr",0,0);
+	box.Set4(0);			//pre defined
+	box.Set(isVideo ? "vide" : "soun",4);
+	box.Zero(3*4);			//reserved
+	box.Set(isVideo ? "VideoHandler" : "SoundHandler",13);
+	box.End();
+
+	box.Begin("minf");
+
+	//Media header
+	if (isVideo)
+	{
+		box.BeginFull("vmhd",0,1);
+		box.Set2(0);		//graphics mode
+		box.Zero(3*2);		//op color
+		box.End();
+	} else {
+		box.BeginFull("smhd",0,0);
+		box.Set2(0);		//balance
+		box.Set2(0);		//reserved
+		box.End();
+	}
+
+	//Data is in this file
+	box.Begin("dinf");
+	box.BeginFull("dref",0,0);
+	box.Set4(1);
+	box.BeginFull("url ",0,1);
+	box.End();
+	box.End();
+	box.End();
+
+	//Empty sample table, only with sample description
+	box.Begin("stbl");
+	box.BeginFull("stsd",0,0);
+	box.Set4(1);
+	WriteSampleEntry(buffer,track);
+	box.End();
+	box.BeginFull("stts",0,0);
+	box.Set4(0);
+	box.End();
+	box.BeginFull("stsc",0,0);
+	box.Set4(0);
+	box.End();
+	box.BeginFull("stsz",0,0);
+	box.Set4(0);
+	box.Set4(0);
+	box.End();
+	box.BeginFull("stco",0,0);
+	box.Set4(0);
+	box.End();
+	box.End();
+
+	box.End(); //minf
+	box.End(); //mdia
+	box.End(); //trak
+}
+
+void FMP4Writer::WriteSampleEntry(std::vector<BYTE>& buffer,const Track& track)
+{
+	BoxWriter box(buffer);
+
+	//Audio
+	if (track.type==MediaFrame::Audio)
+	{
+		box.Begin("Opus");
+		box.Zero(6);			//reserved
+		box.Set2(1);			//data reference index
+		box.Zero(2*4);			//reserved
+		box.Set2(track.channels);	//channel count
+		box.Set2(16);			//sample size
+		box.Set2(0);			//pre defined
+		box.Set2(0);			//reserved
+		box.Set4(48000<<16);		//sample rate
+		//Opus specific box
+		box.Begin("dOps");
+		box.Set1(0);			//version
+		box.Set1(track.channels);	//output channel count
+		box.Set2(312);			//pre skip, libopus lookahead as it is not signaled on rtp
+		box.Set4(track.rate);		//input sample rate
+		box.Set2(0);			//output gain
+		box.Set1(0);			//channel mapping family
+		box.End();
+		box.End();
+		return;
+	}
+
+	//Video
+	switch (track.codec)
+	{
+		case VideoCodec::H264:
+			box.Begin("avc1");
+			break;
+		case VideoCodec::VP8:
+			box.Begin("vp08");
+			break;
+		default:
+			box.Begin("vp09");
+			break;
+	}
+	box.Zero(6);			//reserved
+	box.Set2(1);			//data reference index
+	box.Set2(0);			//pre defined
+	box.Set2(0);			//reserved
+	box.Zero(3*4);			//pre defined
+	box.Set2(track.width);
+	box.Set2(track.height);
+	box.Set4(0x00480000);		//horizontal resolution 72dpi
+	box.Set4(0x00480000);		//vertical resolution 72dpi
+	box.Set4(0);			//reserved
+	box.Set2(1);			//frame count
+	box.Zero(32);			//compressor name
+	box.Set2(0x0018);		//depth
+	box.Set2(0xFFFF);		//pre defined
+
+	if (track.codec==VideoCodec::H264)
+	{
+		//AVC decoder configuration record
+		box.Begin("avcC");
+		box.Set1(1);						//version
+		box.Set1(track.sps.size()>3 ? track.sps[1] : 0x42);	//profile
+		box.Set1(track.sps.size()>3 ? track.sps[2] : 0xC0);	//profile compatibility
+		box.Set1(track.sps.size()>3 ? track.sps[3] : 0x1F);	//level
+		box.Set1(0xFF);						//4 bytes nal length
+		box.Set1(0xE0 | (track.sps.empty() ? 0 : 1));		//num of sps
+		if (!track.sps.empty())
+		{
+			box.Set2(track.sps.size());
+			box.Set(track.sps.data(),track.sps.size());
+		}
+		box.Set1(track.pps.empty() ? 0 : 1);			//num of pps
+		if (!track.pps.empty())
+		{
+			box.Set2(track.pps.size());
+			box.Set(track.pps.data(),track.pps.size());
+		}
+		box.End();
+	} else {
+		//VP codec configuration
+		box.BeginFull("vpcC",1,0);
+		box.Set1(track.profile);
+		box.Set1(track.level);
+		box.Set1(track.bitDepth<<4 | track.chromaSubsampling<<1 | track.fullRange);
+		box.Set1(track.colorPrimaries);
+		box.Set1(track.transferCharacteristics);
+		box.Set1(track.matrixCoefficients);
+		box.Set2(0);			//no codec initialization data
+		box.End();
+	}
+
+	box.End();
+}
+
+bool FMP4Writer::WriteFragment()
+{
+	std::vector<BYTE> buffer;
+	BoxWriter box(buffer);
+	std::vector<size_t> dataOffsets;
+
+	//One more fragment
+	sequence++;
+
+	//Movie fragment
+	box.Begin("moof");
+
+	box.BeginFull("mfhd",0,0);
+	box.Set4(sequence);
+	box.End();
+
+	for (const auto& track : tracks)
+	{
+		//Skip tracks without samples or not in init segment
+		if (track.samples.empty() || !track.inInit)
+			continue;
+
+		box.Begin("traf");
+
+		//Track fragment header, data offsets are relative to moof
+		box.BeginFull("tfhd",0,0x020000);
+		box.Set4(track.id);
+		box.End();
+
+		//Decode time of first sample
+		box.BeginFull("tfdt",1,0);
+		box.Set8(track.decodeTime);
+		box.End();
+
+		//Samples with data offset, duration, size and flags
+		box.BeginFull("trun",0,0x000701);
+		box.Set4(track.samples.size());
+		//Data offset, set later
+		dataOffsets.push_back(box.GetPos());
+		box.Set4(0);
+		for (const auto& sample : track.samples)
+		{
+			box.Set4(sample.duration);
+			box.Set4(sample.size);
+			//Key frames do not depend on others, the rest are non sync samples
+			box.Set4(sample.isSync || track.type!=MediaFrame::Video ? 0x02000000 : 0x01010000);
+		}
+		box.End();
+
+		box.End();
+	}
+
+	box.End();
+
+	//Data is written after mdat header
+	size_t offset = buffer.size()+8;
+	size_t mdatSize = 8;
+	size_t i = 0;
+
+	//Set data offsets
+	for (const auto& track : tracks)
+	{
+		//Skip tracks without samples or not in init segment
+		if (track.samples.empty() || !track.inInit)
+			continue;
+		//Patch it
+		set4(buffer.data(),dataOffsets[i++],offset);
+		//Next
+		offset   += track.data.size();
+		mdatSize += track.data.size();
+	}
+
+	//Media data header
+	BYTE mdat[8];
+	set4(mdat,0,mdatSize);
+	memcpy(mdat+4,"mdat",4);
+
+	//Write moof and mdat header
+	bool ok = file->Write(buffer.data(),buffer.size()) && file->Write(mdat,sizeof(mdat));
+
+	//Write data and reset tracks
+	for (auto& track : tracks)
+	{
+		//Write samples of this fragment
+		if (ok && track.inInit && !track.data.empty())
+			ok = file->Write(track.data.data(),track.data.size());
+		//Next decode time
+		track.decodeTime += track.duration;
+		//Empty fragment
+		track.duration = 0;
+		track.samples.clear();
+		track.data.clear();
+	}
+
+	//Done
+	return ok;
+}
@@ -3,6 +3,10 @@
 #include <stdio.h>
 #include <string.h>
 #include "log.h"
+#include <chrono>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 extern "C" {
 #include <libswscale/swscale.h>
 #include <libavcodec/avcodec.h>
@@ -11,80 +15,130 @@ extern "C" {
 #include <libavutil/common.h>
 }
 
+std::mutex		FrameScaler::cacheMutex;
+FrameScaler::Contexts	FrameScaler::cache;
+DWORD			FrameScaler::cacheSize = 32;
+FrameScaler::Counters	FrameScaler::counters;
+bool			FrameScaler::pyramid = false;
+
+//Max pyramid level, 4x decimation
+static const int MaxLevel = 2;
+
+static void CopyPlane(const BYTE* src,int srcLineWidth,BYTE* dst,int dstLineWidth,int width,int height)
+{
+	//If both are contiguous
+	if (srcLineWidth==width && dstLineWidth==width)
+		//Copy all at once
+		return (void)memcpy(dst,src,width*height);
+	//Copy each line
+	for (int i=0;i<height;++i)
+		memcpy(dst+dstLineWidth*i,src+srcLineWidth*i,width);
+}
+
 FrameScaler::FrameScaler()
 {
 	// No resize 
 	resizeCtx	= NULL;
+	resizeCopy	= false;
 	resizeWidth	= 0;
 	resizeHeight	= 0;
+	resizeLineWidth	= 0;
 	resizeDstWidth	= 0;
 	resizeDstHeight = 0;
 	resizeDstAdjustedHeight = 0;
 	resizeDstAdjustedWidth  = 0;
 	resizeDstLineWidth = 0;
-
-	//tmp buffer
-	tmpWidth  	= 0;
-	tmpHeight 	= 0;
-	tmpBuffer	= NULL;
-	tmpBufferSize	= 0;
-	tmpY		= NULL;
-	tmpU		= NULL;
-	tmpV		= NULL;
+	resizeKeepAspectRatio = true;
 
 	// Bicubic by default 
 	resizeFlags	= SWS_BICUBIC;
+
+	//Scale from source frame
+	resizeLevel	= 0;
+	levelBuffer	= NULL;
+	levelBufferSize	= 0;
 }
 FrameScaler::~FrameScaler()
 {
-	//Free mem
-	if (tmpBuffer)
-		//free
-		free(tmpBuffer);
-	//If we got a context
-	if (resizeCtx)
-		//Closse context
-		sws_freeContext(resizeCtx);
+	//Give back context to the cache
+	ReleaseContext();
+	//Free decimated frames
+	if (levelBuffer)
+		free(levelBuffer);
 }
 
-int FrameScaler::SetResize(int srcWidth,int srcHeight,int srcLineWidth,int dstWidth,int dstHeight,int dstLineWidth,bool keepAspectRatio)
+void FrameScaler::EnablePyramid(bool enabled)
 {
-	// Check Size
-	if (!srcWidth || !srcHeight || !srcLineWidth || !dstWidth || !dstHeight || !dstLineWidth)
+	//Used on next SetResize
+	pyramid = enabled;
+}
+
+FrameScaler::Pyramid::~Pyramid()
+{
+	//Free decimated frames
+	if (buffer)
+		free(buffer);
+}
+
+void FrameScaler::Pyramid::Build(BYTE *frame,int width,int height,int level)
+{
+	//Size of all levels
+	DWORD needed = GetLevelsSize(width,height,level)+AV_INPUT_BUFFER_PADDING_SIZE;
+	//Check if we need a bigger buffer
+	if (needed>size)
 	{
-		//If we got a context
-		if (resizeCtx)
-			//Closse context
-			sws_freeContext(resizeCtx);
-		// No valid context
-		resizeCtx = NULL;
-		//Exit
-		return 0;
+		//Free previous
+		if (buffer)
+			free(buffer);
+		//Alloc new one
+		buffer = (BYTE*)malloc32(needed);
+		size = needed;
 	}
+	//Planes of the source frame
+	DWORD pixels = width*height;
+	BYTE* src[3] = {frame,frame+pixels,frame+pixels*5/4};
+	//Decimate all levels
+	DecimateLevels(src,width,width,height,level,buffer);
+	//Store what it has been built from
+	this->frame	= frame;
+	this->width	= width;
+	this->height	= height;
+	this->levels	= level;
+}
 
-	// Check if we already have a scaler for this
-	if (resizeCtx && (resizeWidth==srcWidth) && (srcHeight==resizeHeight) && (dstWidth==resizeDstWidth) && (dstHeight==resizeDstHeight))
-		//Done
-		return 1;
-
-	//If we already got a context
-	if (resizeCtx)
-		//Closse context
-		sws_freeContext(resizeCtx);
+DWORD FrameScaler::GetLevelsSize(int width,int height,int level)
+{
+	DWORD size = 0;
+	//Add each level
+	for (int i=1;i<=level;++i)
+		size += (width>>i)*(height>>i)*3/2;
+	return size;
+}
 
-	// Create new context
-	if (!(resizeCtx = sws_alloc_context()))
-		// Exit 
-		return 0;
+void FrameScaler::DecimateLevels(BYTE* src[3],int lineWidth,int width,int height,int level,BYTE* buffer)
+{
+	//For each level
+	for (int i=0;i<level;++i)
+	{
+		//Decimate each plane
+		BYTE* planes[3] = {buffer,buffer+width*height/4,buffer+width*height*5/16};
+		Decimate(src[0],lineWidth  ,width  ,height  ,planes[0],width/2);
+		Decimate(src[1],lineWidth/2,width/2,height/2,planes[1],width/4);
+		Decimate(src[2],lineWidth/2,width/2,height/2,planes[2],width/4);
+		//Next level
+		memcpy(src,planes,sizeof(planes));
+		buffer += width*height*3/8;
+		lineWidth = width/2;
+		width /= 2;
+		height /= 2;
+	}
+}
 
-	// Set values
-	resizeWidth		= srcWidth;
-	resizeHeight		= srcHeight;
-	resizeDstWidth		= dstWidth;
-	resizeDstHeight		= dstHeight;
-	resizeDstLineWidth	= dstLineWidth;
-	resizeDstAdjustedWidth  = dstWidth;
-	resizeDstAdjustedHeight = dstHeight;
+void FrameScaler::GetAdjustedSize(int srcWidth,int srcHeight,int dstWidth,int dstHeight,bool keepAspectRatio,int& width,int& height)
+{
+	//Full destination by default
+	width  = dstWidth;
+	height = dstHeight;
 
 	//Check aspect ratio flag
 	if (keepAspectRatio)
@@ -104,8 +158,8 @@ int FrameScaler::SetResize(int srcWidth,int srcHeight,int srcLineWidth,int dstWi
 			// |       |                   |       |
 			// ------------------------------------
 			//Recaultulate weight
-			resizeDstAdjustedWidth  = dstHeight*srcRatio;
-			resizeDstAdjustedHeight = dstHeight;
+			width  = dstHeight*srcRatio;
+			height = dstHeight;
 		} else if (srcRatio>dstRatio) {
 			//Put horizontal scroll bars
 			// -------------------------------------
@@ -119,173 +173,435 @@ int FrameScaler::SetResize(int srcWidth,int srcHeight,int srcLineWidth,int dstWi
 			// |                                   |
 			// -------------------------------------
 			//Recaultulate weight
-			resizeDstAdjustedWidth  = dstWidth;
-			resizeDstAdjustedHeight = dstWidth/srcRatio;
+			width  = dstWidth;
+			height = dstWidth/srcRatio;
 		}
 	}
-	
+}
+
+int FrameScaler::GetLevel(int srcWidth,int srcHeight,int width,int height)
+{
+	int level = 0;
+	//Pick the smallest decimated frame that is still bigger than the target, only with even planes
+	while (pyramid && level<MaxLevel
+		&& (srcWidth  % (4<<level))==0 && (srcWidth >>(level+1))>=width
+		&& (srcHeight % (4<<level))==0 && (srcHeight>>(level+1))>=height)
+		//Next level
+		level++;
+	return level;
+}
+
+int FrameScaler::GetPyramidLevel(int srcWidth,int srcHeight,int dstWidth,int dstHeight,bool keepAspectRatio)
+{
+	//Check size and if it is just copied
+	if (!srcWidth || !srcHeight || !dstWidth || !dstHeight || (srcWidth==dstWidth && srcHeight==dstHeight))
+		//Not decimated
+		return 0;
+	int width,height;
+	//Get size of the image on the destination
+	GetAdjustedSize(srcWidth,srcHeight,dstWidth,dstHeight,keepAspectRatio,width,height);
+	//Get level for it
+	return GetLevel(srcWidth,srcHeight,width,height);
+}
+
+void FrameScaler::Decimate(const BYTE* src,int srcLineWidth,int width,int height,BYTE* dst,int dstLineWidth)
+{
+	//Destination size
+	int w = width/2;
+	int h = height/2;
+
+	for (int j=0;j<h;++j)
+	{
+		//Get the two source lines and the destination one
+		const BYTE* line1 = src+srcLineWidth*j*2;
+		const BYTE* line2 = line1+srcLineWidth;
+		BYTE* out = dst+dstLineWidth*j;
+		int i = 0;
+#ifdef __SSE2__
+		const __m128i mask = _mm_set1_epi16(0x00FF);
+		const __m128i two  = _mm_set1_epi16(2);
+		//16 destination pixels on each step
+		for (;i+16<=w;i+=16)
+		{
+			__m128i sum[2];
+			for (int k=0;k<2;++k)
+			{
+				__m128i a = _mm_loadu_si128((const __m128i*)(line1+i*2+k*16));
+				__m128i b = _mm_loadu_si128((const __m128i*)(line2+i*2+k*16));
+				//Add even and odd pixels of both lines
+				__m128i x = _mm_add_epi16(_mm_and_si128(a,mask),_mm_srli_epi16(a,8));
+				__m128i y = _mm_add_epi16(_mm_and_si128(b,mask),_mm_srli_epi16(b,8));
+				//Rounded average
+				sum[k] = _mm_srli_epi16(_mm_add_epi16(_mm_add_epi16(x,y),two),2);
+			}
+			_mm_storeu_si128((__m128i*)(out+i),_mm_packus_epi16(sum[0],sum[1]));
+		}
+#endif
+		//Rest of the line
+		for (;i<w;++i)
+			out[i] = (line1[i*2]+line1[i*2+1]+line2[i*2]+line2[i*2+1]+2)>>2;
+	}
+}
+
+void FrameScaler::SetContextCacheSize(DWORD size)
+{
+	//Lock cache
+	std::lock_guard<std::mutex> lock(cacheMutex);
+	//Store new size
+	cacheSize = size;
+	//Free least recently used ones
+	while (cache.size()>cacheSize)
+	{
+		sws_freeContext(cache.back().second);
+		cache.pop_back();
+	}
+}
+
+FrameScaler::Stats FrameScaler::GetStats()
+{
+	Stats copy;
+	//Copy
+	copy.contextRebuilds	= counters.contextRebuilds;
+	copy.contextReuses	= counters.contextReuses;
+	copy.resizes		= counters.resizes;
+	copy.copies		= counters.copies;
+	copy.decimations	= counters.decimations;
+	copy.sharedDecimations	= counters.sharedDecimations;
+	copy.totalResizeTime	= counters.totalResizeTime;
+	{
+		//Lock cache
+		std::lock_guard<std::mutex> lock(cacheMutex);
+		//Get idle ones
+		copy.cachedContexts = cache.size();
+	}
+	//Calculate average
+	if (copy.resizes)
+		copy.avgResizeTime = copy.totalResizeTime/copy.resizes;
+	return copy;
+}
+
+void FrameScaler::ResetStats()
+{
+	//Clean
+	counters.contextRebuilds	= 0;
+	counters.contextReuses		= 0;
+	counters.resizes		= 0;
+	counters.copies			= 0;
+	counters.decimations		= 0;
+	counters.sharedDecimations	= 0;
+	counters.totalResizeTime	= 0;
+}
+
+struct SwsContext* FrameScaler::AcquireContext(const ContextKey& key)
+{
+	{
+		//Lock cache
+		std::lock_guard<std::mutex> lock(cacheMutex);
+		//Look for an idle one
+		for (auto it = cache.begin(); it!=cache.end(); ++it)
+		{
+			if (it->first==key)
+			{
+				//Take it out, so only this scaler uses it
+				struct SwsContext* ctx = it->second;
+				cache.erase(it);
+				counters.contextReuses++;
+				return ctx;
+			}
+		}
+	}
+
+	struct SwsContext* ctx;
+
+	// Create new context
+	if (!(ctx = sws_alloc_context()))
+		// Exit 
+		return NULL;
+
 	// Set property's of context
-	av_opt_set_defaults(resizeCtx);
-	av_opt_set_int(resizeCtx, "srcw",       srcWidth		,AV_OPT_SEARCH_CHILDREN);
-	av_opt_set_int(resizeCtx, "srch",       srcHeight		,AV_OPT_SEARCH_CHILDREN);
-	av_opt_set_int(resizeCtx, "src_format", AV_PIX_FMT_YUV420P	,AV_OPT_SEARCH_CHILDREN);
-	av_opt_set_int(resizeCtx, "dstw",       resizeDstAdjustedWidth	,AV_OPT_SEARCH_CHILDREN);
-	av_opt_set_int(resizeCtx, "dsth",       resizeDstAdjustedHeight	,AV_OPT_SEARCH_CHILDREN);
-	av_opt_set_int(resizeCtx, "dst_format", AV_PIX_FMT_YUV420P	,AV_OPT_SEARCH_CHILDREN);
-	av_opt_set_int(resizeCtx, "sws_flags",  resizeFlags		,AV_OPT_SEARCH_CHILDREN);
+	av_opt_set_defaults(ctx);
+	av_opt_set_int(ctx, "srcw",       std::get<0>(key)	,AV_OPT_SEARCH_CHILDREN);
+	av_opt_set_int(ctx, "srch",       std::get<1>(key)	,AV_OPT_SEARCH_CHILDREN);
+	av_opt_set_int(ctx, "src_format", std::get<4>(key)	,AV_OPT_SEARCH_CHILDREN);
+	av_opt_set_int(ctx, "dstw",       std::get<2>(key)	,AV_OPT_SEARCH_CHILDREN);
+	av_opt_set_int(ctx, "dsth",       std::get<3>(key)	,AV_OPT_SEARCH_CHILDREN);
+	av_opt_set_int(ctx, "dst_format", std::get<4>(key)	,AV_OPT_SEARCH_CHILDREN);
+	av_opt_set_int(ctx, "sws_flags",  std::get<5>(key)	,AV_OPT_SEARCH_CHILDREN);
 	
 	// Init context
-	if (sws_init_context(resizeCtx, NULL, NULL) < 0)
+	if (sws_init_context(ctx, NULL, NULL) < 0)
 	{
 		//Free context
-		sws_freeContext(resizeCtx);
-		//Nullify it
-		resizeCtx = NULL;
+		sws_freeContext(ctx);
 		// Exit 
-		return Error("Couldn't init sws context");
+		return NULL;
 	}
 
-	//to use MM2 we need the width and heinght to be multiple of 32
-	tmpWidth = (resizeDstAdjustedWidth/32 +1)*32;
-	tmpHeight = (resizeDstAdjustedHeight/32 +1)*32;
+	//One more
+	counters.contextRebuilds++;
 
-	//Get tmp buffer size
-	tmpBufferSize = tmpWidth*tmpHeight*3/2+AV_INPUT_BUFFER_PADDING_SIZE+32;
+	return ctx;
+}
 
-	//Check if we had it already
-	if (tmpBuffer)
-		//Free it
-		free(tmpBuffer);
+void FrameScaler::ReleaseContext(const ContextKey& key,struct SwsContext* ctx)
+{
+	//Lock cache
+	std::lock_guard<std::mutex> lock(cacheMutex);
+	//Most recently used
+	cache.emplace_front(key,ctx);
+	//Free least recently used ones
+	while (cache.size()>cacheSize)
+	{
+		sws_freeContext(cache.back().second);
+		cache.pop_back();
+	}
+}
 
-	//Allocate it
-	tmpBuffer = (BYTE*)malloc32(tmpBufferSize);
+void FrameScaler::ReleaseContext()
+{
+	//If we got a context
+	if (resizeCtx)
+		//Put it back on the cache
+		ReleaseContext(resizeKey,resizeCtx);
+	// No valid context
+	resizeCtx = NULL;
+}
+
+int FrameScaler::SetResize(int srcWidth,int srcHeight,int srcLineWidth,int dstWidth,int dstHeight,int dstLineWidth,bool keepAspectRatio)
+{
+	// Check Size
+	if (!srcWidth || !srcHeight || !srcLineWidth || !dstWidth || !dstHeight || !dstLineWidth)
+	{
+		//Give back context
+		ReleaseContext();
+		//Nothing to copy
+		resizeCopy = false;
+		//Exit
+		return 0;
+	}
+
+	// Check if we already have a scaler for this
+	if ((resizeCtx || resizeCopy) && (resizeWidth==srcWidth) && (srcHeight==resizeHeight) && (srcLineWidth==resizeLineWidth) && (dstWidth==resizeDstWidth) && (dstHeight==resizeDstHeight) && (dstLineWidth==resizeDstLineWidth) && (keepAspectRatio==resizeKeepAspectRatio))
+		//Done
+		return 1;
+
+	// Set values
+	resizeWidth		= srcWidth;
+	resizeHeight		= srcHeight;
+	resizeLineWidth		= srcLineWidth;
+	resizeDstWidth		= dstWidth;
+	resizeDstHeight		= dstHeight;
+	resizeDstLineWidth	= dstLineWidth;
+	resizeDstAdjustedWidth  = dstWidth;
+	resizeDstAdjustedHeight = dstHeight;
+	resizeKeepAspectRatio	= keepAspectRatio;
 
 	// Set values for line sizes
 	resizeSrc[0] = srcLineWidth;
 	resizeSrc[1] = srcLineWidth/2;
 	resizeSrc[2] = srcLineWidth/2;
-	/*resizeDst[0] = dstLineWidth;
+	resizeDst[0] = dstLineWidth;
 	resizeDst[1] = dstLineWidth/2;
-	resizeDst[2] = dstLineWidth/2;*/
-	resizeDst[0] = tmpWidth;
-	resizeDst[1] = tmpWidth/2;
-	resizeDst[2] = tmpWidth/2;
+	resizeDst[2] = dstLineWidth/2;
+
+	//From source frame
+	resizeLevel = 0;
+
+	//If size does not change
+	if (srcWidth==dstWidth && srcHeight==dstHeight)
+	{
+		//No need for scaling context
+		ReleaseContext();
+		//Just copy the planes
+		resizeCopy = true;
+		//Done
+		return 1;
+	}
+
+	//Need scaling
+	resizeCopy = false;
 
-	//Get tmp planes
-	tmpY = ALIGNTO32(tmpBuffer);
-	tmpU = tmpY+tmpWidth*tmpHeight;
-	tmpV = tmpU+tmpWidth*tmpHeight/4;
+	//Get size of the image on the destination
+	GetAdjustedSize(srcWidth,srcHeight,dstWidth,dstHeight,keepAspectRatio,resizeDstAdjustedWidth,resizeDstAdjustedHeight);
+
+	//Get decimated frame to scale from
+	resizeLevel = GetLevel(srcWidth,srcHeight,resizeDstAdjustedWidth,resizeDstAdjustedHeight);
+
+	//Size of the frame we scale from
+	int levelWidth  = srcWidth  >> resizeLevel;
+	int levelHeight = srcHeight >> resizeLevel;
+
+	//If we are using a decimated frame
+	if (resizeLevel)
+	{
+		//Size of all levels
+		DWORD size = GetLevelsSize(srcWidth,srcHeight,resizeLevel);
+		//Check if we need a bigger buffer
+		if (size+AV_INPUT_BUFFER_PADDING_SIZE>levelBufferSize)
+		{
+			//Free previous
+			if (levelBuffer)
+				free(levelBuffer);
+			//Alloc new one
+			levelBufferSize = size+AV_INPUT_BUFFER_PADDING_SIZE;
+			levelBuffer = (BYTE*)malloc32(levelBufferSize);
+		}
+		//Scaling is done from contiguous decimated planes
+		resizeSrc[0] = levelWidth;
+		resizeSrc[1] = levelWidth/2;
+		resizeSrc[2] = levelWidth/2;
+	}
+
+	//Get key for the context
+	ContextKey key(levelWidth,levelHeight,resizeDstAdjustedWidth,resizeDstAdjustedHeight,AV_PIX_FMT_YUV420P,resizeFlags);
+
+	//Check if current one is still valid
+	if (resizeCtx && resizeKey==key)
+		//Done
+		return 1;
+
+	//Give back previous one
+	ReleaseContext();
+
+	//Get one from the cache or create a new one
+	if (!(resizeCtx = AcquireContext(key)))
+		// Exit 
+		return Error("Couldn't init sws context");
+
+	//Store key
+	resizeKey = key;
 
 	// exit 
 	return 1;
 }
 
-int FrameScaler::Resize(BYTE *srcY,BYTE *srcU,BYTE *srcV,BYTE *dstY, BYTE *dstU, BYTE *dstV)
+int FrameScaler::Resize(BYTE *srcY,BYTE *srcU,BYTE *srcV,BYTE *dstY, BYTE *dstU, BYTE *dstV,const Pyramid* pyramid)
 {
-	// src & dst 
-	BYTE* src[3];
-	BYTE* dst[3];
-
 	// Check 
-	if (!resizeCtx)
+	if (!resizeCtx && !resizeCopy)
 		//Error
 		return 0;
 
-	// Set pointers 
-	src[0] = srcY;
-	src[1] = srcU;
-	src[2] = srcV;
-	/*dst[0] = dstY;
-	dst[1] = dstU;
-	dst[2] = dstV;*/
-	dst[0] = tmpY;
-	dst[1] = tmpU;
-	dst[2] = tmpV;
-
-	// Resize frame 
-	sws_scale(resizeCtx, src, resizeSrc, 0, resizeHeight, dst, resizeDst);
-
-	//Get offsets due to vertical lines (mast be even)
-	DWORD x = (resizeDstWidth-resizeDstAdjustedWidth)/2 & ~1;
-	DWORD y = (resizeDstHeight-resizeDstAdjustedHeight)/2 & ~1;
-
-	//Copy to destination
-	for (DWORD i=0;i<resizeDstHeight;++i)
+	//Start measuring
+	auto ini = std::chrono::steady_clock::now();
+
+	if (resizeCopy)
 	{
-		//Check for horizontal bars
-		if ((i<y) || (i>=(resizeDstAdjustedHeight+y)))
+		//Same size, copy planes only
+		CopyPlane(srcY,resizeSrc[0],dstY,resizeDst[0],resizeWidth,resizeHeight);
+		CopyPlane(srcU,resizeSrc[1],dstU,resizeDst[1],resizeWidth/2,resizeHeight/2);
+		CopyPlane(srcV,resizeSrc[2],dstV,resizeDst[2],resizeWidth/2,resizeHeight/2);
+	} else {
+		//Get offsets due to vertical lines (mast be even)
+		DWORD x = (resizeDstWidth-resizeDstAdjustedWidth)/2 & ~1;
+		DWORD y = (resizeDstHeight-resizeDstAdjustedHeight)/2 & ~1;
+
+		//Fill bars with black
+		for (DWORD i=0;i<(DWORD)resizeDstHeight;++i)
 		{
-			//Fill with black
-			memset(dstY+resizeDstLineWidth*i,0,resizeDstWidth);
-		} else {
-			//Check for vertical bars
-			if (x>0)
+			//Check for horizontal bars
+			if ((i<y) || (i>=(resizeDstAdjustedHeight+y)))
 			{
-				//Set them
+				//Fill with black
+				memset(dstY+resizeDstLineWidth*i,0,resizeDstWidth);
+			} else if (resizeDstAdjustedWidth<resizeDstWidth) {
+				//Set vertical bars
 				memset(dstY+resizeDstLineWidth*i,0,x);
 				memset(dstY+resizeDstLineWidth*i+x+resizeDstAdjustedWidth,0,resizeDstWidth-resizeDstAdjustedWidth-x);
 			}
-			//Copy image in the middle
-			memcpy(dstY+resizeDstLineWidth*i+x,tmpY+tmpWidth*(i-y),resizeDstAdjustedWidth);
 		}
-	}
 
-	//Half them
-	x = x/2;
-	y = y/2;
+		//Chroma size, rounded up as done by the scaler
+		DWORD w = (resizeDstAdjustedWidth+1)/2;
+		DWORD h = (resizeDstAdjustedHeight+1)/2;
 
-	//Copy to destination
-	for (int i=0;i<resizeDstHeight/2;++i)
-	{
-		//Check for horizontal bars
-		if ((i<y) || (i>=(resizeDstAdjustedHeight/2+y)))
+		//Fill bars with black
+		for (DWORD i=0;i<(DWORD)resizeDstHeight/2;++i)
 		{
-			//Fill with black
-			memset(dstU+resizeDstLineWidth*i/2,(BYTE)-128,resizeDstWidth/2);
-			memset(dstV+resizeDstLineWidth*i/2,(BYTE)-128,resizeDstWidth/2);
-		} else {
-			//Check for vertical bars
-			if (x>0)
+			//Check for horizontal bars
+			if ((i<y/2) || (i>=(h+y/2)))
 			{
-				//Set them
-				memset(dstU+resizeDstLineWidth*i/2,(BYTE)-128,x);
-				memset(dstV+resizeDstLineWidth*i/2,(BYTE)-128,x);
-				memset(dstU+resizeDstLineWidth*i/2+x+resizeDstAdjustedWidth/2,(BYTE)-128,resizeDstWidth/2-resizeDstAdjustedWidth/2-x);
-				memset(dstV+resizeDstLineWidth*i/2+x+resizeDstAdjustedWidth/2,(BYTE)-128,resizeDstWidth/2-resizeDstAdjustedWidth/2-x);
+				//Fill with black
+				memset(dstU+resizeDst[1]*i,(BYTE)-128,resizeDstWidth/2);
+				memset(dstV+resizeDst[2]*i,(BYTE)-128,resizeDstWidth/2);
+			} else if (w<(DWORD)resizeDstWidth/2) {
+				//Set vertical bars
+				memset(dstU+resizeDst[1]*i,(BYTE)-128,x/2);
+				memset(dstV+resizeDst[2]*i,(BYTE)-128,x/2);
+				memset(dstU+resizeDst[1]*i+x/2+w,(BYTE)-128,resizeDstWidth/2-w-x/2);
+				memset(dstV+resizeDst[2]*i+x/2+w,(BYTE)-128,resizeDstWidth/2-w-x/2);
 			}
-			//Copy
-			memcpy(dstU+resizeDstLineWidth*i/2+x,tmpU+tmpWidth*(i-y)/2,resizeDstAdjustedWidth/2);
-			memcpy(dstV+resizeDstLineWidth*i/2+x,tmpV+tmpWidth*(i-y)/2,resizeDstAdjustedWidth/2);
 		}
+
+		// Set pointers 
+		BYTE* src[3] = {srcY,srcU,srcV};
+		int height = resizeHeight>>resizeLevel;
+
+		//Check if the level has been already decimated from this frame
+		if (IsShared(pyramid,srcY))
+		{
+			//Get level planes
+			BYTE* level = pyramid->buffer+GetLevelsSize(resizeWidth,resizeHeight,resizeLevel-1);
+			DWORD pixels = (resizeWidth>>resizeLevel)*height;
+			src[0] = level;
+			src[1] = level+pixels;
+			src[2] = level+pixels*5/4;
+		} else {
+			//Decimate down to the level used for scaling
+			DecimateLevels(src,resizeLineWidth,resizeWidth,resizeHeight,resizeLevel,levelBuffer);
+		}
+		//Scale directly into the image rectangle on the destination
+		BYTE* dst[3] = {
+			dstY+resizeDst[0]*y+x,
+			dstU+resizeDst[1]*y/2+x/2,
+			dstV+resizeDst[2]*y/2+x/2
+		};
+
+		// Resize frame 
+		sws_scale(resizeCtx, src, resizeSrc, 0, height, dst, resizeDst);
 	}
 
+	//Get elapsed time
+	QWORD elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now()-ini).count();
+
+	//Update stats
+	counters.resizes++;
+	counters.totalResizeTime += elapsed;
+	if (resizeCopy)
+		counters.copies++;
+	if (resizeLevel)
+		counters.decimations++;
+	if (!resizeCopy && IsShared(pyramid,srcY))
+		counters.sharedDecimations++;
+
 	//Done
 	return 1;
 } 
 
-int FrameScaler::Resize(BYTE *src,DWORD srcWidth,DWORD srcHeight,BYTE *dst,DWORD dstWidth,DWORD dstHeight, bool keepAspectRatio)
+bool FrameScaler::IsShared(const Pyramid* pyramid,const BYTE* srcY) const
 {
-	//If sizes are the inot same
-	if (srcWidth!=dstWidth ||srcHeight!=dstHeight)
-	{
-		//Set resize with full image
-		SetResize(srcWidth,srcHeight,srcWidth,dstWidth,dstHeight,dstWidth,keepAspectRatio);
-		//Calc pointers
-		DWORD srcPixels = srcWidth*srcHeight;
-		BYTE *srcY = src;
-		BYTE *srcU = src+srcPixels;
-		BYTE *srcV = src+srcPixels*5/4;
-		DWORD dstPixels = dstWidth*dstHeight;
-		BYTE *dstY = dst;
-		BYTE *dstU = dst+dstPixels;
-		BYTE *dstV = dst+dstPixels*5/4;
-
-		//Resize imgae
-		Resize(srcY,srcU,srcV,dstY,dstU,dstV);
-	} else {
-		//Just copy
-		memcpy(dst,src,srcWidth*srcHeight*3/2);
-	}
+	//Built from the source frame with the levels needed
+	return resizeLevel && pyramid && pyramid->frame==srcY && pyramid->levels>=resizeLevel
+		&& pyramid->width==resizeWidth && pyramid->height==resizeHeight && pyramid->width==resizeLineWidth;
+}
 
-	return 1;
+int FrameScaler::Resize(BYTE *src,DWORD srcWidth,DWORD srcHeight,BYTE *dst,DWORD dstWidth,DWORD dstHeight, bool keepAspectRatio,const Pyramid* pyramid)
+{
+	//Set resize with full image, if sizes are the same it will just copy
+	if (!SetResize(srcWidth,srcHeight,srcWidth,dstWidth,dstHeight,dstWidth,keepAspectRatio))
+		//Error
+		return 0;
+
+	//Calc pointers
+	DWORD srcPixels = srcWidth*srcHeight;
+	BYTE *srcY = src;
+	BYTE *srcU = src+srcPixels;
+	BYTE *srcV = src+srcPixels*5/4;
+	DWORD dstPixels = dstWidth*dstHeight;
+	BYTE *dstY = dst;
+	BYTE *dstU = dst+dstPixels;
+	BYTE *dstV = dst+dstPixels*5/4;
+
+	//Resize imgae
+	return Resize(srcY,srcU,srcV,dstY,dstU,dstV,pyramid);
 }
@@ -25,26 +25,21 @@ void H264LayerSelector::SelectSpatialLayer(BYTE id)
 
 bool H264LayerSelector::Select(const RTPPacket::shared& packet,bool &mark)
 {
-	//We only siwtch on SPS/PPS not intra, as we need the SPS/PPS
-	bool isIntra = false;
-	//Get payload
-	DWORD payloadLen = packet->GetMediaLength();
-	const BYTE* payload = packet->GetMediaData();
+	//Get layer classification done on reception
+	auto layer = packet->layerClassification ? packet->layerClassification : Classify(packet);
 	
-	//Check we have data
-	if (!payloadLen)
+	//Check we have a supported payload
+	if (!layer)
 		//Nothing
 		return false;
 	
+	//We only siwtch on SPS/PPS not intra, as we need the SPS/PPS
+	bool isIntra = layer->keyFrame;
+	
 	//If packet has frame markings
 	if (packet->HasFrameMarkings())
 	{
-		//Get it from frame markings
-		const auto& fm = packet->GetFrameMarks();
-		//Check if it is intra
-		isIntra = fm.startOfFrame && fm.independent;
-		
-		Log("-H264LayerSelector::Select() | [ssrc:%u,isIntra:%d,s:%d,independet:%d,baseLayerSync:%d,tid:%d]\n",packet->GetSSRC(),isIntra,fm.startOfFrame,fm.independent,fm.baseLayerSync,fm.temporalLayerId);
+		UltraDebug("-H264LayerSelector::Select() | [ssrc:%u,isIntra:%d,s:%d,baseLayerSync:%d,tid:%d]\n",packet->GetSSRC(),isIntra,layer->startOfLayerFrame,layer->switchingPoint,layer->temporalLayerId);
 		
 		//Store current temporal id
 		BYTE currentTemporalLayerId = temporalLayerId;
@@ -53,11 +48,11 @@ bool H264LayerSelector::Select(const RTPPacket::shared& packet,bool &mark)
 		if (nextTemporalLayerId>temporalLayerId)
 		{
 			//Check if we can upscale and it is the start of the layer and it is a layer higher than current
-			if (fm.baseLayerSync && fm.startOfFrame && fm.temporalLayerId>currentTemporalLayerId && fm.temporalLayerId<=nextTemporalLayerId)
+			if (layer->switchingPoint && layer->startOfLayerFrame && layer->temporalLayerId>currentTemporalLayerId && layer->temporalLayerId<=nextTemporalLayerId)
 			{
-				UltraDebug("-H264LayerSelector::Select() | Upscaling temporalLayerId [id:%d,current:%d,target:%d]\n",fm.temporalLayerId,currentTemporalLayerId,nextTemporalLayerId);
+				UltraDebug("-H264LayerSelector::Select() | Upscaling temporalLayerId [id:%d,current:%d,target:%d]\n",layer->temporalLayerId,currentTemporalLayerId,nextTemporalLayerId);
 				//Update current layer
-				temporalLayerId = fm.temporalLayerId;
+				temporalLayerId = layer->temporalLayerId;
 				currentTemporalLayerId = temporalLayerId;
 			}
 		//Check if we need to downscale
@@ -72,13 +67,80 @@ bool H264LayerSelector::Select(const RTPPacket::shared& packet,bool &mark)
 		}
 
 		//If it is not valid for the current layer
-		if (currentTemporalLayerId<fm.temporalLayerId)
+		if (currentTemporalLayerId<layer->temporalLayerId)
 		{
-			UltraDebug("-H264LayerSelector::Select() | dropping packet based on temporalLayerId [current:%d,desc:%d,mark:%d]\n",currentTemporalLayerId,fm.temporalLayerId,packet->GetMark());
+			UltraDebug("-H264LayerSelector::Select() | dropping packet based on temporalLayerId [current:%d,desc:%d,mark:%d]\n",currentTemporalLayerId,layer->temporalLayerId,packet->GetMark());
 			//Drop it
 			return false;
 		}
-	} else {	
+	}
+
+	//Debug("-intra:%d\t waitingForIntra:%d\n",isIntra,waitingForIntra);
+	
+	//If we have to wait for first intra
+	if (waitingForIntra)
+	{
+		//If this is not intra
+		if (!isIntra)
+			//Discard
+			return 0;
+		//Stop waiting
+		waitingForIntra = 0;
+	}
+	
+	//RTP mark is unchanged
+	mark = packet->GetMark();
+	
+	//Select
+	return true;
+	
+}
+
+ std::vector<LayerInfo> H264LayerSelector::GetLayerIds(const RTPPacket::shared& packet,const std::optional<LayerClassification>& layer)
+{
+	std::vector<LayerInfo> infos;
+	
+	//Layers are only known from frame markings
+	if (layer && packet->HasFrameMarkings())
+		//Get data from frame marking
+		infos.emplace_back(layer->temporalLayerId, layer->spatialLayerId);
+	
+	//UltraDebug("-VP9LayerSelector::GetLayerIds() | [tid:%u,sid:%u]\n",info.temporalLayerId,info.spatialLayerId);
+	
+	//Return layer infos
+	return infos;
+}
+
+std::optional<LayerClassification> H264LayerSelector::Classify(const RTPPacket::shared& packet)
+{
+	LayerClassification layer;
+	//We only siwtch on SPS/PPS not intra, as we need the SPS/PPS
+	bool isIntra = false;
+	//Get payload
+	DWORD payloadLen = packet->GetMediaLength();
+	const BYTE* payload = packet->GetMediaData();
+	
+	//Check we have data
+	if (!payloadLen)
+		//Nothing
+		return std::nullopt;
+	
+	//If packet has frame markings
+	if (packet->HasFrameMarkings())
+	{
+		//Get it from frame markings
+		const auto& fm = packet->GetFrameMarks();
+		//Set key frame flag
+		packet->SetKeyFrame(fm.independent);
+		//Check if it is intra
+		isIntra = fm.startOfFrame && fm.independent;
+		//Get layer info
+		layer.temporalLayerId	= fm.temporalLayerId;
+		layer.spatialLayerId	= fm.layerId;
+		layer.switchingPoint	= fm.baseLayerSync;
+		layer.startOfLayerFrame	= fm.startOfFrame;
+		layer.endOfLayerFrame	= fm.endOfFrame;
+	} else {
 		/* +---------------+
 		 * |0|1|2|3|4|5|6|7|
 		 * +-+-+-+-+-+-+-+-+
@@ -88,6 +150,22 @@ bool H264LayerSelector::Select(const RTPPacket::shared& packet,bool &mark)
 		 * F must be 0.
 		 */
 		BYTE nal_unit_type = payload[0] & 0x1f;
+		//Type of the first nal, for the key frame flag
+		BYTE firstNalType = nal_unit_type;
+		
+		//FU-A
+		if (nal_unit_type == 28 && payloadLen>2)
+			//Get first nal type
+			firstNalType = payload[1] & 0x1f;
+		//STAP-A
+		else if (nal_unit_type == 25 && payloadLen>3)
+			//Get first nal type
+			firstNalType = payload[3] & 0x1f;
+		
+		//Check for IDR/PPS/SPS nals
+		if (firstNalType==5 || firstNalType==7 || firstNalType==8)
+			//Key frame
+			packet->SetKeyFrame(true);
 
 		//Debug("-H264 [NAL:%d,type:%d]\n", payload[0], nal_unit_type);
 
@@ -98,12 +176,12 @@ bool H264LayerSelector::Select(const RTPPacket::shared& packet,bool &mark)
 			case 30:
 			case 31:
 				/* undefined */
-				return false;
+				return std::nullopt;
 			case 25:
 				/* STAP-B		Single-time aggregation packet		 5.7.1 */
 				/* 2 byte extra header for DON */
 				/** Not supported */
-				return false;
+				return std::nullopt;
 			case 24:
 				/**
 				   Figure 7 presents an example of an RTP packet that contains an STAP-
@@ -184,10 +262,10 @@ bool H264LayerSelector::Select(const RTPPacket::shared& packet,bool &mark)
 				break;
 			case 26:
 				/* MTAP16 Multi-time aggregation packet	5.7.2 */
-				return false;
+				return std::nullopt;
 			case 27:
 				/* MTAP24 Multi-time aggregation packet	5.7.2 */
-				return false;
+				return std::nullopt;
 			case 28:
 			case 29:
 			{
@@ -196,7 +274,7 @@ bool H264LayerSelector::Select(const RTPPacket::shared& packet,bool &mark)
 
 				//Check length
 				if (payloadLen < 2)
-					return false;
+					return std::nullopt;
 
 				/* +---------------+
 				 * |0|1|2|3|4|5|6|7|
@@ -283,71 +361,10 @@ bool H264LayerSelector::Select(const RTPPacket::shared& packet,bool &mark)
 				break;
 			}
 		}
-	} 
-
-	//Debug("-intra:%d\t waitingForIntra:%d\n",isIntra,waitingForIntra);
-	
-	//If we have to wait for first intra
-	if (waitingForIntra)
-	{
-		//If this is not intra
-		if (!isIntra)
-			//Discard
-			return 0;
-		//Stop waiting
-		waitingForIntra = 0;
 	}
 	
-	//RTP mark is unchanged
-	mark = packet->GetMark();
-	
-	//Select
-	return true;
+	//Set intra
+	layer.keyFrame = isIntra;
 	
+	return layer;
 }
-
- std::vector<LayerInfo> H264LayerSelector::GetLayerIds(const RTPPacket::shared& packet)
-{
-	std::vector<LayerInfo> infos;
-	
-	//If packet has frame markings
-	if (packet->HasFrameMarkings())
-	{
-		//Get it from frame markings
-		const auto& fm = packet->GetFrameMarks();
-		//Get data from frame marking
-		infos.emplace_back(fm.temporalLayerId, fm.layerId);
-		//Set key frame flag
-		packet->SetKeyFrame(fm.independent);
-	} else {
-		//Get payload
-		const uint8_t* payload = packet->GetMediaData();
-		uint32_t len = packet->GetMediaLength();
-		//Check size
-		if (len)
-		{
-			//Check if first nal
-			BYTE nalUnitType = payload[0] & 0x1f;
-			
-			//FU-A
-			if (nalUnitType == 28 && len>2)
-				//Get first nal type
-				nalUnitType = payload[1] & 0x1f;
-			//STAP-A
-			else if (nalUnitType == 25 && len>3)
-				//Get first nal type
-				nalUnitType = payload[3] & 0x1f;
-				
-			//Check for IDR/PPS/SPS nals
-			if (nalUnitType==5 || nalUnitType==7 || nalUnitType==8)
-				//Key frame
-				packet->SetKeyFrame(true);
-		}
-	}
-	
-	//UltraDebug("-VP9LayerSelector::GetLayerIds() | [tid:%u,sid:%u]\n",info.temporalLayerId,info.spatialLayerId);
-	
-	//Return layer infos
-	return infos;
-}
-	
@@ -24,7 +24,8 @@ public:
 	const H264SeqParameterSet&	GetSeqParameterSet()		const { return sps; }
 	const H264PictureParameterSet&	GetPictureParameterSet()	const { return pps; }
 	
-	static std::vector<LayerInfo> GetLayerIds(const RTPPacket::shared& packet);
+	static std::vector<LayerInfo> GetLayerIds(const RTPPacket::shared& packet,const std::optional<LayerClassification>& layer);
+	static std::optional<LayerClassification> Classify(const RTPPacket::shared& packet);
 private:
 	bool waitingForIntra;
 	H264SeqParameterSet sps;
@@ -0,0 +1,442 @@
+#include "log.h"
+
+#include <atomic>
+#include <cctype>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace
+{
+
+//Single producer single consumer ring of variable size records, one per logging thread
+struct Ring
+{
+	static constexpr size_t Size		= 128*1024;
+	static constexpr size_t MaxRecordSize	= Size/4;
+	static constexpr DWORD Padding		= 0x80000000;
+
+	std::atomic<QWORD>	head	= {0};
+	std::atomic<QWORD>	tail	= {0};
+	std::atomic<DWORD>	dropped	= {0};
+	std::atomic<bool>	orphan	= {false};
+	pthread_t		thread	= pthread_self();
+	alignas(8) BYTE		buffer[Size];
+};
+
+//Marks the ring as orphan when the thread exits, so the flusher releases it after printing the pending records
+struct ThreadRing
+{
+	~ThreadRing()
+	{
+		if (ring) ring->orphan = true;
+	}
+	Ring* ring = nullptr;
+};
+
+//Rate limiting state of a call site
+struct CallSite
+{
+	std::atomic<const char*>	msg		= {nullptr};
+	std::atomic<QWORD>		second		= {0};
+	std::atomic<DWORD>		count		= {0};
+	std::atomic<DWORD>		suppressed	= {0};
+};
+
+struct AsyncLogger
+{
+	static constexpr size_t CallSites = 1024;
+	static constexpr size_t CallSiteProbes = 16;
+
+	std::mutex			mutex;
+	std::vector<Ring*>		rings;
+	std::mutex			draining;
+	std::vector<std::pair<const Logger::Record*,const Ring*>> records;
+	std::vector<QWORD>		heads;
+	std::string			output;
+	std::mutex			control;
+	std::condition_variable		wait;
+	std::thread			flusher;
+	bool				running = false;
+	bool				registered = false;
+	CallSite			sites[CallSites];
+};
+
+thread_local ThreadRing threadRing;
+
+AsyncLogger& GetAsyncLogger()
+{
+	//Never deleted, threads could still be logging while exiting
+	static AsyncLogger* logger = new AsyncLogger();
+	return *logger;
+}
+
+Ring* GetThreadRing()
+{
+	//If this thread has not logged before
+	if (!threadRing.ring)
+	{
+		AsyncLogger& logger = GetAsyncLogger();
+		//Create new ring
+		threadRing.ring = new Ring();
+		//Add it for the flusher
+		std::lock_guard<std::mutex> lock(logger.mutex);
+		logger.rings.push_back(threadRing.ring);
+	}
+	return threadRing.ring;
+}
+
+template<typename Print>
+void Append(std::string& output,Print&& print)
+{
+	size_t pos = output.size();
+	//Expect it to fit on a line
+	output.resize(pos+256);
+	//Print it, the string has always room for the trailing null
+	int len = print(&output[pos],257);
+	//If it was truncated
+	if (len>256)
+	{
+		//Grow and print again
+		output.resize(pos+len);
+		print(&output[pos],len+1);
+	}
+	//Remove unused space
+	output.resize(pos+std::max(len,0));
+}
+
+void Drain()
+{
+	AsyncLogger& logger = GetAsyncLogger();
+
+	//Only one consumer at a time
+	std::lock_guard<std::mutex> draining(logger.draining);
+
+	std::vector<Ring*> rings;
+	{
+		//Get current rings
+		std::lock_guard<std::mutex> lock(logger.mutex);
+		rings = logger.rings;
+	}
+
+	//Clear previous
+	logger.records.clear();
+	logger.heads.clear();
+	logger.output.clear();
+
+	//Get all pending records
+	for (auto ring : rings)
+	{
+		//Get published records
+		QWORD head = ring->head.load(std::memory_order_acquire);
+		QWORD tail = ring->tail.load(std::memory_order_relaxed);
+		//Read them
+		while (tail<head)
+		{
+			auto record = (const Logger::Record*)(ring->buffer + tail%Ring::Size);
+			//If it is padding at the end of the ring
+			if (record->size & Ring::Padding)
+			{
+				//Skip it
+				tail += record->size & ~Ring::Padding;
+				continue;
+			}
+			//Add record
+			logger.records.emplace_back(record,ring);
+			//Next
+			tail += record->size;
+		}
+		//Store until printed
+		logger.heads.push_back(head);
+
+		//Check if any message has been dropped
+		if (DWORD dropped = ring->dropped.exchange(0))
+		{
+			struct timeval tv;
+			gettimeofday(&tv,NULL);
+			Append(logger.output,[&](char* out,size_t size){
+				return snprintf(out,size,"[0x%lx][%.10ld.%.3ld][LOG]-Logger::Drain() dropped %u messages\n",(long)ring->thread,(long)tv.tv_sec,(long)tv.tv_usec/1000,dropped);
+			});
+		}
+	}
+
+	//Sort them by time, each ring is already in order
+	std::stable_sort(logger.records.begin(),logger.records.end(),[](const auto& a,const auto& b){
+		return timercmp(&a.first->tv,&b.first->tv,<);
+	});
+
+	//Format them
+	for (const auto& [record,ring] : logger.records)
+	{
+		//Print header
+		Append(logger.output,[&](char* out,size_t size){
+			return snprintf(out,size,"[0x%lx][%.10ld.%.3ld][%s]",(long)ring->thread,(long)record->tv.tv_sec,(long)record->tv.tv_usec/1000,record->level);
+		});
+		//Print message
+		Append(logger.output,[&](char* out,size_t size){
+			return record->format(out,size,(const BYTE*)(record+1));
+		});
+	}
+
+	//Write all of them at once
+	if (!logger.output.empty())
+	{
+		fwrite(logger.output.data(),1,logger.output.size(),stdout);
+		fflush(stdout);
+	}
+
+	//Release printed records
+	for (size_t i=0;i<rings.size();++i)
+		rings[i]->tail.store(logger.heads[i],std::memory_order_release);
+
+	//Remove rings of exited threads
+	std::lock_guard<std::mutex> lock(logger.mutex);
+	for (auto it = logger.rings.begin(); it!=logger.rings.end();)
+	{
+		Ring* ring = *it;
+		//If the thread is gone and all has been printed
+		if (ring->orphan && ring->tail==ring->head)
+		{
+			//Delete it
+			delete ring;
+			it = logger.rings.erase(it);
+		} else {
+			++it;
+		}
+	}
+}
+
+}
+
+bool Logger::EnableAsync(bool async)
+{
+	AsyncLogger& logger = GetAsyncLogger();
+
+	std::unique_lock<std::mutex> lock(logger.control);
+
+	//Set it
+	getInstance().async = async;
+
+	//If enabling
+	if (async)
+	{
+		//If not already running
+		if (!logger.running)
+		{
+			//Print pending messages on exit
+			if (!logger.registered)
+				logger.registered = !atexit([](){ Logger::EnableAsync(false); });
+			//Start flusher
+			logger.running = true;
+			logger.flusher = std::thread([&logger](){
+				std::unique_lock<std::mutex> lock(logger.control);
+				//Until stopped
+				while (logger.running)
+				{
+					lock.unlock();
+					//Print pending
+					Drain();
+					lock.lock();
+					//Wait a bit for more
+					logger.wait.wait_for(lock,std::chrono::milliseconds(10),[&logger](){ return !logger.running; });
+				}
+			});
+		}
+	} else if (logger.running) {
+		//Stop flusher
+		logger.running = false;
+		logger.wait.notify_all();
+		lock.unlock();
+		logger.flusher.join();
+		//Print remaining ones
+		Drain();
+	}
+
+	return async;
+}
+
+void Logger::Flush()
+{
+	//Print pending async messages
+	Drain();
+}
+
+bool Logger::Throttle(const char* msg)
+{
+	AsyncLogger& logger = GetAsyncLogger();
+
+	//The pointer to the format string is unique for each call site
+	size_t hash = (uintptr_t)msg%AsyncLogger::CallSites;
+	CallSite* site = nullptr;
+
+	//Find its slot, probing the next ones on collision
+	for (size_t i=0;i<AsyncLogger::CallSiteProbes && !site;++i)
+	{
+		CallSite& probe = logger.sites[(hash+i)%AsyncLogger::CallSites];
+		const char* current = probe.msg.load(std::memory_order_acquire);
+		//If it is free, try to take it, another thread could have taken it for the same call site
+		if (current==msg || (!current && (probe.msg.compare_exchange_strong(current,msg) || current==msg)))
+			//Found
+			site = &probe;
+	}
+
+	//If there is no room for it
+	if (!site)
+		//Do not throttle it
+		return true;
+
+	//Count on one second periods
+	QWORD second = getTimeMS()/1000;
+	QWORD last = site->second.load(std::memory_order_relaxed);
+
+	//If it is the first message of the period
+	if (last!=second && site->second.compare_exchange_strong(last,second))
+	{
+		//Reset counters
+		DWORD suppressed = site->suppressed.exchange(0);
+		site->count = 1;
+		//If we have skipped any
+		if (suppressed)
+			//Let it know
+			Write("LOG",nullptr,true,"-Logger::Throttle() suppressed %u messages like: %s",suppressed,msg);
+		//Allowed
+		return true;
+	}
+
+	//Check limit
+	if (++site->count<=getInstance().rateLimit)
+		//Allowed
+		return true;
+
+	//Skip it
+	site->suppressed++;
+	return false;
+}
+
+bool Logger::IsDeferrable(const char* msg,const LogArgumentKind* kinds,size_t num)
+{
+	size_t arg = 0;
+
+	//Walk the conversions of the format
+	for (const char* p = strchr(msg,'%'); p; p = strchr(p,'%'))
+	{
+		//Skip %
+		++p;
+		//Escaped %
+		if (*p=='%')
+		{
+			++p;
+			continue;
+		}
+		//Skip flags
+		while (*p && strchr("-+ #0'",*p))
+			++p;
+		//Width
+		if (*p=='*')
+		{
+			//Consumes an int
+			++arg;
+			++p;
+		}
+		while (isdigit(*p))
+			++p;
+		//Positional arguments are not tracked
+		if (*p=='$')
+			return false;
+		bool precision = false;
+		//Precision
+		if (*p=='.')
+		{
+			precision = true;
+			++p;
+			if (*p=='*')
+			{
+				//Consumes an int
+				++arg;
+				++p;
+			}
+			while (isdigit(*p))
+				++p;
+		}
+		//Skip length modifiers
+		while (*p && strchr("hlLqjzt",*p))
+			++p;
+		//If there are not enough arguments
+		if (arg>=num)
+			//Let it fail as it would have done when printed
+			return true;
+		//Get conversion kind
+		LogArgumentKind kind = kinds[arg++];
+		//Pointed data is only read when printed as a string, bounded strings may not be null terminated
+		if (*p=='s' && (kind==LogArgumentKind::Pointer || (kind==LogArgumentKind::String && precision)))
+			return false;
+		//Writes on the argument
+		if (*p=='n')
+			return false;
+		//Next
+		if (*p)
+			++p;
+	}
+
+	//All captured by value
+	return true;
+}
+
+Logger::Record* Logger::Reserve(size_t size)
+{
+	Ring* ring = GetThreadRing();
+
+	//Keep records aligned
+	size = (size+7) & ~7;
+
+	//Check it is not too big for the ring
+	if (size>Ring::MaxRecordSize)
+	{
+		//Drop it
+		ring->dropped++;
+		return nullptr;
+	}
+
+	QWORD head = ring->head.load(std::memory_order_relaxed);
+	QWORD tail = ring->tail.load(std::memory_order_acquire);
+	//Get position on buffer
+	size_t pos = head % Ring::Size;
+	//If it doesn't fit until the end of the ring, skip the remaining space
+	size_t padding = Ring::Size-pos<size ? Ring::Size-pos : 0;
+
+	//Check if there is enough free space
+	if (head+padding+size-tail>Ring::Size)
+	{
+		//Never block the calling thread, drop it
+		ring->dropped++;
+		return nullptr;
+	}
+
+	//If it has to be written at the beginning
+	if (padding)
+	{
+		//Mark end of buffer as padding
+		*(DWORD*)(ring->buffer+pos) = padding | Ring::Padding;
+		//Publish it
+		ring->head.store(head+padding,std::memory_order_release);
+		//Start at the beginning
+		pos = 0;
+	}
+
+	//Get record
+	Record* record = (Record*)(ring->buffer+pos);
+	//Set size
+	record->size = size;
+	//Done
+	return record;
+}
+
+void Logger::Commit(Record* record)
+{
+	Ring* ring = threadRing.ring;
+	//Publish record to the flusher
+	ring->head.store(ring->head.load(std::memory_order_relaxed)+record->size,std::memory_order_release);
+}
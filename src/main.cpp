@@ -15,6 +15,7 @@
 #include "CPUMonitor.h"
 #include "EventSource.h"
 #include "eventstreaminghandler.h"
+#include "framescaler.h"
 extern "C" {
 	#include "libavcodec/avcodec.h"
 }
@@ -157,6 +158,13 @@ int main(int argc,char **argv)
 	const char *pidfile = "mcu.pid";
 	const char *crtfile = NULL;
 	const char *keyfile = NULL;
+	bool ecdsa = false;
+	bool dtlsResumption = false;
+	int dtlsWorkers = 0;
+	int mixerWorkers = 0;
+	bool scalerPyramid = false;
+	bool asyncLog = false;
+	int logRateLimit = 0;
     
 	//Get all
 	for(int i=1;i<argc;i++)
@@ -166,17 +174,24 @@ int main(int argc,char **argv)
 		{
 			//Show usage
 			printf("Medooze MCU media mixer version %s %s\r\n",MCUVERSION,MCUDATE);
-			printf("Usage: mcu [-h] [--help] [--mcu-log logfile] [--mcu-pid pidfile] [--http-port port] [--rtmp-port port] [--min-rtp-port port] [--max-rtp-port port] [--vad-period ms]\r\n\r\n"
+			printf("Usage: mcu [-h] [--help] [--mcu-log logfile] [--mcu-pid pidfile] [--mcu-ecdsa] [--dtls-resumption] [--dtls-workers num] [--mixer-workers num] [--scaler-pyramid] [--async-log] [--log-rate-limit num] [--http-port port] [--rtmp-port port] [--min-rtp-port port] [--max-rtp-port port] [--vad-period ms]\r\n\r\n"
 				"Options:\r\n"
 				" -h,--help        Print help\r\n"
 				" -f               Run as daemon in safe mode\r\n"
 				" -d               Enable debug logging\r\n"
 				" -dd              Enable more debug logging\r\n"
 				" -g               Dump core on SEG FAULT\r\n"
+				" --async-log      Print logs from a background thread instead of on the media threads\r\n"
+				" --log-rate-limit Max number of messages per second printed from the same log call (default: 0, unlimited)\r\n"
 				" --mcu-log        Set mcu log file path (default: mcu.log)\r\n"
 				" --mcu-pid        Set mcu pid file path (default: mcu.pid)\r\n"
 				" --mcu-crt        Set mcu SSL certificate file path (default: mcu.crt)\r\n"
 				" --mcu-key        Set mcu SSL key file path (default: mcu.pid)\r\n"
+				" --mcu-ecdsa      Generate ECDSA P-256 DTLS certificate instead of RSA one\r\n"
+				" --dtls-resumption Allow abbreviated DTLS handshakes for reconnecting peers\r\n"
+				" --dtls-workers   Number of threads doing DTLS handshakes (default: 0, on media threads)\r\n"
+				" --mixer-workers  Number of threads rescaling mosaic slots (default: 0, on mixer threads)\r\n"
+				" --scaler-pyramid Decimate frames 2x or 4x before scaling them down to small mosaic slots\r\n"
 				" --http-port      Set HTTP xmlrpc api port\r\n"
 				" --http-ip        Set HTTP xmlrpc api listening interface ip\r\n"
 				" --min-rtp-port   Set min rtp port\r\n"
@@ -198,6 +213,12 @@ int main(int argc,char **argv)
 		else if (strcmp(argv[i],"-dd")==0)
 			//Enable debug
 			Logger::EnableUltraDebug(true);
+		else if (strcmp(argv[i],"--async-log")==0)
+			//Do not block on logging
+			asyncLog = true;
+		else if (strcmp(argv[i],"--log-rate-limit")==0 && (i+1<argc))
+			//Get max messages per second and call site
+			logRateLimit = atoi(argv[++i]);
 		else if (strcmp(argv[i],"--http-port")==0 && (i+1<argc))
 			//Get port
 			port = atoi(argv[++i]);
@@ -228,6 +249,21 @@ int main(int argc,char **argv)
 		else if (strcmp(argv[i],"--mcu-key")==0 && (i+1<argc))
 			//Get certificate key file
 			keyfile = argv[++i];
+		else if (strcmp(argv[i],"--mcu-ecdsa")==0)
+			//Use ECDSA certificate
+			ecdsa = true;
+		else if (strcmp(argv[i],"--dtls-resumption")==0)
+			//Cache sessions and issue tickets
+			dtlsResumption = true;
+		else if (strcmp(argv[i],"--dtls-workers")==0 && (i+1<argc))
+			//Get number of handshake threads
+			dtlsWorkers = atoi(argv[++i]);
+		else if (strcmp(argv[i],"--mixer-workers")==0 && (i+1<argc))
+			//Get number of composition threads
+			mixerWorkers = atoi(argv[++i]);
+		else if (strcmp(argv[i],"--scaler-pyramid")==0)
+			//Use box filter decimation for small sizes
+			scalerPyramid = true;
 		else if (strcmp(argv[i],"--vad-period")==0 && (i+1<=argc))
 			//Get rtmp port
 			vadPeriod = atoi(argv[++i]);
@@ -326,6 +362,12 @@ int main(int argc,char **argv)
 		//Set new limit
 		setrlimit(RLIMIT_CORE, &l);
 	}
+	//Set log rate limit
+	Logger::SetRateLimit(logRateLimit);
+	//Start flusher thread after forking
+	if (asyncLog)
+		//Enable async logging
+		Logger::EnableAsync(true);
 	//Log version
 	Log("-MCU Version %s %s [pid:%d,ppid:%d]\r\n",MCUVERSION,MCUDATE,getpid(),getppid());
 
@@ -360,6 +402,10 @@ int main(int argc,char **argv)
 
 	//Set default video mixer vad period
 	VideoMixer::SetVADDefaultChangePeriod(vadPeriod);
+	//Set video mixer composition threads
+	VideoMixer::SetCompositionWorkers(mixerWorkers);
+	//Set frame scaler decimation
+	FrameScaler::EnablePyramid(scalerPyramid);
 
 	//Set port ramge
 	if (minPort && maxPort && !RTPTransport::SetPortRange(minPort,maxPort))
@@ -370,6 +416,14 @@ int main(int argc,char **argv)
 	if (crtfile && keyfile)
 		//Set DTLS certificate
 		DTLSConnection::SetCertificate(crtfile,keyfile);
+	else if (ecdsa)
+		//Generate ECDSA certificate
+		DTLSConnection::SetKeyType(DTLSConnection::KEY_ECDSA);
+	
+	//Set session resumption
+	DTLSConnection::EnableSessionResumption(dtlsResumption);
+	//Set handshake threads
+	DTLSConnection::SetHandshakeWorkers(dtlsWorkers);
 	
 	//Init DTLS
 	if (DTLSConnection::Initialize()) 
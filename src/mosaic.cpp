@@ -4,6 +4,7 @@
 #include "asymmetricmosaic.h"
 #include "pipmosaic.h"
 #include <stdexcept>
+#include <algorithm>
 #include <vector>
 #include <map>
 #include <string.h>
@@ -109,12 +110,16 @@ Mosaic::Mosaic(Type type,DWORD size) : overlay(::GetWidth(size),::GetHeight(size
 	mosaicSlots = (int*)malloc(numSlots*sizeof(int));
 	mosaicPos   = (int*)malloc(numSlots*sizeof(int));
 	oldPos	    = (int*)malloc(numSlots*sizeof(int));
+	slotGenerations = (QWORD*)malloc(numSlots*sizeof(QWORD));
 
 	//Empty them
 	memset(mosaicSlots,0,numSlots*sizeof(int));
 	memset(mosaicPos,0,numSlots*sizeof(int));
 	//Old pos are different so they are filled with logo on first pass
 	memset(oldPos,-1,numSlots*sizeof(int));
+	//Nothing displayed yet
+	for (int pos=0;pos<numSlots;pos++)
+		slotGenerations[pos] = SlotInvalid;
 
 	//Alloc resizers
 	resizer = (FrameScaler**)malloc(numSlots*sizeof(FrameScaler*));
@@ -167,6 +172,8 @@ Mosaic::~Mosaic()
 	if (oldPos)
 		//Free it
 		free(oldPos);
+	//Free generations
+	free(slotGenerations);
 
 	//Delete lingering participants
 	for(Participants::iterator it = participants.begin(); it!=participants.end(); it++)
@@ -249,6 +256,86 @@ int* Mosaic::GetOldPositions()
 	return oldPos;
 }
 
+QWORD Mosaic::GetSlotGeneration(int pos)
+{
+	//Check it's in the mosaic
+	if (pos<0 || pos>=numSlots)
+		return SlotInvalid;
+	//Return generation of the frame shown in the slot
+	return slotGenerations[pos];
+}
+
+void Mosaic::SetSlotGeneration(int pos,QWORD generation)
+{
+	//Check it's in the mosaic
+	if (pos<0 || pos>=numSlots)
+		return;
+	//Store it
+	slotGenerations[pos] = generation;
+}
+
+bool Mosaic::IsSlotOverlapping(int pos)
+{
+	//Get slot area
+	int left	= GetLeft(pos);
+	int top		= GetTop(pos);
+	int right	= left + GetWidth(pos);
+	int bottom	= top + GetHeight(pos);
+
+	//Check against the other slots
+	for (int i=0;i<numSlots;++i)
+	{
+		//Skip itself
+		if (i==pos)
+			continue;
+		//Check if they intersect
+		if (left<GetLeft(i)+GetWidth(i) && GetLeft(i)<right && top<GetTop(i)+GetHeight(i) && GetTop(i)<bottom)
+			return true;
+	}
+	//Disjoint
+	return false;
+}
+
+void Mosaic::SetChanged(int pos)
+{
+	//Lock regions
+	ScopedLock scoped(mutex);
+	//Only the slot area is modified
+	AddChangedRegion(GetLeft(pos),GetTop(pos),GetWidth(pos),GetHeight(pos));
+	//We have changed
+	SetChanged();
+}
+
+void Mosaic::AddChangedRegion(DWORD left,DWORD top,DWORD width,DWORD height)
+{
+	//Clip to mosaic
+	if (left>=(DWORD)mosaicTotalWidth || top>=(DWORD)mosaicTotalHeight || !width || !height)
+		return;
+	//Add region
+	VideoRegion region;
+	region.left	= left;
+	region.top	= top;
+	region.width	= std::min<DWORD>(width,mosaicTotalWidth-left);
+	region.height	= std::min<DWORD>(height,mosaicTotalHeight-top);
+	changedRegions.push_back(region);
+}
+
+VideoRegions Mosaic::GetChangedRegions()
+{
+	//Lock method
+	ScopedLock scoped(mutex);
+	//Return copy
+	return changedRegions;
+}
+
+void Mosaic::ClearChangedRegions()
+{
+	//Lock method
+	ScopedLock scoped(mutex);
+	//Clean them
+	changedRegions.clear();
+}
+
 QWORD Mosaic::GetVADBlockingTime()
 {
 	//Check if the position is fixed
@@ -611,6 +698,8 @@ int Mosaic::SetOverlayPNG(const char* filename)
 	overlayUsed = true;
 	//Display it
 	overlayNeedsUpdate = true;
+	//Whole image changes
+	AddChangedRegion(0,0,mosaicTotalWidth,mosaicTotalHeight);
 
 	//OK
 	return 1;
@@ -632,6 +721,8 @@ int Mosaic::SetOverlaySVG(const char* svg)
 	overlayUsed = true;
 	//Display it
 	overlayNeedsUpdate = true;
+	//Whole image changes
+	AddChangedRegion(0,0,mosaicTotalWidth,mosaicTotalHeight);
 	//OK
 	return 1;
 }
@@ -656,6 +747,8 @@ int Mosaic::RenderOverlayText(const std::wstring& text,DWORD x,DWORD y,DWORD wid
 	//Lock method
 	ScopedLock scoped(mutex);
 	
+	//Text area changes
+	AddChangedRegion(x,y,width,height);
 	//Render text
 	return overlay.RenderText(text,x,y,width,height,properties);
 }
@@ -665,6 +758,8 @@ int Mosaic::RenderOverlayText(const std::string& utf8,DWORD x,DWORD y,DWORD widt
 	//Lock method
 	ScopedLock scoped(mutex);
 	
+	//Text area changes
+	AddChangedRegion(x,y,width,height);
 	//Render text
 	return overlay.RenderText(utf8,x,y,width,height,properties);
 }
@@ -682,6 +777,8 @@ int Mosaic::ResetOverlay()
 	overlayUsed = false;
 	//Display it
 	overlayNeedsUpdate = false;
+	//Whole image changes
+	AddChangedRegion(0,0,mosaicTotalWidth,mosaicTotalHeight);
 	//OK
 	return 1;
 }
@@ -771,6 +868,8 @@ bool Mosaic::SetPadding(int top, int right, int bottom, int left)
 	paddingRight = right;
 	paddingBottom = bottom;
 	paddingLeft = left;
+	//Slot geometry has changed, so redraw all of them on next pass
+	memset(oldPos,-1,numSlots*sizeof(int));
 	//Done
 	return true;
 }
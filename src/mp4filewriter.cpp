@@ -0,0 +1,333 @@
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include "log.h"
+#include "mp4filewriter.h"
+
+//Writer being created, mp4v2 open callback does not have any user data
+static thread_local MP4FileWriter* opening = nullptr;
+
+const MP4FileProvider MP4FileWriter::provider = {
+	//open
+	[](const char* name, MP4FileMode) -> void* {
+		//Only files created from MP4FileWriter::Create
+		if (!opening || !opening->Open(name))
+			return nullptr;
+		return opening;
+	},
+	//seek, all callbacks return true on failure
+	[](void* handle, int64_t pos) -> int {
+		return !((MP4FileWriter*)handle)->Seek(pos);
+	},
+	//read
+	[](void* handle, void* buffer, int64_t size, int64_t* nin, int64_t) -> int {
+		size_t read = 0;
+		bool ok = ((MP4FileWriter*)handle)->Read((BYTE*)buffer,size,read);
+		*nin = read;
+		return !ok;
+	},
+	//write
+	[](void* handle, const void* buffer, int64_t size, int64_t* nout, int64_t) -> int {
+		bool ok = ((MP4FileWriter*)handle)->Write((const BYTE*)buffer,size);
+		*nout = ok ? size : 0;
+		return !ok;
+	},
+	//close
+	[](void* handle) -> int {
+		return !((MP4FileWriter*)handle)->Close();
+	}
+};
+
+MP4FileWriter::MP4FileWriter(size_t blockSize, size_t maxQueuedBytes) :
+	blockSize(blockSize),
+	maxQueuedBytes(maxQueuedBytes)
+{
+}
+
+MP4FileWriter::~MP4FileWriter()
+{
+	//Close if still opened
+	if (fd!=FD_INVALID)
+		Close();
+}
+
+MP4FileHandle MP4FileWriter::Create(const char* filename,uint32_t flags)
+{
+	//Set us as the file being opened
+	opening = this;
+	//Create mp4 file, open callback is called synchronously
+	MP4FileHandle mp4 = MP4CreateProvider(filename,flags,&provider);
+	//Done
+	opening = nullptr;
+	//Return handle
+	return mp4;
+}
+
+bool MP4FileWriter::Open(const char* filename)
+{
+	//Check not already opened
+	if (fd!=FD_INVALID)
+		return Error("-MP4FileWriter::Open() already opened\n");
+
+	//Open file, also readable as mp4v2 could read back what it has written
+	fd = open(filename, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+
+	//Check
+	if (fd==FD_INVALID)
+		return Error("-MP4FileWriter::Open() could not open file [file:%s,errno:%d]\n",filename,errno);
+
+	//Reset
+	stats = {};
+	totalWriteLatency = {};
+	failed = false;
+	position = 0;
+	current.offset = 0;
+	current.data.reserve(blockSize);
+	running = true;
+
+	//Start writer thread
+	thread = std::thread([this](){ Run(); });
+
+	//Done
+	return true;
+}
+
+bool MP4FileWriter::Seek(uint64_t pos)
+{
+	//Next write will start a new block if not contiguous
+	position = pos;
+	//Done
+	return true;
+}
+
+bool MP4FileWriter::Read(BYTE* data,size_t size,size_t& read)
+{
+	//Wait until everything is on disk
+	if (!Flush())
+		return false;
+
+	//Read it
+	ssize_t len = pread(fd,data,size,position);
+
+	//Check
+	if (len<0)
+		return Error("-MP4FileWriter::Read() failed [errno:%d]\n",errno);
+
+	//Move
+	position += len;
+	read = len;
+
+	//Done
+	return true;
+}
+
+bool MP4FileWriter::Write(const BYTE* data,size_t size)
+{
+	//Check opened
+	if (fd==FD_INVALID)
+		return false;
+
+	//If it is not contiguous with current block, start a new one
+	if (position!=current.offset+current.data.size())
+	{
+		//Queue current one
+		Submit();
+		//New block starts here
+		current.offset = position;
+	}
+
+	//Copy into current block
+	while (size)
+	{
+		//Copy as much as we can
+		size_t len = std::min(size,blockSize-current.data.size());
+		current.data.insert(current.data.end(),data,data+len);
+		//Move
+		data += len;
+		size -= len;
+		position += len;
+		//If block is full
+		if (current.data.size()==blockSize)
+			//Queue it
+			Submit();
+	}
+
+	//Done
+	return !failed;
+}
+
+void MP4FileWriter::Submit()
+{
+	//Nothing to do if empty
+	if (current.data.empty())
+		return;
+
+	//Next block starts just after this one
+	uint64_t next = current.offset+current.data.size();
+
+	//Lock
+	std::unique_lock<std::mutex> lock(mutex);
+
+	//If there is too much data queued, wait for the disk to catch up
+	if (stats.queuedBytes+current.data.size()>maxQueuedBytes && !queue.empty())
+	{
+		//One more stall
+		stats.stalls++;
+		//Wait
+		cond.wait(lock,[&](){ return stats.queuedBytes+current.data.size()<=maxQueuedBytes || queue.empty(); });
+	}
+
+	//Update queue stats
+	stats.queuedBytes += current.data.size();
+	stats.queuedBlocks++;
+	stats.maxQueuedBytes  = std::max(stats.maxQueuedBytes,stats.queuedBytes);
+	stats.maxQueuedBlocks = std::max(stats.maxQueuedBlocks,stats.queuedBlocks);
+
+	//Queue it
+	current.queued = std::chrono::steady_clock::now();
+	queue.push_back(std::move(current));
+
+	//Reuse a written buffer if available
+	current = {};
+	current.offset = next;
+	if (!pool.empty())
+	{
+		current.data = std::move(pool.back());
+		pool.pop_back();
+	} else {
+		current.data.reserve(blockSize);
+	}
+
+	//Wake up writer
+	cond.notify_all();
+}
+
+bool MP4FileWriter::Flush()
+{
+	//Queue current block
+	Submit();
+
+	//Lock
+	std::unique_lock<std::mutex> lock(mutex);
+	//Wait until all blocks have been written
+	cond.wait(lock,[&](){ return queue.empty() && !writing; });
+
+	//Done
+	return !failed;
+}
+
+bool MP4FileWriter::Close()
+{
+	//Check opened
+	if (fd==FD_INVALID)
+		return false;
+
+	//Write everything
+	bool ok = Flush();
+
+	//Stop writer
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		running = false;
+		cond.notify_all();
+	}
+	thread.join();
+
+	//Close file
+	if (close(fd)<0)
+		ok = Error("-MP4FileWriter::Close() failed [errno:%d]\n",errno);
+	fd = FD_INVALID;
+
+	//Release buffers
+	current = {};
+	pool.clear();
+
+	Log("-MP4FileWriter::Close() [written:%llu,blocks:%llu,maxQueued:%llu,stalls:%llu,avgLatency:%lldus,maxLatency:%lldus]\n",
+		stats.bytesWritten,stats.blocksWritten,stats.maxQueuedBytes,stats.stalls,stats.avgWriteLatency.count(),stats.maxWriteLatency.count());
+
+	//Done
+	return ok;
+}
+
+MP4FileWriter::Stats MP4FileWriter::GetStats()
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	return stats;
+}
+
+bool MP4FileWriter::WriteBlock(const BYTE* data,size_t size,uint64_t offset)
+{
+	//Until all written
+	while (size)
+	{
+		//Write at block position
+		ssize_t len = pwrite(fd,data,size,offset);
+		//Check error
+		if (len<0)
+		{
+			//Retry if interrupted
+			if (errno==EINTR)
+				continue;
+			//Error
+			return Error("-MP4FileWriter::WriteBlock() failed [errno:%d]\n",errno);
+		}
+		//Move
+		data += len;
+		size -= len;
+		offset += len;
+	}
+	//Done
+	return true;
+}
+
+void MP4FileWriter::Run()
+{
+	//Lock
+	std::unique_lock<std::mutex> lock(mutex);
+
+	while (true)
+	{
+		//Wait for blocks or stop
+		cond.wait(lock,[&](){ return !queue.empty() || !running; });
+
+		//If stopped and nothing left
+		if (queue.empty())
+			break;
+
+		//Get first block, they must be written in order as later ones could overwrite previous data
+		Block block = std::move(queue.front());
+		queue.pop_front();
+		writing = true;
+
+		//Write without holding the lock
+		lock.unlock();
+		bool ok = WriteBlock(block.data.data(),block.data.size(),block.offset);
+		auto latency = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now()-block.queued);
+		lock.lock();
+
+		//Update stats
+		writing = false;
+		stats.queuedBytes -= block.data.size();
+		stats.queuedBlocks--;
+		if (ok)
+		{
+			stats.bytesWritten += block.data.size();
+			stats.blocksWritten++;
+			totalWriteLatency += latency;
+			stats.avgWriteLatency = totalWriteLatency/stats.blocksWritten;
+			stats.maxWriteLatency = std::max(stats.maxWriteLatency,latency);
+		} else {
+			stats.failed = failed = true;
+		}
+
+		//Keep a few buffers for reuse
+		if (pool.size()<2)
+		{
+			block.data.clear();
+			pool.push_back(std::move(block.data));
+		}
+
+		//Wake up producer if waiting
+		cond.notify_all();
+	}
+}
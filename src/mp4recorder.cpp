@@ -10,13 +10,54 @@
 
 
 
-mp4track::mp4track(MP4FileHandle mp4) :
-	mp4(mp4)
+mp4track::mp4track(MP4FileHandle mp4, bool deferHints) :
+	mp4(mp4),
+	deferHints(deferHints)
 {
 }
 
+mp4track::mp4track(FMP4Writer* fmp4) :
+	fmp4(fmp4)
+{
+}
+
+void mp4track::WriteHint(const HintSample& sample)
+{
+	// Add rtp hint
+	MP4AddRtpHint(mp4, hint);
+
+	//For each packet
+	for (const auto& packet : sample.packets)
+	{
+		//Create rtp packet
+		MP4AddRtpPacket(mp4, hint, packet.mark, 0);
+		//Add prefix data if any
+		if (packet.prefixLen)
+			MP4AddRtpImmediateData(mp4, hint, packet.prefix, packet.prefixLen);
+		//Add rtp data
+		MP4AddRtpSampleData(mp4, hint, sample.sampleId, packet.pos, packet.size);
+	}
+
+	// Write rtp hint
+	MP4WriteRtpHint(mp4, hint, sample.duration, sample.isSync);
+}
+
+void mp4track::AddHint(HintSample&& sample)
+{
+	//If deferring hints to close time
+	if (deferHints)
+		//Store it
+		hints.push_back(std::move(sample));
+	else
+		//Write it now
+		WriteHint(sample);
+}
+
 void mp4track::SetTrackName(const std::string& name)
 {
+	//Fragmented files have no track names
+	if (fmp4)
+		return;
 	MP4SetTrackName(mp4, track, name.c_str());
 }
 
@@ -24,6 +65,17 @@ int mp4track::CreateAudioTrack(AudioCodec::Type codec, DWORD rate, bool disableH
 {
 	Log("-mp4track::CreateAudioTrack() [codec:%d]\n",codec);
 	
+	//If writing fragments
+	if (fmp4)
+	{
+		//Create track
+		track = fmp4->AddAudioTrack(codec,rate);
+		//Sotore clock rate
+		clockrate = rate;
+		//Done
+		return track;
+	}
+
 	BYTE type;
 
 	//Check the codec
@@ -118,6 +170,17 @@ int mp4track::CreateVideoTrack(VideoCodec::Type codec, DWORD rate, int width, in
 	
 	Log("-mp4track::CreateVideoTrack() [codec:%d,rate:%d,width:%d,height:%d]\n",codec,rate,width,height);
 	
+	//If writing fragments
+	if (fmp4)
+	{
+		//Create track
+		track = fmp4->AddVideoTrack(codec,rate,width,height);
+		//Sotore clock rate
+		clockrate = rate;
+		//Done
+		return track!=0;
+	}
+
 	BYTE type;
 
 	//Check the codec
@@ -234,6 +297,10 @@ int mp4track::CreateVideoTrack(VideoCodec::Type codec, DWORD rate, int width, in
 
 int mp4track::CreateTextTrack()
 {
+	//Not supported on fragmented files
+	if (fmp4)
+		return 0;
+
 	//Create subtitle track
 	track = MP4AddSubtitleTrack(mp4,1000,0,0);
 	
@@ -247,23 +314,30 @@ int mp4track::CreateTextTrack()
 int mp4track::FlushAudioFrame(AudioFrame* frame,DWORD duration)
 {
 	//Log("-mp4track::FlushAudioFrame() [duration:%u,length:%d]\n",duration,frame->GetLength());
+	//If writing fragments
+	if (fmp4)
+	{
+		//Save audio frame, no hints
+		if (track)
+			fmp4->WriteSample(track, frame->GetData(), frame->GetLength(), duration, true);
+		// Delete old one
+		delete frame;
+		//Stored
+		return 1;
+	}
+
 	// Save audio frame
 	MP4WriteSample(mp4, track, frame->GetData(), frame->GetLength(), duration, 0, 1);
 
 	//If as rtp info
 	if (hint)
 	{
-		// Add rtp hint
-		MP4AddRtpHint(mp4, hint);
-
-		///Create packet
-		MP4AddRtpPacket(mp4, hint, 0, 0);
-
-		// Set full frame as data
-		MP4AddRtpSampleData(mp4, hint, sampleId, 0, frame->GetLength());
-
-		// Write rtp hint
-		MP4WriteRtpHint(mp4, hint, duration, 1);
+		//Full frame as data in a single packet
+		HintPacket packet = {};
+		packet.pos  = 0;
+		packet.size = frame->GetLength();
+		//Add hint
+		AddHint({sampleId, duration, true, {packet}});
 	}
 
 	// Delete old one
@@ -357,6 +431,24 @@ int mp4track::WriteAudioFrame(AudioFrame &audioFrame)
 int mp4track::FlushVideoFrame(VideoFrame* frame,DWORD duration)
 {
 	//Log("-mp4track::FlushVideoFrame() [duration:%u,width:%d,height:%d%s]\n",duration, frame->GetWidth(), frame->GetWidth(), frame->IsIntra() ? ",intra" : "");
+	//If writing fragments
+	if (fmp4)
+	{
+		//If track is supported
+		if (track)
+		{
+			//Get parameter sets for the init segment
+			if (frame->GetCodec()==VideoCodec::H264 && frame->IsIntra())
+				AddFragmentedParameterSets(frame);
+			//Save video frame, no hints
+			fmp4->WriteSample(track, frame->GetData(), frame->GetLength(), duration, frame->IsIntra());
+		}
+		// Delete old one
+		delete frame;
+		//Stored
+		return 1;
+	}
+
 	// Save video frame
 	MP4WriteSample(mp4, track, frame->GetData(), frame->GetLength(), duration, 0, frame->IsIntra());
 
@@ -365,8 +457,8 @@ int mp4track::FlushVideoFrame(VideoFrame* frame,DWORD duration)
 	{
 		//Get list
 		const MediaFrame::RtpPacketizationInfo& rtpInfo = frame->GetRtpPacketizationInfo();
-		//Add hint for frame
-		MP4AddRtpHint(mp4, hint);
+		//Hint for frame
+		HintSample sample = {sampleId, duration, frame->IsIntra(), {}};
 		//Get iterator
 		MediaFrame::RtpPacketizationInfo::const_iterator it = rtpInfo.begin();
 		//Latest?
@@ -381,15 +473,21 @@ int mp4track::FlushVideoFrame(VideoFrame* frame,DWORD duration)
 			last = (it==rtpInfo.end());
 
 			//Create rtp packet
-			MP4AddRtpPacket(mp4, hint, last, 0);
+			HintPacket packet = {};
+			packet.mark = last;
+			packet.pos  = rtp.GetPos();
+			packet.size = rtp.GetSize();
 
 			//Prefix data can't be longer than 14bytes per mp4 spec
 			if (rtp.GetPrefixLen() && rtp.GetPrefixLen()<14)
+			{
 				//Add rtp data
-				MP4AddRtpImmediateData(mp4, hint, rtp.GetPrefixData(), rtp.GetPrefixLen());
+				memcpy(packet.prefix, rtp.GetPrefixData(), rtp.GetPrefixLen());
+				packet.prefixLen = rtp.GetPrefixLen();
+			}
 
-			//Add rtp data
-			MP4AddRtpSampleData(mp4, hint, sampleId, rtp.GetPos(), rtp.GetSize());
+			//Add it
+			sample.packets.push_back(packet);
 
 			//It is h264 and we still do not have SPS or PPS?
 			// only check full full naltypes
@@ -414,7 +512,7 @@ int mp4track::FlushVideoFrame(VideoFrame* frame,DWORD duration)
 			}
 		}
 		//Save rtp
-		MP4WriteRtpHint(mp4, hint, duration, frame->IsIntra());
+		AddHint(std::move(sample));
 	}
 
 	// Delete old one
@@ -423,10 +521,41 @@ int mp4track::FlushVideoFrame(VideoFrame* frame,DWORD duration)
 	return 1;
 }
 
+void mp4track::AddFragmentedParameterSets(const VideoFrame* frame)
+{
+	const BYTE* data = frame->GetData();
+	DWORD size = frame->GetLength();
+
+	//Parse length prefixed nals
+	while (size>4)
+	{
+		//Get nal size
+		DWORD nalSize = get4(data,0);
+		//Check it
+		if (!nalSize || nalSize>size-4)
+			break;
+		//Get nal
+		const BYTE* nal = data+4;
+		//Check nal type
+		BYTE nalType = nal[0] & 0x1F;
+		//If it a SPS NAL
+		if (nalType==0x07)
+			//Set it, with nal header
+			fmp4->SetH264SequenceParameterSet(track,nal,nalSize);
+		//If it is a PPS NAL
+		else if (nalType==0x08)
+			//Set it, with nal header
+			fmp4->SetH264PictureParameterSet(track,nal,nalSize);
+		//Next
+		data += 4+nalSize;
+		size -= 4+nalSize;
+	}
+}
+
 void mp4track::AddH264SequenceParameterSet(const BYTE* data, DWORD size)
 {
-	//If it a SPS NAL
-	if (hasSPS)
+	//If it a SPS NAL or parameter sets are read from the frames when writing fragments
+	if (hasSPS || fmp4)
 		//Do noting
 		return;	
 	
@@ -457,8 +586,8 @@ void mp4track::AddH264SequenceParameterSet(const BYTE* data, DWORD size)
 
 void mp4track::AddH264PictureParameterSet(const BYTE* data, DWORD size)
 {
-	//If it a PPS NAL
-	if (hasPPS)
+	//If it a PPS NAL or parameter sets are read from the frames when writing fragments
+	if (hasPPS || fmp4)
 		//Do noting
 		return;	
 	
@@ -502,6 +631,15 @@ int mp4track::WriteVideoFrame(VideoFrame& videoFrame)
 
 int mp4track::FlushTextFrame(TextFrame *frame, DWORD duration)
 {
+	//Text is not supported on fragmented files
+	if (fmp4)
+	{
+		// Delete old one
+		delete frame;
+		//Skip
+		return 0;
+	}
+
 	//Set the duration of the frame on the screen
 	MP4Duration frameduration = duration;
 
@@ -601,6 +739,17 @@ int mp4track::Close()
 		frame = NULL;
 	}
 
+	//Write deferred hints
+	for (const auto& sample : hints)
+		WriteHint(sample);
+	//Clear them
+	hints.clear();
+	hints.shrink_to_fit();
+
+	//Fragments already written can't be adjusted
+	if (fmp4)
+		return 1;
+
 	//If we have timing information
 	if (firstSenderTime && lastSenderTime && lastSenderTime>firstSenderTime && lastTimestamp>firstTimestamp)
 	{
@@ -638,7 +787,7 @@ MP4Recorder::MP4Recorder(Listener* listener) :
 MP4Recorder::~MP4Recorder()
 {
 	//If not closed
-        if (mp4!=MP4_INVALID_FILE_HANDLE)
+        if (mp4!=MP4_INVALID_FILE_HANDLE || (fmp4 && fmp4->IsOpened()))
 		//Close sync
 		Close(false);
         
@@ -661,15 +810,24 @@ bool MP4Recorder::Create(const char* filename)
 	Log("-MP4Recorder::Create() Opening mp4 recording [%s]\n",filename);
 
 	//If we are recording
-	if (mp4!=MP4_INVALID_FILE_HANDLE)
+	if (mp4!=MP4_INVALID_FILE_HANDLE || (fmp4 && fmp4->IsOpened()))
 		//Close
 		Close();
 
 	// We have to wait for first I-Frame
 	waitVideo = 0;
 
+	// Not fragmented
+	std::atomic_store(&fmp4,std::shared_ptr<FMP4Writer>());
+
+	// Create write behind file, so disk stalls do not block the recording loop
+	auto writer = std::make_shared<MP4FileWriter>();
+
 	// Create mp4 file
-	mp4 = MP4Create(filename,0);
+	mp4 = writer->Create(filename,0);
+
+	// Store it, stats could be read from other threads
+	std::atomic_store(&this->writer,writer);
 
 	// If failed
 	if (mp4 == MP4_INVALID_FILE_HANDLE)
@@ -680,6 +838,53 @@ bool MP4Recorder::Create(const char* filename)
 	return true;
 }
 
+bool MP4Recorder::CreateFragmented(const char* filename, std::chrono::milliseconds fragmentDuration)
+{
+	Log("-MP4Recorder::CreateFragmented() Opening fragmented mp4 recording [%s,fragment:%lldms]\n",filename,fragmentDuration.count());
+
+	//If we are recording
+	if (mp4!=MP4_INVALID_FILE_HANDLE || (fmp4 && fmp4->IsOpened()))
+		//Close
+		Close();
+
+	// We have to wait for first I-Frame
+	waitVideo = 0;
+
+	// Create fragmented writer
+	auto fmp4 = std::make_shared<FMP4Writer>(fragmentDuration);
+
+	// Store it, stats could be read from other threads
+	std::atomic_store(&this->fmp4,fmp4);
+
+	// Open file
+	if (!fmp4->Open(filename))
+                //Error
+		return Error("-Error opening fragmented mp4 file for recording\n");
+
+	//Success
+	return true;
+}
+
+bool MP4Recorder::Rotate(const char* filename)
+{
+	Log("-MP4Recorder::Rotate() [%s]\n",filename);
+
+	//Only for fragmented recordings
+	if (!fmp4 || !fmp4->IsOpened())
+		return Error("-MP4Recorder::Rotate() No fragmented mp4 file opened for recording\n");
+
+	//Switch file in recording thread, after the frames already queued
+	loop.Async([=,filename = std::string(filename)](...){
+		//Check it is still opened
+		if (fmp4 && fmp4->IsOpened())
+			//Rotate on next key frame
+			fmp4->Rotate(filename.c_str());
+	});
+
+	//Done
+	return true;
+}
+
 bool MP4Recorder::Record()
 {
 	return Record(true, false);
@@ -696,7 +901,7 @@ bool MP4Recorder::Record(bool waitVideo, bool disableHints)
 	Log("-MP4Recorder::Record() [waitVideo:%d,disableHints:%d]\n",waitVideo,disableHints);
 	
         //Check mp4 file is opened
-        if (mp4 == MP4_INVALID_FILE_HANDLE)
+        if (mp4 == MP4_INVALID_FILE_HANDLE && !(fmp4 && fmp4->IsOpened()))
                 //Error
                 return Error("No MP4 file opened for recording\n");
         
@@ -746,8 +951,8 @@ bool MP4Recorder::Close(bool async)
 {
 	Log("-MP4Recorder::Close()\n");
 	
-        //Stop always
-        auto res = loop.Async([=](...){
+        //Stop always, keep a reference to the writer in case a new file is created before this is run
+        auto res = loop.Async([=,writer = writer,fmp4 = fmp4](...){
 		Debug(">MP4Recorder::Close() | Async\n");
 		
 		//Not recording anymore
@@ -777,6 +982,11 @@ bool MP4Recorder::Close(bool async)
 
 		//Empty file
 		mp4 = MP4_INVALID_FILE_HANDLE;
+
+		//If fragmented
+		if (fmp4 && fmp4->IsOpened())
+			//Write last fragment and close
+			fmp4->Close();
 		
 		//Triger listener
 		if (this->listener)
@@ -802,9 +1012,18 @@ void MP4Recorder::onMediaFrame(const MediaFrame &frame)
 
 void MP4Recorder::onMediaFrame(DWORD ssrc, const MediaFrame &frame)
 {
-	
+	//One more frame queued
+	uint64_t queued = ++queuedFrames;
+	//Update max
+	uint64_t max = maxQueuedFrames;
+	while (queued>max && !maxQueuedFrames.compare_exchange_weak(max,queued));
+	//Get enqueue time
+	auto enqueued = std::chrono::steady_clock::now();
+
 	//run async	
 	loop.Async([=,cloned = frame.Clone()](...){
+		//Dequeued
+		queuedFrames--;
 		//Check we are recording
 		if (recording) 
 		{
@@ -812,6 +1031,13 @@ void MP4Recorder::onMediaFrame(DWORD ssrc, const MediaFrame &frame)
 			processMediaFrame(ssrc,*cloned,cloned->GetTime());
 			//Delete
 			delete cloned;
+			//Get latency since it was queued
+			uint64_t latency = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now()-enqueued).count();
+			//Update stats
+			processedFrames++;
+			totalFrameLatency += latency;
+			if (latency>maxFrameLatency)
+				maxFrameLatency = latency;
 		} 
 		//Check if doing time shift recording
 		else if (timeShiftDuration) 
@@ -872,7 +1098,7 @@ void MP4Recorder::processMediaFrame(DWORD ssrc, const MediaFrame &frame, QWORD t
 				// Calculate time diff since first
 				QWORD delta = time > first ? time-first : 0;
 				//Create object
-				audioTrack = new mp4track(mp4);
+				audioTrack = fmp4 ? new mp4track(fmp4.get()) : new mp4track(mp4,deferHints);
 				//Create track
 				audioTrack->CreateAudioTrack(audioFrame.GetCodec(),audioFrame.GetClockRate(),disableHints);
 				//Set name as ssrc
@@ -942,7 +1168,7 @@ void MP4Recorder::processMediaFrame(DWORD ssrc, const MediaFrame &frame, QWORD t
 					// Calculate time diff since first
 					QWORD delta = time > first ? time-first : 0;
 					//Create object
-					videoTrack = new mp4track(mp4);
+					videoTrack = fmp4 ? new mp4track(fmp4.get()) : new mp4track(mp4,deferHints);
 					//Create track
 					videoTrack->CreateVideoTrack(videoFrame.GetCodec(),videoFrame.GetClockRate(),videoFrame.GetWidth(),videoFrame.GetHeight(),disableHints);
 					//Set name as ssrc
@@ -1038,7 +1264,7 @@ void MP4Recorder::processMediaFrame(DWORD ssrc, const MediaFrame &frame, QWORD t
 			if (!textTrack)
 			{
 				//Create object
-				textTrack = new mp4track(mp4);
+				textTrack = fmp4 ? new mp4track(fmp4.get()) : new mp4track(mp4,deferHints);
 				//Create track
 				textTrack->CreateTextTrack();
 				//Set name as ssrc
@@ -1079,6 +1305,30 @@ void MP4Recorder::processMediaFrame(DWORD ssrc, const MediaFrame &frame, QWORD t
 }
 
 
+MP4Recorder::Stats MP4Recorder::GetStats()
+{
+	Stats stats;
+
+	//Get frame queue stats
+	uint64_t processed = processedFrames;
+	stats.queuedFrames	= queuedFrames;
+	stats.maxQueuedFrames	= maxQueuedFrames;
+	stats.avgFrameLatency	= std::chrono::microseconds(processed ? totalFrameLatency/processed : 0);
+	stats.maxFrameLatency	= std::chrono::microseconds(maxFrameLatency);
+
+	//Get a reference to the writers
+	auto writer = std::atomic_load(&this->writer);
+	auto fmp4 = std::atomic_load(&this->fmp4);
+	//Get file writer stats
+	if (fmp4)
+		stats.writer = fmp4->GetStats();
+	else if (writer)
+		stats.writer = writer->GetStats();
+
+	//Done
+	return stats;
+}
+
 bool MP4Recorder::SetH264ParameterSets(const std::string& sprop)
 {
 	BYTE nal[MTU];
@@ -32,6 +32,8 @@ Canvas::Canvas(DWORD width,DWORD height)
 	memset(overlay,0,overlaySize);
 	//Do not display
 	display = false;
+	//Calculate runs on first draw
+	runsChanged = true;
 }
 
 Overlay::Overlay(DWORD width,DWORD height) : Canvas(width,height)
@@ -206,6 +208,8 @@ int Canvas::LoadPNG(const char* filename)
 	
 	//Display it then
 	display = true;
+	//Alpha has changed
+	runsChanged = true;
 end:
 	if (logo)
 		av_free(logo);
@@ -283,6 +287,8 @@ int Canvas::LoadSVG(const char* svg)
 		
 		//Done
 		display = true;
+		//Alpha has changed
+		runsChanged = true;
 	} catch ( Magick::Exception &error ) {
 		display = false;
 		return Error("-Canvas: failed to load picture file %s: %s.\n", svg, error.what() );
@@ -444,6 +450,8 @@ int Canvas::RenderText(const std::string& utf8,DWORD x,DWORD y,DWORD width,DWORD
 		sws_freeContext(sws);
 		//OK
 		display = true;
+		//Alpha has changed
+		runsChanged = true;
 	} catch ( Magick::Exception &error ) {
 		display = false;
 		return Error("-Canvas: failed to render text: %s: %s.\n", utf8.c_str(), error.what() );
@@ -470,157 +478,20 @@ void Canvas::Reset()
 {
 	//Clean overlay memory
 	memset(overlay,0,overlaySize);
+	//Alpha has changed
+	runsChanged = true;
 }
 
 void Canvas::Draw(BYTE*image,BYTE* frame)
 {
-	//Get source
-	BYTE* srcY1 = frame;
-	BYTE* srcY2 = frame+width;
-	BYTE* srcU  = frame+width*height;
-	BYTE* srcV  = frame+width*height*5/4;
-	//Get overlay
-	BYTE* ovrY1 = overlay;
-	BYTE* ovrY2 = overlay+width;
-	BYTE* ovrU  = overlay+width*height;
-	BYTE* ovrV  = overlay+width*height*5/4;
-	BYTE* ovrA1 = overlay+width*height*3/2;
-	BYTE* ovrA2 = overlay+width*height*3/2+width;
-	//Get destingation
-	BYTE* dstY1 = image;
-	BYTE* dstY2 = image+width;
-	BYTE* dstU  = image+width*height;
-	BYTE* dstV  = image+width*height*5/4;
-
-	for (int j=0; j<height/2; ++j)
+	//Get transparent and opaque runs again if overlay has changed
+	if (runsChanged)
 	{
-		for (int i=0; i<width/2; ++i)
-		{
-			//Get alpha values
-			BYTE a11 = *(ovrA1++);
-			BYTE a12 = *(ovrA1++);
-			BYTE a21 = *(ovrA2++);
-			BYTE a22 = *(ovrA2++);
-			//Check
-			if (a11==0)
-			{
-				//Set alpha
-				*(dstY1++) = *(srcY1++);
-				//Increase pointer
-				++ovrY1;
-			} else if (a11==255) {
-				//Set original image
-				*(dstY1++) = *(ovrY1++);
-				//Increase pointer
-				++srcY1;
-			} else {
-				DWORD n = 255-a11;
-				DWORD oY = *(ovrY1++);
-				DWORD sY = *(srcY1++);
-				*(dstY1++) = (oY*a11+sY*n)/255;
-				//Calculate and move pointer
-				//*(dstY1++) = (((DWORD)(*(ovrY1++)))*a11 + (((DWORD)(*(srcY1++)))*(~a11)))/255;
-			}
-			//Check
-			if (a12==0)
-			{
-				//Set alpha
-				*(dstY1++) = *(srcY1++);
-				//Increase pointer
-				++ovrY1;
-			} else if (a12==255) {
-				//Set original image
-				*(dstY1++) = *(ovrY1++);
-				//Increase pointer
-				++srcY1;
-			} else {
-				DWORD n = 255-a12;
-				DWORD oY = *(ovrY1++);
-				DWORD sY = *(srcY1++);
-				*(dstY1++) = (oY*a12+sY*n)/255;
-				//Calculate and move pointer
-				//*(dstY1++) = (((DWORD)(*(ovrY1++)))*a12 + (((DWORD)(*(srcY1++)))*(~a12)))/255;
-			}
-			//Check
-			if (a21==0)
-			{
-				//Set alpha
-				*(dstY2++) = *(srcY2++);
-				//Increase pointer
-				++ovrY2;
-			} else if (a21==255) {
-				//Set original image
-				*(dstY2++) = *(ovrY2++);
-				//Increase pointer
-				++srcY2;
-			} else {
-				DWORD n = 255-a21;
-				DWORD oY = *(ovrY2++);
-				DWORD sY = *(srcY2++);
-				*(dstY2++) = (oY*a21+sY*n)/255;
-				//Calculate and move pointer
-				//*(dstY2++) = (((DWORD)(*(ovrY2++)))*a21 + (((DWORD)(*(srcY2++)))*(~a21)))/255;
-			}
-			//Check
-			if (a22==0)
-			{
-				//Set alpha
-				*(dstY2++) = *(srcY2++);
-				//Increase pointer
-				++ovrY2;
-			} else if (a22==255) {
-				//Set original image
-				*(dstY2++) = *(ovrY2++);
-				//Increase pointer
-				++srcY2;
-			} else {
-				DWORD n = 255-a22;
-				DWORD oY = *(ovrY2++);
-				DWORD sY = *(srcY2++);
-				*(dstY2++) = (oY*a22+sY*n)/255;
-				//Calculate and move pointer
-				//*(dstY2++) = (((DWORD)(*(ovrY2++)))*a22 + (((DWORD)(*(srcY2++)))*(~a22)))/255;
-			}
-			//Summ all alphas
-			DWORD alpha = a11+a21+a21+a22;
-			//Check UV
-			if (alpha==0)
-			{
-				//Set UV
-				*(dstU++) = *(srcU++);
-				*(dstV++) = *(srcV++);
-				//Increase pointers
-				++ovrU;
-				++ovrV;
-			} else if (alpha == 1020) {
-				//Set UV
-				*(dstU++) = *(ovrU++);
-				*(dstV++) = *(ovrV++);
-				//Increase pointers
-				++srcU;
-				++srcV;
-			} else {
-				DWORD negalpha = 1020-alpha;
-				DWORD oU = *(ovrU++);
-				DWORD oV = *(ovrV++);
-				DWORD sU = *(srcU++);
-				DWORD sV = *(srcV++);
-				*(dstU++) = (oU*alpha+sU*negalpha)/1020;
-				*(dstV++) = (oV*alpha+sV*negalpha)/1020;
-				//Calculate and move pointer
-				//*(dstU++) = (((DWORD)(*(ovrU++)))*alpha + (((DWORD)(*(srcU++)))*negalpha))/1020;
-				//*(dstV++) = (((DWORD)(*(ovrV++)))*alpha + (((DWORD)(*(srcV++)))*negalpha))/1020;
-
-			}
-		}
-		//Skip Y line
-		srcY1 += width;
-		srcY2 += width;
-		dstY1 += width;
-		dstY2 += width;
-		ovrY1 += width;
-		ovrY2 += width;
-		ovrA1 += width;
-		ovrA2 += width;
+		//Calculate
+		AlphaBlend::CalculateRuns(overlay,width,height,runs);
+		//Done
+		runsChanged = false;
 	}
+	//Blend with best kernel available
+	AlphaBlend::Blend(AlphaBlend::GetKernel(),image,frame,overlay,width,height,&runs);
 }
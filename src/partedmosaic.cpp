@@ -72,7 +72,7 @@ PartedMosaic::~PartedMosaic()
 * Update
 * 	Update slot of mosaic with given image
 *****************************/
-int PartedMosaic::Update(int pos, BYTE *image, int imgWidth, int imgHeight,bool keepAspectRatio)
+int PartedMosaic::Update(int pos, BYTE *image, int imgWidth, int imgHeight,bool keepAspectRatio,const FrameScaler::Pyramid* pyramid)
 {
 	//Check it's in the mosaic
 	if (pos<0 || pos >= numSlots)
@@ -142,11 +142,11 @@ int PartedMosaic::Update(int pos, BYTE *image, int imgWidth, int imgHeight,bool
 		resizer[pos]->SetResize(imgWidth,imgHeight,imgWidth,mosaicWidth,mosaicHeight,mosaicTotalWidth,keepAspectRatio);
 
 		//And resize
-		resizer[pos]->Resize(imageY,imageU,imageV,lineaY,lineaU,lineaV);
+		resizer[pos]->Resize(imageY,imageU,imageV,lineaY,lineaU,lineaV,pyramid);
 	}
 
 	//We have changed
-	SetChanged();
+	SetChanged(pos);
 
 	return 1;
 }
@@ -162,7 +162,8 @@ int PartedMosaic::Clean(int pos)
 		return 0;
 
 	DWORD mosaicNumPixels = mosaicTotalWidth*mosaicTotalHeight;
-	DWORD offset,offset2;
+	DWORD offset=0;
+	DWORD offset2=0;
 	BYTE *lineaY;
 	BYTE *lineaU;
 	BYTE *lineaV;
@@ -204,7 +205,7 @@ int PartedMosaic::Clean(int pos)
 	}
 
 	//We have changed
-	SetChanged();
+	SetChanged(pos);
 
 	return 1;
 }
@@ -234,7 +235,7 @@ int PartedMosaic::GetTop(int pos)
 	int j = pos - i*mosaicCols;
 	
 	//Get offsets
-	return SIZE2MUL(GetPaddingTop()+GetWidth(pos)*i);
+	return SIZE2MUL(GetPaddingTop()+GetHeight(pos)*i);
 }
 int PartedMosaic::GetLeft(int pos)
 {
@@ -242,5 +243,5 @@ int PartedMosaic::GetLeft(int pos)
 	int i = pos / mosaicCols;
 	int j = pos - i*mosaicCols;
 	//Get offsets
-	return SIZE2MUL(GetPaddingLeft()+GetHeight(pos)*j);
+	return SIZE2MUL(GetPaddingLeft()+GetWidth(pos)*j);
 }
@@ -3,6 +3,7 @@
 #include "tools.h"
 #include <stdlib.h>
 #include <string.h>
+#include <algorithm>
 
 PipeVideoInput::PipeVideoInput()
 {
@@ -79,6 +80,8 @@ int PipeVideoInput::StartVideoCapture(int width,int height,int fps)
 	imgPos = false;
 	imgNew = false;
 	grabPic = 0;
+	grabPartial = false;
+	grabChanged.clear();
 
 	//Estamos capturando
 	capturing = true;
@@ -149,14 +152,28 @@ VideoBuffer PipeVideoInput::GrabFrame(DWORD timeout)
 		}
 	}
 
-	//Lo vamos a consumir
-	imgNew=0;
-
 	//Nos quedamos con el puntero antes de que lo cambien
 	pic.width	= videoWidth;
 	pic.height	= videoHeight;
 	pic.buffer	= grabPic;
 
+	//If it is a new picture
+	if (imgNew)
+	{
+		//Pass changes since last grabbed one
+		pic.partial = grabPartial;
+		pic.changed.swap(grabChanged);
+	} else {
+		//Same picture than before, nothing changed
+		pic.partial = true;
+	}
+	//Reset changes
+	grabPartial = true;
+	grabChanged.clear();
+
+	//Lo vamos a consumir
+	imgNew=0;
+
 	//Y liberamos el mutex
 	pthread_mutex_unlock(&newPicMutex);
 
@@ -180,7 +197,7 @@ void  PipeVideoInput::CancelGrabFrame()
 	
 }
 
-int PipeVideoInput::SetFrame(BYTE * buffer, int width, int height)
+int PipeVideoInput::SetFrame(BYTE * buffer, int width, int height, const VideoRegions* changed)
 {
 	//Protegemos
 	pthread_mutex_lock(&newPicMutex);
@@ -196,6 +213,33 @@ int PipeVideoInput::SetFrame(BYTE * buffer, int width, int height)
 
 		//Copy & Resize
 		resizer.Resize(buffer,width,height,grabPic,videoWidth,videoHeight,true);
+
+		//If we don't know what has changed or image is letterboxed
+		if (!changed || !width || !height || width*videoHeight!=height*videoWidth)
+		{
+			//Full frame
+			grabPartial = false;
+			grabChanged.clear();
+		//If only some regions changed since last grabbed frame
+		} else if (grabPartial) {
+			//Margin for the scaler filter taps
+			const DWORD margin = width!=videoWidth || height!=videoHeight ? 2 : 0;
+			//Scale regions to the captured size
+			for (const auto& region : *changed)
+			{
+				DWORD left	= region.left*videoWidth/width;
+				DWORD top	= region.top*videoHeight/height;
+				DWORD right	= ((region.left+region.width)*videoWidth+width-1)/width;
+				DWORD bottom	= ((region.top+region.height)*videoHeight+height-1)/height;
+				VideoRegion scaled;
+				scaled.left	= left>margin ? left-margin : 0;
+				scaled.top	= top>margin ? top-margin : 0;
+				scaled.width	= std::min<DWORD>(right+margin,videoWidth)-scaled.left;
+				scaled.height	= std::min<DWORD>(bottom+margin,videoHeight)-scaled.top;
+				//Add it
+				grabChanged.push_back(scaled);
+			}
+		}
 		
 		//Hay imagen
 		imgNew = true;
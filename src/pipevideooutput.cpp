@@ -18,6 +18,7 @@ PipeVideoOutput::PipeVideoOutput(pthread_mutex_t* mutex, pthread_cond_t* cond)
 	isChanged	= false;
 	versionChanged	= false;
 	version		= -1;
+	generation	= 0;
 	videoWidth	= 0;
 	videoHeight	= 0;
 }
@@ -50,6 +51,9 @@ int PipeVideoOutput::NextFrame(BYTE *pic)
 
 	//Copiamos
 	memcpy(buffer,pic,bufferSize);
+
+	//New frame
+	generation++;
 	
 	//Release
 	Unlock();
@@ -81,6 +85,9 @@ void PipeVideoOutput::ClearFrame()
 	// paint the background in black for YUV
 	memset(buffer		, 0		, num);
 	memset(buffer+num	, (BYTE) -128	, num/2);
+
+	//New frame
+	generation++;
 	
 	//Release
 	Unlock();
@@ -121,6 +128,9 @@ int PipeVideoOutput::SetVideoSize(int width,int height)
 	//Get memory
 	buffer = (BYTE*)malloc(bufferSize);
 
+	//Previous frame is gone
+	generation++;
+
 	//Release
 	Unlock();
 	
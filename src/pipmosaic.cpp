@@ -39,7 +39,7 @@ PIPMosaic::~PIPMosaic()
 * Update
 * 	Update slot of mosaic with given image
 *****************************/
-int PIPMosaic::Update(int pos, BYTE *image, int imgWidth, int imgHeight,bool keepAspectRatio)
+int PIPMosaic::Update(int pos, BYTE *image, int imgWidth, int imgHeight,bool keepAspectRatio,const FrameScaler::Pyramid* pyramid)
 {
 	//TODO: Use margins
 	
@@ -121,7 +121,7 @@ int PIPMosaic::Update(int pos, BYTE *image, int imgWidth, int imgHeight,bool kee
 			//Set resize
 			resizer[pos]->SetResize(imgWidth,imgHeight,imgWidth,mosaicTotalWidth,mosaicTotalHeight,mosaicTotalWidth,keepAspectRatio);
 			//Resize and set to slot
-			resizer[pos]->Resize(imageY,imageU,imageV,underY,underU,underV);
+			resizer[pos]->Resize(imageY,imageU,imageV,underY,underU,underV,pyramid);
 
 			//Change pointers from image to resized one
 			imageY = underY;
@@ -254,12 +254,12 @@ int PIPMosaic::Update(int pos, BYTE *image, int imgWidth, int imgHeight,bool kee
 			//Set resize
 			resizer[pos]->SetResize(imgWidth,imgHeight,imgWidth,mosaicWidth,mosaicHeight,mosaicTotalWidth,keepAspectRatio);
 			//Resize and set to slot
-			resizer[pos]->Resize(imageY,imageU,imageV,lineaY,lineaU,lineaV);
+			resizer[pos]->Resize(imageY,imageU,imageV,lineaY,lineaU,lineaV,pyramid);
 		}
 	}
 
 	//We have changed
-	SetChanged();
+	SetChanged(pos);
 
 	return 1;
 }
@@ -322,7 +322,7 @@ int PIPMosaic::Clean(int pos)
 	}
 
 	//We have changed
-	SetChanged();
+	SetChanged(pos);
 
 	return 1;
 }
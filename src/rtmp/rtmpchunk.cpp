@@ -1,6 +1,7 @@
 #include "log.h"
 #include "tools.h"
 #include "rtmp/rtmpchunk.h"
+#include <algorithm>
 #include <stdexcept>
 #include <cstdlib>
 
@@ -127,7 +128,8 @@ RTMPChunkOutputStream::RTMPChunkOutputStream(DWORD chunkStreamId) : RTMPChunkStr
 {
 	//Empty message
 	message = NULL;
-	msgBuffer = NULL;
+	pos = 0;
+	chunkedSize = 0;
 	//Store own id
 	this->chunkStreamId = chunkStreamId;
 	//Init mutex
@@ -144,10 +146,7 @@ RTMPChunkOutputStream::~RTMPChunkOutputStream()
 		delete(*it);
 
 	if (message)
-	{
-		delete(msgBuffer);
 		delete(message);
-	}
 	//Unlock
 	pthread_mutex_unlock(&mutex);
 	//Destroy mutex
@@ -167,6 +166,27 @@ void RTMPChunkOutputStream::SendMessage(RTMPMessage *msg)
 }
 
 DWORD RTMPChunkOutputStream::GetNextChunk(BYTE *data,DWORD size,DWORD maxChunkSize)
+{
+	Chunk chunk;
+
+	//Check we have enought size for the biggest chunk
+	if (size<MaxHeaderSize+maxChunkSize)
+		//Nothing written
+		return 0;
+
+	//Get next chunk header and payload slice, never the whole chunked message
+	if (!GetNextChunk(data,size,maxChunkSize,chunk,false))
+		//No more data to send here
+		return 0;
+
+	//Copy payload after the header
+	memcpy(data+chunk.headerLen,chunk.data.get(),chunk.length);
+
+	//Return copied data
+	return chunk.headerLen+chunk.length;
+}
+
+bool RTMPChunkOutputStream::GetNextChunk(BYTE *data,DWORD size,DWORD maxChunkSize,Chunk& chunk,bool useCache)
 {
 	//lock now
 	pthread_mutex_lock(&mutex);
@@ -174,7 +194,10 @@ DWORD RTMPChunkOutputStream::GetNextChunk(BYTE *data,DWORD size,DWORD maxChunkSi
 	RTMPChunkBasicHeader header;
 	//Set chunk stream id
 	header.SetStreamId(chunkStreamId);
-	//Chunk header
+	//Chunk headers, only one of them is serialized
+	RTMPChunkType0 type0;
+	RTMPChunkType1 type1;
+	RTMPChunkType2 type2;
 	RTMPObject* chunkHeader = NULL;
 	//Extended timestamp
 	RTMPExtendedTimestamp extts;
@@ -190,7 +213,7 @@ DWORD RTMPChunkOutputStream::GetNextChunk(BYTE *data,DWORD size,DWORD maxChunkSi
 			//Unlock
 			pthread_mutex_unlock(&mutex);
 			//No more data to send here
-			return 0;
+			return false;
 		}
 		//Get the next message to send
 		message = messages.front();
@@ -205,17 +228,18 @@ DWORD RTMPChunkOutputStream::GetNextChunk(BYTE *data,DWORD size,DWORD maxChunkSi
 		//Start sending 
 		pos = 0;
 
-		//Allocate data for serialized message
-		msgBuffer = (BYTE*)malloc(msgLength);
-		//Serialize it
-		message->Serialize(msgBuffer,msgLength);
+		//Get serialized message, media payloads are shared and not copied
+		payload = message->GetPayload();
+		//If allowed, check if it has been already chunked for this chunk stream and size
+		if (useCache)
+			chunked = payload->GetChunked(chunkStreamId,maxChunkSize);
+		//Store size it was chunked with
+		chunkedSize = maxChunkSize;
 
 		//Select wich header
 		if (!msgStreamId || msgStreamId!=streamId || msgTimestamp<timestamp)
 		{
-			//Create chunk header type 0 (last check is for backward time on Seek)
-			RTMPChunkType0* type0 = new RTMPChunkType0();
-			//Set header type
+			//Chunk header type 0 (last check is for backward time on Seek)
 			header.SetFmt(0);
 			//Check timestamp
 			if (msgTimestamp>=0xFFFFFF)
@@ -223,42 +247,38 @@ DWORD RTMPChunkOutputStream::GetNextChunk(BYTE *data,DWORD size,DWORD maxChunkSi
 				//Set flag
 				useExtTimestamp = true;
 				//Use extended header
-				type0->SetTimestamp(0xFFFFFF);
+				type0.SetTimestamp(0xFFFFFF);
 				//Set it
 				extts.SetTimestamp(msgTimestamp);
 
 			} else {
 				//Set timestamp
-				type0->SetTimestamp(msgTimestamp);
+				type0.SetTimestamp(msgTimestamp);
 			}
 			//Set data in chunk header
-			type0->SetMessageLength(msgLength);
-			type0->SetMessageTypeId(msgType);
-			type0->SetMessageStreamId(msgStreamId);
+			type0.SetMessageLength(msgLength);
+			type0.SetMessageTypeId(msgType);
+			type0.SetMessageStreamId(msgStreamId);
 			//Not delta available for next packet
 			msgTimestampDelta = 0;
 			//Store object
-			chunkHeader = type0;
+			chunkHeader = &type0;
 		} else if (msgLength!=length || msgType!=type) {
-			//Create chunk header type 1
-			RTMPChunkType1* type1 = new RTMPChunkType1();
-			//Set header type
+			//Chunk header type 1
 			header.SetFmt(1);
 			//Set data in chunk header
-			type1->SetTimestampDelta(msgTimestampDelta);
-			type1->SetMessageLength(msgLength);
-			type1->SetMessageTypeId(msgType);
+			type1.SetTimestampDelta(msgTimestampDelta);
+			type1.SetMessageLength(msgLength);
+			type1.SetMessageTypeId(msgType);
 			//Store object
-			chunkHeader = type1;
+			chunkHeader = &type1;
 		} else if (msgTimestampDelta!=timestampDelta) {
-			//Create chunk header type 1
-			RTMPChunkType2* type2 = new RTMPChunkType2();
-			//Set header type
+			//Chunk header type 2
 			header.SetFmt(2);
 			//Set data in chunk header
-			type2->SetTimestampDelta(msgTimestampDelta);
+			type2.SetTimestampDelta(msgTimestampDelta);
 			//Store object
-			chunkHeader = type2;
+			chunkHeader = &type2;
 		} else {
 			//Set header type 3 as it shares all data with previous
 			header.SetFmt(3);
@@ -289,41 +309,59 @@ DWORD RTMPChunkOutputStream::GetNextChunk(BYTE *data,DWORD size,DWORD maxChunkSi
 		//Serialize extened header
 		headersLen += extts.Serialize(data+headersLen,size-headersLen);
 
-	//Size of the msg data of the chunk
-	DWORD payloadLen = maxChunkSize;
-	//If we have more than needed
-	if (payloadLen>length-pos)
-		//Just copy until the oend of the object
-		payloadLen = length-pos;
-	
-	//Copy
-	memcpy(data+headersLen,msgBuffer+pos,payloadLen);
+	//Set header length
+	chunk.headerLen	= headersLen;
+
+	//If the chunk size has changed while sending the message
+	if (chunked && chunkedSize!=maxChunkSize)
+		//Chunk the rest on the fly
+		chunked.reset();
 
-	//Increase sent data from msg
-	pos += payloadLen;
+	//If we have the whole message chunked
+	if (chunked)
+	{
+		//Size of the msg data of the chunk
+		DWORD payloadLen = std::min(maxChunkSize,length-pos);
+		//Only the first header is specific to this connection, next ones are type 3 headers already on the chunked data
+		DWORD continuation = pos ? headersLen : 0;
+		//Get chunk start on the chunked data, continuation header included
+		DWORD offset = pos ? pos+(pos/maxChunkSize-1)*continuation : 0;
+		//One chunk at a time so other chunk streams can be interleaved
+		chunk.headerLen	= headersLen-continuation;
+		chunk.data	= std::shared_ptr<const BYTE>(chunked,chunked->data()+offset);
+		chunk.length	= continuation+payloadLen;
+		//Increase sent data from msg
+		pos += payloadLen;
+	} else {
+		//Size of the msg data of the chunk
+		DWORD payloadLen = maxChunkSize;
+		//If we have more than needed
+		if (payloadLen>length-pos)
+			//Just send until the end of the object
+			payloadLen = length-pos;
+		//Set chunk, payload is referenced so it outlives the message
+		chunk.data	= std::shared_ptr<const BYTE>(payload,payload->GetData()+pos);
+		chunk.length	= payloadLen;
+		//Increase sent data from msg
+		pos += payloadLen;
+	}
 	//Check if we have finished with this message	
 	if (pos==length)
 	{
-		//Delete buffer
-		free(msgBuffer);
-		//Null
-		msgBuffer = NULL;
+		//Release payload
+		payload.reset();
+		chunked.reset();
 		//Delete message
 		delete(message);
 		//Next one
 		message = NULL;
 	}
 
-	//Check
-	if (chunkHeader)
-		//Delete it
-		delete (chunkHeader);
-
 	//Unlock
 	pthread_mutex_unlock(&mutex);
 
-	//Return copied data
-	return headersLen+payloadLen;	
+	//Done
+	return true;
 }
 
 bool RTMPChunkOutputStream::HasData()
@@ -365,10 +403,9 @@ bool RTMPChunkOutputStream::ResetStream(DWORD id)
 	//If we have message of this stream
 	if (message && message->GetStreamId()==id)
 	{
-		//Delete buffer
-		free(msgBuffer);
-		//Null
-		msgBuffer = NULL;
+		//Release payload
+		payload.reset();
+		chunked.reset();
 		//Delete message
 		delete(message);
 		//Next one
@@ -360,7 +360,7 @@ DWORD RTMPClientConnection::SerializeChunkData(BYTE *data,DWORD size)
 		while (chunkOutputStream->HasData())
 		{
 			//Check if we do not have enought space left for more
-			if(size-len<maxOutChunkSize+12)
+			if(size-len<maxOutChunkSize+RTMPChunkOutputStream::MaxHeaderSize)
 			{
 				//We have more data to write
 				ufds[0].events = POLLIN | POLLOUT | POLLERR | POLLHUP;
@@ -1045,10 +1045,10 @@ void RTMPClientConnection::onMediaFrame(DWORD streamId,RTMPMediaFrame *frame)
 	{
 		case RTMPMediaFrame::Audio:
 			//Append to the audio trunk
-			chunkOutputStreams[4]->SendMessage(new RTMPMessage(streamId,ts,frame->Clone()));
+			chunkOutputStreams[4]->SendMessage(new RTMPMessage(streamId,ts,RTMPMessage::Audio,frame->GetPayload()));
 			break;
 		case RTMPMediaFrame::Video:
-			chunkOutputStreams[5]->SendMessage(new RTMPMessage(streamId,ts,frame->Clone()));
+			chunkOutputStreams[5]->SendMessage(new RTMPMessage(streamId,ts,RTMPMessage::Video,frame->GetPayload()));
 			break;
 	}
 	//Signal frames
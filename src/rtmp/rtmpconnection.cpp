@@ -6,14 +6,14 @@
 #include <signal.h>
 #include <errno.h>
 #include <stdio.h>
-#include <thread>
 #include "log.h"
 #include "assertions.h"
 #include "tools.h"
 #include "rtmp/rtmphandshake.h"
 #include "rtmp/rtmpconnection.h"
 
-constexpr int PoolTimeout = 5E3; //5s
+constexpr DWORD MaxSerializeSize = 64*1024;
+constexpr DWORD MaxGatherChunks = 64;
 
 /********************************
  * RTMP connection demultiplex buffers streams from incoming raw data
@@ -21,7 +21,8 @@ constexpr int PoolTimeout = 5E3; //5s
  * to the message layer.
  *******************************************************************/
 
-RTMPConnection::RTMPConnection(Listener *listener)
+RTMPConnection::RTMPConnection(Listener *listener,RTMPEventLoop& loop) :
+	loop(loop)
 {
 	//Set initial state
 	state = HEADER_C0_WAIT;
@@ -34,6 +35,10 @@ RTMPConnection::RTMPConnection(Listener *listener)
 	windowSize = 0;
 	curWindowSize = 0;
 	recvSize = 0;
+	//No bandwidth calculation yet
+	bandIni = 0;
+	bandSize = 0;
+	bandCalc = 0;
 	//Not encripted by default
 	digest = false;
 	//Store listener
@@ -85,31 +90,35 @@ int RTMPConnection::Init(int fd)
 	//Store socket
 	socket = fd;
 
+	//Set non blocking
+	int fsflags = fcntl(socket,F_GETFL,0);
+	fsflags |= O_NONBLOCK;
+	fcntl(socket,F_SETFL,fsflags);
+
+	//Set no delay option
+	int flag = 1;
+        setsockopt(socket, IPPROTO_TCP, TCP_NODELAY, &flag, sizeof(int));
+
 	//I am inited
 	inited = true;
 
-	//Start
-	Start();
+	//We are running
+	running = true;
+
+	//Attach to event loop, it will drive all the socket io from now on
+	if (!loop.AddConnection(shared_from_this()))
+	{
+		//Not running
+		running = false;
+		//Error
+		return Error("-RTMPConnection::Init() could not add connection to event loop [%d]\n",fd);
+	}
 
 	Log("<RTMP Connection init\n");
 
 	return 1;
 }
 
-void RTMPConnection::Start()
-{
-	//We are running
-	running = true;
-	
-	//Start thread and run
-	thread = std::thread([=](...){
-		//Block signals to avoid exiting on SIGUSR1
-		blocksignals();
-		//Run
-		Run(); 
-	});
-}
-
 void RTMPConnection::Stop()
 {
 	//If got socket
@@ -117,10 +126,8 @@ void RTMPConnection::Stop()
 	{
 		//Not running;
 		running = false;
-		//Close socket
-		shutdown(socket,SHUT_RDWR);
-		//Will cause poll to return
-		MCU_CLOSE(socket);
+		//Remove from loop, it will close the socket
+		loop.RemoveConnection(this);
 	}
 }
 
@@ -139,121 +146,131 @@ int RTMPConnection::End()
 	//Stop just in case
 	Stop();
 
-	//If thread is already running
-	if (thread.joinable())
-	{
-		//If we are on different thread
-		if (std::this_thread::get_id()!=thread.get_id())
-			//Join it
-			thread.join();
-		else
-			//Detach as we are ending ourselves
-			thread.detach();
-	}
-
 	//Ended
 	Log("<RTMPConnection::End()\n");
 
 	return 1;
 }
 
-
 /***************************
- * Run
- * 	Server running thread
+ * OnReadable
+ * 	Read all available data from socket, called from event loop
  ***************************/
-int RTMPConnection::Run()
+bool RTMPConnection::OnReadable()
 {
-	BYTE data[1400];
-	unsigned int size = 1400;
-
-	Log(">RTMPConnection::Run() [connection:%p]\n",this);
-
-	//Set values for polling
-	ufds[0].fd = socket;
-	ufds[0].events = POLLIN | POLLERR | POLLHUP;
-
-	//Set non blocking so we can get an error when we are closed by end
-	int fsflags = fcntl(socket,F_GETFL,0);
-	fsflags |= O_NONBLOCK;
-	fcntl(socket,F_SETFL,fsflags);
+	BYTE data[16384];
 
-	//Set no delay option
-	int flag = 1;
-        setsockopt(socket, IPPROTO_TCP, TCP_NODELAY, &flag, sizeof(int));
-	//Catch all IO errors
-	signal(SIGIO,EmptyCatch);
-
-	//Run until ended
-	while(running)
+	//Edge triggered, so read until socket is drained
+	while(true)
 	{
-		//Wait for events
-		int ret = poll(ufds,1,PoolTimeout);
-		
-		//If there was an error
-		if (ret<0)
-			//Check again
+		//Read data from connection
+		int len = read(socket,data,sizeof(data));
+		//Check errors
+		if (len<0 && (errno==EAGAIN || errno==EWOULDBLOCK))
+			//Wait for more
+			return true;
+		//If interrupted
+		if (len<0 && errno==EINTR)
+			//Try again
 			continue;
-		
-		//If timed out
-		if (ret==0)
+		//If closed or failed
+		if (len<=0)
 		{
-			//Log and exit run loop
-			Log("-RTMPConnection::Run() Timedout [connection:%p]\n",this);
-			break;
+			//Error
+			Log("-RTMPConnection::OnReadable() Readed [%d,%d]\n",len,errno);
+			//Exit
+			return false;
 		}
-			
-		if (ufds[0].revents & POLLOUT)
-		{
-			//Write data buffer
-			DWORD len = SerializeChunkData(data,size);
-			//Check length
-			if (len)
-			{
-				//Send it
-				WriteData(data,len);
-				//Increase sent bytes
-				outBytes += len;
-			}
+		//Increase in bytes
+		inBytes += len;
+		//Got activity
+		lastActivity = loop.GetNow();
+
+		try {
+			//Parse data
+			ParseData(data,len);
+		} catch (std::exception &e) {
+			//Show error
+			Error("Exception parsing data: %s\n",e.what());
+			//Dump it
+			Dump(data,len);
+			//Break on any error
+			return false;
 		}
+	}
+}
 
-		if (ufds[0].revents & POLLIN)
-		{
-			//Read data from connection
-			int len = read(socket,data,size);
-			if (len<=0)
-			{
-				//Error
-				Log("Readed [%d,%d]\n",len,errno);
-				//Exit
-				break;
-			}
-			//Increase in bytes
-			inBytes += len;
+/***************************
+ * OnWritable
+ * 	Flush pending data and chunks, called from event loop
+ ***************************/
+bool RTMPConnection::OnWritable()
+{
+	//Any message enqueued from now on will need a new flush
+	writePending = false;
 
-			try {
-				//Parse data
-				ParseData(data,len);
-			} catch (std::exception &e) {
-				//Show error
-				Error("Exception parsing data: %s\n",e.what());
-				//Dump it
-				Dump(data,len);
-				//Break on any error
-				break;
-			}
-		}
+	//Send data left from previous writes first
+	while (pendingPos<pending.size())
+	{
+		//Send it
+		ssize_t len = send(socket,pending.data()+pendingPos,pending.size()-pendingPos,MSG_NOSIGNAL | MSG_DONTWAIT);
+		//Check errors
+		if (len<0)
+			//Wait for next writable event unless failed
+			return errno==EAGAIN || errno==EWOULDBLOCK || errno==EINTR;
+		//Move
+		pendingPos += len;
+		//Increase sent bytes
+		outBytes += len;
+		//Got activity
+		lastActivity = loop.GetNow();
+	}
 
-		if ((ufds[0].revents & POLLHUP) || (ufds[0].revents & POLLERR))
-		{
+	//All pending data sent
+	pending.clear();
+	pendingPos = 0;
+
+	//Do not keep big buffers for idle connections
+	if (pending.capacity()>MaxSerializeSize)
+		pending.shrink_to_fit();
+
+	//Chunk headers and payload references pool shared by all connections of this loop
+	static thread_local BYTE headers[MaxGatherChunks*RTMPChunkOutputStream::MaxHeaderSize];
+	static thread_local RTMPChunkOutputStream::Chunk chunks[MaxGatherChunks];
+	static thread_local iovec iov[MaxGatherChunks*2];
+
+	//Gather as many chunks as we can
+	while (DWORD num = GatherChunks(iov,chunks,headers,MaxGatherChunks))
+	{
+		//Send headers and payloads in one go
+		bool ok = WriteData(iov,num*2);
+		//Release payloads, anything not sent has been already copied
+		for (DWORD i=0;i<num;++i)
+			chunks[i].data.reset();
+		//Check error
+		if (!ok)
 			//Error
-			Log("Pool error event [%d]\n",ufds[0].revents);
-			//Exit
+			return false;
+		//If socket buffer is full
+		if (!pending.empty())
+			//Wait for next writable event
 			break;
-		}
 	}
-	
-	Log("-RTMPConnection::Run() Disconnecting [connection:%p]\n",this);
+
+	//Done
+	return true;
+}
+
+/***************************
+ * OnClosed
+ * 	Connection removed from event loop
+ ***************************/
+void RTMPConnection::OnClosed()
+{
+	Log("-RTMPConnection::OnClosed() Disconnecting [connection:%p]\n",this);
+
+	//Not running anymore
+	running = false;
 
 	//If got application
 	if (app)
@@ -282,73 +299,65 @@ int RTMPConnection::Run()
 	if (listener)
 		//launch event
 		listener->onDisconnect(this);
-	
-	Log("<RTMPConnection::Run() [connection:%p]\n",this);
-
-	//Done
-	return 1;
 }
 
 void RTMPConnection::SignalWriteNeeded()
 {
-	//lock now
-	pthread_mutex_lock(&mutex);
-
-	//Check if there was not anyhting left in the queeue
-	if (!(ufds[0].events & POLLOUT))
-	{
-		//Init bandwidth calculation
-		bandIni = getDifTime(&startTime);
-		//Nothing sent
-		bandSize = 0;
-	}
+	//If there is already a flush scheduled it will send this data too
+	if (writePending.exchange(true))
+		//Done
+		return;
 
-	//Set to wait also for read events
-	ufds[0].events = POLLIN | POLLOUT | POLLERR | POLLHUP;
+	//Get a reference, we could be already being destroyed
+	auto self = weak_from_this().lock();
 
-	//Unlock
-	pthread_mutex_unlock(&mutex);
+	//If not running anymore
+	if (!self || !running)
+		//Nothing to flush
+		return;
 
-	//Signal the pthread this will cause the poll call to exit
-	pthread_kill(thread.native_handle(),SIGIO);
+	//Flush it on the event loop
+	loop.SignalWriteNeeded(self);
 }
 
-DWORD RTMPConnection::SerializeChunkData(BYTE *data,DWORD size)
+DWORD RTMPConnection::GatherChunks(iovec* iov,RTMPChunkOutputStream::Chunk* chunks,BYTE* headers,DWORD max)
 {
+	DWORD num = 0;
 	DWORD len = 0;
 
 	//Lock mutex
 	pthread_mutex_lock(&mutex);
 
-	//Remove the write signal
-	//ufds[0].events = POLLIN | POLLERR | POLLHUP;
-
 	//Iterate the chunks in ascendig order (more important firsts)
-	for (RTMPChunkOutputStreams::iterator it=chunkOutputStreams.begin(); it!=chunkOutputStreams.end();++it)
+	for (RTMPChunkOutputStreams::iterator it=chunkOutputStreams.begin(); it!=chunkOutputStreams.end() && num<max && len<MaxSerializeSize;++it)
 	{
 		//Get stream
 		RTMPChunkOutputStream* chunkOutputStream = it->second;
 
-		//Check it it has data pending
-		while (chunkOutputStream->HasData())
+		//Get chunks while we have room for them
+		while (num<max && len<MaxSerializeSize)
 		{
-			//Check if we do not have enought space left for more
-			if(size-len<maxOutChunkSize+12)
-			{
-				//We have more data to write
-				//ufds[0].events = POLLIN | POLLOUT | POLLERR | POLLHUP;
-				//End this writing
-				goto end;
-			}
-
-			//Write next chunk from this stream
-			len += chunkOutputStream->GetNextChunk(data+len,size-len,maxOutChunkSize);
-
+			//Get header slot from the pool
+			BYTE* header = headers+num*RTMPChunkOutputStream::MaxHeaderSize;
+			//Get chunk
+			RTMPChunkOutputStream::Chunk& chunk = chunks[num];
+			//Serialize next chunk header from this stream
+			if (!chunkOutputStream->GetNextChunk(header,RTMPChunkOutputStream::MaxHeaderSize,maxOutChunkSize,chunk))
+				//No more data on this stream
+				break;
+			//Header
+			iov[num*2].iov_base	= header;
+			iov[num*2].iov_len	= chunk.headerLen;
+			//Payload is written from the shared message buffer
+			iov[num*2+1].iov_base	= (void*)chunk.data.get();
+			iov[num*2+1].iov_len	= chunk.length;
+			//Increase size
+			len += chunk.headerLen+chunk.length;
+			//Next
+			num++;
 		}
 	}
 
-
-end:
 	//Add size
 	bandSize += len;
 	//Calc elapsed time
@@ -356,9 +365,6 @@ end:
 	//Check if
 	if (!len)
 	{
-		//Do not wait for write anymore
-		ufds[0].events = POLLIN | POLLERR | POLLHUP;
-
 		//Check
 		if (elapsed)
 		{
@@ -383,8 +389,8 @@ end:
 	//Un Lock mutex
 	pthread_mutex_unlock(&mutex);
 
-	//Return chunks data length
-	return len;
+	//Return number of chunks
+	return num;
 }
 
 /***********************
@@ -774,18 +780,99 @@ void RTMPConnection::ParseData(BYTE *data,const DWORD size)
 
 /***********************
  * WriteData
- *	Write data to socket
+ *	Write data to socket, queuing what could not be sent
  ***********************/
-int RTMPConnection::WriteData(BYTE *data,const DWORD size)
+bool RTMPConnection::WriteData(const BYTE *data,const DWORD size)
 {
-#ifdef DEBUG
-	/*char name[256];
-	sprintf(name,"/tmp/mcu_out_%p.raw",this);
-	int fd = open(name,O_CREAT|O_WRONLY|O_APPEND, S_IRUSR | S_IWUSR, 0644);
-	write(fd,data,size);
-	MCU_CLOSE(fd);*/
-#endif
-	return write(socket,data,size);
+	DWORD pos = 0;
+
+	//Only write directly if there is nothing queued to keep ordering
+	while (pendingPos==pending.size() && pos<size)
+	{
+		//Send it
+		ssize_t len = send(socket,data+pos,size-pos,MSG_NOSIGNAL | MSG_DONTWAIT);
+		//Check errors
+		if (len<0)
+		{
+			//If interrupted
+			if (errno==EINTR)
+				//Try again
+				continue;
+			//If socket buffer is full
+			if (errno==EAGAIN || errno==EWOULDBLOCK)
+				//Queue the rest
+				break;
+			//Error
+			return Error("-RTMPConnection::WriteData() error writing to socket [errno:%d]\n",errno);
+		}
+		//Move
+		pos += len;
+		//Increase sent bytes
+		outBytes += len;
+		//Got activity
+		lastActivity = loop.GetNow();
+	}
+
+	//Queue anything left until socket is writable again
+	if (pos<size)
+		pending.insert(pending.end(),data+pos,data+size);
+
+	return true;
+}
+
+/***********************
+ * WriteData
+ *	Write scattered data to socket, queuing what could not be sent
+ ***********************/
+bool RTMPConnection::WriteData(iovec* iov,int count)
+{
+	//Only write directly if there is nothing queued to keep ordering
+	while (pendingPos==pending.size() && count)
+	{
+		msghdr msg = {};
+		//Set buffers
+		msg.msg_iov	= iov;
+		msg.msg_iovlen	= count;
+		//Send them
+		ssize_t len = sendmsg(socket,&msg,MSG_NOSIGNAL | MSG_DONTWAIT);
+		//Check errors
+		if (len<0)
+		{
+			//If interrupted
+			if (errno==EINTR)
+				//Try again
+				continue;
+			//If socket buffer is full
+			if (errno==EAGAIN || errno==EWOULDBLOCK)
+				//Queue the rest
+				break;
+			//Error
+			return Error("-RTMPConnection::WriteData() error writing to socket [errno:%d]\n",errno);
+		}
+		//Increase sent bytes
+		outBytes += len;
+		//Got activity
+		lastActivity = loop.GetNow();
+		//Skip buffers fully sent
+		while (count && (size_t)len>=iov->iov_len)
+		{
+			len -= iov->iov_len;
+			iov++;
+			count--;
+		}
+		//Skip what was sent of the next one
+		if (count)
+		{
+			iov->iov_base = (BYTE*)iov->iov_base+len;
+			iov->iov_len -= len;
+		}
+	}
+
+	//Queue anything left until socket is writable again
+	for (int i=0;i<count;++i)
+		pending.insert(pending.end(),(BYTE*)iov[i].iov_base,(BYTE*)iov[i].iov_base+iov[i].iov_len);
+
+	return true;
 }
 
 void RTMPConnection::ProcessControlMessage(DWORD streamId,BYTE type,RTMPObject* msg)
@@ -1265,10 +1352,10 @@ void RTMPConnection::onMediaFrame(DWORD streamId,RTMPMediaFrame *frame)
 	{
 		case RTMPMediaFrame::Audio:
 			//Append to the audio trunk
-			chunkOutputStreams[4]->SendMessage(new RTMPMessage(streamId,ts,frame->Clone()));
+			chunkOutputStreams[4]->SendMessage(new RTMPMessage(streamId,ts,RTMPMessage::Audio,frame->GetPayload()));
 			break;
 		case RTMPMediaFrame::Video:
-			chunkOutputStreams[5]->SendMessage(new RTMPMessage(streamId,ts,frame->Clone()));
+			chunkOutputStreams[5]->SendMessage(new RTMPMessage(streamId,ts,RTMPMessage::Video,frame->GetPayload()));
 			break;
 	}
 	//Signal frames
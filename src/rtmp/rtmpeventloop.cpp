@@ -0,0 +1,364 @@
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <errno.h>
+#include <vector>
+#include "log.h"
+#include "tools.h"
+#include "assertions.h"
+#include "rtmp/rtmpconnection.h"
+#include "rtmp/rtmpeventloop.h"
+
+const size_t RTMPEventLoop::MaxEvents = 256;
+const std::chrono::milliseconds RTMPEventLoop::IdleTimeout = std::chrono::milliseconds(5000);
+
+static std::chrono::milliseconds Now()
+{
+	return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now().time_since_epoch());
+}
+
+RTMPEventLoop::RTMPEventLoop()
+{
+}
+
+RTMPEventLoop::~RTMPEventLoop()
+{
+	//Stop just in case
+	if (running)
+		Stop();
+}
+
+bool RTMPEventLoop::Start()
+{
+	//If already started
+	if (running)
+		//Error
+		return Error("-RTMPEventLoop::Start() | Already running\n");
+
+	//Create epoll
+	epollfd = epoll_create1(EPOLL_CLOEXEC);
+	//Check
+	if (epollfd==FD_INVALID)
+		//Error
+		return Error("-RTMPEventLoop::Start() | could not create epoll [errno:%d]\n",errno);
+
+	//Create wake up event fd
+	wakeup = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	//Check
+	if (wakeup==FD_INVALID)
+	{
+		//Close epoll
+		close(epollfd);
+		epollfd = FD_INVALID;
+		//Error
+		return Error("-RTMPEventLoop::Start() | could not create eventfd [errno:%d]\n",errno);
+	}
+
+	//Level triggered, we drain it always
+	epoll_event event = {};
+	event.events	= EPOLLIN;
+	event.data.fd	= wakeup;
+	//Add it
+	epoll_ctl(epollfd, EPOLL_CTL_ADD, wakeup, &event);
+
+	//Running
+	running = true;
+	//Not signaled
+	signaled = false;
+	//Get now
+	now = lastIdleCheck = Now();
+
+	//Start thread and run
+	thread = std::thread([this](){
+		//Block signals
+		blocksignals();
+		//Run
+		Run();
+	});
+
+	//Done
+	return true;
+}
+
+bool RTMPEventLoop::Stop()
+{
+	//Check if running
+	if (!running)
+		//Nothing to do
+		return Error("-RTMPEventLoop::Stop() | Already stopped\n");
+
+	Debug(">RTMPEventLoop::Stop() [connections:%u]\n",(DWORD)numConnections);
+
+	//Not running
+	running = false;
+
+	//If it is running
+	if (thread.joinable())
+	{
+		//Force wake up
+		uint64_t one = 1;
+		one = write(wakeup,(uint8_t*)&one,sizeof(one));
+		//Wait for it
+		thread.join();
+	}
+
+	//Close fds
+	close(wakeup);
+	close(epollfd);
+	//Invalidate
+	wakeup = epollfd = FD_INVALID;
+
+	Debug("<RTMPEventLoop::Stop()\n");
+
+	//Done
+	return true;
+}
+
+void RTMPEventLoop::Async(Task&& task)
+{
+	//Enqueue it, it will be run at the end of current loop iteration
+	tasks.enqueue(std::move(task));
+	//Wake up loop
+	Signal();
+}
+
+bool RTMPEventLoop::AddConnection(const std::shared_ptr<RTMPConnection>& connection)
+{
+	//Check
+	if (!running)
+		//Error
+		return Error("-RTMPEventLoop::AddConnection() | Loop not running\n");
+
+	//One more
+	numConnections++;
+
+	//Add it on the loop thread, so the map is populated before any event is received
+	Async([this,connection](){
+		//Get socket
+		int fd = connection->GetSocket();
+		//Add it
+		connections[fd] = connection;
+		//Last activity is now
+		connection->lastActivity = now;
+		//Edge triggered for reading and writing
+		epoll_event event = {};
+		event.events	= EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+		event.data.fd	= fd;
+		//Add it
+		if (epoll_ctl(epollfd, EPOLL_CTL_ADD, fd, &event)<0)
+		{
+			//Error
+			Error("-RTMPEventLoop::AddConnection() | epoll_ctl failed [fd:%d,errno:%d]\n",fd,errno);
+			//Close it
+			CloseConnection(fd);
+		}
+	});
+
+	//Done
+	return true;
+}
+
+void RTMPEventLoop::RemoveConnection(RTMPConnection* connection)
+{
+	//Remove it on the loop thread
+	Async([this,connection](){
+		//Find it
+		for (const auto& [fd,con] : connections)
+		{
+			//If it is the same
+			if (con.get()==connection)
+			{
+				//Close it
+				CloseConnection(fd);
+				//Done
+				break;
+			}
+		}
+	});
+}
+
+void RTMPEventLoop::SignalWriteNeeded(const std::shared_ptr<RTMPConnection>& connection)
+{
+	//Flush it on the loop thread, coalescing with any other output produced in this iteration
+	Async([this,connection](){
+		//Find it
+		auto it = connections.find(connection->GetSocket());
+		//Ensure it has not been closed in the meanwhile
+		if (it==connections.end() || it->second!=connection)
+			//Ignore
+			return;
+		//Flush pending data
+		if (!connection->OnWritable())
+			//Close it
+			CloseConnection(it->first);
+	});
+}
+
+void RTMPEventLoop::Signal()
+{
+	uint64_t one = 1;
+
+	//If we are in the loop thread or already signaled
+	if (IsLoopThread() || signaled.exchange(true))
+		//No need to do anything
+		return;
+
+	//Write to the eventfd
+	one = write(wakeup,(uint8_t*)&one,sizeof(one));
+}
+
+void RTMPEventLoop::CloseConnection(int fd)
+{
+	//Find it
+	auto it = connections.find(fd);
+	//If not found
+	if (it==connections.end())
+		//Done
+		return;
+
+	//Keep a reference while we are closing it
+	auto connection = it->second;
+	//Remove from map
+	connections.erase(it);
+	//One less
+	numConnections--;
+
+	//Remove from epoll, it will be removed anyway on close, but dup'ed fds could keep it
+	epoll_ctl(epollfd, EPOLL_CTL_DEL, fd, nullptr);
+
+	//Launch disconnection
+	connection->OnClosed();
+
+	//Close socket
+	shutdown(fd,SHUT_RDWR);
+	MCU_CLOSE(fd);
+}
+
+void RTMPEventLoop::CheckIdleConnections()
+{
+	//Only once per second
+	if (now-lastIdleCheck<std::chrono::milliseconds(1000))
+		//Done
+		return;
+
+	//Update last check
+	lastIdleCheck = now;
+
+	//Connections timed out
+	std::vector<int> timedout;
+
+	//Check all
+	for (const auto& [fd,connection] : connections)
+		//If nothing has been sent or received for a while
+		if (now-connection->lastActivity>IdleTimeout)
+			//Timed out
+			timedout.push_back(fd);
+
+	//Close them
+	for (auto fd : timedout)
+	{
+		//Log
+		Log("-RTMPEventLoop::CheckIdleConnections() Timedout [fd:%d]\n",fd);
+		//Close
+		CloseConnection(fd);
+	}
+}
+
+void RTMPEventLoop::Run()
+{
+	Log(">RTMPEventLoop::Run() [%p]\n",this);
+
+	epoll_event events[MaxEvents];
+
+	//Run until ended
+	while(running)
+	{
+		//Wait for events, wake up each second to check idle connections
+		int num = epoll_wait(epollfd, events, MaxEvents, tasks.size_approx() ? 0 : 1000);
+
+		//Update now
+		now = Now();
+
+		//Check error
+		if (num<0 && errno!=EINTR)
+		{
+			//Error
+			Error("-RTMPEventLoop::Run() | epoll_wait failed [errno:%d]\n",errno);
+			//Exit
+			break;
+		}
+
+		//For each event
+		for (int i=0; i<num; ++i)
+		{
+			//Get fd
+			int fd = events[i].data.fd;
+			//Get events
+			uint32_t revents = events[i].events;
+
+			//If it is the wake up event
+			if (fd==wakeup)
+			{
+				uint64_t val;
+				//Remove pending data
+				while (read(wakeup,&val,sizeof(val))>0)
+				{
+					//DO nothing
+				}
+				//We are not signaled anymore
+				signaled = false;
+				//Next
+				continue;
+			}
+
+			//Find connection
+			auto it = connections.find(fd);
+			//If it has been already closed in this loop
+			if (it==connections.end())
+				//Skip
+				continue;
+
+			//Keep a reference while processing
+			auto connection = it->second;
+			bool ok = true;
+
+			//Read all data first, also on hang up so we get any data left and the error
+			if (revents & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR))
+				ok = connection->OnReadable();
+			//If we can write
+			if (ok && (revents & EPOLLOUT))
+				ok = connection->OnWritable();
+
+			//If failed or socket error
+			if (!ok || (revents & (EPOLLHUP | EPOLLERR)))
+				//Close connection
+				CloseConnection(fd);
+		}
+
+		//Run queued tasks
+		Task task;
+		//Get all pending taks
+		while (tasks.try_dequeue(task))
+			//Execute it
+			task();
+
+		//Check idle connections
+		CheckIdleConnections();
+	}
+
+	//Run queued tasks so any pending connection is added and cleaned up
+	Task task;
+	while (tasks.try_dequeue(task))
+		task();
+
+	//Get all fds
+	std::vector<int> fds;
+	for (const auto& [fd,connection] : connections)
+		fds.push_back(fd);
+	//Close all remaining connections
+	for (auto fd : fds)
+		CloseConnection(fd);
+
+	Log("<RTMPEventLoop::Run() [%p]\n",this);
+}
@@ -3,6 +3,7 @@
 #include "avcdescriptor.h"
 #include <stdexcept>
 #include <cstdlib>
+#include <algorithm>
 
 /************************************
  * RTMPMesssage
@@ -174,6 +175,23 @@ RTMPMessage::RTMPMessage(DWORD streamId,QWORD timestamp,RTMPMetaData* meta)
 	this->media = NULL;
 }
 
+RTMPMessage::RTMPMessage(DWORD streamId,QWORD timestamp,Type type,const RTMPPayload& payload)
+{
+	//Store values
+	this->streamId = streamId;
+	this->type = type;
+	this->timestamp = timestamp;
+	//Message body is already serialized
+	this->length = payload->GetSize();
+	//Store msg
+	this->ctrl = NULL;
+	this->cmd = NULL;
+	this->meta = NULL;
+	this->media = NULL;
+	//Shared, not copied
+	this->payload = payload;
+}
+
 RTMPMessage::~RTMPMessage()
 {
 	//Free
@@ -187,8 +205,33 @@ RTMPMessage::~RTMPMessage()
 		delete(media);
 }
 
+RTMPPayload RTMPMessage::GetPayload()
+{
+	//If not created yet
+	if (!payload)
+	{
+		//Create buffer
+		auto data = std::make_shared<RTMPMessagePayload>(length);
+		//Serialize message
+		Serialize(data->GetData(),length);
+		//Store it
+		payload = data;
+	}
+	//Return it
+	return payload;
+}
+
 DWORD RTMPMessage::Serialize(BYTE* data,DWORD size)
 {
+	if (payload)
+	{
+		//Check size
+		if (size<payload->GetSize())
+			return 0;
+		//Copy it
+		memcpy(data,payload->GetData(),payload->GetSize());
+		return payload->GetSize();
+	}
 	if (ctrl)
 		return ctrl->Serialize(data,size);
 	if (cmd)
@@ -808,6 +851,72 @@ void RTMPMetaData::Dump()
 		params[i]->Dump();
 	Debug("[/RTMPMetaData]\n");
 }
+/*************************
+ * MessagePayload
+ *
+ ************************/
+const size_t RTMPMessagePayload::MaxChunkedEntries = 4;
+
+RTMPMessagePayload::Chunked RTMPMessagePayload::GetChunked(DWORD chunkStreamId,DWORD chunkSize) const
+{
+	//Nothing to split if it fits in a single chunk
+	if (!chunkSize || buffer.size()<=chunkSize)
+		return nullptr;
+
+	//Lock, payload is shared by connections on different threads
+	std::lock_guard<std::mutex> lock(mutex);
+
+	//Find entry for this chunk stream and size
+	auto it = std::find_if(chunked.begin(),chunked.end(),[=](const ChunkedEntry& entry){
+		return entry.chunkStreamId==chunkStreamId && entry.chunkSize==chunkSize;
+	});
+
+	//If not found
+	if (it==chunked.end())
+	{
+		//Do not cache too many different layouts
+		if (chunked.size()<MaxChunkedEntries)
+			//Remember the request, it will be built if requested again
+			chunked.push_back({chunkStreamId,chunkSize,nullptr});
+		//Only one viewer so far, chunk it on the fly
+		return nullptr;
+	}
+
+	//If already built
+	if (it->data)
+		//Reuse it
+		return it->data;
+
+	//Type 3 continuation header for this chunk stream
+	RTMPChunkBasicHeader header;
+	header.SetStreamId(chunkStreamId);
+	header.SetFmt(3);
+	BYTE continuation[3];
+	DWORD headerLen = header.Serialize(continuation,sizeof(continuation));
+
+	//Number of continuation headers
+	DWORD num = (buffer.size()-1)/chunkSize;
+	//Allocate wire data
+	auto data = std::make_shared<std::vector<BYTE>>();
+	data->reserve(buffer.size()+num*headerLen);
+
+	//Split payload adding continuation headers between chunks
+	for (DWORD pos=0;pos<buffer.size();pos+=chunkSize)
+	{
+		//Add header except for the first one
+		if (pos)
+			data->insert(data->end(),continuation,continuation+headerLen);
+		//Add chunk data
+		data->insert(data->end(),buffer.begin()+pos,buffer.begin()+std::min<size_t>(pos+chunkSize,buffer.size()));
+	}
+
+	//Store it
+	it->data = data;
+
+	//Done
+	return it->data;
+}
+
 /*************************
  * MediaFrame
  *
@@ -845,6 +954,8 @@ RTMPMediaFrame::RTMPMediaFrame(Type type,QWORD timestamp,DWORD size)
 DWORD RTMPMediaFrame::Parse(BYTE *data,DWORD size)
 {
 	DWORD len = size;
+	//Content is changing
+	InvalidatePayload();
 	//Check size
 	if (pos+len>bufferSize)
 	{
@@ -877,6 +988,24 @@ DWORD RTMPMediaFrame::Serialize(BYTE* data,DWORD size)
 	return mediaSize;
 }
 
+RTMPPayload RTMPMediaFrame::GetPayload()
+{
+	//If not serialized since last change
+	if (!payload)
+	{
+		//Get serialized size
+		DWORD size = GetSize();
+		//Create buffer for the whole message body
+		auto data = std::make_shared<RTMPMessagePayload>(size);
+		//Serialize it once, it will be shared by all the messages created from this frame
+		data->SetSize(Serialize(data->GetData(),size));
+		//Store it
+		payload = data;
+	}
+	//Return shared payload
+	return payload;
+}
+
 RTMPMediaFrame::~RTMPMediaFrame()
 {
 	//Check buffer alwasy
@@ -948,6 +1077,9 @@ void RTMPVideoFrame::Dump()
 
 DWORD RTMPVideoFrame::Parse(BYTE *data,DWORD size)
 {
+	//Content is changing
+	InvalidatePayload();
+
 	BYTE* buffer = data;
 	DWORD bufferLen = size;
 
@@ -1051,6 +1183,9 @@ DWORD RTMPVideoFrame::GetSize()
 
 DWORD RTMPVideoFrame::SetVideoFrame(BYTE* data,DWORD size)
 {
+	//Content is changing
+	InvalidatePayload();
+
 	//Check if enought space
 	if (size>bufferSize)
 		//Failed
@@ -1116,6 +1251,9 @@ void RTMPAudioFrame::Dump()
 
 DWORD RTMPAudioFrame::Parse(BYTE *data,DWORD size)
 {
+	//Content is changing
+	InvalidatePayload();
+
 	BYTE* buffer = data;
 	DWORD bufferLen = size;
 
@@ -1198,6 +1336,9 @@ DWORD RTMPAudioFrame::GetSize()
 
 DWORD RTMPAudioFrame::SetAudioFrame(const BYTE* data,DWORD size)
 {
+	//Content is changing
+	InvalidatePayload();
+
 	//Check if enought space
 	if (size>bufferSize)
 		//Failed
@@ -6,6 +6,8 @@
 #include <errno.h>
 #include <sys/poll.h>
 #include <fcntl.h>
+#include <algorithm>
+#include <thread>
 #include "tools.h"
 #include "log.h"
 #include "assertions.h"
@@ -43,18 +45,41 @@ RTMPServer::~RTMPServer()
 
 /************************
 * Init
-* 	Open the listening server port
+* 	Open the listening server port and start the connection event loops
 *************************/
-int RTMPServer::Init(int port)
+int RTMPServer::Init(int port,DWORD numLoops)
 {
-	Log("-RTMPServer::Init() [port:%d]\n",port);
+	//By default one loop per core
+	if (!numLoops)
+		numLoops = std::max(1u,std::thread::hardware_concurrency());
+
+	Log("-RTMPServer::Init() [port:%d,loops:%u]\n",port,numLoops);
 	
 	//Check not already inited
 	if (inited)
 		//Error
 		return Error("-RTMPServer::Init() RTMP Server is already running.\n");
 
-	
+	//Create event loops
+	for (DWORD i=0;i<numLoops;++i)
+	{
+		//Create new loop
+		auto loop = std::make_shared<RTMPEventLoop>();
+		//Start it
+		if (!loop->Start())
+		{
+			//Stop already started ones
+			for (auto& started : loops)
+				started->Stop();
+			//Clean
+			loops.clear();
+			//Error
+			return Error("-RTMPServer::Init() Could not start event loop\n");
+		}
+		//Add it
+		loops.push_back(loop);
+	}
+
 
 	//Save server port
 	serverPort = port;
@@ -173,11 +198,6 @@ init:
 			goto init;
 		}
 
-		//Set non blocking again
-		fsflags = fcntl(fd,F_GETFL,0);
-		fsflags |= O_NONBLOCK;
-		fcntl(fd,F_SETFL,fsflags);
-
 		//Create the connection
 		CreateConnection(fd);
 	}
@@ -193,24 +213,29 @@ init:
  *************************/
 void RTMPServer::CreateConnection(int fd)
 {
-	//Create new RTMP connection
-	auto rtmp = std::make_shared<RTMPConnection>(this);
+	//Get the event loop with less connections
+	auto loop = *std::min_element(loops.begin(),loops.end(),[](const auto& a,const auto& b){
+		return a->GetConnectionsCount()<b->GetConnectionsCount();
+	});
 
-	Log(">RTMPServer::CreateConnection() connection [fd:%d,%p]\n",fd,rtmp);
+	//Create new RTMP connection
+	auto rtmp = std::make_shared<RTMPConnection>(this,*loop);
 
-	//Init connection
-	rtmp->Init(fd);
+	Log(">RTMPServer::CreateConnection() connection [fd:%d,%p]\n",fd,rtmp.get());
 
 	//Lock list
 	pthread_mutex_lock(&sessionMutex);
 
-	//Append
+	//Append before starting it, as it could be disconnected right away
 	connections[fd] = rtmp;
 
 	//Unlock
 	pthread_mutex_unlock(&sessionMutex);
 
-	Log("<RTMPServer::CreateConnection() [0x%x]\n",rtmp);
+	//Init connection
+	rtmp->Init(fd);
+
+	Log("<RTMPServer::CreateConnection() [%p]\n",rtmp.get());
 }
 
 /*********************
@@ -284,6 +309,12 @@ int RTMPServer::End()
         pthread_join(serverThread,NULL);
         Log("-RTMPServer::End() Joined server thread [%d]\n",serverThread);
 
+	//Stop all event loops, will disconnect all connections
+	for (auto& loop : loops)
+		loop->Stop();
+	//Release them
+	loops.clear();
+
 	//Delete connections
 	DeleteAllConnections();
 
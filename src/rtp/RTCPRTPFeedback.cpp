@@ -66,6 +66,9 @@ DWORD RTCPRTPFeedback::Parse(const BYTE* data,DWORD size)
 	mediaSSRC = get4(data,len+4);
 	//skip fields
 	len += 8;
+	//NACK fields are fixed size, reserve them all at once
+	if (feedbackType==NACK && packetSize>len)
+		fields.reserve(fields.size()+(packetSize-len)/4);
 	//While we have more
 	while (len<packetSize)
 	{
@@ -147,213 +150,58 @@ DWORD RTCPRTPFeedback::Serialize(BYTE* data,DWORD size)
 }
 
 
-DWORD RTCPRTPFeedback::TransportWideFeedbackMessageField::GetSize() const
+namespace {
+
+//Statuses pending to be written on next chunk, at most 14 different ones, longer runs are all the same so only counted
+class PendingStatuses
 {
-	//If we have no packets
-	if (packets.size()==0)
-		return 0;
-	
-	//Initial time in us
-	QWORD time = 0;
-	
-	//Calculate temporal info
-	bool firstReceived	= false;
-	QWORD referenceTime	= 0;
-	
-	//Store delta array
-	std::list<int> deltas;
-	std::list<PacketStatus> statuses;
-	PacketStatus lastStatus = PacketStatus::Reserved;
-	PacketStatus maxStatus = PacketStatus::NotReceived;
-	bool allsame = true;
-	
-	//Header
-	DWORD len = 8;
-	
-	//For each packet 
-	for (Packets::const_iterator it = packets.begin(); it!=packets.end(); ++it)
+public:
+	using PacketStatus = RTCPRTPFeedback::TransportWideFeedbackMessageField::PacketStatus;
+	static constexpr DWORD Capacity = 16;
+public:
+	void push_back(PacketStatus status)
 	{
-		PacketStatus status = PacketStatus::NotReceived;
-		
-		//If got packet
-		if (it->second)
-		{
-			int delta = 0;
-			//If first received
-			if (!firstReceived)
-			{
-				//Got it 
-				firstReceived = true;
-				//Set it as 3 bytes signed integer
-				referenceTime = (it->second/64000) & 0x7FFFFF;
-				//Get initial time
-				time = referenceTime * 64000;
-			}
-					
-			//Get delta
-			if (it->second>time)
-				delta = (it->second-time)/250;
-			else
-				delta = -(int)((time-it->second)/250);
-			//If it is negative or to big
-			if (delta<0 || delta> 127)
-				//Big one
-				status = PacketStatus::LargeOrNegativeDelta;
-			else
-				//Small
-				status = PacketStatus::SmallDelta;
-			//Store delta
-			deltas.push_back(delta);
-			//Set next time
-			time = time + delta*250;
-		}
-		
-		//Check if all previoues ones were equal and this one the firt different
-		if (allsame && lastStatus!=PacketStatus::Reserved && status!=lastStatus)
-		{
-			//Anything bigger is worth a run
-			if (statuses.size()>7)
-			{
-				//One chunk
-				len+=2;
-				//Remove all statuses
-				statuses.clear();
-				//REset
-				lastStatus = PacketStatus::Reserved;
-				maxStatus = PacketStatus::NotReceived;
-				allsame = true;
-			} else {
-				//Not same
-				allsame = false;
-			}
-		}
-		
-		//Push back statuses, it will be handled later
-		statuses.push_back(status);
-		
-		//If it is bigger
-		if (status>maxStatus)
-			//Store it
-			maxStatus = status;
-		//Store las status
-		lastStatus = status;
-
-		//If they are different already
-		if (!allsame)
-		{
-			//Check 
-			if (maxStatus==PacketStatus::LargeOrNegativeDelta && statuses.size()>6)
-			{
-				//One chunk
-				len+=2;
-				//Remove next 7
-				for (DWORD i=0;i<7;++i)
-					//Remove
-					statuses.pop_front();
-				//REset
-				lastStatus = PacketStatus::Reserved;
-				maxStatus = PacketStatus::NotReceived;
-				allsame = true;
-				// We need to restore the values, as there may be more elements on the buffer
-				for (auto it = statuses.begin(); it!=statuses.end(); ++it)
-				{
-					//Get status
-					status = *it;
-					//If it is bigger
-					if (status>maxStatus)
-						//Store it
-						maxStatus = status;
-					//Check if it is the same
-					if (allsame && lastStatus!=PacketStatus::Reserved && status!=lastStatus)
-						//not the same
-						allsame = false;
-					//Store las status
-					lastStatus = status;
-				}
-			} else if (statuses.size()>13) {
-				//One chunk
-				len+=2;
-				//Remove last 14
-				for (DWORD i=0;i<14;++i)
-					//Remove
-					statuses.pop_front();
-				//REset
-				lastStatus = PacketStatus::Reserved;
-				maxStatus = PacketStatus::NotReceived;
-				allsame = true;
-			}
-		}
+		//Only store while there is room, runs are all the same
+		if (count<Capacity)
+			items[(first+count)%Capacity] = status;
+		count++;
 	}
-	
-	//If not finished yet
-	if (statuses.size()>0)
-		//One chunk more
-		len+=2;
-	
-	//Write now the deltas
-	for (std::list<int>::iterator it = deltas.begin(); it!=deltas.end(); ++it)
+	void pop_front()
 	{
-		//Check size
-		if (*it<0 || *it>127)
-		{
-			//2 bytes
-			//Inc
-			len += 2;
-		} else {
-			//1 byte
-			//Inc
-			len ++;
-		}
+		first = (first+1)%Capacity;
+		count--;
 	}
+	PacketStatus front() const		{ return items[first];				}
+	PacketStatus operator[](DWORD i) const	{ return items[(first+i)%Capacity];		}
+	DWORD size() const			{ return count;					}
+	void clear()				{ first = 0; count = 0;				}
+private:
+	PacketStatus items[Capacity];
+	DWORD first = 0;
+	DWORD count = 0;
+};
 
-	//Add zero padding
-	if (len%4)
-		//DWORD boundary
-		len += 4 - (len%4);
-	
-	//Done
-	return len;
 }
 
-DWORD RTCPRTPFeedback::TransportWideFeedbackMessageField::Serialize(BYTE* data,DWORD size) const
+DWORD RTCPRTPFeedback::TransportWideFeedbackMessageField::Encode(BitWritter* writter,BYTE* deltas,DWORD& deltasLen) const
 {
-	//If we have no packets
-	if (packets.size()==0)
-		return 0;
+	//Initial time in us
+	QWORD time = 0;
 	
 	//Calculate temporal info
-	WORD baseSeqNumber	= packets.begin()->first;
 	bool firstReceived	= false;
 	QWORD referenceTime	= 0;
-	WORD packetStatusCount	= packets.size();
-
-	/*
-		0                   1                   2                   3
-		0 1 2 3 4 5 6 7 8 9 0 1 2 3 4 5 6 7 8 9 0 1 2 3 4 5 6 7 8 9 0 1
-	       +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
-	       |      base sequence number     |      packet status count      |
-	       +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
-	       |                 reference time                | fb pkt. count |
-	       +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+	
-	 */
-	//Set data
-	set2(data,0,baseSeqNumber);
-	set2(data,2,packetStatusCount);
-	//Set3 referenceTime when first received
-	set1(data,7,feedbackPacketCount);
-	
-	//Initial time in us
-	QWORD time = 0;
 	
-	//Store delta array
-	std::list<int> deltas;
-	std::list<PacketStatus> statuses;
+	//Pending statuses
+	PendingStatuses statuses;
 	PacketStatus lastStatus = PacketStatus::Reserved;
 	PacketStatus maxStatus = PacketStatus::NotReceived;
 	bool allsame = true;
 	
-	//Bitwritter for the rest
-	BitWritter writter(data+8,size-8);
+	//Chunks length
+	DWORD len = 0;
+	//No deltas yet
+	deltasLen = 0;
 	
 	//For each packet 
 	for (Packets::const_iterator it = packets.begin(); it!=packets.end(); ++it)
@@ -373,8 +221,6 @@ DWORD RTCPRTPFeedback::TransportWideFeedbackMessageField::Serialize(BYTE* data,D
 				referenceTime = (it->second/64000) & 0x7FFFFF;
 				//Get initial time
 				time = referenceTime * 64000;
-				//also in bufffer
-				set3(data,4,referenceTime);
 			}
 			
 			//Get delta
@@ -384,13 +230,21 @@ DWORD RTCPRTPFeedback::TransportWideFeedbackMessageField::Serialize(BYTE* data,D
 				delta = -(int)((time-it->second)/250);
 			//If it is negative or to big
 			if (delta<0 || delta> 127)
+			{
 				//Big one
 				status = PacketStatus::LargeOrNegativeDelta;
-			else
+				//2 bytes
+				if (deltas) set2(deltas,deltasLen,(short)delta);
+				//Inc
+				deltasLen += 2;
+			} else {
 				//Small
 				status = PacketStatus::SmallDelta;
-			//Store delta
-			deltas.push_back(delta);
+				//1 byte
+				if (deltas) set1(deltas,deltasLen,(BYTE)delta);
+				//Inc
+				deltasLen ++;
+			}
 			//Set next time
 			time = time + delta*250;
 		}
@@ -410,9 +264,14 @@ DWORD RTCPRTPFeedback::TransportWideFeedbackMessageField::Serialize(BYTE* data,D
 				       +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
 					T = 0
 				 */
-				writter.Put(1,0);
-				writter.Put(2,lastStatus);
-				writter.Put(13,statuses.size());
+				if (writter)
+				{
+					writter->Put(1,0);
+					writter->Put(2,lastStatus);
+					writter->Put(13,statuses.size());
+				}
+				//One chunk
+				len+=2;
 				//Remove all statuses
 				statuses.clear();
 				//Reset status
@@ -450,25 +309,30 @@ DWORD RTCPRTPFeedback::TransportWideFeedbackMessageField::Serialize(BYTE* data,D
 					T = 1
 					S = 1
 				 */
-				writter.Put(1,1);
-				writter.Put(1,1);
+				if (writter)
+				{
+					writter->Put(1,1);
+					writter->Put(1,1);
+				}
 				//Set next 7
 				for (DWORD i=0;i<7;++i)
 				{
 					//Write
-					writter.Put(2,(BYTE)statuses.front());
+					if (writter) writter->Put(2,(BYTE)statuses.front());
 					//Remove
 					statuses.pop_front();
 				}
+				//One chunk
+				len+=2;
 				//REset
 				lastStatus = PacketStatus::Reserved;
 				maxStatus = PacketStatus::NotReceived;
 				allsame = true;
 				// We need to restore the values, as there may be more elements on the buffer
-				for (auto it = statuses.begin(); it!=statuses.end(); ++it)
+				for (DWORD i=0; i<statuses.size(); ++i)
 				{
 					//Get status
-					status = *it;
+					status = statuses[i];
 					//If it is bigger
 					if (status>maxStatus)
 						//Store it
@@ -490,16 +354,21 @@ DWORD RTCPRTPFeedback::TransportWideFeedbackMessageField::Serialize(BYTE* data,D
 					 T = 1
 					 S = 0
 				 */
-				writter.Put(1,1);
-				writter.Put(1,0);
-				//Set next 7
+				if (writter)
+				{
+					writter->Put(1,1);
+					writter->Put(1,0);
+				}
+				//Set next 14
 				for (DWORD i=0;i<14;++i)
 				{
 					//Write
-					writter.Put(1,(BYTE)statuses.front());
+					if (writter) writter->Put(1,(BYTE)statuses.front());
 					//Remove
 					statuses.pop_front();
 				}
+				//One chunk
+				len+=2;
 				//REset
 				lastStatus = PacketStatus::Reserved;
 				maxStatus = PacketStatus::NotReceived;
@@ -511,57 +380,122 @@ DWORD RTCPRTPFeedback::TransportWideFeedbackMessageField::Serialize(BYTE* data,D
 	//If not finished yet
 	if (statuses.size()>0)
 	{
+		//One chunk more
+		len+=2;
+		//If only counting
+		if (!writter)
+			//Done
+			return len;
 		//How big was the same run
 		if (allsame)
 		{
 			//Write run!
-			writter.Put(1,0);
-			writter.Put(2,lastStatus);
-			writter.Put(13,statuses.size());
+			writter->Put(1,0);
+			writter->Put(2,lastStatus);
+			writter->Put(13,statuses.size());
 		} else if (maxStatus==PacketStatus::LargeOrNegativeDelta) {
 			//Write chunk
-			writter.Put(1,1);
-			writter.Put(1,1);
+			writter->Put(1,1);
+			writter->Put(1,1);
 			//Wirte rest
-			for (std::list<PacketStatus>::iterator it = statuses.begin(); it!= statuses.end(); ++it)
+			for (DWORD i=0; i<statuses.size(); ++i)
 				//Write
-				writter.Put(2,(BYTE)*it);
+				writter->Put(2,(BYTE)statuses[i]);
 			//Write pending
-			writter.Put(14-statuses.size()*2,0);
+			writter->Put(14-statuses.size()*2,0);
 		} else {
 			//Write chunck
-			writter.Put(1,1);
-			writter.Put(1,0);
+			writter->Put(1,1);
+			writter->Put(1,0);
 			//Wirte rest
-			for (std::list<PacketStatus>::iterator it = statuses.begin(); it!= statuses.end(); ++it)
+			for (DWORD i=0; i<statuses.size(); ++i)
 				//Write
-				writter.Put(1,(BYTE)*it);
+				writter->Put(1,(BYTE)statuses[i]);
 			//Write pending
-			writter.Put(14-statuses.size(),0);
+			writter->Put(14-statuses.size(),0);
 		}
 	}
 	
-	//Flush wirtter and aling, count also header
-	DWORD len = writter.Flush()+8;
+	//Done
+	return len;
+}
+
+DWORD RTCPRTPFeedback::TransportWideFeedbackMessageField::GetSize() const
+{
+	//If we have no packets
+	if (packets.size()==0)
+		return 0;
+	
+	//Count chunks and deltas
+	DWORD deltasLen = 0;
+	//Header
+	DWORD len = 8 + Encode(nullptr,nullptr,deltasLen) + deltasLen;
+
+	//Add zero padding
+	if (len%4)
+		//DWORD boundary
+		len += 4 - (len%4);
+	
+	//Done
+	return len;
+}
+
+DWORD RTCPRTPFeedback::TransportWideFeedbackMessageField::Serialize(BYTE* data,DWORD size) const
+{
+	//If we have no packets
+	if (packets.size()==0)
+		return 0;
+	
+	//Get chunks length, deltas go right after them
+	DWORD deltasLen = 0;
+	DWORD chunksLen = Encode(nullptr,nullptr,deltasLen);
+	
+	//Check size including padding
+	if (size<((8+chunksLen+deltasLen+3) & ~3u))
+		//Error
+		return 0;
 	
-	//Write now the deltas
-	for (std::list<int>::iterator it = deltas.begin(); it!=deltas.end(); ++it)
+	//Calculate temporal info
+	WORD baseSeqNumber	= packets.begin()->first;
+	QWORD referenceTime	= 0;
+	WORD packetStatusCount	= packets.size();
+	
+	//Reference time is taken from the first received one
+	for (Packets::const_iterator it = packets.begin(); it!=packets.end(); ++it)
 	{
-		//Check size
-		if (*it<0 || *it>127)
+		//If got packet
+		if (it->second)
 		{
-			//2 bytes
-			set2(data,len,(short)*it);
-			//Inc
-			len += 2;
-		} else {
-			//1 byte
-			set1(data,len,(BYTE)*it);
-			//Inc
-			len ++;
+			//Set it as 3 bytes signed integer
+			referenceTime = (it->second/64000) & 0x7FFFFF;
+			break;
 		}
 	}
 
+	/*
+		0                   1                   2                   3
+		0 1 2 3 4 5 6 7 8 9 0 1 2 3 4 5 6 7 8 9 0 1 2 3 4 5 6 7 8 9 0 1
+	       +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+	       |      base sequence number     |      packet status count      |
+	       +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+	       |                 reference time                | fb pkt. count |
+	       +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+	
+	 */
+	//Set data
+	set2(data,0,baseSeqNumber);
+	set2(data,2,packetStatusCount);
+	set3(data,4,referenceTime);
+	set1(data,7,feedbackPacketCount);
+	
+	//Bitwritter for the chunks
+	BitWritter writter(data+8,chunksLen);
+	
+	//Write chunks and deltas in a single pass
+	Encode(&writter,data+8+chunksLen,deltasLen);
+	
+	//Flush wirtter and aling, count also header and deltas
+	DWORD len = writter.Flush()+8+deltasLen;
+
 	//Add zero padding
 	while (len%4)
 		//Add padding
@@ -588,6 +522,7 @@ DWORD RTCPRTPFeedback::TransportWideFeedbackMessageField::Parse(const BYTE* data
 
 	//Rseserve initial space
 	statuses.reserve(packetStatusCount);
+	packets.reserve(packetStatusCount);
 
 	//Where we are 
 	DWORD len = 8;
@@ -674,7 +609,7 @@ DWORD RTCPRTPFeedback::TransportWideFeedbackMessageField::Parse(const BYTE* data
 		{
 			case PacketStatus::NotReceived:
 				//Append not received
-				packets[baseSeqNumber+i] = 0;
+				packets.insert(std::make_pair(baseSeqNumber+i,0));
 				break;
 			case PacketStatus::SmallDelta:
 			{
@@ -688,7 +623,7 @@ DWORD RTCPRTPFeedback::TransportWideFeedbackMessageField::Parse(const BYTE* data
 				//Increase delta
 				len += 1;
 				//Append it
-				packets[baseSeqNumber+i] = time;
+				packets.insert(std::make_pair(baseSeqNumber+i,time));
 				break;
 			}
 			case PacketStatus::LargeOrNegativeDelta:
@@ -704,7 +639,7 @@ DWORD RTCPRTPFeedback::TransportWideFeedbackMessageField::Parse(const BYTE* data
 				//Increase delta
 				time += delta;
 				//Append it
-				packets[baseSeqNumber+i] = time;
+				packets.insert(std::make_pair(baseSeqNumber+i,time));
 				break;	
 			}
 			case PacketStatus::Reserved:
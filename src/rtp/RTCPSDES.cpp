@@ -126,7 +126,7 @@ void RTCPSDES::Description::Dump()
 	{
 		Debug("\t\t[Description ssrc=%u count=%u\n",ssrc,items.size());
 		for(Items::iterator it=items.begin();it!=items.end();++it)
-			Debug("\t\t\t[%s '%.*s'/]\n",RTCPSDES::Item::TypeToString((*it)->GetType()),(*it)->GetSize(),(*it)->GetData());
+			Debug("\t\t\t[%s '%s'/]\n",RTCPSDES::Item::TypeToString((*it)->GetType()),std::string((const char*)(*it)->GetData(),(*it)->GetSize()).c_str());
 		Debug("\t\t[/Description]\n");
 	} else
 		Debug("\t\t[Description ssrc=%u/]\n",ssrc);
@@ -1,5 +1,6 @@
 #include "rtp/RTPIncomingMediaStreamDepacketizer.h"
 #include "use.h"
+#include "Metrics.h"
 
 RTPIncomingMediaStreamDepacketizer::RTPIncomingMediaStreamDepacketizer(RTPIncomingMediaStream* incomingSource) :
 	timeService(incomingSource->GetTimeService())
@@ -46,8 +47,13 @@ void RTPIncomingMediaStreamDepacketizer::onRTP(RTPIncomingMediaStream* group,con
 	if (!depacketizer)
 		//Do nothing
 		return;
+	//Time depacketizing of all streams
+	static Metrics::Histogram& depacketizeTime = Metrics::GetHistogram("mediaserver_rtp_depacketize_seconds","Time depacketizing each rtp packet","",1E-9);
+	QWORD ini = Metrics::Now();
 	//Pass the pakcet to the depacketizer
 	 MediaFrame* frame = depacketizer->AddPacket(packet);
+	//Update stats
+	depacketizeTime.Record(Metrics::Now()-ini);
 
 	 //If we have a new frame
 	 if (frame)
@@ -37,7 +37,7 @@ void RTPIncomingMediaStreamMultiplexer::RemoveListener(RTPIncomingMediaStream::L
 void RTPIncomingMediaStreamMultiplexer::onRTP(RTPIncomingMediaStream* stream,const RTPPacket::shared& packet)
 {
 	//Dispatch in thread async
-	timeService.Async([=](...){
+	timeService.Post([=](...){
 		//Deliver to all listeners
 		for (auto listener : listeners)
 			//Dispatch rtp packet
@@ -48,7 +48,7 @@ void RTPIncomingMediaStreamMultiplexer::onRTP(RTPIncomingMediaStream* stream,con
 void RTPIncomingMediaStreamMultiplexer::onRTP(RTPIncomingMediaStream* stream,const std::vector<RTPPacket::shared>& packets)
 {
 	//Dispatch in thread async
-	timeService.Async([=](...){
+	timeService.Post([=](...){
 		//For each packet
 		for (const auto& packet : packets)
 			//Deliver to all listeners
@@ -295,8 +295,10 @@ RTPIncomingSource* RTPIncomingSourceGroup::Process(RTPPacket::shared &packet)
 	//if it is video
 	if (type == MediaFrame::Video)
 	{
-		//Check if we can ge the layer info
-		auto info = VideoLayerSelector::GetLayerIds(packet);
+		//Classify it once for all the layer selectors
+		packet->layerClassification = VideoLayerSelector::Classify(packet);
+		//Get the layer info from it
+		auto info = VideoLayerSelector::GetLayerIds(packet,packet->layerClassification);
 		//UltraDebug("-VideoLayerSelector::GetLayerIds() | [id:%x,tid:%u,sid:%u]\n",info.GetId(),info.temporalLayerId,info.spatialLayerId);
 		//Update source and layer info
 		source->Update(time, packet->GetSeqNum(), packet->GetRTPHeader().GetSize() + packet->GetMediaLength(), info, VideoLayerSelector::AreLayersInfoeAggregated(packet));
@@ -127,6 +127,7 @@ RTPPacket::shared RTPPacket::Clone() const
 	cloned->vp9PayloadDescriptor = vp9PayloadDescriptor;
 	cloned->activeDecodeTargets  = activeDecodeTargets;
 	cloned->templateDependencyStructure = templateDependencyStructure;
+	cloned->layerClassification  = layerClassification;
 	//Return it
 	return cloned;
 }
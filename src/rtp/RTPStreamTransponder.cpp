@@ -2,6 +2,7 @@
 #include "waitqueue.h"
 #include "vp8/vp8.h"
 #include "DependencyDescriptorLayerSelector.h"
+#include <optional>
 
 
 RTPStreamTransponder::RTPStreamTransponder(RTPOutgoingSourceGroup* outgoing,RTPSender* sender) :
@@ -95,31 +96,49 @@ void RTPStreamTransponder::Close()
 
 
 void RTPStreamTransponder::onRTP(RTPIncomingMediaStream* stream,const RTPPacket::shared& packet)
+{
+	Rewrite rewrite;
+	
+	//Update state and check if it has to be forwarded
+	if (!Process(packet,rewrite))
+		//Drop
+		return;
+	
+	//Send packet
+	if (sender)
+		//Create clone on sender thread
+		sender->Enqueue(packet,[rewrite = std::move(rewrite)](const RTPPacket::shared& packet) -> RTPPacket::shared {
+			//Clone and rewrite it
+			return rewrite.Apply(packet);
+		});
+}
+
+bool RTPStreamTransponder::Process(const RTPPacket::shared& packet,Rewrite& rewrite)
 {
 	
 	if (!packet)
 		//Exit
-		return;
+		return false;
 	
 	//If muted
 	if (muted)
 		//Skip
-		return;
+		return false;
 
 	//Check if it is an empty packet
 	if (!packet->GetMediaLength())
 	{
-		UltraDebug("-RTPStreamTransponder::onRTP() | dropping empty packet\n");
+		UltraDebug("-RTPStreamTransponder::Process() | dropping empty packet\n");
 		//Drop it
 		dropped++;
 		//Exit
-		return;
+		return false;
 	}
 	
 	//Check sender
 	if (!sender)
 		//Nothing
-		return;
+		return false;
 	
 	//Check if source has changed
 	if (source && packet->GetSSRC()!=source)
@@ -161,6 +180,10 @@ void RTPStreamTransponder::onRTP(RTPIncomingMediaStream* stream,const RTPPacket:
 		//No layer
 		spatialLayerId = LayerInfo::MaxLayerId;
 		temporalLayerId = LayerInfo::MaxLayerId;
+		autoSpatialLayerId = LayerInfo::MaxLayerId;
+		autoTemporalLayerId = LayerInfo::MaxLayerId;
+		lastAutoLayerSelection = 0;
+		lastAutoLayerSwitch = 0;
 		
 		//Reset frame numbers
 		firstFrameNumber = NoFrameNum;
@@ -206,7 +229,7 @@ void RTPStreamTransponder::onRTP(RTPIncomingMediaStream* stream,const RTPPacket:
 	//Ensure it is not before first one
 	if (extSeqNum<firstExtSeqNum)
 		//Exit
-		return;
+		return false;
 	
 	//Only for viedo
 	if (packet->GetMediaType()==MediaFrame::Video)
@@ -228,9 +251,19 @@ void RTPStreamTransponder::onRTP(RTPIncomingMediaStream* stream,const RTPPacket:
 	//If we have selector for codec
 	if (selector)
 	{
-		//Select layer
-		selector->SelectSpatialLayer(spatialLayerId);
-		selector->SelectTemporalLayer(temporalLayerId);
+		//If selecting the layer from the viewer estimation
+		if (autoLayerSelection)
+		{
+			//Check if it has to be changed
+			UpdateAutoLayer(getTimeMS());
+			//Select layer
+			selector->SelectSpatialLayer(autoSpatialLayerId);
+			selector->SelectTemporalLayer(autoTemporalLayerId);
+		} else {
+			//Select layer
+			selector->SelectSpatialLayer(spatialLayerId);
+			selector->SelectTemporalLayer(temporalLayerId);
+		}
 		
 		//Select pacekt
 		if (!packet->GetMediaLength() || !selector->Select(packet,mark))
@@ -241,12 +274,12 @@ void RTPStreamTransponder::onRTP(RTPIncomingMediaStream* stream,const RTPPacket:
 			if (selector->IsWaitingForIntra() && getTimeDiffMS(lastSentPLI)>1E3)
 			{
 				//Log
-				//UltraDebug("-RTPStreamTransponder::onRTP() | selector IsWaitingForIntra\n");
+				//UltraDebug("-RTPStreamTransponder::Process() | selector IsWaitingForIntra\n");
 				//Request it again
 				RequestPLI();
 			}
 			//Drop
-			return;
+			return false;
 		}
 		//Get current spatial layer id
 		lastSpatialLayerId = selector->GetSpatialLayer();
@@ -375,41 +408,53 @@ void RTPStreamTransponder::onRTP(RTPIncomingMediaStream* stream,const RTPPacket:
 	//Get last frame number
 	lastFrameNumber = continousFrameNumber;
 	
-	//Send packet
-	if (sender)
-		//Create clone on sender thread
-		sender->Enqueue(packet,[=](const RTPPacket::shared& packet) -> RTPPacket::shared {
-			//Clone packet
-			auto cloned = packet->Clone();
-			//Set new seq numbers
-			cloned->SetExtSeqNum(extSeqNum);
-			//Set normailized timestamp
-			cloned->SetTimestamp(timestamp);
-			//Set mark again
-			cloned->SetMark(mark);
-			//Change ssrc
-			cloned->SetSSRC(ssrc);
-			//We need to rewrite vp8 picture ids
-			cloned->rewitePictureIds = rewitePictureIds;
-			//Ensure we have desc
-			if (cloned->vp8PayloadDescriptor)
-			{
-				//Rewrite picture id
-				cloned->vp8PayloadDescriptor->pictureId = pictureId;
-				//Rewrite tl0 index
-				cloned->vp8PayloadDescriptor->temporalLevelZeroIndex = temporalLevelZeroIndex;
-			}
-			//If it has a dependency descriptor
-			if (forwaredDecodeTargets && cloned->HasTemplateDependencyStructure())
-				//Override mak
-				cloned->OverrideActiveDecodeTargets(forwaredDecodeTargets);
-			//If we have a continous frame number
-			if (cloned->HasDependencyDestriptor() && continousFrameNumber!=NoFrameNum)
-				//Update it
-				cloned->OverrideFrameNumber(static_cast<uint16_t>(continousFrameNumber));
-			//Move it
-			return cloned;
-		});
+	//Set rewrite for the forwarded packet
+	rewrite.extSeqNum		= extSeqNum;
+	rewrite.timestamp		= timestamp;
+	rewrite.mark			= mark;
+	rewrite.ssrc			= ssrc;
+	rewrite.rewitePictureIds	= rewitePictureIds;
+	rewrite.pictureId		= pictureId;
+	rewrite.temporalLevelZeroIndex	= temporalLevelZeroIndex;
+	rewrite.continousFrameNumber	= continousFrameNumber;
+	rewrite.forwaredDecodeTargets	= std::move(forwaredDecodeTargets);
+	
+	//Forward it
+	return true;
+}
+
+RTPPacket::shared RTPStreamTransponder::Rewrite::Apply(const RTPPacket::shared& packet) const
+{
+	//Clone packet
+	auto cloned = packet->Clone();
+	//Set new seq numbers
+	cloned->SetExtSeqNum(extSeqNum);
+	//Set normailized timestamp
+	cloned->SetTimestamp(timestamp);
+	//Set mark again
+	cloned->SetMark(mark);
+	//Change ssrc
+	cloned->SetSSRC(ssrc);
+	//We need to rewrite vp8 picture ids
+	cloned->rewitePictureIds = rewitePictureIds;
+	//Ensure we have desc
+	if (cloned->vp8PayloadDescriptor)
+	{
+		//Rewrite picture id
+		cloned->vp8PayloadDescriptor->pictureId = pictureId;
+		//Rewrite tl0 index
+		cloned->vp8PayloadDescriptor->temporalLevelZeroIndex = temporalLevelZeroIndex;
+	}
+	//If it has a dependency descriptor
+	if (forwaredDecodeTargets && cloned->HasTemplateDependencyStructure())
+		//Override mak
+		cloned->OverrideActiveDecodeTargets(forwaredDecodeTargets);
+	//If we have a continous frame number
+	if (cloned->HasDependencyDestriptor() && continousFrameNumber!=NoFrameNum)
+		//Update it
+		cloned->OverrideFrameNumber(static_cast<uint16_t>(continousFrameNumber));
+	//Move it
+	return cloned;
 }
 
 void RTPStreamTransponder::onBye(RTPIncomingMediaStream* stream)
@@ -481,6 +526,113 @@ void RTPStreamTransponder::SelectLayer(int spatialLayerId,int temporalLayerId)
 		RequestPLI();
 }
 
+void RTPStreamTransponder::SetAutoLayerSelection(bool enabled)
+{
+	//Log
+	UltraDebug("-RTPStreamTransponder::SetAutoLayerSelection() | [enabled:%d]\n", enabled);
+
+	autoLayerSelection = enabled;
+}
+
+void RTPStreamTransponder::UpdateAutoLayer(QWORD now)
+{
+	//Do not check on every packet
+	if (lastAutoLayerSelection && now-lastAutoLayerSelection<AutoLayerSelectionInterval)
+		//Keep current one
+		return;
+	//Update last check
+	lastAutoLayerSelection = now;
+	
+	//Get viewer estimation
+	DWORD available = sender ? sender->GetAvailableBitrate() : 0;
+	//Get the incoming layer bitrates
+	const RTPIncomingSource* source = incoming ? incoming->GetMediaSource() : nullptr;
+	
+	//Best layer fitting in the estimation and lowest one as fallback
+	std::optional<LayerInfo> selected;
+	std::optional<LayerInfo> lowest;
+	DWORD selectedBitrate = 0;
+	DWORD lowestBitrate = 0;
+	
+	//If we have both the estimation and the layers
+	if (available && source)
+	{
+		//Current auto selected layer
+		WORD current = LayerInfo(autoTemporalLayerId,autoSpatialLayerId).GetId();
+		
+		//Layers are ordered by spatial and then temporal id
+		for (const auto& [id,layer] : source->layers)
+		{
+			//Skip layers above the manual selection or not being received
+			if (layer.spatialLayerId>spatialLayerId || layer.temporalLayerId>temporalLayerId || !layer.bitrate)
+				//Next
+				continue;
+			//Get bitrate required to decode the layer
+			DWORD bitrate = layer.bitrate;
+			//If each packet is only accounted on its own layer
+			if (!source->aggregatedLayers)
+				//Add the bitrate of the layers it depends on
+				for (const auto& [otherId,other] : source->layers)
+					if (otherId!=id && other.spatialLayerId<=layer.spatialLayerId && other.temporalLayerId<=layer.temporalLayerId)
+						bitrate += other.bitrate;
+			//First one is the lowest
+			if (!lowest)
+			{
+				//Store it
+				lowest = layer;
+				lowestBitrate = bitrate;
+			}
+			//Require some headroom for going up
+			double margin = id>current ? AutoLayerUpSwitchMargin : 1.0;
+			//If it fits
+			if (bitrate*margin<=available)
+			{
+				//Highest one so far
+				selected = layer;
+				selectedBitrate = bitrate;
+			}
+		}
+		//If none fits
+		if (!selected)
+		{
+			//Use the lowest one
+			selected = lowest;
+			selectedBitrate = lowestBitrate;
+		}
+		//Don't go up again too soon after a switch
+		if (selected && selected->GetId()>current && lastAutoLayerSwitch && now-lastAutoLayerSwitch<AutoLayerUpSwitchDelay)
+			//Keep current one
+			return;
+	}
+	
+	//If we can't decide
+	if (!selected)
+	{
+		//Use manual selection
+		autoSpatialLayerId  = spatialLayerId;
+		autoTemporalLayerId = temporalLayerId;
+		//Done
+		return;
+	}
+	
+	//If not changed
+	if (selected->spatialLayerId==autoSpatialLayerId && selected->temporalLayerId==autoTemporalLayerId)
+		//Nothing to do
+		return;
+	
+	Debug("-RTPStreamTransponder::UpdateAutoLayer() | Switching layer [sid:%d,tid:%d,bitrate:%u,available:%u]\n",selected->spatialLayerId,selected->temporalLayerId,selectedBitrate,available);
+	
+	//Switch
+	autoSpatialLayerId  = selected->spatialLayerId;
+	autoTemporalLayerId = selected->temporalLayerId;
+	//Update last switch time
+	lastAutoLayerSwitch = now;
+	
+	if (lastSpatialLayerId!=autoSpatialLayerId)
+		//Request update on the incoming
+		RequestPLI();
+}
+
 void RTPStreamTransponder::Mute(bool muting)
 {
 	//Log
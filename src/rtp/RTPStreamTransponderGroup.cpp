@@ -0,0 +1,154 @@
+#include "rtp/RTPStreamTransponderGroup.h"
+#include <algorithm>
+
+
+RTPStreamTransponderGroup::RTPStreamTransponderGroup(DWORD ssrc,TimeService& timeService) :
+	timeService(timeService)
+{
+	//Store ssrc
+	this->ssrc = ssrc;
+}
+
+void RTPStreamTransponderGroup::Stop()
+{
+	//Wait until all the previous async have finished as async calls are executed in order
+	timeService.Async([=](...){}).wait();
+}
+
+void RTPStreamTransponderGroup::AddListener(RTPIncomingMediaStream::Listener* listener)
+{
+	Debug("-RTPStreamTransponderGroup::AddListener() [listener:%p,this:%p]\n",listener,this);
+
+	//Dispatch in thread sync
+	timeService.Sync([=](...){
+		//If it is a transponder
+		if (auto transponder = dynamic_cast<RTPStreamTransponder*>(listener))
+		{
+			//Add it to the fan out if not already there
+			if (std::find(transponders.begin(),transponders.end(),transponder)==transponders.end())
+				transponders.push_back(transponder);
+		} else {
+			//Deliver packets one by one
+			listeners.insert(listener);
+		}
+	});
+}
+
+void RTPStreamTransponderGroup::RemoveListener(RTPIncomingMediaStream::Listener* listener)
+{
+	Debug("-RTPStreamTransponderGroup::RemoveListener() [listener:%p,this:%p]\n",listener,this);
+
+	//Dispatch in thread sync
+	timeService.Sync([=](...){
+		//Remove from both
+		transponders.erase(std::remove(transponders.begin(),transponders.end(),listener),transponders.end());
+		listeners.erase(listener);
+		//Senders could be gone
+		batches.clear();
+	});
+}
+
+void RTPStreamTransponderGroup::onRTP(RTPIncomingMediaStream* stream,const RTPPacket::shared& packet)
+{
+	//Dispatch in thread async
+	timeService.Post([=](...){
+		//Fan out
+		Forward(packet);
+	});
+}
+
+void RTPStreamTransponderGroup::Forward(const RTPPacket::shared& packet)
+{
+	//Deliver to all listeners
+	for (auto listener : listeners)
+		//Dispatch rtp packet
+		listener->onRTP(this,packet);
+
+	//Calculate the rewrites of all transponders
+	for (auto transponder : transponders)
+	{
+		RTPStreamTransponder::Rewrite rewrite;
+		//Update transponder and check if it has to be forwarded
+		if (!transponder->Process(packet,rewrite))
+			//Next
+			continue;
+		//Get sender
+		RTPSender* sender = transponder->GetSender();
+		//Check it
+		if (!sender)
+			//Next
+			continue;
+		//Get loop it sends from
+		TimeService* loop = sender->GetSenderTimeService();
+		//If it can't send right away from it
+		if (!loop)
+		{
+			//Create clone on sender thread as the transponder does
+			sender->Enqueue(packet,[rewrite = std::move(rewrite)](const RTPPacket::shared& packet) -> RTPPacket::shared {
+				//Clone and rewrite it
+				return rewrite.Apply(packet);
+			});
+			//Next
+			continue;
+		}
+		//Find batch for the loop
+		auto it = std::find_if(batches.begin(),batches.end(),[loop](const Batch& batch){ return batch.loop==loop; });
+		//If not found
+		if (it==batches.end())
+			//Create new one
+			it = batches.insert(batches.end(),Batch{loop,{}});
+		//Add to batch
+		it->forwarded.push_back({sender,std::move(rewrite)});
+	}
+
+	//Post one task per sender loop
+	for (auto& batch : batches)
+	{
+		//Get number of forwarded packets
+		size_t size = batch.forwarded.size();
+		//If nothing to send
+		if (!size)
+			//Next
+			continue;
+		//Clone and send them all on the sender loop
+		batch.loop->Post([packet,forwarded = std::move(batch.forwarded)](...){
+			//For each transponder
+			for (const auto& entry : forwarded)
+				//Send rewritten clone
+				entry.sender->Send(entry.rewrite.Apply(packet));
+		});
+		//Reuse same size for next packet
+		batch.forwarded.clear();
+		batch.forwarded.reserve(size);
+	}
+}
+
+void RTPStreamTransponderGroup::onBye(RTPIncomingMediaStream* stream)
+{
+	//Dispatch in thread async
+	timeService.Post([=](...){
+		//Deliver to all transponders
+		for (auto transponder : transponders)
+			//Dispatch bye
+			transponder->onBye(this);
+		//Deliver to all listeners
+		for (auto listener : listeners)
+			//Dispatch bye
+			listener->onBye(this);
+	});
+}
+
+void RTPStreamTransponderGroup::onEnded(RTPIncomingMediaStream* stream)
+{
+	//Dispatch in thread async
+	timeService.Post([=](...){
+		//Deliver to all transponders
+		for (auto transponder : transponders)
+			//Dispatch ended
+			transponder->onEnded(this);
+		//Deliver to all listeners
+		for (auto listener : listeners)
+			//Dispatch ended
+			listener->onEnded(this);
+	});
+}
@@ -0,0 +1,111 @@
+#include "rtp/RTPTransportWideArrivals.h"
+#include <algorithm>
+
+bool RTPTransportWideArrivals::Fits(DWORD extSeqNum) const
+{
+	//Empty ring fits anything, lost ones before it are bounded on drain
+	if (!count)
+		return true;
+	//Late ones already reported are not stored
+	if (reported && extSeqNum<=lastReported)
+		return true;
+	//Lost ones since last drain are walked too
+	DWORD start = reported ? lastReported+1 : std::min(first,extSeqNum);
+	//Check span of the pending ones including the new one
+	return std::max(last,extSeqNum) - start < Capacity;
+}
+
+bool RTPTransportWideArrivals::Add(DWORD extSeqNum,QWORD time)
+{
+	//If it was already reported as lost
+	if (reported && extSeqNum<=lastReported)
+		//Drop it, reporting it again would restart the range below the reported ones
+		return false;
+	//If it is the first one
+	if (!count)
+	{
+		//Start window
+		first = extSeqNum;
+		last = extSeqNum;
+		firstTime = time;
+	} else {
+		//Update window
+		first = std::min(first,extSeqNum);
+		last = std::max(last,extSeqNum);
+	}
+	//Get slot
+	Arrival& arrival = arrivals[extSeqNum % Capacity];
+	//If it is not a duplicate
+	if (arrival.extSeqNum!=extSeqNum || !arrival.time)
+		//One more
+		count++;
+	//Store it
+	arrival.extSeqNum = extSeqNum;
+	arrival.time = time;
+	//Added
+	return true;
+}
+
+void RTPTransportWideArrivals::Drain(QWORD initTime,RTCPRTPFeedback::TransportWideFeedbackMessageField::Packets& packets)
+{
+	//If nothing pending
+	if (!count)
+		//Done
+		return;
+
+	//Report lost ones since last drain
+	DWORD start = reported ? lastReported+1 : first;
+
+	//After a long gap report only the last lost ones fitting on the ring
+	if (last-start>=Capacity)
+		//Pending ones always fit
+		start = last-Capacity+1;
+
+	//Reserve space for all of them
+	packets.reserve(packets.size()+last-start+1);
+
+	//Walk the seq nums in order
+	for (DWORD extSeqNum=start; extSeqNum<=last; ++extSeqNum)
+	{
+		//Lost ones before the window are not on the ring
+		if (extSeqNum<first)
+		{
+			//Not received
+			packets.insert(std::make_pair(extSeqNum,0));
+			//Next
+			continue;
+		}
+		//Get slot
+		Arrival& arrival = arrivals[extSeqNum % Capacity];
+		//If it was received
+		if (arrival.extSeqNum==extSeqNum && arrival.time)
+		{
+			//Add with relative time
+			packets.insert(std::make_pair(extSeqNum,arrival.time - initTime));
+			//Clear slot
+			arrival.time = 0;
+		} else {
+			//Not received
+			packets.insert(std::make_pair(extSeqNum,0));
+		}
+	}
+
+	//Store last reported, late ones are not stored so it is the max
+	lastReported = last;
+	reported = true;
+	//Nothing pending
+	count = 0;
+	firstTime = 0;
+}
+
+void RTPTransportWideArrivals::Reset()
+{
+	//Clear all
+	arrivals.fill(Arrival());
+	first = 0;
+	last = 0;
+	count = 0;
+	firstTime = 0;
+	lastReported = 0;
+	reported = false;
+}
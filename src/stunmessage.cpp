@@ -45,10 +45,34 @@ bool STUNMessage::IsSTUN(const BYTE* data,DWORD size)
 }
 
 STUNMessage* STUNMessage::Parse(const BYTE* data,DWORD size)
+{
+	View view;
+
+	//Parse it without copying
+	if (!view.Parse(data,size))
+		return NULL;
+
+	//Create new message
+	STUNMessage* msg = new STUNMessage(view.GetType(),view.GetMethod(),view.GetTransactionId());
+
+	//Copy attributes
+	for (DWORD i=0;i<view.GetNumAttributes();++i)
+	{
+		//Get attribute
+		const View::Attribute& attribute = view.GetAttributeAt(i);
+		//Add it
+		msg->AddAttribute((Attribute::Type)attribute.type,attribute.attr,attribute.size);
+	}
+
+	//Return it
+	return msg;
+}
+
+bool STUNMessage::View::Parse(const BYTE* data,DWORD size)
 {
 	//Ensure it looks like a STUN message.
 	if (! IsSTUN(data, size))
-		return NULL;
+		return false;
 
 	/*
 	 * The message type field is decomposed further into the following
@@ -76,8 +100,12 @@ STUNMessage* STUNMessage::Parse(const BYTE* data,DWORD size)
 	//Get class
 	WORD type = ((data[0] & 0x01) << 1) | ((data[1] & 0x10) >> 4);
 
-	//Create new message
-	STUNMessage* msg = new STUNMessage((Type)type,(Method)method,data+8);
+	//Store message
+	this->data = data;
+	this->size = size;
+	this->type = (Type)type;
+	this->method = (Method)method;
+	this->numAttributes = 0;
 
 	/*
 	  STUN Attributes
@@ -117,32 +145,29 @@ STUNMessage* STUNMessage::Parse(const BYTE* data,DWORD size)
 		if (size<i+4+attrLen) 
 		{
 			::Debug("-STUNMessage::Parse() | the attribute length exceeds the remaining size | message discarded\n");
-			delete msg;
-			return NULL;
+			return false;
 		}
 
 		//FINGERPRINT must be the last attribute.
 		if (hasFingerprint) 
 		{
 			::Debug("-STUNMessage::Parse() | attribute after FINGERPRINT is not allowed | message discarded\n");
-			delete msg;
-			return NULL;
+			return false;
 		}
 
 		//After a MESSAGE-INTEGRITY attribute just FINGERPRINT is allowed.
-		if (hasMessageIntegrity && attrType != Attribute::FingerPrint) 
+		if (hasMessageIntegrity && attrType != STUNMessage::Attribute::FingerPrint) 
 		{
 			::Debug("-STUNMessage::Parse() | attribute after MESSAGE_INTEGRITY other than FINGERPRINT is not allowed | message discarded\n");
-			delete msg;
-			return NULL;
+			return false;
 		}
 
 		switch(attrType) 
 		{
-			case Attribute::MessageIntegrity:
+			case STUNMessage::Attribute::MessageIntegrity:
 				hasMessageIntegrity = true;
 				break;
-			case Attribute::FingerPrint:
+			case STUNMessage::Attribute::FingerPrint:
 				hasFingerprint = true;
 				posFingerprint = i;
 				break;
@@ -150,8 +175,15 @@ STUNMessage* STUNMessage::Parse(const BYTE* data,DWORD size)
 				break;
 		}
 
+		//Check we have space for it
+		if (numAttributes==MaxAttributes)
+		{
+			::Debug("-STUNMessage::Parse() | too many attributes | message discarded\n");
+			return false;
+		}
+
 		//Add it
-		msg->AddAttribute((Attribute::Type)attrType,data+i+4,attrLen);
+		attributes[numAttributes++] = {attrType,attrLen,data+i+4};
 
 		//Next
 		i = pad32(i+4+attrLen);
@@ -161,8 +193,7 @@ STUNMessage* STUNMessage::Parse(const BYTE* data,DWORD size)
 	if ((DWORD)i != size) 
 	{
 		::Debug("-STUNMessage::Parse() | computed message size does not match total size | message discarded\n");
-		delete msg;
-		return NULL;
+		return false;
 	}
 
 	// If it has FINGERPRINT attribute then verify it.
@@ -182,14 +213,295 @@ STUNMessage* STUNMessage::Parse(const BYTE* data,DWORD size)
 		if (announced != computed)
 		{
 			::Debug("-STUNMessage::Parse() | computed FINGERPRINT value does not match the value in the message | message discarded\n");
-			delete msg;
-			return NULL;
+			return false;
 		}
 	}
 
-	//Return it
-	return msg;
+	//Parsed
+	return true;
+}
+const STUNMessage::View::Attribute* STUNMessage::View::GetAttribute(STUNMessage::Attribute::Type type) const
+{
+	//For each
+	for (DWORD i=0;i<numAttributes;++i)
+		//Check attr
+		if (attributes[i].type==type)
+			//Return it
+			return &attributes[i];
+	//Not found
+	return NULL;
+}
+
+bool STUNMessage::View::CheckAuthenticatedFingerPrint(Integrity& integrity,const char* pwd) const
+{
+	BYTE hmac[20];
+
+	//Get message integrity attribute
+	const Attribute* attr = GetAttribute(STUNMessage::Attribute::MessageIntegrity);
+
+	//Ensure we have found the attribute
+	if (!attr || attr->size!=sizeof(hmac))
+		return false;
+
+	//Get attribute position
+	DWORD pos = attr->attr-4-data;
+
+	//Calculate HMAC up to the attribute, with length including the message integrity attribute
+	if (!integrity.Calculate(pwd,data,pos,pos-20+24,hmac))
+		return false;
+
+	//Compare generated hmac with integrity attribute
+	return memcmp(attr->attr,hmac,sizeof(hmac))==0;
+}
+
+STUNMessage::Integrity::Integrity()
+{
+	//Create context
+	ctx = HMAC_CTX_new();
+}
+
+STUNMessage::Integrity::~Integrity()
+{
+	//Free context
+	HMAC_CTX_free(ctx);
+}
+
+bool STUNMessage::Integrity::Calculate(const char* pwd,const BYTE* data,DWORD size,WORD length,BYTE* hmac)
+{
+	//Check
+	if (!ctx || size<4)
+		return false;
+
+	//If password has changed
+	if (!keyed || this->pwd!=pwd)
+	{
+		//Store it
+		this->pwd = pwd;
+		//Set up key
+		keyed = HMAC_Init_ex(ctx,pwd,strlen(pwd),EVP_sha1(),NULL);
+		//Check
+		if (!keyed)
+			return false;
+	//Reuse key
+	} else if (!HMAC_Init_ex(ctx,NULL,0,NULL,NULL)) {
+		//Error
+		return false;
+	}
+
+	//Header with the message length to authenticate
+	BYTE header[4];
+	set2(header,0,get2(data,0));
+	set2(header,2,length);
+
+	//Calculate it without modifying or copying the data
+	unsigned int len = 0;
+	return HMAC_Update(ctx,header,sizeof(header))
+		&& HMAC_Update(ctx,data+4,size-4)
+		&& HMAC_Final(ctx,hmac,&len)
+		&& len==20;
+}
+
+static WORD GetMessageTypeField(STUNMessage::Type type,STUNMessage::Method method)
+{
+	//Convert so we can sift
+	WORD msgType = type;
+	WORD msgMethod = method;
+
+	//Merge the type and method
+	WORD msgTypeField =  (msgMethod & 0x0f80) << 2;
+	msgTypeField |= (msgMethod & 0x0070) << 1;
+	msgTypeField |= (msgMethod & 0x000f);
+	msgTypeField |= (msgType & 0x02) << 7;
+	msgTypeField |= (msgType & 0x01) << 4;
+
+	return msgTypeField;
+}
+
+STUNMessage::Writer::Writer(BYTE* data,DWORD size,Type type,Method method,const BYTE* transId) :
+	data(data),
+	size(size),
+	pos(20)
+{
+	//Check header fits
+	if (size<20)
+	{
+		//Do not write anything
+		overflow = true;
+		return;
+	}
+
+	//Set type and method
+	set2(data,0,GetMessageTypeField(type,method));
+
+	//Empty attributes
+	set2(data,2,0);
+
+	//Set cookie
+	memcpy(data+4,MagicCookie,4);
+
+	//Set trnasaction
+	memcpy(data+8,transId,12);
+}
+
+BYTE* STUNMessage::Writer::Reserve(Attribute::Type type,WORD len)
+{
+	//Get padded end of the attribute
+	DWORD end = pad32(pos+4+len);
+
+	//Check it fits
+	if (overflow || end>size)
+	{
+		//Error
+		overflow = true;
+		return NULL;
+	}
+
+	//Set attr type
+	set2(data,pos,type);
+	set2(data,pos+2,len);
+
+	//Get value
+	BYTE* value = data+pos+4;
+
+	//Zero padding
+	memset(value+len,0,end-pos-4-len);
+
+	//Move
+	pos = end;
+
+	//Value of the attribute
+	return value;
 }
+
+bool STUNMessage::Writer::AddAttribute(Attribute::Type type,const BYTE *attr,WORD len)
+{
+	//Reserve space
+	BYTE* value = Reserve(type,len);
+	//Check
+	if (!value)
+		return false;
+	//Copy
+	if (len)
+		memcpy(value,attr,len);
+	//Done
+	return true;
+}
+
+bool STUNMessage::Writer::AddAttribute(Attribute::Type type,QWORD attr)
+{
+	//Reserve space
+	BYTE* value = Reserve(type,8);
+	//Check
+	if (!value)
+		return false;
+	//Set it
+	set8(value,0,attr);
+	//Done
+	return true;
+}
+
+bool STUNMessage::Writer::AddAttribute(Attribute::Type type,DWORD attr)
+{
+	//Reserve space
+	BYTE* value = Reserve(type,4);
+	//Check
+	if (!value)
+		return false;
+	//Set it
+	set4(value,0,attr);
+	//Done
+	return true;
+}
+
+bool STUNMessage::Writer::AddXorAddressAttribute(uint32_t addr, uint16_t port)
+{
+	//Reserve space
+	BYTE* aux = Reserve(Attribute::XorMappedAddress,8);
+	//Check
+	if (!aux)
+		return false;
+
+	//Unused
+	aux[0] = 0;
+	//Family
+	aux[1] = 1;
+	//Set port
+	memcpy(aux+2,&port,2);
+	//Xor it
+	aux[2] ^= MagicCookie[0];
+	aux[3] ^= MagicCookie[1];
+	//Set addres
+	memcpy(aux+4,&addr,4);
+	//Xor it
+	aux[4] ^= MagicCookie[0];
+	aux[5] ^= MagicCookie[1];
+	aux[6] ^= MagicCookie[2];
+	aux[7] ^= MagicCookie[3];
+
+	//Done
+	return true;
+}
+
+bool STUNMessage::Writer::AddUsernameAttribute(const char* local,const char* remote)
+{
+	//Get lengths
+	DWORD localLen = strlen(local);
+	DWORD remoteLen = strlen(remote);
+
+	//Reserve space for "remote:local"
+	BYTE* value = Reserve(Attribute::Username,remoteLen+1+localLen);
+	//Check
+	if (!value)
+		return false;
+
+	//Create username
+	memcpy(value,remote,remoteLen);
+	value[remoteLen] = ':';
+	memcpy(value+remoteLen+1,local,localLen);
+
+	//Done
+	return true;
+}
+
+DWORD STUNMessage::Writer::AuthenticatedFingerPrint(Integrity& integrity,const char* pwd)
+{
+	//Check message integrity and fingerprint fit
+	if (overflow || pos+24+8>size)
+		return ::Error("-STUNMessage::Writer::AuthenticatedFingerPrint() | Not enought size [size:%u,need:%u]\n",size,pos+24+8);
+
+	//Length including the message integrity attribute but not the fingerprint
+	set2(data,2,pos-20+24);
+
+	//Calculate HMAC and put it in the attibute value
+	if (!integrity.Calculate(pwd,data,pos,pos-20+24,data+pos+4))
+		return ::Error("-STUNMessage::Writer::AuthenticatedFingerPrint() | HMAC failed\n");
+
+	//Set message integriti attribute
+	set2(data,pos,Attribute::MessageIntegrity);
+	set2(data,pos+2,20);
+
+	//INcrease sixe
+	pos += 24;
+
+	//Final length
+	set2(data,2,pos-20+8);
+
+	//Calculate crc 32 XOR'ed with the 32-bit value 0x5354554e
+	CRC32Calc crc32calc;
+	DWORD crc32 = crc32calc.Update(data,pos) ^ 0x5354554e;
+
+	//Set fingerprint attribute
+	set2(data,pos,Attribute::FingerPrint);
+	set2(data,pos+2,4);
+	set4(data,pos+4,crc32);
+
+	//INcrease sixe
+	pos += 8;
+
+	//Return size
+	return pos;
+}
+
 DWORD STUNMessage::NonAuthenticatedFingerPrint(BYTE* data,DWORD size)
 {
 	//Get size - Message attribute - FINGERPRINT
@@ -292,14 +604,17 @@ DWORD STUNMessage::AuthenticatedFingerPrint(BYTE* data,DWORD size,const char* pw
 		i = pad32(i+4+(*it)->size);
 	}
 
-	DWORD len;
+	DWORD len = 20;
 	CRC32Calc crc32calc;
+	//Reuse hmac context on this thread
+	static thread_local Integrity integrity;
 
 	//Change length to omit the Fingerprint attribute from the HMAC calculation of the message integrity
 	set2(data,2,msgSize-20-8);
 
 	//Calculate HMAC and put it in the attibute value
-	HMAC(EVP_sha1(),(BYTE*)pwd, strlen(pwd),data,i,data+i+4,&len);
+	if (!integrity.Calculate(pwd,data,i,msgSize-20-8,data+i+4))
+		return ::Error("-STUNMessage::AuthenticatedFingerPrint() | HMAC failed\n");
 
 	//Set message integriti attribute
 	set2(data,i,Attribute::MessageIntegrity);
@@ -359,27 +674,23 @@ bool STUNMessage::CheckAuthenticatedFingerPrint(const BYTE* data,DWORD size,cons
 	if (!hasMessageIntegrity)
 		return false;
 	
-	//Create new data for authentication and hmac
-	BYTE* authentication = (BYTE*)malloc(i+20);
-	
-	//Copy input
-	memcpy(authentication,data,i);
-	
-	//Change length to add the Fingerprint attribute from the HMAC calculation of the message integrity
-	set2(authentication,2,i+4);
+	//Get integrity attribute
+	Attribute* attr = GetAttribute(Attribute::MessageIntegrity);
 
-	//Calculate HMAC and put it in the attibute value
-	DWORD len = 0;
-	HMAC(EVP_sha1(),(BYTE*)pwd, strlen(pwd),authentication,i,authentication+i,&len);
+	//Check it
+	if (!attr || attr->size!=20)
+		return false;
+
+	//Reuse hmac context on this thread
+	static thread_local Integrity integrity;
+	BYTE hmac[20];
+
+	//Calculate HMAC in place, with length including the message integrity attribute
+	if (!integrity.Calculate(pwd,data,i,i+4,hmac))
+		return false;
 	
 	//Compare generated hmac with integrity attribute
-	bool result = len && memcmp(GetAttribute(Attribute::MessageIntegrity)->attr,authentication+i,len)==0;
-	
-	//Free mem
-	free(authentication);
-	
-	//Return result
-	return result;
+	return memcmp(attr->attr,hmac,sizeof(hmac))==0;
 }
 
 DWORD STUNMessage::GetSize()
@@ -5,6 +5,9 @@
 #include <pipevideooutput.h>
 #include <set>
 #include <functional>
+#include <atomic>
+#include <algorithm>
+#include <time.h>
 
 typedef std::pair<int, DWORD> Pair;
 typedef std::set<Pair, std::less<Pair>    > OrderedSetOfPairs;
@@ -12,6 +15,7 @@ typedef std::set<Pair, std::greater<Pair> > RevOrderedSetOfPairs;
 
 
 DWORD VideoMixer::vadDefaultChangePeriod = 2000;
+VideoMixer::Workers VideoMixer::workers;
 int VideoMixer::MosaicDefault = 0;
 int VideoMixer::NoMosaic = -1;
 
@@ -116,14 +120,31 @@ int VideoMixer::MixVideo()
 }
 
 
+static QWORD getThreadCPUTime()
+{
+	timespec ts;
+	//Get cpu time consumed by calling thread
+	clock_gettime(CLOCK_THREAD_CPUTIME_ID,&ts);
+	//Return in us
+	return ((QWORD)ts.tv_sec)*1000000 + ts.tv_nsec/1000;
+}
+
 void VideoMixer::Process(bool forceUpdate, QWORD now)
 {
+	//Get cpu time at start
+	QWORD cpu = getThreadCPUTime();
+	//New tick
+	ticks++;
+	//Slots updated and skipped on this tick
+	DWORD updated = 0;
+	DWORD skipped = 0;
+	//Slots using an already scaled frame and slots needing a rescale
+	DWORD hits = 0;
+	DWORD misses = 0;
+
 	//Protegemos la lista
 	lstVideosUse.WaitUnusedAndLock();
 
-	//New version
-	version++;
-
 	//For each mosaic
 	for (Mosaics::iterator itMosaic=mosaics.begin();itMosaic!=mosaics.end();++itMosaic)
 	{
@@ -218,8 +239,12 @@ void VideoMixer::Process(bool forceUpdate, QWORD now)
 					Error("-participant not found %d for slot %d,cleaning it\n",partId,i);
 					//If it was not there previously
 					if (changed)
+					{
 						//Clean position
-						mosaic->Clean(i,logo);
+						updates.push_back({mosaic,i});
+						//Nothing shown
+						mosaic->InvalidateSlot(i);
+					}
 					//Next slot
 					continue;
 				}
@@ -238,29 +263,50 @@ void VideoMixer::Process(bool forceUpdate, QWORD now)
 				//Get output
 				PipeVideoOutput *output = it->second->output;
 				
-				//Lock it
-				output->Lock();
+				//Lock it until composition is done, only once as it may be shown on several mosaics
+				if (std::find(locked.begin(),locked.end(),output)==locked.end())
+				{
+					//Lock it
+					output->Lock();
+					//Add to locked ones
+					locked.push_back(output);
+				}
+
+				//Get generation of current participant frame
+				QWORD generation = output->GetGeneration();
 
 				//If we've got a new frame or the participant image was not in slot yet
-				if ((output && output->IsChanged(version)) || changed)
+				if (changed || mosaic->GetSlotGeneration(i)!=generation)
 				{
 					//Change mosaic
-					mosaic->Update(i,output->GetFrame(),output->GetWidth(),output->GetHeight(),keepAspectRatio);
-
+					SlotUpdate update = {mosaic,i,output->GetFrame(),output->GetWidth(),output->GetHeight(),partId,generation};
 					//Check if debug is enabled
 					if (vadMode!=NoVAD && proxy && Logger::IsDebugEnabled())
 					{
-						//Get vad
-						DWORD vad = proxy->GetVAD(partId);
 						//Set VU meter
-						mosaic->DrawVUMeter(i,vad,48000);
+						update.vumeter = true;
+						//Get vad
+						update.vad = proxy->GetVAD(partId);
 					}
+					//Add it
+					updates.push_back(update);
+					//Store displayed frame
+					mosaic->SetSlotGeneration(i,generation);
+					//One more
+					updated++;
+				} else {
+					//Keep the frame scaled for this slot size, if any, so its scaler and buffer are reused on next frame
+					auto rendition = renditions.find({partId,mosaic->GetWidth(i),mosaic->GetHeight(i),keepAspectRatio});
+					if (rendition!=renditions.end())
+						rendition->second.tick = ticks;
+					//Nothing new to display
+					skipped++;
 				}
-				//Release it
-				output->Unlock();
 			} else if (changed) {
 				//Clean position
-				mosaic->Clean(i,logo);
+				updates.push_back({mosaic,i});
+				//Nothing shown
+				mosaic->InvalidateSlot(i);
 			}
 		}
 		//Free mem
@@ -268,6 +314,47 @@ void VideoMixer::Process(bool forceUpdate, QWORD now)
 		free(newPos);
 	}
 
+	//Scale only once the frames shown at same size on several slots
+	ShareRenditions(hits,misses);
+
+	//Rescale and copy all slots
+	ComposeSlots();
+
+	//For each locked output
+	for (auto output : locked)
+		//Release it
+		output->Unlock();
+
+	//Done
+	updates.clear();
+	locked.clear();
+	scaling.clear();
+	decimating.clear();
+
+	//Drop renditions of participants not shown anymore at that size
+	for (auto it = renditions.begin(); it!=renditions.end();)
+	{
+		//If not used
+		if (it->second.tick!=ticks)
+			//Remove
+			it = renditions.erase(it);
+		else
+			//Next
+			++it;
+	}
+
+	//Drop decimations of participants not scaled down anymore
+	for (auto it = decimations.begin(); it!=decimations.end();)
+	{
+		//If not used
+		if (it->second.tick!=ticks)
+			//Remove
+			it = decimations.erase(it);
+		else
+			//Next
+			++it;
+	}
+
 	//For each video
 	for (Videos::iterator it=lstVideos.begin();it!=lstVideos.end();++it)
 	{
@@ -281,12 +368,21 @@ void VideoMixer::Process(bool forceUpdate, QWORD now)
 
 		//Si no ha cambiado el frame volvemos al principio
 		if (input && mosaic && (source->refresh || mosaic->HasChanged() || forceUpdate))
+		{
+			//Get changed areas so encoder can skip the rest
+			VideoRegions changed = mosaic->GetChangedRegions();
 			//Colocamos el frame
-			input->SetFrame(mosaic->GetFrame(),mosaic->GetWidth(),mosaic->GetHeight());
+			input->SetFrame(mosaic->GetFrame(),mosaic->GetWidth(),mosaic->GetHeight(),&changed);
+		}
 		//Reset refresh 
 		source->refresh = true;
 	}
 	
+	//Changes have been passed to all inputs
+	for (Mosaics::iterator itMosaic=mosaics.begin();itMosaic!=mosaics.end();++itMosaic)
+		//Clean them
+		itMosaic->second->ClearChangedRegions();
+
 	//Reset overlays if displaying names
 	if (displayNames) 
 		//For each mosaic
@@ -296,6 +392,255 @@ void VideoMixer::Process(bool forceUpdate, QWORD now)
 	
 	//Desprotege la lista
 	lstVideosUse.Unlock();
+
+	//Get cpu time spent on this tick
+	cpu = getThreadCPUTime() - cpu;
+
+	//Lock stats
+	ScopedLock scoped(statsMutex);
+	//Update them
+	stats.ticks++;
+	stats.updatedSlots += updated;
+	stats.skippedSlots += skipped;
+	stats.renditionHits += hits;
+	stats.renditionMisses += misses;
+	stats.lastCPUTime = cpu;
+	stats.maxCPUTime = std::max(stats.maxCPUTime,cpu);
+	totalCPUTime += cpu;
+}
+
+void VideoMixer::UpdateSlot(const SlotUpdate& update)
+{
+	//If there is no participant
+	if (!update.frame)
+	{
+		//Clean position
+		update.mosaic->Clean(update.pos,logo);
+		//Done
+		return;
+	}
+	//Change mosaic
+	update.mosaic->Update(update.pos,update.frame,update.width,update.height,keepAspectRatio,update.pyramid);
+	//If debug is enabled
+	if (update.vumeter)
+		//Set VU meter
+		update.mosaic->DrawVUMeter(update.pos,update.vad,48000);
+}
+
+void VideoMixer::ShareRenditions(DWORD& hits,DWORD& misses)
+{
+	//Count slots showing each participant frame at each size
+	for (auto& update : updates)
+	{
+		//Skip clean ups
+		if (!update.frame)
+			continue;
+		//Get slot size
+		update.slotWidth  = update.mosaic->GetWidth(update.pos);
+		update.slotHeight = update.mosaic->GetHeight(update.pos);
+		//If it needs a rescale
+		if (update.width!=update.slotWidth || update.height!=update.slotHeight)
+			//One more use
+			uses[{update.partId,update.slotWidth,update.slotHeight,keepAspectRatio}]++;
+	}
+
+	//For each slot
+	for (auto& update : updates)
+	{
+		//Skip clean ups and copies
+		if (!update.frame || (update.width==update.slotWidth && update.height==update.slotHeight))
+			continue;
+		//Get key
+		RenditionKey key = {update.partId,update.slotWidth,update.slotHeight,keepAspectRatio};
+		//If only on this slot
+		if (uses[key]<2)
+		{
+			//It will be rescaled into the mosaic directly
+			update.pyramid = SharePyramid(update);
+			misses++;
+			continue;
+		}
+		//Get rendition
+		Rendition& rendition = renditions[key];
+		//Used on this tick
+		rendition.tick = ticks;
+		//If it is not already scaled from this frame
+		if (rendition.generation!=update.generation)
+		{
+			//Check size
+			DWORD size = update.slotWidth*update.slotHeight*3/2;
+			//Allocate buffer
+			if (rendition.size!=size)
+			{
+				//Free previous
+				free(rendition.buffer);
+				//Alloc new one
+				rendition.buffer = (BYTE*)malloc32(size);
+				rendition.size = size;
+			}
+			//Store frame to scale
+			rendition.generation	= update.generation;
+			rendition.frame		= update.frame;
+			rendition.frameWidth	= update.width;
+			rendition.frameHeight	= update.height;
+			rendition.width		= update.slotWidth;
+			rendition.height	= update.slotHeight;
+			rendition.pyramid	= SharePyramid(update);
+			//Scale it before composing
+			scaling.push_back(&rendition);
+			//Scaled
+			misses++;
+		} else {
+			//Reused
+			hits++;
+		}
+		//Copy scaled frame into the slot
+		update.frame	= rendition.buffer;
+		update.width	= rendition.width;
+		update.height	= rendition.height;
+	}
+
+	//Clean counts
+	uses.clear();
+}
+
+const FrameScaler::Pyramid* VideoMixer::SharePyramid(const SlotUpdate& update)
+{
+	//Get level it would be scaled from
+	int level = FrameScaler::GetPyramidLevel(update.width,update.height,update.slotWidth,update.slotHeight,keepAspectRatio);
+	//If it is not decimated
+	if (!level)
+		//Scale from the frame
+		return nullptr;
+	//Get participant decimation
+	Decimation& decimation = decimations[update.partId];
+	//If it is the first use on this tick
+	if (decimation.tick!=ticks)
+	{
+		//Nothing needed yet
+		decimation.tick  = ticks;
+		decimation.level = 0;
+		//Build it before composing
+		decimating.push_back(&decimation);
+	}
+	//If participant has a new frame
+	if (decimation.generation!=update.generation)
+	{
+		//Previous levels are not valid
+		decimation.generation	= update.generation;
+		decimation.built	= 0;
+	}
+	//Store frame
+	decimation.frame  = update.frame;
+	decimation.width  = update.width;
+	decimation.height = update.height;
+	//Decimate down to the smallest level used
+	decimation.level = std::max(decimation.level,level);
+	//Scale from it
+	return &decimation.pyramid;
+}
+
+void VideoMixer::ComposeSlots()
+{
+	//Decimate first the participant frames being scaled down
+	RunParallel(decimating.size(),[this](size_t i){
+		Decimation* decimation = decimating[i];
+		//If not already done for this frame
+		if (decimation->built<decimation->level)
+		{
+			decimation->pyramid.Build(decimation->frame,decimation->width,decimation->height,decimation->level);
+			decimation->built = decimation->level;
+		}
+	});
+	//Scale the frames shared by several slots
+	RunParallel(scaling.size(),[this](size_t i){
+		Rendition* rendition = scaling[i];
+		rendition->scaler.Resize(rendition->frame,rendition->frameWidth,rendition->frameHeight,rendition->buffer,rendition->width,rendition->height,keepAspectRatio,rendition->pyramid);
+	});
+	//Slots overlapping others go first, in slot order, as they draw on the area of the others (i.e. main PIP slot)
+	for (auto& update : updates)
+		if ((update.overlapping = update.mosaic->IsSlotOverlapping(update.pos)))
+			UpdateSlot(update);
+	//The rest write a disjoint area of its mosaic, so they can be updated concurrently
+	RunParallel(updates.size(),[this](size_t i){
+		if (!updates[i].overlapping)
+			UpdateSlot(updates[i]);
+	});
+}
+
+void VideoMixer::RunParallel(size_t count,const std::function<void(size_t)>& job)
+{
+	//If there is no need to run in parallel
+	if (workers.empty() || count<2)
+	{
+		//Run them on the mixer thread
+		for (size_t i=0;i<count;++i)
+			job(i);
+		//Done
+		return;
+	}
+
+	std::atomic<size_t> next(0);
+	auto run = [&](){
+		size_t i;
+		//Get next pending job
+		while ((i = next++)<count)
+			//Run it
+			job(i);
+	};
+
+	//Wake up workers, mixer thread will also run jobs
+	size_t num = std::min(workers.size(),count-1);
+	if (composing.size()<num)
+		composing.resize(num);
+	for (size_t i=0;i<num;++i)
+		composing[i] = workers[i]->Async([&run](std::chrono::milliseconds){ run(); });
+
+	//Run on this thread too
+	run();
+
+	//Wait for all workers
+	for (size_t i=0;i<num;++i)
+		composing[i].wait();
+}
+
+void VideoMixer::SetCompositionWorkers(DWORD num)
+{
+	//Stop previous ones
+	for (auto& worker : workers)
+		worker->Stop();
+	workers.clear();
+
+	//Start new ones
+	for (DWORD i=0;i<num;++i)
+	{
+		auto worker = std::make_unique<EventLoop>();
+		//Start it without socket
+		if (!worker->Start())
+		{
+			Error("-VideoMixer::SetCompositionWorkers() | Could not start composition worker\n");
+			break;
+		}
+		//Add it
+		workers.push_back(std::move(worker));
+	}
+	//Log it
+	Log("-VideoMixer composition workers set to %zu\n",workers.size());
+}
+
+VideoMixer::Stats VideoMixer::GetStats()
+{
+	//Lock stats
+	ScopedLock scoped(statsMutex);
+	//Copy
+	Stats copy = stats;
+	//Calculate average
+	if (copy.ticks)
+		copy.avgCPUTime = totalCPUTime/copy.ticks;
+	//Calculate ratio of slots not needing a rescale
+	if (copy.renditionHits+copy.renditionMisses)
+		copy.renditionHitRatio = (double)copy.renditionHits/(copy.renditionHits+copy.renditionMisses);
+	return copy;
 }
 /*******************************
  * CreateMosaic
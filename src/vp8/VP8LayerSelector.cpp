@@ -30,22 +30,21 @@ void VP8LayerSelector::SelectSpatialLayer(BYTE id)
 	
 bool VP8LayerSelector::Select(const RTPPacket::shared& packet,bool &mark)
 {
-	//Get header and description from packet
-	auto& desc   = packet->vp8PayloadDescriptor;
-	auto& header = packet->vp8PayloadHeader;
+	//Get layer classification done on reception
+	auto layer = packet->layerClassification ? packet->layerClassification : Classify(packet);
 
 	//Check that you are having a descriptor
-	if (!desc)
+	if (!layer)
 		//Error
 		return 0;
 	
-	//UltraDebug("-intra:%d\t tl:%u\t picId:%u\t tl0picIdx:%u\t sync:%u\t waitingForIntra:%d\n",header && header->isKeyFrame,desc->temporalLayerIndex,desc->pictureId,desc->temporalLevelZeroIndex,desc->layerSync,waitingForIntra);
+	//UltraDebug("-intra:%d\t tl:%u\t sync:%u\t waitingForIntra:%d\n",layer->keyFrame,layer->temporalLayerId,layer->switchingPoint,waitingForIntra);
 	
 	//If we have to wait for first intra
 	if (waitingForIntra)
 	{
 		//If this is not intra
-		if (!header || !header->isKeyFrame)
+		if (!layer->keyFrame)
 			//Discard
 			return 0;
 		//Stop waiting
@@ -59,11 +58,11 @@ bool VP8LayerSelector::Select(const RTPPacket::shared& packet,bool &mark)
 	if (nextTemporalLayerId>temporalLayerId)
 	{
 		//Check if we can upscale and it is the start of the layer and it is a layer higher than current
-		if (desc->layerSync && desc->startOfPartition && desc->temporalLayerIndex>currentTemporalLayerId && desc->temporalLayerIndex<=nextTemporalLayerId)
+		if (layer->switchingPoint && layer->startOfLayerFrame && layer->temporalLayerId>currentTemporalLayerId && layer->temporalLayerId<=nextTemporalLayerId)
 		{
-			UltraDebug("-VP8LayerSelector::Select() | Upscaling temporalLayerId [id:%d,current:%d,target:%d]\n",desc->temporalLayerIndex,currentTemporalLayerId,nextTemporalLayerId);
+			UltraDebug("-VP8LayerSelector::Select() | Upscaling temporalLayerId [id:%d,current:%d,target:%d]\n",layer->temporalLayerId,currentTemporalLayerId,nextTemporalLayerId);
 			//Update current layer
-			temporalLayerId = desc->temporalLayerIndex;
+			temporalLayerId = layer->temporalLayerId;
 			currentTemporalLayerId = temporalLayerId;
 		}
 	//Check if we need to downscale
@@ -78,9 +77,9 @@ bool VP8LayerSelector::Select(const RTPPacket::shared& packet,bool &mark)
 	}
 	
 	//If it is not valid for the current layer
-	if (currentTemporalLayerId<desc->temporalLayerIndex)
+	if (currentTemporalLayerId<layer->temporalLayerId)
 	{
-		//UltraDebug("-VP8LayerSelector::Select() | dropping packet based on temporalLayerId [current:%d,desc:%d,mark:%d]\n",currentTemporalLayerId,desc->temporalLayerIndex,packet->GetMark());
+		//UltraDebug("-VP8LayerSelector::Select() | dropping packet based on temporalLayerId [current:%d,desc:%d,mark:%d]\n",currentTemporalLayerId,layer->temporalLayerId,packet->GetMark());
 		//Drop it
 		return false;
 	}
@@ -88,16 +87,26 @@ bool VP8LayerSelector::Select(const RTPPacket::shared& packet,bool &mark)
 	//RTP mark is unchanged
 	mark = packet->GetMark();
 	
-	//UltraDebug("-VP8LayerSelector::Select() | Accepting packet [extSegNum:%u,mark:%d,desc->tid:%d,current:%d]\n",packet->GetExtSeqNum(),mark,desc->temporalLayerIndex,currentTemporalLayerId);
+	//UltraDebug("-VP8LayerSelector::Select() | Accepting packet [extSegNum:%u,mark:%d,tid:%d,current:%d]\n",packet->GetExtSeqNum(),mark,layer->temporalLayerId,currentTemporalLayerId);
 	
 	//Select
 	return true;
 }
 
- std::vector<LayerInfo> VP8LayerSelector::GetLayerIds(const RTPPacket::shared& packet)
+ std::vector<LayerInfo> VP8LayerSelector::GetLayerIds(const RTPPacket::shared& packet,const std::optional<LayerClassification>& layer)
 {
 	std::vector<LayerInfo> infos;
 	
+	//If we got the descriptor
+	if (layer)
+		//Set temporal layer info
+		infos.emplace_back(layer->temporalLayerId,0);
+	//UltraDebug("-VP8LayerSelector::GetLayerIds() | [tid:%u,sid:%u]\n",info.temporalLayerId,info.spatialLayerId);
+	return infos;
+}
+
+std::optional<LayerClassification> VP8LayerSelector::Classify(const RTPPacket::shared& packet)
+{
 	//Check if it already have the descriptor
 	if (!packet->vp8PayloadDescriptor)
 	{
@@ -113,7 +122,7 @@ bool VP8LayerSelector::Select(const RTPPacket::shared& packet,bool &mark)
 			//Clear desc
 			packet->vp8PayloadDescriptor.reset();
 			//NOne
-			return infos;
+			return std::nullopt;
 		}
 		
 		//Parse header if first packet
@@ -135,10 +144,22 @@ bool VP8LayerSelector::Select(const RTPPacket::shared& packet,bool &mark)
 		}
 	}
 	
-	//If we got the descriptor
-	if (packet->vp8PayloadDescriptor)
-		//Set temporal layer info
-		infos.emplace_back(packet->vp8PayloadDescriptor->temporalLayerIndex,0);
-	//UltraDebug("-VP8LayerSelector::GetLayerIds() | [tid:%u,sid:%u]\n",info.temporalLayerId,info.spatialLayerId);
-	return infos;
+	//Get header and description from packet
+	auto& desc   = packet->vp8PayloadDescriptor;
+	auto& header = packet->vp8PayloadHeader;
+
+	//Check that you are having a descriptor
+	if (!desc)
+		//None
+		return std::nullopt;
+
+	LayerClassification layer;
+	//Only temporal layers
+	layer.temporalLayerId	= desc->temporalLayerIndex;
+	layer.switchingPoint	= desc->layerSync;
+	layer.startOfLayerFrame	= desc->startOfPartition;
+	layer.endOfLayerFrame	= packet->GetMark();
+	//Header is only present on first partition
+	layer.keyFrame		= header && header->isKeyFrame;
+	return layer;
 }
@@ -33,7 +33,8 @@ public:
 	VideoCodec::Type GetCodec()	const override { return VideoCodec::VP8;	}
 	bool IsWaitingForIntra()	const override { return waitingForIntra;	}
 	
-	static std::vector<LayerInfo> GetLayerIds(const RTPPacket::shared& packet);
+	static std::vector<LayerInfo> GetLayerIds(const RTPPacket::shared& packet,const std::optional<LayerClassification>& layer);
+	static std::optional<LayerClassification> Classify(const RTPPacket::shared& packet);
 	
 private:
 	bool waitingForIntra;
@@ -7,6 +7,7 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
+#include <algorithm>
 #include "log.h"
 #include "vp8encoder.h"
 #include "vp8.h"
@@ -75,6 +76,9 @@ int VP8Encoder::SetSize(int width, int height)
 	//calculate number of pixels in  input image
 	numPixels = width*height;
 
+	//New codec has no active map
+	activeMapEnabled = false;
+
 	// Open codec
 	return OpenCodec();
 }
@@ -237,6 +241,58 @@ int VP8Encoder::FastPictureUpdate()
 	return true;
 }
 
+/************************
+* SetChangedRegions
+* 	Only encode the macroblocks of the changed regions on next frame
+**************************/
+int VP8Encoder::SetChangedRegions(const VideoRegions* changed)
+{
+	if (!opened)
+		return 0;
+
+	//Size in macroblocks
+	unsigned int cols = (width+15)/16;
+	unsigned int rows = (height+15)/16;
+
+	vpx_active_map_t map = {};
+
+	//If full frame
+	if (!changed)
+	{
+		//Already disabled
+		if (!activeMapEnabled)
+			return 1;
+		//Disable active map
+		map.rows = rows;
+		map.cols = cols;
+		map.active_map = NULL;
+		activeMapEnabled = false;
+	} else {
+		//All inactive
+		activeMap.assign(rows*cols,0);
+		//Activate macroblocks of each region
+		for (const auto& region : *changed)
+		{
+			unsigned int right  = std::min(cols,(region.left+region.width+15)/16);
+			unsigned int bottom = std::min(rows,(region.top+region.height+15)/16);
+			for (unsigned int row = region.top/16; row<bottom; ++row)
+				for (unsigned int col = region.left/16; col<right; ++col)
+					activeMap[row*cols+col] = 1;
+		}
+		map.rows = rows;
+		map.cols = cols;
+		map.active_map = activeMap.data();
+		activeMapEnabled = true;
+	}
+
+	//Set it
+	if (vpx_codec_control(&encoder, VP8E_SET_ACTIVEMAP, &map)!=VPX_CODEC_OK)
+		//Error
+		return Error("-VP8Encoder::SetChangedRegions() could not set active map [error %d:%s]\n",encoder.err,encoder.err_detail);
+
+	return 1;
+}
+
 VideoFrame* VP8Encoder::EncodeFrame(BYTE *buffer,DWORD bufferSize)
 {
 	if(!opened)
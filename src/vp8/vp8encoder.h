@@ -21,6 +21,7 @@ public:
 	virtual int FastPictureUpdate();
 	virtual int SetSize(int width,int height);
 	virtual int SetFrameRate(int fps,int kbits,int intraPeriod);
+	virtual int SetChangedRegions(const VideoRegions* changed);
 private:
 	int OpenCodec();
 private:
@@ -40,6 +41,9 @@ private:
 	int pts;
 	int num;
 	int threads;
+	//Macroblocks changed on next frame
+	std::vector<BYTE> activeMap;
+	bool activeMapEnabled = false;
 };
 
 #endif	/* VP8ENCODER_H */
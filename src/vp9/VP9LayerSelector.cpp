@@ -45,16 +45,15 @@ void VP9LayerSelector::SelectSpatialLayer(BYTE id)
 	
 bool VP9LayerSelector::Select(const RTPPacket::shared& packet,bool &mark)
 {
+	//Get layer classification done on reception
+	auto layer = packet->layerClassification ? packet->layerClassification : Classify(packet);
+	
 	//Get VP9 payload description
-	if (!packet->vp9PayloadDescriptor) 
+	if (!layer) 
 		return Error("-VP9LayerSelector::Select() | coulnd't retrieve VP9PayloadDescription\n");
 	
-	//Get description
-	auto& desc = *packet->vp9PayloadDescriptor;
-	
-	//if (desc.startOfLayerFrame)
-	//	//UltraDebug("-VP9LayerSelector::Select() | s:%d end:%d #%d T%dS%d P=%d D=%d S=%d %s\n", desc.startOfLayerFrame, desc.endOfLayerFrame, desc.pictureId,desc.temporalLayerId,desc.spatialLayerId,desc.interPicturePredictedLayerFrame,desc.interlayerDependencyUsed,desc.switchingPoint
-//			,desc.interPicturePredictedLayerFrame==0 && desc.spatialLayerId==1 ? "<----------------------":"");
+	//if (layer->startOfLayerFrame)
+	//	//UltraDebug("-VP9LayerSelector::Select() | s:%d end:%d T%dS%d K=%d S=%d\n", layer->startOfLayerFrame, layer->endOfLayerFrame, layer->temporalLayerId,layer->spatialLayerId,layer->keyFrame,layer->switchingPoint);
 	
 	//Store current temporal id
 	BYTE currentTemporalLayerId = temporalLayerId;
@@ -63,27 +62,27 @@ bool VP9LayerSelector::Select(const RTPPacket::shared& packet,bool &mark)
 	if (nextTemporalLayerId>temporalLayerId)
 	{
 		//Check if we can upscale and it is the start of the layer and it is a valid layer
-		if (desc.switchingPoint && desc.startOfLayerFrame && currentTemporalLayerId<desc.temporalLayerId && desc.temporalLayerId<=nextTemporalLayerId)
+		if (layer->switchingPoint && layer->startOfLayerFrame && currentTemporalLayerId<layer->temporalLayerId && layer->temporalLayerId<=nextTemporalLayerId)
 		{
-			//UltraDebug("-VP9LayerSelector::Select() | Upscaling temporalLayerId [id:%d,target:%d]\n",desc.temporalLayerId,nextTemporalLayerId);
+			//UltraDebug("-VP9LayerSelector::Select() | Upscaling temporalLayerId [id:%d,target:%d]\n",layer->temporalLayerId,nextTemporalLayerId);
 			//Update current layer
-			currentTemporalLayerId = temporalLayerId = desc.temporalLayerId;
+			currentTemporalLayerId = temporalLayerId = layer->temporalLayerId;
 		}
 	//Check if we need to downscale
 	} else if (nextTemporalLayerId<temporalLayerId) {
 		//We can only downscale on the end of a layer to set the market bit
-		if (desc.endOfLayerFrame)
+		if (layer->endOfLayerFrame)
 		{
-			//UltraDebug("-VP9LayerSelector::Select() | Downscaling temporalLayerId [id:%d,target:%d]\n",desc.temporalLayerId,nextTemporalLayerId);
+			//UltraDebug("-VP9LayerSelector::Select() | Downscaling temporalLayerId [id:%d,target:%d]\n",layer->temporalLayerId,nextTemporalLayerId);
 			//Update to target layer for next packets
-			temporalLayerId = desc.temporalLayerId;
+			temporalLayerId = layer->temporalLayerId;
 		}
 	}
 	
 	//If it is from a higher layers
-	if (desc.temporalLayerId>currentTemporalLayerId)
+	if (layer->temporalLayerId>currentTemporalLayerId)
 	{
-		//UltraDebug("-VP9LayerSelector::Select() | dropping packet based on temporalLayerId [us:%d,desc:%d,mark:%d]\n",temporalLayerId,desc.temporalLayerId,packet->GetMark());
+		//UltraDebug("-VP9LayerSelector::Select() | dropping packet based on temporalLayerId [us:%d,desc:%d,mark:%d]\n",temporalLayerId,layer->temporalLayerId,packet->GetMark());
 		//Drop it
 		return false;
 	}
@@ -102,28 +101,28 @@ bool VP9LayerSelector::Select(const RTPPacket::shared& packet,bool &mark)
 			when encoding a layer synchronization frame in response to an LRR
 		 */
 		//Check if we can upscale and it is the start of the layer and it is a valid layer
-		if (desc.interPicturePredictedLayerFrame==0 && desc.startOfLayerFrame && currentSpatialLayerId<desc.spatialLayerId && desc.spatialLayerId<=nextSpatialLayerId)
+		if (layer->keyFrame && layer->startOfLayerFrame && currentSpatialLayerId<layer->spatialLayerId && layer->spatialLayerId<=nextSpatialLayerId)
 		{
-			//UltraDebug("-VP9LayerSelector::Select() | Upscaling spatialLayerId [id:%d,to:%d,target:%d]\n",desc.spatialLayerId,spatialLayerId,nextSpatialLayerId);
+			//UltraDebug("-VP9LayerSelector::Select() | Upscaling spatialLayerId [id:%d,to:%d,target:%d]\n",layer->spatialLayerId,spatialLayerId,nextSpatialLayerId);
 			//Update current layer
-			currentSpatialLayerId = spatialLayerId = desc.spatialLayerId;
+			currentSpatialLayerId = spatialLayerId = layer->spatialLayerId;
 			
 		}
 	//Ceck if we need to downscale
 	} else if (nextSpatialLayerId<spatialLayerId) {
 		//We can only downscale on the end of a layer to set the market bit
-		if (desc.endOfLayerFrame)
+		if (layer->endOfLayerFrame)
 		{
-			//UltraDebug("-VP9LayerSelector::Select() | Downscaling spatialLayerId [id:%d,to:%d,target:%d]\n",desc.spatialLayerId,spatialLayerId,nextSpatialLayerId);
+			//UltraDebug("-VP9LayerSelector::Select() | Downscaling spatialLayerId [id:%d,to:%d,target:%d]\n",layer->spatialLayerId,spatialLayerId,nextSpatialLayerId);
 			//Update to target layer
-			spatialLayerId = desc.spatialLayerId;
+			spatialLayerId = layer->spatialLayerId;
 		}
 	}
 	
 	//If it is from a higher layers
-	if (desc.spatialLayerId>currentSpatialLayerId)
+	if (layer->spatialLayerId>currentSpatialLayerId)
 	{
-		//UltraDebug("-VP9LayerSelector::Select() | dropping packet based on spatialLayerId [us:%d,desc:%d,mark:%d]\n",spatialLayerId,desc.spatialLayerId,packet->GetMark());
+		//UltraDebug("-VP9LayerSelector::Select() | dropping packet based on spatialLayerId [us:%d,desc:%d,mark:%d]\n",spatialLayerId,layer->spatialLayerId,packet->GetMark());
 		//Drop it
 		return false;
 	}
@@ -131,8 +130,8 @@ bool VP9LayerSelector::Select(const RTPPacket::shared& packet,bool &mark)
 	//If we have to wait for first intra
 	if (waitingForIntra)
 	{
-		//If this is not intra
-		if (!desc.interPicturePredictedLayerFrame)
+		//If this is not a predicted layer frame
+		if (layer->keyFrame)
 			//Discard
 			return false;
 		//Stop waiting
@@ -140,18 +139,31 @@ bool VP9LayerSelector::Select(const RTPPacket::shared& packet,bool &mark)
 	}
 	
 	//RTP mark is set for the last frame layer of the selected layer
-	mark = packet->GetMark() || (desc.endOfLayerFrame && spatialLayerId==desc.spatialLayerId && nextSpatialLayerId<=spatialLayerId);
+	mark = packet->GetMark() || (layer->endOfLayerFrame && spatialLayerId==layer->spatialLayerId && nextSpatialLayerId<=spatialLayerId);
 	
-	//UltraDebug("-VP9LayerSelector::Select() | Accepting packet [extSegNum:%u,mark:%d,sid:%d,tid:%d,current:S%dL%d]\n",packet->GetExtSeqNum(),mark,desc.spatialLayerId,desc.temporalLayerId,spatialLayerId,temporalLayerId);
+	//UltraDebug("-VP9LayerSelector::Select() | Accepting packet [extSegNum:%u,mark:%d,sid:%d,tid:%d,current:S%dL%d]\n",packet->GetExtSeqNum(),mark,layer->spatialLayerId,layer->temporalLayerId,spatialLayerId,temporalLayerId);
 	//Select
 	return true;
 	
 }
 
- std::vector<LayerInfo> VP9LayerSelector::GetLayerIds(const RTPPacket::shared& packet)
+ std::vector<LayerInfo> VP9LayerSelector::GetLayerIds(const RTPPacket::shared& packet,const std::optional<LayerClassification>& layer)
 {
 	 std::vector<LayerInfo> infos;
 	
+	//Check if we have it
+	if (layer)
+		//Get data from header
+		infos.emplace_back(layer->temporalLayerId,layer->spatialLayerId);
+	
+	//UltraDebug("-VP9LayerSelector::GetLayerIds() | [tid:%u,sid:%u]\n",info.temporalLayerId,info.spatialLayerId);
+	
+	//Return layer info
+	return infos;
+}
+
+std::optional<LayerClassification> VP9LayerSelector::Classify(const RTPPacket::shared& packet)
+{
 	//If we don't have one yet
 	if (!packet->vp9PayloadDescriptor)
 	{
@@ -188,23 +200,27 @@ bool VP9LayerSelector::Select(const RTPPacket::shared& packet,bool &mark)
 			desc.temporalLayer0Index		= fm.tl0PicIdx;
 		//We need to parse it
 		} else if (packet->GetMediaLength() && !desc.Parse(packet->GetMediaData(),packet->GetMediaLength())) {
-			Error("-VP9LayerSelector::GetLayerIds() | parse error\n");
+			Error("-VP9LayerSelector::Classify() | parse error\n");
 		}
 		//Set key fram
 		packet->SetKeyFrame(!desc.interPicturePredictedLayerFrame);
 	}
 
-	//Check if we have it now
-	if (packet->vp9PayloadDescriptor)
-	{
-		//Get data from header
-		infos.emplace_back(packet->vp9PayloadDescriptor->temporalLayerId,packet->vp9PayloadDescriptor->spatialLayerId);
-	} else if (packet->GetMaxMediaLength()) { 
-		Error("-VP9LayerSelector::GetLayerIds() | no descriptor");
-	}
+	//Check we have a payload description
+	if (!packet->vp9PayloadDescriptor)
+		//None
+		return std::nullopt;
 	
-	//UltraDebug("-VP9LayerSelector::GetLayerIds() | [tid:%u,sid:%u]\n",info.temporalLayerId,info.spatialLayerId);
+	//Get description
+	auto& desc = *packet->vp9PayloadDescriptor;
 	
-	//Return layer info
-	return infos;
+	LayerClassification layer;
+	layer.temporalLayerId	= desc.temporalLayerId;
+	layer.spatialLayerId	= desc.spatialLayerId;
+	layer.switchingPoint	= desc.switchingPoint;
+	layer.startOfLayerFrame	= desc.startOfLayerFrame;
+	layer.endOfLayerFrame	= desc.endOfLayerFrame;
+	//Layer frame without inter picture prediction
+	layer.keyFrame		= !desc.interPicturePredictedLayerFrame;
+	return layer;
 }
@@ -32,7 +32,8 @@ public:
 	VideoCodec::Type GetCodec()	const override { return VideoCodec::VP9;	}
 	bool IsWaitingForIntra()	const override { return false;			}
 	
-	static std::vector<LayerInfo> GetLayerIds(const RTPPacket::shared& packet);
+	static std::vector<LayerInfo> GetLayerIds(const RTPPacket::shared& packet,const std::optional<LayerClassification>& layer);
+	static std::optional<LayerClassification> Classify(const RTPPacket::shared& packet);
 private:
 	bool waitingForIntra;
 	BYTE temporalLayerId;
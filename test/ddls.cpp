@@ -258,7 +258,16 @@ public:
 		for (int i=0; i<packets.size();++i)
 			assert(DependencyDescriptorLayerSelector::GetLayerIds(packets[i])==info[i]);
 		
-		
+		//Check layer classification
+		for (int i=0; i<packets.size();++i)
+		{
+			auto layer = DependencyDescriptorLayerSelector::Classify(packets[i]);
+			assert(layer);
+			//Frame temporal layer is the lowest one it is present on
+			assert(layer->temporalLayerId==info[i].back().temporalLayerId);
+			//One decode target per layer
+			assert(__builtin_popcount(layer->decodeTargets)==info[i].size());
+		}
 		
 		//No content adaptation
 		{
@@ -293,6 +302,22 @@ public:
 			assert(isEqual(*forwarded, {0,1,1}));
 		}
 		
+		//S0T1 with packets classified on reception
+		{
+			std::vector<int> selected;
+			DependencyDescriptorLayerSelector selector(VideoCodec::AV1);
+			selector.SelectSpatialLayer(0);
+			selector.SelectTemporalLayer(1);
+			for (const auto& packet: packets)
+			{
+				packet->layerClassification = DependencyDescriptorLayerSelector::Classify(packet);
+				if (selector.Select(packet,mark))
+					selected.push_back(packet->GetSeqNum());
+			}
+			//Same as without classification
+			assert(isEqual(selected, {10,12,14}));
+		}
+		
 		//Simulate loss
 		{
 			auto packets = generateRTPStream(frames, templateDependencyStructure, {12});
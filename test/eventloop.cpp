@@ -0,0 +1,89 @@
+#include "test.h"
+#include "EventLoop.h"
+#include <atomic>
+#include <thread>
+
+class EventLoopTestPlan: public TestPlan
+{
+public:
+	EventLoopTestPlan() : TestPlan("EventLoop test plan")
+	{
+	}
+
+	virtual void Execute()
+	{
+		Log("testStats\n");
+		testStats();
+
+		Log("testLateness\n");
+		testLateness();
+	}
+
+	void testStats()
+	{
+		EventLoop loop;
+		loop.Start();
+
+		//Trace all callbacks longer than 1ms
+		loop.SetSlowCallbackThreshold(std::chrono::milliseconds(1));
+
+		//Slow timer
+		std::atomic<int> fired(0);
+		auto timer = loop.CreateTimer(10ms,10ms,[&](...){
+			std::this_thread::sleep_for(2ms);
+			fired++;
+		});
+		timer->SetName("EventLoopTestPlan - slow");
+
+		//Enough tasks to be sampled
+		std::atomic<int> executed(0);
+		for (int i=0;i<64;++i)
+			loop.Post([&](...){ executed++; });
+
+		//Wait for them
+		while (fired<5 || executed<64)
+			std::this_thread::sleep_for(1ms);
+
+		timer->Cancel();
+		loop.Stop();
+
+		auto stats = loop.GetStats();
+
+		//Timers
+		assert(stats.timerDuration.count("EventLoopTestPlan - slow"));
+		auto& slow = stats.timerDuration["EventLoopTestPlan - slow"];
+		assert(slow.count>=5);
+		assert(slow.GetPercentile(50)>=2000000);
+		assert(stats.timerLateness.count==slow.count);
+
+		//Sampled tasks
+		assert(stats.taskWait.count>=64/16);
+		assert(stats.taskDuration.count==stats.taskWait.count);
+	}
+
+	void testLateness()
+	{
+		EventLoop loop;
+		loop.Start();
+
+		//Timer delayed by a blocking task
+		std::atomic<bool> fired(false);
+		auto timer = loop.CreateTimer(5ms,[&](...){ fired = true; });
+		loop.Post([](...){ std::this_thread::sleep_for(30ms); });
+
+		//Wait for it
+		while (!fired)
+			std::this_thread::sleep_for(1ms);
+
+		loop.Stop();
+
+		auto stats = loop.GetStats();
+
+		//Late by the blocked time after it was due, not by the ms truncation of the timers
+		assert(stats.timerLateness.count==1);
+		assert(stats.timerLateness.GetPercentile(100)>=20000000);
+		assert(stats.timerLateness.GetPercentile(100)<100000000);
+	}
+};
+
+EventLoopTestPlan eventLoopTestPlan;
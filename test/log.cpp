@@ -0,0 +1,254 @@
+#include "test.h"
+#include <chrono>
+#include <functional>
+#include <string>
+#include <thread>
+#include <vector>
+#include <sys/mman.h>
+
+class LogTestPlan: public TestPlan
+{
+public:
+	LogTestPlan() : TestPlan("Log test plan")
+	{
+	}
+
+	virtual void Execute()
+	{
+		Log("testWrap\n");
+		testWrap();
+
+		Log("testDropped\n");
+		testDropped();
+
+		Log("testRateLimit\n");
+		testRateLimit();
+
+		Log("testRateLimitCollision\n");
+		testRateLimitCollision();
+
+		Log("testRateLimitSync\n");
+		testRateLimitSync();
+
+		Log("testBoundedStrings\n");
+		testBoundedStrings();
+	}
+
+	//Run with async or sync logging and return what has been printed
+	static std::string Capture(std::function<void()> run,bool async = true)
+	{
+		fflush(stdout);
+		//Redirect stdout to a temporary file
+		FILE* file = tmpfile();
+		int fd = dup(fileno(stdout));
+		dup2(fileno(file),fileno(stdout));
+
+		Logger::EnableAsync(async);
+		run();
+		//Stops the flusher and prints the remaining ones
+		Logger::EnableAsync(false);
+
+		//Restore stdout
+		fflush(stdout);
+		dup2(fd,fileno(stdout));
+		close(fd);
+
+		//Read output
+		std::string output;
+		char buffer[4096];
+		rewind(file);
+		while (size_t len = fread(buffer,1,sizeof(buffer),file))
+			output.append(buffer,len);
+		fclose(file);
+		return output;
+	}
+
+	static size_t Count(const std::string& output,const std::string& str)
+	{
+		size_t num = 0;
+		for (size_t pos = output.find(str); pos!=std::string::npos; pos = output.find(str,pos+str.size()))
+			num++;
+		return num;
+	}
+
+	//Sum of the numbers printed after each occurrence
+	static DWORD Sum(const std::string& output,const std::string& str)
+	{
+		DWORD sum = 0;
+		for (size_t pos = output.find(str); pos!=std::string::npos; pos = output.find(str,pos+str.size()))
+			sum += strtoul(output.c_str()+pos+str.size(),nullptr,10);
+		return sum;
+	}
+
+	void testWrap()
+	{
+		//Records of different sizes going several times around the ring, printed before it gets full
+		const DWORD messages = 3000;
+		std::string padding(97,'x');
+
+		std::string output = Capture([&](){
+			for (DWORD i=0;i<messages;++i)
+			{
+				Log("-LogTestPlan::testWrap() [%u,%s]\n",i,padding.c_str()+i%97);
+				if (i%500==499)
+					Logger::Flush();
+			}
+		});
+
+		//All printed in order
+		size_t pos = 0;
+		for (DWORD i=0;i<messages;++i)
+		{
+			char line[256];
+			snprintf(line,sizeof(line),"-LogTestPlan::testWrap() [%u,%s]\n",i,padding.c_str()+i%97);
+			pos = output.find(line,pos);
+			assert(pos!=std::string::npos);
+		}
+		assert(Count(output,"-LogTestPlan::testWrap()")==messages);
+		assert(!Count(output,"dropped"));
+	}
+
+	void testDropped()
+	{
+		//Too big for the ring
+		std::string big(64*1024,'x');
+		//Logged faster than printed
+		const DWORD messages = 20000;
+		std::string medium(1000,'x');
+
+		std::string output = Capture([&](){
+			Log("-LogTestPlan::testDropped() big [%s]\n",big.c_str());
+			Logger::Flush();
+			for (DWORD i=0;i<messages;++i)
+				Log("-LogTestPlan::testDropped() medium [%s]\n",medium.c_str());
+		});
+
+		//Big one is reported as dropped on its own
+		assert(!Count(output,"-LogTestPlan::testDropped() big"));
+		assert(Count(output,"dropped 1 messages"));
+		//Printed and dropped ones add up
+		DWORD printed = Count(output,"-LogTestPlan::testDropped() medium");
+		DWORD dropped = Sum(output,"-Logger::Drain() dropped ");
+		assert(printed<messages);
+		assert(printed+dropped==messages+1);
+	}
+
+	void testRateLimit()
+	{
+		const DWORD messages = 100;
+
+		std::string output = Capture([&](){
+			Logger::SetRateLimit(10);
+			for (DWORD i=0;i<messages;++i)
+				Log("-LogTestPlan::testRateLimit() [%u]\n",i);
+			//Next period
+			std::this_thread::sleep_for(std::chrono::milliseconds(1100));
+			Log("-LogTestPlan::testRateLimit() [%u]\n",messages);
+			Logger::SetRateLimit(0);
+		});
+
+		//Suppressed ones are reported on next period with the format of the call site
+		DWORD reports = Count(output,"messages like: -LogTestPlan::testRateLimit()");
+		DWORD printed = Count(output,"-LogTestPlan::testRateLimit() [") - reports;
+		DWORD suppressed = Sum(output,"-Logger::Throttle() suppressed ");
+		assert(reports);
+		assert(suppressed);
+		assert(printed+suppressed==messages+1);
+		//Last one printed after the report
+		assert(output.find("[100]")>output.rfind("-Logger::Throttle() suppressed"));
+	}
+
+	void testRateLimitCollision()
+	{
+		const DWORD messages = 100;
+		//Two call sites on the same slot of the call site table
+		static char formats[2048];
+		char* a = formats;
+		char* b = formats+1024;
+		strcpy(a,"-LogTestPlan::testRateLimitCollision() a [%u]\n");
+		strcpy(b,"-LogTestPlan::testRateLimitCollision() b [%u]\n");
+
+		std::string output = Capture([&](){
+			Logger::SetRateLimit(10);
+			for (DWORD i=0;i<messages;++i)
+			{
+				Log(a,i);
+				Log(b,i);
+			}
+			//Next period
+			std::this_thread::sleep_for(std::chrono::milliseconds(1100));
+			Log(a,messages);
+			Log(b,messages);
+			Logger::SetRateLimit(0);
+		});
+
+		//Both are throttled without resetting each other
+		for (const char* site : {"a [","b ["})
+		{
+			std::string line = std::string("-LogTestPlan::testRateLimitCollision() ") + site;
+			std::string report = std::string("messages like: ") + line;
+			DWORD reports = Count(output,report);
+			DWORD printed = Count(output,line) - reports;
+			assert(reports);
+			assert(printed<messages);
+			//Sum the suppressed ones reported for this call site only
+			DWORD suppressed = 0;
+			for (size_t pos = output.find(report); pos!=std::string::npos; pos = output.find(report,pos+report.size()))
+			{
+				size_t start = output.rfind("suppressed ",pos);
+				suppressed += strtoul(output.c_str()+start+strlen("suppressed "),nullptr,10);
+			}
+			assert(printed+suppressed==messages+1);
+		}
+	}
+
+	void testRateLimitSync()
+	{
+		const DWORD messages = 100;
+
+		std::string output = Capture([&](){
+			Logger::SetRateLimit(10);
+			for (DWORD i=0;i<messages;++i)
+				Log("-LogTestPlan::testRateLimitSync() [%u]\n",i);
+			Logger::SetRateLimit(0);
+		},false);
+
+		//Not throttled
+		assert(Count(output,"-LogTestPlan::testRateLimitSync()")==messages);
+	}
+
+	void testBoundedStrings()
+	{
+		//Not null terminated string at the end of a page followed by an unreadable one
+		long pageSize = sysconf(_SC_PAGESIZE);
+		BYTE* pages = (BYTE*)mmap(nullptr,2*pageSize,PROT_READ|PROT_WRITE,MAP_PRIVATE|MAP_ANONYMOUS,-1,0);
+		assert(pages!=MAP_FAILED);
+		mprotect(pages+pageSize,pageSize,PROT_NONE);
+		char* bounded = (char*)pages+pageSize-5;
+		memcpy(bounded,"hello",5);
+
+		//Non string pointer printed as a string, changed before it is printed
+		std::vector<BYTE> data = {'w','o','r','l','d'};
+
+		std::string output = Capture([&](){
+			Log("-LogTestPlan::testBoundedStrings() [%.*s]\n",5,bounded);
+			Log("-LogTestPlan::testBoundedStrings() [%.3s]\n",bounded);
+			Log("-LogTestPlan::testBoundedStrings() [%.*s]\n",(int)data.size(),data.data());
+			memcpy(data.data(),"xxxxx",5);
+			//Pointers printed as such are captured by value
+			Log("-LogTestPlan::testBoundedStrings() [%p,%s,%d%%]\n",(void*)pages,"done",100);
+		});
+
+		char pointer[256];
+		snprintf(pointer,sizeof(pointer),"-LogTestPlan::testBoundedStrings() [%p,done,100%%]\n",(void*)pages);
+
+		assert(Count(output,"-LogTestPlan::testBoundedStrings() [hello]\n"));
+		assert(Count(output,"-LogTestPlan::testBoundedStrings() [hel]\n"));
+		assert(Count(output,"-LogTestPlan::testBoundedStrings() [world]\n"));
+		assert(Count(output,pointer));
+
+		munmap(pages,2*pageSize);
+	}
+};
+
+LogTestPlan logTestPlan;
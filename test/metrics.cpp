@@ -0,0 +1,142 @@
+#include "test.h"
+#include "Metrics.h"
+#include <thread>
+#include <vector>
+
+class MetricsTestPlan: public TestPlan
+{
+public:
+	MetricsTestPlan() : TestPlan("Metrics test plan")
+	{
+	}
+
+	virtual void Execute()
+	{
+		Log("testBuckets\n");
+		testBuckets();
+
+		Log("testCounter\n");
+		testCounter();
+
+		Log("testHistogram\n");
+		testHistogram();
+
+		Log("testDump\n");
+		testDump();
+	}
+
+	void testBuckets()
+	{
+		//Small values are exact
+		for (QWORD value=0;value<16;++value)
+		{
+			DWORD bucket = Metrics::Histogram::GetBucket(value);
+			assert(Metrics::Histogram::GetBucketStart(bucket)==value);
+			assert(Metrics::Histogram::GetBucketEnd(bucket)==value+1);
+		}
+
+		//All values are inside their bucket and within the precision
+		for (QWORD value=1;value<((QWORD)1<<Metrics::Histogram::MaxBits);value=value*3/2+1)
+		{
+			DWORD bucket = Metrics::Histogram::GetBucket(value);
+			QWORD start = Metrics::Histogram::GetBucketStart(bucket);
+			QWORD end = Metrics::Histogram::GetBucketEnd(bucket);
+			assert(bucket<Metrics::Histogram::Buckets);
+			assert(start<=value && value<end);
+			assert((end-start)*Metrics::Histogram::SubBuckets<=std::max<QWORD>(start,Metrics::Histogram::SubBuckets));
+		}
+
+		//Buckets are contiguous
+		for (DWORD bucket=0;bucket+1<Metrics::Histogram::Buckets;++bucket)
+			assert(Metrics::Histogram::GetBucketEnd(bucket)==Metrics::Histogram::GetBucketStart(bucket+1));
+
+		//Big values saturate
+		assert(Metrics::Histogram::GetBucket((QWORD)-1)==Metrics::Histogram::Buckets-1);
+	}
+
+	void testCounter()
+	{
+		Metrics::Counter& counter = Metrics::GetCounter("test_counter_total","Test counter");
+
+		//Same instance for same name
+		assert(&counter==&Metrics::GetCounter("test_counter_total","Test counter"));
+		assert(&counter!=&Metrics::GetCounter("test_counter_total","Test counter","label=\"other\""));
+
+		//Update from many threads
+		std::vector<std::thread> threads;
+		for (int i=0;i<32;++i)
+			threads.emplace_back([&counter](){
+				for (int j=0;j<1000;++j)
+					counter.Increment();
+			});
+		for (auto& thread : threads)
+			thread.join();
+
+		assert(counter.GetValue()==32000);
+	}
+
+	void testHistogram()
+	{
+		Metrics::Histogram histogram;
+
+		//Empty
+		auto snapshot = histogram.GetSnapshot();
+		assert(snapshot.count==0);
+		assert(snapshot.GetPercentile(99)==0);
+
+		//1..1000 from different threads
+		std::vector<std::thread> threads;
+		for (int i=0;i<4;++i)
+			threads.emplace_back([&histogram,i](){
+				for (QWORD value=i+1;value<=1000;value+=4)
+					histogram.Record(value);
+			});
+		for (auto& thread : threads)
+			thread.join();
+
+		snapshot = histogram.GetSnapshot();
+		assert(snapshot.count==1000);
+		assert(snapshot.sum==500500);
+		assert(snapshot.max==1000);
+		assert(snapshot.GetMean()==500.5);
+		//Percentiles within the bucket precision
+		assert(snapshot.GetPercentile(50)>=500 && snapshot.GetPercentile(50)<=500*9/8);
+		assert(snapshot.GetPercentile(99)>=990 && snapshot.GetPercentile(99)<=1000);
+		assert(snapshot.GetPercentile(100)==1000);
+		//Exact on powers of two
+		assert(snapshot.GetCountBelow(512)==511);
+		assert(snapshot.GetCountBelow(1024)==1000);
+	}
+
+	void testDump()
+	{
+		Metrics::Histogram& latency = Metrics::GetHistogram("test_latency_seconds","Test latency","op=\"test\"",1E-9);
+		Metrics::Counter& packets = Metrics::GetCounter("test_packets_total","Test packets");
+
+		latency.Record(3);
+		latency.Record(1000);
+		packets.Increment(7);
+
+		std::string dump = Metrics::Dump();
+
+		Log("%s",dump.c_str());
+
+		assert(dump.find("# HELP test_packets_total Test packets\n")!=std::string::npos);
+		assert(dump.find("# TYPE test_packets_total counter\ntest_packets_total 7\n")!=std::string::npos);
+		assert(dump.find("# TYPE test_latency_seconds histogram\n")!=std::string::npos);
+		assert(dump.find("test_latency_seconds_bucket{op=\"test\",le=\"1e-09\"} 0\n")!=std::string::npos);
+		assert(dump.find("test_latency_seconds_bucket{op=\"test\",le=\"3e-09\"} 1\n")!=std::string::npos);
+		assert(dump.find("test_latency_seconds_bucket{op=\"test\",le=\"1.023e-06\"} 2\n")!=std::string::npos);
+		assert(dump.find("test_latency_seconds_bucket{op=\"test\",le=\"+Inf\"} 2\n")!=std::string::npos);
+		assert(dump.find("test_latency_seconds_sum{op=\"test\"} 1.003e-06\n")!=std::string::npos);
+		assert(dump.find("test_latency_seconds_count{op=\"test\"} 2\n")!=std::string::npos);
+
+		//Same name metrics are grouped after the metadata
+		size_t help = dump.find("# HELP test_counter_total");
+		assert(help!=std::string::npos);
+		assert(dump.find("# HELP test_counter_total",help+1)==std::string::npos);
+		assert(dump.find("test_counter_total 32000\ntest_counter_total{label=\"other\"} 0\n")!=std::string::npos);
+	}
+};
+
+MetricsTestPlan metricsTestPlan;
@@ -0,0 +1,354 @@
+#include <unistd.h>
+#include <thread>
+#include <vector>
+#include <algorithm>
+#include "test.h"
+#include "mp4filewriter.h"
+#include "mp4recorder.h"
+#include "fmp4writer.h"
+
+//Simulate a slow disk by delaying each block write
+class SlowMP4FileWriter : public MP4FileWriter
+{
+public:
+	SlowMP4FileWriter(size_t blockSize, size_t maxQueuedBytes, std::chrono::milliseconds delay) :
+		MP4FileWriter(blockSize,maxQueuedBytes),
+		delay(delay)
+	{
+	}
+protected:
+	virtual bool WriteBlock(const BYTE* data,size_t size,uint64_t offset) override
+	{
+		std::this_thread::sleep_for(delay);
+		return MP4FileWriter::WriteBlock(data,size,offset);
+	}
+private:
+	std::chrono::milliseconds delay;
+};
+
+class MP4Plan: public TestPlan
+{
+public:
+	MP4Plan() : TestPlan("MP4 test plan")
+	{
+
+	}
+
+	virtual void Execute()
+	{
+		//Prefer tmpfs so only the simulated delay is measured
+		std::string dir = access("/dev/shm",W_OK)==0 ? "/dev/shm" : "/tmp";
+
+		testWriteBehind(dir + "/mp4writer-test.bin");
+		testBackpressure(dir + "/mp4writer-test.bin");
+		testRecorder(dir + "/mp4recorder-test.mp4");
+		testFragmented(dir + "/fmp4writer-test-1.mp4",dir + "/fmp4writer-test-2.mp4");
+		testFragmentedCodecConfig(dir + "/fmp4writer-test-3.mp4");
+	}
+
+	static std::vector<BYTE> WriteSamples(MP4FileWriter& writer, size_t num, size_t size)
+	{
+		std::vector<BYTE> expected;
+		std::vector<BYTE> sample(size);
+
+		//mdat header placeholder
+		BYTE header[8] = {};
+		assert(writer.Write(header,sizeof(header)));
+		expected.insert(expected.end(),header,header+sizeof(header));
+
+		//Small writes as mp4v2 does for each sample
+		for (size_t i=0;i<num;++i)
+		{
+			memset(sample.data(),i,size);
+			assert(writer.Write(sample.data(),size));
+			expected.insert(expected.end(),sample.begin(),sample.end());
+		}
+
+		//Seek back and overwrite header as done on close
+		set4(header,0,expected.size());
+		assert(writer.Seek(0));
+		assert(writer.Write(header,4));
+		memcpy(expected.data(),header,4);
+
+		//Seek back to the end and append moov
+		assert(writer.Seek(expected.size()));
+		assert(writer.Write(header,sizeof(header)));
+		expected.insert(expected.end(),header,header+sizeof(header));
+
+		return expected;
+	}
+
+	static void CheckFile(const std::string& filename, const std::vector<BYTE>& expected)
+	{
+		std::vector<BYTE> data(expected.size()+1);
+		FILE* f = fopen(filename.c_str(),"rb");
+		assert(f);
+		size_t len = fread(data.data(),1,data.size(),f);
+		fclose(f);
+		assert(len==expected.size());
+		assert(memcmp(data.data(),expected.data(),len)==0);
+		unlink(filename.c_str());
+	}
+
+	void testWriteBehind(const std::string& filename)
+	{
+		//64KB blocks, 20ms per block write
+		SlowMP4FileWriter writer(64*1024,64*1024*1024,std::chrono::milliseconds(20));
+
+		assert(writer.Open(filename.c_str()));
+
+		//Write 4MB, which would take more than 1s if writes were synchronous
+		auto ini = std::chrono::steady_clock::now();
+		auto expected = WriteSamples(writer,4096,1024);
+		auto elapsed = std::chrono::steady_clock::now()-ini;
+
+		auto stats = writer.GetStats();
+		Log("-testWriteBehind() [elapsed:%lldms,queued:%llu,maxQueued:%llu,stalls:%llu]\n",
+			std::chrono::duration_cast<std::chrono::milliseconds>(elapsed).count(),stats.queuedBlocks,stats.maxQueuedBlocks,stats.stalls);
+
+		//Producer must not have waited for the disk
+		assert(stats.stalls==0);
+		assert(stats.maxQueuedBlocks>1);
+		assert(elapsed<std::chrono::milliseconds(500));
+
+		assert(writer.Close());
+
+		stats = writer.GetStats();
+		assert(stats.queuedBytes==0);
+		assert(stats.bytesWritten>=expected.size());
+		assert(stats.maxWriteLatency>=std::chrono::milliseconds(20));
+
+		CheckFile(filename,expected);
+	}
+
+	void testBackpressure(const std::string& filename)
+	{
+		//Only two blocks allowed in queue
+		SlowMP4FileWriter writer(64*1024,128*1024,std::chrono::milliseconds(5));
+
+		assert(writer.Open(filename.c_str()));
+
+		auto expected = WriteSamples(writer,1024,1024);
+
+		auto stats = writer.GetStats();
+		//Memory is bounded
+		assert(stats.maxQueuedBytes<=128*1024);
+		assert(stats.stalls>0);
+
+		assert(writer.Close());
+
+		CheckFile(filename,expected);
+	}
+
+	void testRecorder(const std::string& filename)
+	{
+		const int num = 100;
+		BYTE payload[160];
+		memset(payload,0xFF,sizeof(payload));
+
+		MP4Recorder recorder;
+		//Write hints on close
+		recorder.SetDeferHints(true);
+
+		assert(recorder.Create(filename.c_str()));
+		assert(recorder.Record(false,false));
+
+		for (int i=0;i<num;++i)
+		{
+			AudioFrame frame(AudioCodec::PCMU);
+			frame.SetClockRate(8000);
+			frame.SetTimestamp(i*160);
+			frame.SetTime(getTimeMS());
+			frame.SetMedia(payload,sizeof(payload));
+			recorder.onMediaFrame(frame);
+		}
+
+		assert(recorder.Close(false));
+
+		auto stats = recorder.GetStats();
+		assert(stats.queuedFrames==0);
+		assert(stats.maxQueuedFrames>0);
+		assert(stats.writer.bytesWritten>num*sizeof(payload));
+
+		//Check all samples and hints are there
+		MP4FileHandle mp4 = MP4Read(filename.c_str());
+		assert(mp4!=MP4_INVALID_FILE_HANDLE);
+		MP4TrackId audio = MP4FindTrackId(mp4,0,MP4_AUDIO_TRACK_TYPE);
+		MP4TrackId hint  = MP4FindTrackId(mp4,0,MP4_HINT_TRACK_TYPE);
+		assert(MP4GetTrackNumberOfSamples(mp4,audio)==num);
+		assert(MP4GetTrackNumberOfSamples(mp4,hint)==num);
+		MP4Close(mp4);
+
+		unlink(filename.c_str());
+	}
+
+	static std::vector<BYTE> ReadFile(const std::string& filename)
+	{
+		std::vector<BYTE> data;
+		BYTE buffer[4096];
+
+		FILE* f = fopen(filename.c_str(),"rb");
+		assert(f);
+		size_t len;
+		while ((len=fread(buffer,1,sizeof(buffer),f))>0)
+			data.insert(data.end(),buffer,buffer+len);
+		fclose(f);
+
+		return data;
+	}
+
+	//Get contents of first box of a type, nested ones included
+	static std::vector<BYTE> FindBox(const std::vector<BYTE>& data,const char* type)
+	{
+		auto it = std::search(data.begin(),data.end(),type,type+4);
+		if (it==data.end() || it-data.begin()<4)
+			return {};
+		size_t pos = it-data.begin()-4;
+		DWORD size = get4(data.data(),pos);
+		assert(size>=8 && pos+size<=data.size());
+		return std::vector<BYTE>(data.begin()+pos+8,data.begin()+pos+size);
+	}
+
+	//Get top level boxes of a file
+	static std::vector<std::string> GetBoxes(const std::string& filename)
+	{
+		std::vector<std::string> boxes;
+		std::vector<BYTE> data = ReadFile(filename);
+
+		//Parse top level boxes
+		size_t pos = 0;
+		while (pos+8<=data.size())
+		{
+			DWORD size = get4(data.data(),pos);
+			assert(size>=8 && pos+size<=data.size());
+			boxes.emplace_back((const char*)data.data()+pos+4,4);
+			pos += size;
+		}
+		//All file must be boxes
+		assert(pos==data.size());
+
+		return boxes;
+	}
+
+	void testFragmented(const std::string& first,const std::string& second)
+	{
+		//Fake H264 parameter sets with nal header
+		BYTE sps[] = {0x67,0x42,0xC0,0x1F,0x00};
+		BYTE pps[] = {0x68,0xCE,0x3C,0x80};
+		BYTE frame[2048];
+		BYTE audio[80];
+		memset(frame,0xAA,sizeof(frame));
+		memset(audio,0xBB,sizeof(audio));
+
+		//One second fragments
+		FMP4Writer writer(std::chrono::milliseconds(1000));
+
+		assert(writer.Open(first.c_str()));
+
+		DWORD video = writer.AddVideoTrack(VideoCodec::H264,90000,640,480);
+		DWORD opus  = writer.AddAudioTrack(AudioCodec::OPUS,48000);
+		assert(video && opus);
+		//Not supported
+		assert(!writer.AddAudioTrack(AudioCodec::PCMU,8000));
+
+		writer.SetH264SequenceParameterSet(video,sps,sizeof(sps));
+		writer.SetH264PictureParameterSet(video,pps,sizeof(pps));
+
+		size_t maxBuffered = 0;
+
+		//10 seconds at 25fps with a key frame each second, 20ms audio
+		for (int i=0;i<250;++i)
+		{
+			//Rotate in the middle
+			if (i==125)
+				assert(writer.Rotate(second.c_str()));
+			assert(writer.WriteSample(video,frame,sizeof(frame),3600,i%25==0));
+			assert(writer.WriteSample(opus,audio,sizeof(audio),960,true));
+			assert(writer.WriteSample(opus,audio,sizeof(audio),960,true));
+			maxBuffered = std::max(maxBuffered,writer.GetBufferedSize());
+		}
+
+		assert(writer.Close());
+
+		Log("-testFragmented() [fragments:%u,maxBuffered:%zu,written:%llu]\n",writer.GetFragments(),maxBuffered,writer.GetStats().bytesWritten);
+
+		//Only one fragment in memory
+		assert(maxBuffered<=26*sizeof(frame)+52*sizeof(audio));
+		assert(writer.GetFragments()==10);
+
+		//Both files are playable on their own, rotation waits for the next key frame
+		for (const auto& filename : {first,second})
+		{
+			auto boxes = GetBoxes(filename);
+			assert(boxes.size()==2+5*2);
+			assert(boxes[0]=="ftyp");
+			assert(boxes[1]=="moov");
+			for (size_t i=2;i<boxes.size();i+=2)
+			{
+				assert(boxes[i]=="moof");
+				assert(boxes[i+1]=="mdat");
+			}
+			unlink(filename.c_str());
+		}
+	}
+
+	void testFragmentedCodecConfig(const std::string& filename)
+	{
+		//Fake H264 parameter sets with nal header
+		BYTE sps[] = {0x67,0x4D,0x40,0x28,0x00};
+		BYTE pps[] = {0x68,0xCE,0x3C,0x80};
+		BYTE frame[1024];
+		//Stereo CELT TOC
+		BYTE audio[80] = {0xFC};
+		memset(frame,0xAA,sizeof(frame));
+
+		FMP4Writer writer(std::chrono::milliseconds(1000));
+
+		assert(writer.Open(filename.c_str()));
+
+		DWORD video = writer.AddVideoTrack(VideoCodec::H264,90000,640,480);
+		DWORD opus  = writer.AddAudioTrack(AudioCodec::OPUS,48000);
+
+		//10 seconds with a key frame each second, parameter sets only after 6 seconds
+		for (int i=0;i<250;++i)
+		{
+			if (i==150)
+			{
+				writer.SetH264SequenceParameterSet(video,sps,sizeof(sps));
+				writer.SetH264PictureParameterSet(video,pps,sizeof(pps));
+			}
+			assert(writer.WriteSample(video,frame,sizeof(frame),3600,i%25==0));
+			assert(writer.WriteSample(opus,audio,sizeof(audio),1920,true));
+			//Memory is bounded while waiting for parameter sets
+			assert(writer.GetBufferedSize()<=101*(sizeof(frame)+sizeof(audio)));
+		}
+
+		assert(writer.Close());
+
+		//Fragments without parameter sets are dropped, first written one starts on the key frame before them
+		auto boxes = GetBoxes(filename);
+		assert(boxes.size()==2+5*2);
+		assert(boxes[0]=="ftyp");
+		assert(boxes[1]=="moov");
+
+		auto data = ReadFile(filename);
+
+		//Init segment has the parameter sets
+		auto avcC = FindBox(data,"avcC");
+		assert(avcC.size()==6+2+sizeof(sps)+1+2+sizeof(pps));
+		assert(avcC[1]==sps[1] && avcC[3]==sps[3]);
+		assert(memcmp(avcC.data()+8,sps,sizeof(sps))==0);
+		assert(memcmp(avcC.data()+8+sizeof(sps)+3,pps,sizeof(pps))==0);
+
+		//Stereo opus
+		auto dOps = FindBox(data,"dOps");
+		assert(dOps.size()==11);
+		assert(dOps[1]==2);
+		assert(get4(dOps.data(),4)==48000);
+
+		unlink(filename.c_str());
+	}
+
+};
+
+MP4Plan mp4;
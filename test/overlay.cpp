@@ -1,5 +1,9 @@
 #include "test.h"
 #include "overlay.h"
+#include "alphablend.h"
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
 
 
 
@@ -23,10 +27,95 @@ public:
 		return true;
 	}
 
+	//Original per 2x2 block blending
+	static void reference(BYTE* image,const BYTE* frame,const BYTE* overlay,DWORD width,DWORD height)
+	{
+		DWORD numpixels = width*height;
+		for (DWORD j=0;j<height;j+=2)
+		{
+			for (DWORD i=0;i<width;i+=2)
+			{
+				DWORD a[4];
+				for (DWORD k=0;k<4;++k)
+				{
+					DWORD pos = (j+k/2)*width+i+k%2;
+					a[k] = overlay[numpixels*3/2+pos];
+					if (a[k]==0)
+						image[pos] = frame[pos];
+					else if (a[k]==255)
+						image[pos] = overlay[pos];
+					else
+						image[pos] = (overlay[pos]*a[k]+frame[pos]*(255-a[k]))/255;
+				}
+				DWORD alpha = a[0]+a[2]+a[2]+a[3];
+				for (DWORD plane : {numpixels,numpixels*5/4})
+				{
+					DWORD pos = plane+j/2*width/2+i/2;
+					if (alpha==0)
+						image[pos] = frame[pos];
+					else if (alpha==1020)
+						image[pos] = overlay[pos];
+					else
+						image[pos] = (overlay[pos]*alpha+frame[pos]*(1020-alpha))/1020;
+				}
+			}
+		}
+	}
+
+	int blend()
+	{
+		for (DWORD width : {40,102,1280})
+		{
+			DWORD height = 36;
+			DWORD numpixels = width*height;
+			std::vector<BYTE> frame(numpixels*3/2);
+			std::vector<BYTE> overlay(numpixels*5/2);
+			std::vector<BYTE> expected(frame.size());
+			//Random pixels
+			for (auto& b : frame)
+				b = rand();
+			for (auto& b : overlay)
+				b = rand();
+			//Transparent, opaque, random and short alpha runs
+			BYTE* alpha = overlay.data()+numpixels*3/2;
+			for (DWORD j=0;j<height;++j)
+				for (DWORD i=0;i<width;++i)
+					if (j<8)
+						alpha[j*width+i] = 0;
+					else if (j<16)
+						alpha[j*width+i] = 255;
+					else if (j<24)
+						alpha[j*width+i] = (i/8)%2 ? 255 : 0;
+					else if (j<30)
+						alpha[j*width+i] = i<width/3 ? 0 : i<width*2/3 ? 255 : rand();
+
+			reference(expected.data(),frame.data(),overlay.data(),width,height);
+
+			AlphaBlend::Runs runs;
+			AlphaBlend::CalculateRuns(overlay.data(),width,height,runs);
+
+			for (auto kernel : {AlphaBlend::Scalar,AlphaBlend::SSE41,AlphaBlend::AVX2})
+			{
+				if (!AlphaBlend::IsSupported(kernel))
+					continue;
+				std::vector<BYTE> image(frame.size());
+				//All pixels
+				AlphaBlend::Blend(kernel,image.data(),frame.data(),overlay.data(),width,height);
+				assert(memcmp(image.data(),expected.data(),image.size())==0);
+				//With alpha runs
+				memset(image.data(),0,image.size());
+				AlphaBlend::Blend(kernel,image.data(),frame.data(),overlay.data(),width,height,&runs);
+				assert(memcmp(image.data(),expected.data(),image.size())==0);
+			}
+		}
+		//OK
+		return true;
+	}
 	
 	virtual void Execute()
 	{
 		canvas();
+		blend();
 	}
 	
 };
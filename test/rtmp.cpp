@@ -6,6 +6,8 @@
 #include <memory>
 #include "test.h"
 #include "rtmp/rtmpmessage.h"
+#include "rtmp/rtmpchunk.h"
+#include <vector>
 
 class RTMPPlan: public TestPlan
 {
@@ -20,6 +22,8 @@ public:
 	{
 		testFailedCommand();
 		testMetadata();
+		testPayload();
+		testChunkedPayload();
 	}
 	
 	void testFailedCommand()
@@ -77,6 +81,85 @@ public:
 		assert(meta.Parse(buffer+1, sizeof(buffer)-1));
 		meta.Dump();
 	}
+
+	void testPayload()
+	{
+		BYTE data[16] = {};
+		RTMPVideoFrame frame(0,sizeof(data));
+		frame.SetVideoCodec(RTMPVideoFrame::AVC);
+		frame.SetFrameType(RTMPVideoFrame::INTRA);
+		frame.SetAVCType(RTMPVideoFrame::AVCNALU);
+		frame.SetVideoFrame(data,sizeof(data));
+
+		//Serialized once and shared
+		auto payload = frame.GetPayload();
+		assert(payload==frame.GetPayload());
+		assert(payload->GetSize()==5+sizeof(data));
+
+		//Writing the media data serializes it again
+		frame.GetMediaData()[0] = 0xAA;
+		auto written = frame.GetPayload();
+		assert(written!=payload);
+		assert(written->GetData()[5]==0xAA);
+		//Already shared ones are not modified
+		assert(payload->GetData()[5]==0);
+
+		//Reading it does not
+		const RTMPVideoFrame& readonly = frame;
+		assert(readonly.GetMediaData()[0]==0xAA);
+		assert(written==frame.GetPayload());
+
+		//Changing the size too
+		frame.SetMediaSize(8);
+		auto resized = frame.GetPayload();
+		assert(resized!=written);
+		assert(resized->GetSize()==5+8);
+	}
+
+	void testChunkedPayload()
+	{
+		const DWORD chunkSize = 128;
+		std::vector<BYTE> data(1000);
+		for (size_t i=0;i<data.size();++i)
+			data[i] = i;
+		RTMPVideoFrame frame(0x1000000,data.size());
+		frame.SetVideoCodec(RTMPVideoFrame::AVC);
+		frame.SetFrameType(RTMPVideoFrame::INTRA);
+		frame.SetAVCType(RTMPVideoFrame::AVCNALU);
+		frame.SetVideoFrame(data.data(),data.size());
+
+		//Chunked on the fly, first viewer and second one using the chunked payload
+		RTMPChunkOutputStream copied(5),first(5),cached(5);
+		for (int i=0;i<3;++i)
+		{
+			copied.SendMessage(new RTMPMessage(1,0x1000000+i*40,frame.Clone()));
+			first.SendMessage(new RTMPMessage(1,0x1000000+i*40,RTMPMessage::Video,frame.GetPayload()));
+			cached.SendMessage(new RTMPMessage(1,0x1000000+i*40,RTMPMessage::Video,frame.GetPayload()));
+		}
+
+		BYTE expected[RTMPChunkOutputStream::MaxHeaderSize+chunkSize];
+		BYTE header[RTMPChunkOutputStream::MaxHeaderSize];
+		std::vector<BYTE> wire;
+		DWORD chunks = 0;
+		while (copied.HasData())
+		{
+			DWORD len = copied.GetNextChunk(expected,sizeof(expected),chunkSize);
+			assert(len);
+			//Request it so the payload gets chunked
+			RTMPChunkOutputStream::Chunk chunk;
+			assert(first.GetNextChunk(header,sizeof(header),chunkSize,chunk));
+			//Same wire data one chunk at a time
+			assert(cached.GetNextChunk(header,sizeof(header),chunkSize,chunk));
+			assert(chunk.length<=RTMPChunkOutputStream::MaxHeaderSize+chunkSize);
+			wire.assign(header,header+chunk.headerLen);
+			wire.insert(wire.end(),chunk.data.get(),chunk.data.get()+chunk.length);
+			assert(wire.size()==len);
+			assert(!memcmp(wire.data(),expected,len));
+			chunks++;
+		}
+		assert(!cached.HasData());
+		assert(chunks==3*((frame.GetSize()+chunkSize-1)/chunkSize));
+	}
 };
 
 RTMPPlan rtmp;
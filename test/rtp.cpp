@@ -1,5 +1,7 @@
 #include "test.h"
 #include "rtp.h"
+#include "rtp/RTPTransportWideArrivals.h"
+#include "FlatMap.h"
 
 class RTPTestPlan: public TestPlan
 {
@@ -42,6 +44,10 @@ public:
 		testTransportWideFeedbackMessage();
 		Log("Transport Wide Message Feedback (2)\n");
 		testTransportWideFeedbackMessageParser();
+		Log("Transport Wide arrivals\n");
+		testTransportWideArrivals();
+		Log("FlatMap\n");
+		testFlatMap();
 		Log("testBye\n");
 		testBye();
 		Log("testExtSeqNum\n");
@@ -597,6 +603,188 @@ public:
 		
 		free(data);
 	}
+	void testTransportWideArrivals()
+	{
+		using Packets = RTCPRTPFeedback::TransportWideFeedbackMessageField::Packets;
+		QWORD initTime = 500;
+		RTPTransportWideArrivals arrivals;
+
+		//Drain in order with a gap
+		{
+			assert(arrivals.Add(1,1000));
+			assert(arrivals.Add(2,2000));
+			assert(arrivals.Add(4,4000));
+			//Duplicate is counted once
+			assert(arrivals.Add(4,4000));
+			assert(arrivals.GetCount()==3);
+			assert(arrivals.GetFirstTime()==1000);
+			Packets packets;
+			arrivals.Drain(initTime,packets);
+			assert(arrivals.IsEmpty());
+			assert(arrivals.GetMaxExtSeqNum()==4);
+			assert(packets.size()==4);
+			assert(packets.find(1)->second==500);
+			assert(packets.find(2)->second==1500);
+			assert(packets.find(3)->second==0);
+			assert(packets.find(4)->second==3500);
+		}
+
+		//Lost ones since last drain are reported and out of order pending ones are sorted
+		{
+			assert(arrivals.Add(8,8000));
+			assert(arrivals.Add(7,7000));
+			Packets packets;
+			arrivals.Drain(initTime,packets);
+			assert(packets.size()==4);
+			assert(packets.begin()->first==5);
+			assert(packets.find(5)->second==0);
+			assert(packets.find(6)->second==0);
+			assert(packets.find(7)->second==6500);
+			assert(packets.rbegin()->first==8);
+		}
+
+		//Late packets already reported are dropped and the range does not restart below the reported ones
+		{
+			assert(arrivals.Fits(6));
+			assert(!arrivals.Add(6,9000));
+			assert(arrivals.IsEmpty());
+			assert(arrivals.Add(9,9500));
+			assert(!arrivals.Add(5,9600));
+			assert(arrivals.GetCount()==1);
+			Packets packets;
+			arrivals.Drain(initTime,packets);
+			assert(packets.size()==1);
+			assert(packets.begin()->first==9);
+			assert(packets.begin()->second==9000);
+		}
+
+		//Ring index wrap and transport seq num cycle wrap
+		{
+			RTPTransportWideArrivals wrap;
+			DWORD start = 0xFFFF - 5;
+			for (DWORD i=0;i<12;++i)
+				//Skip one after the cycle
+				if (i!=8)
+					assert(wrap.Add(start+i,10000+i));
+			Packets packets;
+			wrap.Drain(initTime,packets);
+			assert(packets.size()==12);
+			assert(packets.begin()->first==start);
+			assert(packets.rbegin()->first==0x10005);
+			assert(packets.find(0x10002)->second==0);
+			assert(packets.find(0x10003)->second==10009-initTime);
+			//Slots are cleared so the next round over the ring does not see stale times
+			for (DWORD i=1;i<=RTPTransportWideArrivals::Capacity;++i)
+				assert(wrap.Add(0x10005+i,20000));
+			packets.clear();
+			wrap.Drain(initTime,packets);
+			assert(packets.size()==RTPTransportWideArrivals::Capacity);
+			for (const auto& [extSeqNum,time] : packets)
+				assert(time==20000-initTime);
+		}
+
+		//Span of the pending and lost ones is bounded to the ring capacity
+		{
+			DWORD lastReported = arrivals.GetMaxExtSeqNum();
+			//Empty ring fits anything
+			assert(arrivals.Fits(lastReported+10*RTPTransportWideArrivals::Capacity));
+			assert(arrivals.Add(lastReported+10,30000));
+			assert(arrivals.Fits(lastReported+RTPTransportWideArrivals::Capacity));
+			assert(!arrivals.Fits(lastReported+RTPTransportWideArrivals::Capacity+1));
+			Packets packets;
+			arrivals.Drain(initTime,packets);
+			assert(packets.size()==10);
+		}
+
+		//After a long gap only the last lost ones fitting on the ring are reported
+		{
+			DWORD lastReported = arrivals.GetMaxExtSeqNum();
+			DWORD extSeqNum = lastReported+5000;
+			assert(arrivals.Add(extSeqNum,40000));
+			Packets packets;
+			arrivals.Drain(initTime,packets);
+			assert(packets.size()==RTPTransportWideArrivals::Capacity);
+			assert(packets.begin()->first==extSeqNum-RTPTransportWideArrivals::Capacity+1);
+			assert(packets.begin()->second==0);
+			assert(packets.rbegin()->first==extSeqNum);
+			assert(packets.rbegin()->second==40000-initTime);
+		}
+
+		//Drained feedback round trips
+		{
+			assert(arrivals.Add(arrivals.GetMaxExtSeqNum()+2,50000));
+			assert(arrivals.Add(arrivals.GetMaxExtSeqNum()+1,50250));
+			auto rtcp = RTCPCompoundPacket::Create();
+			auto feedback = rtcp->CreatePacket<RTCPRTPFeedback>(RTCPRTPFeedback::TransportWideFeedbackMessage,1,2);
+			auto field = feedback->CreateField<RTCPRTPFeedback::TransportWideFeedbackMessageField>(1);
+			arrivals.Drain(initTime,field->packets);
+			BYTE data[1500];
+			DWORD len = rtcp->Serialize(data,sizeof(data));
+			assert(len);
+			auto parsed = RTCPCompoundPacket::Parse(data,len);
+			assert(parsed);
+			auto& a = field->packets;
+			auto& b = parsed->GetPacket<RTCPRTPFeedback>(0)->GetField<RTCPRTPFeedback::TransportWideFeedbackMessageField>(0)->packets;
+			assert(a.size()==3);
+			assert(a.size()==b.size());
+			for (auto orig=a.begin(), mod=b.begin(); orig!=a.end(); ++orig, ++mod)
+				//Same seq nums and reception status
+				assert((orig->first & 0xFFFF)==(mod->first & 0xFFFF) && !orig->second==!mod->second);
+		}
+
+		//Reset starts reporting again
+		{
+			arrivals.Reset();
+			assert(arrivals.IsEmpty());
+			assert(arrivals.GetMaxExtSeqNum()==0);
+			assert(arrivals.Add(3,1000));
+			Packets packets;
+			arrivals.Drain(initTime,packets);
+			assert(packets.size()==1);
+		}
+	}
+
+	void testFlatMap()
+	{
+		FlatMap<DWORD,QWORD> map;
+		assert(map.empty());
+		//Append in order
+		assert(map.insert(std::make_pair(2,20)).second);
+		assert(map.insert(std::make_pair(5,50)).second);
+		//Insert in the middle and at the front
+		assert(map.insert(std::make_pair(3,30)).second);
+		assert(map.insert(std::make_pair(1,10)).second);
+		//Duplicate does not override, same as std::map
+		auto res = map.insert(std::make_pair(3,33));
+		assert(!res.second);
+		assert(res.first->second==30);
+		assert(map.size()==4);
+		//Sorted iteration
+		DWORD prev = 0;
+		for (const auto& [key,value] : map)
+		{
+			assert(key>prev);
+			assert(value==key*10);
+			prev = key;
+		}
+		assert(map.rbegin()->first==5);
+		//Lookup
+		assert(map.find(4)==map.end());
+		assert(map.find(5)->second==50);
+		//Default insert
+		map[4] = 40;
+		assert(map.size()==5);
+		assert(map.find(4)->second==40);
+		assert(map[4]==40);
+		assert(map.size()==5);
+		//Erase returns next
+		auto it = map.erase(map.find(2));
+		assert(it->first==3);
+		assert(map.size()==4);
+		map.clear();
+		assert(map.empty());
+	}
+
 	void testTransportWideFeedbackMessageParser()
 	{
 		{
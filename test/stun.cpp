@@ -14,6 +14,7 @@ public:
 	virtual void Execute()
 	{
 		testAuth();
+		testView();
 	}
 	
 	void testAuth()
@@ -50,6 +51,64 @@ public:
 		delete parsed;
 		
 	}
+
+	void testView()
+	{
+		BYTE transId[12];
+		set4(transId,0,1);
+		set8(transId,4,getTime());
+
+		//Serialize same message with both apis
+		STUNMessage request(STUNMessage::Request,STUNMessage::Binding,transId);
+		request.AddUsernameAttribute("localusername","remoteusername");
+		request.AddAttribute(STUNMessage::Attribute::IceControlled,(QWORD)1);
+		request.AddAttribute(STUNMessage::Attribute::Priority,(DWORD)33554431);
+		request.AddAttribute(STUNMessage::Attribute::UseCandidate);
+
+		uint8_t expected[1024] = {};
+		size_t expectedLen = request.AuthenticatedFingerPrint(expected,sizeof(expected),"pwd");
+
+		STUNMessage::Integrity integrity;
+		uint8_t data[1024] = {};
+		STUNMessage::Writer writer(data,sizeof(data),STUNMessage::Request,STUNMessage::Binding,transId);
+		assert(writer.AddUsernameAttribute("localusername","remoteusername"));
+		assert(writer.AddAttribute(STUNMessage::Attribute::IceControlled,(QWORD)1));
+		assert(writer.AddAttribute(STUNMessage::Attribute::Priority,(DWORD)33554431));
+		assert(writer.AddAttribute(STUNMessage::Attribute::UseCandidate,NULL,0));
+		size_t len = writer.AuthenticatedFingerPrint(integrity,"pwd");
+
+		//Must be byte exact
+		assert(len && len==expectedLen);
+		assert(memcmp(data,expected,len)==0);
+
+		//Parse without copying
+		STUNMessage::View view;
+		assert(view.Parse(data,len));
+		assert(view.GetType()==STUNMessage::Request);
+		assert(view.GetMethod()==STUNMessage::Binding);
+		assert(memcmp(view.GetTransactionId(),transId,12)==0);
+		assert(view.HasAttribute(STUNMessage::Attribute::UseCandidate));
+		auto username = view.GetAttribute(STUNMessage::Attribute::Username);
+		assert(username && std::string((const char*)username->attr,username->size)=="remoteusername:localusername");
+		auto priority = view.GetAttribute(STUNMessage::Attribute::Priority);
+		assert(priority && get4(priority->attr,0)==33554431);
+
+		//Check authentication, also after changing the key
+		assert(view.CheckAuthenticatedFingerPrint(integrity,"pwd"));
+		assert(!view.CheckAuthenticatedFingerPrint(integrity,"other"));
+		assert(view.CheckAuthenticatedFingerPrint(integrity,"pwd"));
+
+		//Response must not fit in a small buffer
+		uint8_t small[40];
+		STUNMessage::Writer response(small,sizeof(small),STUNMessage::Response,STUNMessage::Binding,transId);
+		assert(response.AddXorAddressAttribute(htonl(0x7F000001),htons(5000)));
+		assert(!response.AuthenticatedFingerPrint(integrity,"pwd"));
+
+		//Corrupted messages are rejected
+		data[len-1] ^= 0xFF;
+		assert(!view.Parse(data,len));
+		assert(!view.Parse(data,len-3));
+	}
 	
 };
 
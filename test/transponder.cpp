@@ -0,0 +1,226 @@
+#include "test.h"
+#include "rtp.h"
+#include "EventLoop.h"
+#include "rtp/RTPStreamTransponder.h"
+#include "rtp/RTPStreamTransponderGroup.h"
+
+//Sender with a settable bandwidth estimation
+class EstimationSender : public RTPSender
+{
+public:
+	virtual int Enqueue(const RTPPacket::shared& packet) override { return 1; }
+	virtual int Enqueue(const RTPPacket::shared& packet,std::function<RTPPacket::shared(const RTPPacket::shared&)> modifier) override { return 1; }
+	virtual DWORD GetAvailableBitrate() override { return available; }
+
+	DWORD available = 0;
+};
+
+//Sender recording the packets sent right away from its loop and the enqueued ones
+class RecordingSender : public RTPSender
+{
+public:
+	RecordingSender(TimeService* loop) : loop(loop) {}
+
+	virtual int Enqueue(const RTPPacket::shared& packet) override { enqueued.push_back(packet); return 1; }
+	virtual int Enqueue(const RTPPacket::shared& packet,std::function<RTPPacket::shared(const RTPPacket::shared&)> modifier) override { enqueued.push_back(modifier(packet)); return 1; }
+	virtual int Send(RTPPacket::shared&& packet) override { sent.push_back(packet); return 1; }
+	virtual TimeService* GetSenderTimeService() override { return loop; }
+
+	std::vector<RTPPacket::shared> enqueued;
+	std::vector<RTPPacket::shared> sent;
+private:
+	TimeService* loop;
+};
+
+//Incoming stream with fixed layer bitrates
+class LayeredStream : public RTPIncomingMediaStream
+{
+public:
+	LayeredStream(EventLoop& loop) : loop(loop) {}
+
+	virtual void AddListener(Listener* listener) override {}
+	virtual void RemoveListener(Listener* listener) override {}
+	virtual DWORD GetMediaSSRC() override { return 1; }
+	virtual TimeService& GetTimeService() override { return loop; }
+	virtual const RTPIncomingSource* GetMediaSource() const override { return &source; }
+
+	void AddLayer(BYTE spatialLayerId,BYTE temporalLayerId,DWORD bitrate)
+	{
+		LayerInfo info(temporalLayerId,spatialLayerId);
+		auto& layer = source.layers.emplace(info.GetId(),info).first->second;
+		layer.bitrate = bitrate;
+	}
+
+	RTPIncomingSource source;
+private:
+	EventLoop& loop;
+};
+
+//Expose the selection so it can be driven with a fake clock
+class AutoLayerTransponder : public RTPStreamTransponder
+{
+public:
+	using RTPStreamTransponder::RTPStreamTransponder;
+	using RTPStreamTransponder::UpdateAutoLayer;
+};
+
+class TransponderTestPlan: public TestPlan
+{
+public:
+	TransponderTestPlan() : TestPlan("RTPStreamTransponder test plan")
+	{
+	}
+
+	virtual void Execute()
+	{
+		Log("testAutoLayerSelection\n");
+		testAutoLayerSelection();
+
+		Log("testGroupSenders\n");
+		testGroupSenders();
+	}
+
+	void testGroupSenders()
+	{
+		EventLoop loop;
+		loop.Start();
+
+		RTPStreamTransponderGroup group(1,loop);
+		RTPOutgoingSourceGroup queuedOutgoing(MediaFrame::Audio,loop);
+		RTPOutgoingSourceGroup directOutgoing(MediaFrame::Audio,loop);
+		queuedOutgoing.media.ssrc = 100;
+		directOutgoing.media.ssrc = 200;
+		//Without a sender loop packets are enqueued one by one
+		RecordingSender queued(nullptr);
+		//With it they are batched and sent right away from it
+		RecordingSender direct(&loop);
+
+		RTPStreamTransponder queuedTransponder(&queuedOutgoing,&queued);
+		RTPStreamTransponder directTransponder(&directOutgoing,&direct);
+		queuedTransponder.SetIncoming(&group,nullptr);
+		directTransponder.SetIncoming(&group,nullptr);
+
+		auto rtp = std::make_shared<RTPPacket>(MediaFrame::Audio,AudioCodec::OPUS);
+		rtp->SetSSRC(1);
+		rtp->SetPayloadType(111);
+		rtp->SetClockRate(48000);
+		BYTE payload[100] = {};
+		rtp->SetPayload(payload,sizeof(payload));
+
+		group.onRTP(nullptr,rtp);
+		//Wait for the fan out and then for the batch posted by it
+		group.Stop();
+		loop.Async([](...){}).wait();
+
+		//Each one rewritten for its own stream
+		assert(queued.enqueued.size()==1 && queued.sent.empty());
+		assert(queued.enqueued[0]->GetSSRC()==100);
+		assert(direct.sent.size()==1 && direct.enqueued.empty());
+		assert(direct.sent[0]->GetSSRC()==200);
+
+		queuedTransponder.Close();
+		directTransponder.Close();
+		loop.Stop();
+	}
+
+	void testAutoLayerSelection()
+	{
+		EventLoop loop;
+		loop.Start();
+
+		RTPOutgoingSourceGroup outgoing(MediaFrame::Video,loop);
+		EstimationSender sender;
+		LayeredStream incoming(loop);
+
+		//Two spatial and two temporal layers, each packet accounted only on its own layer
+		incoming.source.aggregatedLayers = false;
+		incoming.AddLayer(0,0,150000);
+		incoming.AddLayer(0,1,100000);
+		incoming.AddLayer(1,0,400000);
+		incoming.AddLayer(1,1,250000);
+		//So decoding each layer requires
+		const LayerInfo L0T0(0,0);	//150kbps
+		const LayerInfo L0T1(1,0);	//250kbps
+		const LayerInfo L1T0(0,1);	//550kbps
+		const LayerInfo L1T1(1,1);	//900kbps
+		const LayerInfo All(LayerInfo::MaxLayerId,LayerInfo::MaxLayerId);
+
+		AutoLayerTransponder transponder(&outgoing,&sender);
+		transponder.SetIncoming(&incoming,nullptr);
+		transponder.SetAutoLayerSelection(true);
+
+		QWORD now = 1000;
+
+		//Without estimation the manual selection is used
+		sender.available = 0;
+		transponder.UpdateAutoLayer(now);
+		assert(transponder.GetAutoLayer()==All);
+
+		//Estimation is not checked again until next interval
+		sender.available = 2000000;
+		transponder.UpdateAutoLayer(now+RTPStreamTransponder::AutoLayerSelectionInterval-1);
+		assert(transponder.GetAutoLayer()==All);
+
+		//Highest one fitting
+		now += RTPStreamTransponder::AutoLayerSelectionInterval;
+		transponder.UpdateAutoLayer(now);
+		assert(transponder.GetAutoLayer()==L1T1);
+
+		//Going down is done right away
+		now += RTPStreamTransponder::AutoLayerSelectionInterval;
+		sender.available = 600000;
+		transponder.UpdateAutoLayer(now);
+		assert(transponder.GetAutoLayer()==L1T0);
+		QWORD lastSwitch = now;
+
+		//Going up is held after a switch
+		sender.available = 2000000;
+		for (now += RTPStreamTransponder::AutoLayerSelectionInterval; now-lastSwitch<RTPStreamTransponder::AutoLayerUpSwitchDelay; now += RTPStreamTransponder::AutoLayerSelectionInterval)
+		{
+			transponder.UpdateAutoLayer(now);
+			assert(transponder.GetAutoLayer()==L1T0);
+		}
+		transponder.UpdateAutoLayer(now);
+		assert(transponder.GetAutoLayer()==L1T1);
+
+		//Lowest one when none fits
+		now += RTPStreamTransponder::AutoLayerSelectionInterval;
+		sender.available = 100000;
+		transponder.UpdateAutoLayer(now);
+		assert(transponder.GetAutoLayer()==L0T0);
+
+		//Going up requires headroom over the layer bitrate
+		now += RTPStreamTransponder::AutoLayerUpSwitchDelay;
+		sender.available = 260000;
+		transponder.UpdateAutoLayer(now);
+		assert(transponder.GetAutoLayer()==L0T0);
+		now += RTPStreamTransponder::AutoLayerSelectionInterval;
+		sender.available = 300000;
+		transponder.UpdateAutoLayer(now);
+		assert(transponder.GetAutoLayer()==L0T1);
+
+		//But staying on the current one does not
+		now += RTPStreamTransponder::AutoLayerSelectionInterval;
+		sender.available = 250000;
+		transponder.UpdateAutoLayer(now);
+		assert(transponder.GetAutoLayer()==L0T1);
+
+		//Never above the manual selection
+		now += RTPStreamTransponder::AutoLayerUpSwitchDelay;
+		sender.available = 2000000;
+		transponder.SelectLayer(0,LayerInfo::MaxLayerId);
+		transponder.UpdateAutoLayer(now);
+		assert(transponder.GetAutoLayer()==L0T1);
+
+		//Estimation lost, back to manual selection
+		now += RTPStreamTransponder::AutoLayerSelectionInterval;
+		sender.available = 0;
+		transponder.UpdateAutoLayer(now);
+		assert(transponder.GetAutoLayer()==LayerInfo(LayerInfo::MaxLayerId,0));
+
+		transponder.Close();
+		loop.Stop();
+	}
+};
+
+TransponderTestPlan transponderTestPlan;